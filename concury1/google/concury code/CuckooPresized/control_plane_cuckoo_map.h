@@ -15,10 +15,17 @@
 
 #pragma once
 
+#include <atomic>
+#include <immintrin.h>
 #include "macros.h"
 #include "../hash.h"
 #include "../common.h"
 
+// event counts of the maps, in PROFILE builds
+static const Counter cuckooCollisions("Cuckoo", "cuckoo collision"), cuckooDirectInserts("Cuckoo", "direct insert"),
+  cuckooInserts("Cuckoo", "cuckoo insert"), cuckooInsertFails("Cuckoo", "cuckoo insert fail"),
+  cuckooGrows("Cuckoo", "grow"), cuckooRehashes("Cuckoo", "rehash"), cuckooItemCopies("Cuckoo", "copy item");
+
 // Class for efficiently storing key->value mappings when the size is
 // known in advance and the keys are pre-hashed into uint64s.
 // Keys should have "good enough" randomness (be spread across the
@@ -32,7 +39,17 @@
 // or delete functions (until some subsequent use of this table
 // requires them).
 //
-// Threads must synchronize their access to a PresizedCuckooMap.
+// Threads must synchronize their access to a PresizedCuckooMap, unless
+// concurrentRead is set: then any number of threads may Find while a single
+// writer thread Inserts/Removes (see SeqLock below). Clear and Compose still
+// need all readers to be quiescent.
+//
+// Tables that neither export nor allow concurrent reads grow online: once
+// the load passes kLoadFactor (or a cuckoo path cannot be found), a bucket
+// array of twice the size is allocated, and every following Insert/Remove
+// migrates kMigrateBucketsPerOp buckets of the old array into it. Find
+// checks both arrays until the migration is done. Should an entry find no
+// place in the new array, all entries are rehashed into a larger one at once.
 //
 // The cuckoo hash table is 4-way associative (each "bucket" has 4
 // "slots" for key/value entries).  Uses breadth-first-search to find
@@ -45,11 +62,11 @@ class DataPlaneCuckooMap;
 template<class K, bool allowGateway, class Match>
 class BloomFilterControlPlane;
 
-template<class Key, class Value, class Match = uint8_t, bool willExport = true, int kCandidateBuckets = 2, int kSlotsPerBucket = 4>
+template<class Key, class Value, class Match = uint8_t, bool willExport = true, int kCandidateBuckets = 2, int kSlotsPerBucket = 4, bool concurrentRead = false>
 class ControlPlaneCuckooMap {
   friend class DataPlaneCuckooMap<Key, Value, Match, kCandidateBuckets, kSlotsPerBucket>;
   
-  template<class K, class V, class M, bool E, int B, int S> friend
+  template<class K, class V, class M, bool E, int B, int S, bool C> friend
   class ControlPlaneCuckooMap;
   
   template<class K, bool G, class M, bool T> friend
@@ -81,6 +98,8 @@ public:
     for (auto &hash : h) {
       hash.setSeed(rand());
     }
+    
+    if (concurrentRead) seqLocks_.resize(kLockStripes);
   }
   
   explicit operator ControlPlaneCuckooMap<Key, Value, Match, false, kCandidateBuckets, kSlotsPerBucket>() const {
@@ -89,14 +108,17 @@ public:
     other.entryCount = entryCount;
     other.cpq_.reset();
     other.num_buckets_ = num_buckets_;
+    other.old_num_buckets_ = old_num_buckets_;
+    other.migrated_ = migrated_;
     // Very small cuckoo tables don't work, because the probability
     // of having same-bucket hashes is large.  We compromise for those
     // uses by having a larger static starting size.
     other.buckets_.resize(buckets_.size());
+    other.oldBuckets_.resize(oldBuckets_.size());
     
-    for (int i = 0; i < buckets_.size(); ++i) {
-      auto &bsrc = buckets_[i];
-      auto &bdst = other.buckets_[i];
+    for (int i = 0; i < buckets_.size() + oldBuckets_.size(); ++i) {
+      auto &bsrc = i < buckets_.size() ? buckets_[i] : oldBuckets_[i - buckets_.size()];
+      auto &bdst = i < buckets_.size() ? other.buckets_[i] : other.oldBuckets_[i - buckets_.size()];
       
       for (int slot = 0; slot < kSlotsPerBucket; ++slot) {
         bdst.occupiedMask = bsrc.occupiedMask;
@@ -123,6 +145,8 @@ public:
   void Clear(uint32_t num_entries) {
     entryCount = 0;
     cpq_.reset();
+    oldBuckets_.clear();
+    old_num_buckets_ = migrated_ = 0;
     num_entries /= kLoadFactor;
     num_buckets_ = (num_entries + kSlotsPerBucket - 1) / kSlotsPerBucket;
     // Very small cuckoo tables don't work, because the probability
@@ -156,6 +180,11 @@ public:
   // Returns collided key if some key collides with the key being inserted;
   // returns null if the table is full; returns &k if inserted successfully.
   const Key *Insert(const Key &k, const Value &v) {
+    if (kAutoGrow) {
+      if (growing()) MigrateSome();
+      else if (entryCount >= kLoadFactor * num_buckets_ * kSlotsPerBucket) StartGrowth();
+    }
+    
     // Merged find and duplicate checking.
     uint32_t target_bucket;
     int target_slot = -1;
@@ -167,7 +196,7 @@ public:
         vector<Key> &set = collisionSets[bucket];
         for (const Key &key : set) {
           if (getDigest(key) == getDigest(k)) {
-            Counter::count("Cuckoo", "cuckoo collision");
+            cuckooCollisions.add();
             return &key;         // Collisions are not allowed.
           }
         }
@@ -178,16 +207,14 @@ public:
       uint32_t bucket = fast_map_to_buckets(h[i](k));
       Bucket *bptr = &buckets_[bucket];
       for (int slot = 0; slot < kSlotsPerBucket; slot++) {
-        #ifdef FULL_DEBUG
         if (bptr->occupiedMask & (1ULL << slot)) {
+          #ifdef FULL_DEBUG
           if (k == bptr->keys[slot]) { // Duplicates are not allowed.
             entryCount--;
             return &bptr->keys[slot];
           }
-        } else
           #endif
-        
-        if (target_slot == -1) {
+        } else if (target_slot == -1) {
           target_bucket = bucket;
           target_slot = slot; // do not break, to go through full duplication test
           
@@ -196,26 +223,38 @@ public:
           #endif
         }
       }
+      
+      #ifndef FULL_DEBUG
+      if (target_slot != -1) break;
+      #endif
     }
     
     if (target_slot != -1) {
-      Counter::count("Cuckoo", "direct insert");
+      cuckooDirectInserts.add();
       InsertInternal(k, v, target_bucket, target_slot);
       return &k;
     }
     
     // No space, perform cuckooInsert
-    Counter::count("Cuckoo", "cuckoo insert");
+    cuckooInserts.add();
     if (CuckooInsert(k, v)) {
       return &k;
+    } else if (kAutoGrow) {
+      // no path in this array: the retry goes to a fresh one of twice the size
+      if (growing()) FinishGrowth();
+      StartGrowth();
+      if (!Place(k, v)) Rehash(num_buckets_ * 2, &k, &v);
+      return &k;
     } else {
-      Counter::count("Cuckoo", "cuckoo insert fail");
+      cuckooInsertFails.add();
       entryCount--;
       return nullptr;
     }
   }
   
   inline bool Remove(const Key &k, bool delCollision = true) {
+    if (growing()) MigrateSome();
+    
     for (int i = 0; i < kCandidateBuckets; ++i) {
       uint32_t bucket = fast_map_to_buckets(h[i](k));
       if (RemoveInBucket(k, bucket)) {
@@ -225,6 +264,19 @@ public:
       }
     }
     
+    if (growing()) {
+      for (int i = 0; i < kCandidateBuckets; ++i) {
+        Bucket &bref = oldBuckets_[multiply_high_u32(h[i](k), old_num_buckets_)];
+        for (int slot = 0; slot < kSlotsPerBucket; slot++) {
+          if ((bref.occupiedMask & (1U << slot)) && bref.keys[slot] == k) {
+            bref.occupiedMask ^= 1U << slot;
+            entryCount--;
+            return true;
+          }
+        }
+      }
+    }
+    
     return false;
   }
   
@@ -242,7 +294,7 @@ public:
       vector<Key> &set = collisionSets[bucket];
       for (const Key &key : set) {
         if (getDigest(key) == getDigest(k)) {
-          Counter::count("Cuckoo", "cuckoo collision");
+          cuckooCollisions.add();
           results[i] = &key;
         }
       }
@@ -252,16 +304,33 @@ public:
   
   // Returns true if found.  Sets *out = value.
   inline bool Find(const Key &k, Value &out) const {
+    if (concurrentRead) return FindOptimistic(k, out);
+    
     for (int i = 0; i < kCandidateBuckets; ++i) {
       uint32_t bucket = fast_map_to_buckets(h[i](k));
       if (FindInBucket(k, bucket, out)) return true;
     }
     
+    if (growing()) {
+      for (int i = 0; i < kCandidateBuckets; ++i) {
+        const Bucket &bref = oldBuckets_[multiply_high_u32(h[i](k), old_num_buckets_)];
+        for (int slot = 0; slot < kSlotsPerBucket; slot++) {
+          if ((bref.occupiedMask & (1U << slot)) && (bref.keys[slot] == k)) {
+            out = bref.values[slot];
+            return true;
+          }
+        }
+      }
+    }
+    
     return false;
   }
   
   /// compose two maps in place
   void Compose(unordered_map<Value, Value> &migrate) {
+    ScopedTimer timer("Cuckoo Compose");
+    if (growing()) FinishGrowth();
+    
     for (auto &bucket : buckets_) {
       for (int slot = 0; slot < kSlotsPerBucket; ++slot) {
         if (bucket.occupiedMask & (1ULL << slot)) {
@@ -280,10 +349,12 @@ public:
   unordered_map<Key, Value, Hasher32<Key>> toMap() const {
     unordered_map<Key, Value, Hasher32<Key>> map;
     
-    for (auto &bucket: buckets_) {  // all buckets
-      for (int slot = 0; slot < kSlotsPerBucket; ++slot) {
-        if (bucket.occupiedMask & (1ULL << slot))
-          map.insert(make_pair(bucket.keys[slot], bucket.values[slot]));
+    for (auto *array : {&buckets_, &oldBuckets_}) {
+      for (auto &bucket: *array) {  // all buckets
+        for (int slot = 0; slot < kSlotsPerBucket; ++slot) {
+          if (bucket.occupiedMask & (1ULL << slot))
+            map.insert(make_pair(bucket.keys[slot], bucket.values[slot]));
+        }
       }
     }
     
@@ -291,7 +362,28 @@ public:
   }
   
   uint64_t getMemoryCost() const {
-    return num_buckets_ * sizeof(buckets_[0]);
+    return (num_buckets_ + old_num_buckets_) * sizeof(Bucket) + seqLocks_.size() * sizeof(SeqLock);
+  }
+  
+  /// a bucket array is used by the slots holding entries, both arrays while growing(). the path queue and the
+  /// visited list are inline, in the object
+  MemoryBreakdown getMemoryBreakdown() const {
+    MemoryBreakdown b;
+    b.add("object", sizeof(*this), sizeof(*this));
+    b.add("buckets", (uint64_t) entryCount * sizeof(Bucket) / kSlotsPerBucket,
+          heapBytes(buckets_.data()) + heapBytes(oldBuckets_.data()));
+    b.addVector("collision-sets", collisionSets);
+    b.addVector("seq-locks", seqLocks_);
+    return b;
+  }
+  
+  inline bool growing() const {
+    return old_num_buckets_ != 0;
+  }
+  
+  /// migrate all remaining buckets of the old array at once
+  void FinishGrowth() {
+    while (growing()) MigrateSome();
   }
 
 private:
@@ -314,6 +406,14 @@ private:
   
   static constexpr uint8_t kMaxBFSPathLen = 5;
   
+  // Online growth, see the class comment. Growth swaps the bucket array under
+  // the readers, and would invalidate the bucket layout an exported data plane
+  // mirrors, so it is off for both. Migrating 4 buckets per operation empties
+  // an old array of N buckets after N / 4 operations, well before the doubled
+  // array can fill up.
+  static constexpr bool kAutoGrow = !willExport && !concurrentRead;
+  static constexpr int kMigrateBucketsPerOp = 4;
+  
   // Constants for BFS cuckoo path search:
   // The visited list must be maintained for all but the last level of search
   // in order to trace back the path. The BFS search has two roots
@@ -344,6 +444,74 @@ private:
   static constexpr int kMaxQueueSize = calMaxQueueSize();
   static constexpr int kVisitedListSize = calVisitedListSize();
   
+  // Striped sequence locks for concurrentRead. The writer makes the counter
+  // of a bucket's stripe odd while it modifies the bucket; a reader snapshots
+  // the counters of all candidate buckets, probes them, and retries if any
+  // counter was odd or has moved. Snapshotting all candidates (not one bucket
+  // at a time) is what keeps a key that is being cuckooed from bucket B to
+  // bucket A from being missed in both. Copying a map resets its counters.
+  static constexpr uint32_t kLockStripes = 1024;   // must be power of 2
+  
+  struct SeqLock {
+    std::atomic<uint32_t> seq{0};
+    
+    SeqLock() = default;
+    
+    SeqLock(const SeqLock &) {}
+    
+    SeqLock &operator=(const SeqLock &) {
+      seq.store(0, std::memory_order_relaxed);
+      return *this;
+    }
+  };
+  
+  inline void beginWrite(uint32_t bucket) {
+    if (!concurrentRead) return;
+    std::atomic<uint32_t> &seq = seqLocks_[bucket & (kLockStripes - 1)].seq;
+    seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+  
+  inline void endWrite(uint32_t bucket) {
+    if (!concurrentRead) return;
+    std::atomic<uint32_t> &seq = seqLocks_[bucket & (kLockStripes - 1)].seq;
+    seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+  
+  inline bool FindOptimistic(const Key &k, Value &out) const {
+    uint32_t bucket[kCandidateBuckets];
+    uint32_t version[kCandidateBuckets];
+    
+    for (int i = 0; i < kCandidateBuckets; ++i) {
+      bucket[i] = fast_map_to_buckets(h[i](k));
+    }
+    
+    while (true) {
+      for (int i = 0; i < kCandidateBuckets; ++i) {
+        while ((version[i] = seqLocks_[bucket[i] & (kLockStripes - 1)].seq.load(std::memory_order_acquire)) & 1) {
+          _mm_pause();
+        }
+      }
+      
+      bool found = false;
+      Value result;
+      for (int i = 0; i < kCandidateBuckets && !found; ++i) {
+        found = FindInBucket(k, bucket[i], result);
+      }
+      
+      std::atomic_thread_fence(std::memory_order_acquire);
+      bool consistent = true;
+      for (int i = 0; i < kCandidateBuckets; ++i) {
+        consistent &= seqLocks_[bucket[i] & (kLockStripes - 1)].seq.load(std::memory_order_relaxed) == version[i];
+      }
+      
+      if (consistent) {
+        if (found) out = result;
+        return found;
+      }
+    }
+  }
+  
   // Buckets are organized with key_types clustered for access speed
   // and for compactness while remaining aligned.
   template<bool E, typename Dummy = void>
@@ -456,14 +624,88 @@ private:
     }
   }
   
+  void StartGrowth() {
+    cuckooGrows.add();
+    oldBuckets_.swap(buckets_);
+    old_num_buckets_ = num_buckets_;
+    migrated_ = 0;
+    
+    num_buckets_ *= 2;
+    buckets_.clear();
+    buckets_.resize(num_buckets_, Bucket());
+  }
+  
+  void MigrateSome() {
+    for (int n = 0; n < kMigrateBucketsPerOp && migrated_ < old_num_buckets_; ++n, ++migrated_) {
+      Bucket &bref = oldBuckets_[migrated_];
+      for (int slot = 0; slot < kSlotsPerBucket; slot++) {
+        if (!(bref.occupiedMask & (1U << slot))) continue;
+        
+        // the new array is at most half full, so this hardly fails: when it does, all goes to a larger one at once
+        if (!Place(bref.keys[slot], bref.values[slot])) {
+          Rehash(num_buckets_ * 2);
+          return;
+        }
+        bref.occupiedMask ^= 1U << slot;
+      }
+    }
+    
+    if (migrated_ == old_num_buckets_) {
+      std::vector<Bucket>().swap(oldBuckets_);
+      old_num_buckets_ = migrated_ = 0;
+    }
+  }
+  
+  // every entry of both arrays, and k if given, into a fresh array of at least num_buckets buckets, doubled until all
+  // of them are placed. ends any growth. entryCount is left as it is: no entry is lost or added
+  void Rehash(uint32_t num_buckets, const Key *k = nullptr, const Value *v = nullptr) {
+    cuckooRehashes.add();
+    vector<pair<Key, Value>> entries;
+    if (k) entries.push_back(make_pair(*k, *v));
+    for (vector<Bucket> *array : {&buckets_, &oldBuckets_}) {
+      for (Bucket &bref : *array) {
+        for (int slot = 0; slot < kSlotsPerBucket; slot++) {
+          if (bref.occupiedMask & (1U << slot)) entries.push_back(make_pair(bref.keys[slot], bref.values[slot]));
+        }
+      }
+    }
+    std::vector<Bucket>().swap(oldBuckets_);
+    old_num_buckets_ = migrated_ = 0;
+    
+    for (num_buckets_ = num_buckets;; num_buckets_ *= 2) {
+      buckets_.clear();
+      buckets_.resize(num_buckets_, Bucket());
+      
+      size_t placed = 0;
+      while (placed < entries.size() && Place(entries[placed].first, entries[placed].second)) ++placed;
+      if (placed == entries.size()) return;
+    }
+  }
+  
+  // put an entry known to be absent into the current array, without touching entryCount
+  inline bool Place(const Key &k, const Value &v) {
+    for (int i = 0; i < kCandidateBuckets; ++i) {
+      uint32_t bucket = fast_map_to_buckets(h[i](k));
+      int slot = FindFreeSlot(bucket);
+      if (slot != -1) {
+        InsertInternal(k, v, bucket, slot);
+        return true;
+      }
+    }
+    
+    return CuckooInsert(k, v);
+  }
+  
   inline void InsertInternal(const Key &k, const Value &v, uint32_t b, int slot) {
     Bucket &bptr = buckets_[b];
+    beginWrite(b);
     bptr.keys[slot] = k;
     bptr.values[slot] = v;
     
     setDigest<willExport>(bptr, slot, getDigest(k));
     
     bptr.occupiedMask |= 1U << slot;
+    endWrite(b);
     
     if (willExport) insertCollision(k);
   }
@@ -474,7 +716,9 @@ private:
     Bucket &bref = buckets_[b];
     for (int i = 0; i < kSlotsPerBucket; i++) {
       if ((bref.occupiedMask & (1U << i)) && bref.keys[i] == k) {
+        beginWrite(b);
         bref.occupiedMask ^= 1U << i;
+        endWrite(b);
         
         return true;
       }
@@ -508,13 +752,16 @@ private:
   }
   
   inline void CopyItem(uint32_t src_bucket, int src_slot, uint32_t dst_bucket, int dst_slot) {
-    Counter::count("Cuckoo", "copy item");
+    cuckooItemCopies.add();
     Bucket &src_ref = buckets_[src_bucket];
     Bucket &dst_ref = buckets_[dst_bucket];
+    beginWrite(dst_bucket);
     dst_ref.keys[dst_slot] = src_ref.keys[src_slot];
     dst_ref.values[dst_slot] = src_ref.values[src_slot];
     
     setDigest<willExport>(dst_ref, dst_slot, src_ref, src_slot);
+    dst_ref.occupiedMask |= 1U << dst_slot;
+    endWrite(dst_bucket);
   }
   
   bool CuckooInsert(const Key &k, const Value &v) {
@@ -530,8 +777,10 @@ private:
       CuckooPathEntry entry = cpq_.pop_front();
       int free_slot = FindFreeSlot(entry.bucket);
       if (free_slot != -1) {
-        // found a free slot in this path. just insert and follow this path
-        buckets_[entry.bucket].occupiedMask |= 1U << free_slot;
+        // found a free slot in this path. just insert and follow this path.
+        // CopyItem/InsertInternal mark the free slot occupied only once it
+        // holds a valid entry, and each moved key is copied before its old
+        // slot is overwritten, so concurrent readers never miss it.
         while (entry.depth > 1) {
           // "copy" instead of "swap" because one entry is always zero.
           // After, write target key/value over top of last copied entry.
@@ -570,9 +819,16 @@ private:
   uint32_t num_buckets_;
   std::vector<Bucket> buckets_;
   
+  // the array being migrated away from while growing(), buckets below migrated_ are already empty
+  uint32_t old_num_buckets_ = 0;
+  uint32_t migrated_ = 0;
+  std::vector<Bucket> oldBuckets_;
+  
   CuckooPathQueue cpq_;
   CuckooPathEntry visited_[kVisitedListSize];
   std::vector<std::vector<Key>> collisionSets;
+  
+  std::vector<SeqLock> seqLocks_;   // empty unless concurrentRead
 };
 
 template<class Key, class Value, class Match = uint16_t, int kCandidateBuckets = 2, int kSlotsPerBucket = 4>
@@ -665,6 +921,16 @@ public:
     return num_buckets_ * sizeof(buckets_[0]);
   }
 
+  MemoryBreakdown getMemoryBreakdown() const {
+    uint64_t slots = 0;
+    for (const Bucket &b : buckets_) slots += __builtin_popcount(b.occupiedMask);
+    
+    MemoryBreakdown b;
+    b.add("object", sizeof(*this), sizeof(*this));
+    b.add("buckets", slots * sizeof(Bucket) / kSlotsPerBucket, heapBytes(buckets_.data()));
+    return b;
+  }
+
 private:
   // Utility function to compute (x * y) >> 64, or "multiply high".
   // On x86-64, this is a single instruction, but not all platforms
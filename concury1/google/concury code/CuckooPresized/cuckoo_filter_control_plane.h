@@ -3,6 +3,11 @@
 #include "../control_plane.h"
 #include "control_plane_cuckoo_map.h"
 
+// event counts of the routers, in PROFILE builds
+static const Counter cpDigestCollisions("Cuckoo-CP", "digest collision"), cpLevel1Adds("Cuckoo-CP", "lv1 add"),
+  cpLevel1Rebuilds("Cuckoo-CP", "level1 rebuild"), cpLevel1ReRebuilds("Cuckoo-CP", "level1 re-rebuild"),
+  cpLevel2Rebuilds("Cuckoo-CP", "level2 full, only rebuild lv2");
+
 template<class K, class Match = uint8_t>
 class TwoLevelCuckooRouter {
 public:
@@ -109,7 +114,7 @@ public:
       }
       rebuild(k, host);
     } else if (result != &k) { // collision
-      Counter::count(getName(), "digest collision");
+      cpDigestCollisions.add();
   
       vector<const K *>collisions = level1->FindAllCollisions(k);
       for (int i = 0; i < 2; ++i) {
@@ -130,7 +135,7 @@ public:
         rebuildL2(k, host);
       }
     } else {
-      Counter::count(getName(), "lv1 add");
+      cpLevel1Adds.add();
     }
   }
   
@@ -397,7 +402,7 @@ public:
 
 private:
   void rebuild(const K &k, uint16_t host) {
-    Counter::count(getName(), "level1 rebuild");
+    cpLevel1Rebuilds.add();
     Clocker rebuild("Cuckoo level1 rebuild");
     
     unordered_map<K, uint16_t, Hasher32<K>> map = level1->toMap();
@@ -413,7 +418,7 @@ private:
     
     uint32_t capacity = ControlPlane<K, allowGateway>::capacity;
     while (!level1) {
-      Counter::count(getName(), "level1 re-rebuild");
+      cpLevel1ReRebuilds.add();
       
       level1 = new ControlPlaneCuckooMap<K, uint16_t, Match, true, 2, 4>(capacity);
       level2 = new ControlPlaneCuckooMap<K, uint16_t, Match, false, 2, 4>(capacity / 10);
@@ -433,7 +438,7 @@ private:
   }
   
   void rebuildL2(const K &k, uint16_t host) {
-    Counter::count(getName(), "level2 full, only rebuild lv2");
+    cpLevel2Rebuilds.add();
     unordered_map<K, uint16_t, Hasher32<K>> map = level2->toMap();
     map.insert(make_pair(k, host));
     
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include "../memory_breakdown.h"
+
+using namespace std;
+
+/**
+ * An array of T kept in equally sized chunks, for the per-key arrays of ControlPlaneOthello.
+ *
+ * Growing allocates the missing chunks and never copies, moves or reallocates what is already stored, so there is no
+ * moment where the old and the new array are both alive, and the capacity is at most one chunk more than asked for.
+ * An element costs one more shift and mask to reach than in a vector.
+ *
+ * The chunk size is a power of two, picked when the first chunk is allocated: about a sixteenth of the capacity asked
+ * for then. clear() frees everything, so the next reserve picks again.
+ */
+template<class T>
+class ChunkedArray {
+  vector<unique_ptr<T[]>> chunks;
+  uint8_t shift = 0;
+  uint32_t mask = 0;
+
+public:
+  static const uint8_t MIN_CHUNK_BITS = 6;
+  static const uint8_t MAX_CHUNK_BITS = 16;
+  
+  ChunkedArray() {}
+  
+  ChunkedArray(const ChunkedArray &other) {
+    *this = other;
+  }
+  
+  ChunkedArray(ChunkedArray &&other) = default;
+  
+  ChunkedArray &operator=(ChunkedArray &&other) = default;
+  
+  ChunkedArray &operator=(const ChunkedArray &other) {
+    if (this == &other) return *this;
+    shift = other.shift;
+    mask = other.mask;
+    chunks.clear();
+    for (const unique_ptr<T[]> &c : other.chunks) {
+      chunks.emplace_back(new T[mask + 1]);
+      copy(c.get(), c.get() + mask + 1, chunks.back().get());
+    }
+    return *this;
+  }
+  
+  inline T &operator[](uint32_t i) {
+    return chunks[i >> shift][i & mask];
+  }
+  
+  inline const T &operator[](uint32_t i) const {
+    return chunks[i >> shift][i & mask];
+  }
+  
+  /// make room for at least n elements. the new elements are default-initialized
+  void reserve(uint32_t n) {
+    if (n == 0) return;
+    if (chunks.empty()) {
+      for (shift = MIN_CHUNK_BITS; shift < MAX_CHUNK_BITS && (uint64_t(1) << (shift + 4)) < n; ++shift);
+      mask = (uint32_t(1) << shift) - 1;
+    }
+    
+    size_t needed = ((uint64_t) n + mask) >> shift;
+    if (needed <= chunks.size()) return;
+    chunks.reserve(needed);
+    while (chunks.size() < needed) chunks.emplace_back(new T[mask + 1]);
+  }
+  
+  /// free all chunks
+  void clear() {
+    vector<unique_ptr<T[]>>().swap(chunks);
+  }
+  
+  /// set the first n elements to value
+  void fill(const T &value, uint32_t n) {
+    for (uint32_t c = 0; n > 0; ++c) {
+      uint32_t len = min(n, mask + 1);
+      std::fill(chunks[c].get(), chunks[c].get() + len, value);
+      n -= len;
+    }
+  }
+  
+  inline uint32_t capacity() const {
+    return uint32_t(chunks.size() << shift);
+  }
+  
+  /// bytes allocated for the chunks and the chunk table
+  uint64_t getMemoryCost() const {
+    uint64_t bytes = heapBytes(chunks.data());
+    for (const unique_ptr<T[]> &c : chunks) bytes += heapBytes(c.get());
+    return bytes;
+  }
+};
@@ -1,9 +1,13 @@
 #pragma once
 
 #include "../common.h"
+#include "chunked_array.h"
 
 using namespace std;
 
+// steps of the forest walks, in PROFILE builds
+static const Counter othelloFillSteps("Othello", "fillTreeDFS step"), othelloFixSteps("Othello", "fixHalfTreeDFS step");
+
 template<class K, class V, uint8_t L, uint8_t DL>
 class DataPlaneOthello;
 
@@ -28,10 +32,16 @@ class OthelloFilterControlPlane;
  *  set willExport to true. Additional computation and memory overheads will apply on insert, while lookups will be faster.
  *
  *  If you wish to maintain the disjoint set, the insertion will become faster but the deletion is slower, in the sense that
- *  memory accesses are more expensive than computation
+ *  memory accesses are more expensive than computation. Without it, the disjoint set only lives during a build.
+ *
+ *  Key ids are stored as Index: head, nextAtA/nextAtB and indMem. A uint16_t halves them when no more than 65535 keys
+ *  are ever held; growing past what Index can index throws.
+ *
+ *  Memory: the per-key arrays (keys, values, nextAtA, nextAtB) are chunked and grow without copying. The node arrays
+ *  grow 1.5x at a time and are allocated to their exact size, with at least ma + mb = 2.33x the keys they hold.
  */
 template<class K, class V, uint8_t L = sizeof(V) * 8, uint8_t DL = 0,
-  bool maintainDP = false, bool maintainDisjointSet = true, bool randomized = false>
+  bool maintainDP = false, bool maintainDisjointSet = true, bool randomized = false, class Index = uint32_t>
 class ControlPlaneOthello {
   template<class K1, class V1, uint8_t L1, uint8_t DL1> friend
   class DataPlaneOthello;
@@ -54,6 +64,8 @@ public:
   const static uint64_t DEMASK = ~(uint64_t(-1) << DL);   // lower DL bits are 1, others are 0
   const static uint64_t VMASK = ~(uint64_t(-1) << L);   // lower L bits are 1, others are 0
   const static uint64_t VDMASK = (VDEMASK << 1) & VDEMASK; // [1, VDL) bits are 1
+  const static Index NIL = Index(-1);     // no key. also bounds the key count
+  static_assert(is_unsigned<Index>::value, "The key index must be an unsigned integer. ");
   //****************************************
   //*************DATA Plane
   //****************************************
@@ -99,7 +111,9 @@ private:
   /// \return the number of uint64_t elements to hold ma + mb valueType elements
   inline void memResize() {
     if (!maintainingDP) return;
-    mem.resize(((ma + mb) * VDL + 63) / 64);
+    size_t n = ((ma + mb) * VDL + 63) / 64;
+    mem.reserve(n);   // exactly, where resize would double
+    mem.resize(n);
   }
   
   /// Set the index-th element to be value. if the index > ma, it is the (index - ma)-th element in array B
@@ -221,7 +235,7 @@ public:
       out = vd >> DL;
     } else {
       uint32_t index = queryIndex(k);
-      if (index >= values.size()) return false;// throw runtime_error("Index out of bound. Maybe not a member");
+      if (index >= keyCnt) return false;// throw runtime_error("Index out of bound. Maybe not a member");
       out = values[index];
     }
     return true;
@@ -229,7 +243,7 @@ public:
 
 public:
   explicit ControlPlaneOthello(uint32_t keyCapacity = 256) {
-    for (minimalKeyCapacity = 256; minimalKeyCapacity < keyCapacity; minimalKeyCapacity <<= 1);
+    minimalKeyCapacity = max(256U, keyCapacity);
     
     resizeKey(0);
     
@@ -248,34 +262,45 @@ public:
       throw runtime_error("The specified capacity is less than current key size! ");
     }
     
-    uint32_t nextMb;
+    if (keyCount > NIL) {
+      throw runtime_error("The specified capacity is more than the key index type can hold! ");
+    }
+    
+    uint64_t nextMb;
     
     if (compact) {
       nextMb = max(minimalKeyCapacity, keyCount);
     } else {
       nextMb = minimalKeyCapacity;
       while (nextMb < keyCount)
-        nextMb <<= 1;
+        nextMb += nextMb / 2;
     }
+    nextMb = min(nextMb, (uint64_t) NIL);
     uint32_t nextMa = static_cast<uint32_t>(1.33334 * nextMb);
     
-    if (keyCount > keys.capacity()) {
-      uint32_t keyCntReserve = max(256U, keyCount * 2U);
-      keys.resize(keyCntReserve);
-      values.resize(keyCntReserve);
-      nextAtA.resize(keyCntReserve);
-      nextAtB.resize(keyCntReserve);
-    }
-    
     if (nextMa > ma || nextMa < 0.8 * ma) {
       ma = nextMa;
       mb = nextMb;
       
       memResize();
       
+      // exact sizes, and freed before allocated: build() fills both
+      vector<Index>().swap(indMem);
+      vector<Index>().swap(head);
       indMem.resize(ma + mb);
       head.resize(ma + mb);
-      connectivityForest.resize(ma + mb);
+      
+      // the chunk size is picked on the first allocation, so an empty Othello starts over for the new capacity
+      if (keyCnt == 0) {
+        keys.clear();
+        values.clear();
+        nextAtA.clear();
+        nextAtB.clear();
+      }
+      keys.reserve(mb);
+      values.reserve(mb);
+      nextAtA.reserve(mb);
+      nextAtB.reserve(mb);
       
       build();
     }
@@ -294,6 +319,7 @@ public:
   }
   
   void compose(const unordered_map<V, V> &migration) {
+    ScopedTimer timer("Othello compose");
     for (int i = 0; i < size(); ++i) {
       uint16_t &val = values[i];
       
@@ -325,9 +351,9 @@ public:
 
 private:
   // ******input of control plane
-  vector<K> keys{};
-  vector<V> values{};
-  vector<uint32_t> indMem{};       // memory space for indices
+  ChunkedArray<K> keys{};
+  ChunkedArray<V> values{};
+  vector<Index> indMem{};       // memory space for indices
   
   inline V randVal(int i = 0) const {
     V v = rand();
@@ -344,10 +370,10 @@ private:
       if (maintainingDP) memSet(i, randomized ? (randVal(i) & VDMASK) : 0);
     }
     
-    fill(head.begin(), head.end(), -1);
-    fill(nextAtA.begin(), nextAtA.end(), -1);
-    fill(nextAtB.begin(), nextAtB.end(), -1);
-    connectivityForest.reset();
+    fill(head.begin(), head.end(), NIL);
+    nextAtA.fill(NIL, keyCnt);
+    nextAtB.fill(NIL, keyCnt);
+    connectivityForest.assign(ma + mb);
   }
   
   uint32_t tryCount = 0; //!< number of rehash before a valid hash pair is found.
@@ -355,9 +381,9 @@ private:
    first and next1, next2 maintain linked lists,
    each containing all keys with the same hash in either of their ends
    */
-  vector<int32_t> head{};         //!< subscript: hashValue, value: keyIndex
-  vector<int32_t> nextAtA{};         //!< subscript: keyIndex, value: keyIndex
-  vector<int32_t> nextAtB{};         //! h2(keys[i]) = h2(keys[next2[i]]);
+  vector<Index> head{};         //!< subscript: hashValue, value: keyIndex
+  ChunkedArray<Index> nextAtA{};         //!< subscript: keyIndex, value: keyIndex
+  ChunkedArray<Index> nextAtB{};         //! h2(keys[i]) = h2(keys[next2[i]]);
   
   DisjointSet connectivityForest;                     //!< store the hash values that are connected by key edges
   
@@ -370,15 +396,14 @@ private:
     }
   }
   
-  /// update the disjoint set and the connected forest so that
-  /// include all the old keys and the newly inserted key
+  /// update the connected forest so that it includes all the old keys and the newly inserted key.
+  /// the disjoint set is left to the caller
   /// \note this method won't change the node value
-  inline void addEdge(int key, uint32_t ha, uint32_t hb) {
+  inline void addEdge(uint32_t key, uint32_t ha, uint32_t hb) {
     nextAtA[key] = head[ha];
     head[ha] = key;
     nextAtB[key] = head[hb];
     head[hb] = key;
-    connectivityForest.merge(ha, hb);
   }
   
   /// test if this hash pair is acyclic, and build:
@@ -403,6 +428,7 @@ private:
         return false;
       }
       addEdge(i, ha, hb);
+      connectivityForest.merge(ha, hb);
     }
     return true;
   }
@@ -412,16 +438,18 @@ private:
   /// 1. the value of root is not properly set before the function call
   /// 2. the values are in the value array
   /// 3. the root is always from array A
-  /// Side effect: all node in this tree is set and if updateToFilled
+  /// Side effect: all node in this tree is set and if updateToFilled, and marked in reached if given
   template<bool fillValue, bool fillIndex, bool keepDigest = false>
-  void fillTreeDFS(uint32_t root) {
+  void fillTreeDFS(uint32_t root, vector<bool> *reached = nullptr) {
+    ScopedTimer timer("fillTreeDFS");
     assert(root < ma);
     
     stack<pair<uint32_t, uint32_t>> stack;  // previous key id, this node
     stack.push(make_pair(uint32_t(-1), root));
+    if (reached) (*reached)[root] = true;
     
     while (!stack.empty()) {
-      Counter::count("Othello", "fillTreeDFS step");
+      othelloFillSteps.add();
       uint32_t prev = stack.top().first;
       uint32_t nid = stack.top().second;
       stack.pop();
@@ -430,9 +458,9 @@ private:
       
       // // find all the opposite side node to be filled
       // search all the edges of this node, to fill and enqueue the opposite side, and record the fill
-      vector<int32_t> &nextKeyOfThisKey = isAtoB ? nextAtA : nextAtB;
+      ChunkedArray<Index> &nextKeyOfThisKey = isAtoB ? nextAtA : nextAtB;
       
-      for (int keyId = head[nid]; keyId >= 0; keyId = nextKeyOfThisKey[keyId]) {
+      for (uint32_t keyId = head[nid]; keyId != NIL; keyId = nextKeyOfThisKey[keyId]) {
         // now the opposite side node needs to be filled
         // fill and enqueue all next element of it
         if (keyId == prev) continue;
@@ -443,6 +471,7 @@ private:
         uint32_t nextNode = isAtoB ? hb : ha;
         
         fillSingle<fillValue, fillIndex, keepDigest>(keyId, nextNode, nid);
+        if (reached) (*reached)[nextNode] = true;
         
         stack.push(make_pair(uint32_t(keyId), nextNode));
       }
@@ -500,6 +529,7 @@ private:
   /// Side effect: all node in this tree is set and if updateToFilled
   template<bool fillValue, bool fillIndex, bool keepDigest = false>
   void fixHalfTreeDFS(uint32_t keyId, uint32_t root, uint32_t hb) {
+    ScopedTimer timer("fixHalfTreeDFS");
     assert(root < ma && keyId != uint32_t(-1));
     
     uint64_t x = fillValue ? (keepDigest ? memValueGet(root) : memGet(root)) : 0;
@@ -514,7 +544,7 @@ private:
     stack.push(make_pair(keyId, root));
     
     while (!stack.empty()) {
-      Counter::count("Othello", "fixHalfTreeDFS step");
+      othelloFixSteps.add();
       uint32_t prev = stack.top().first;
       uint32_t nid = stack.top().second;
       stack.pop();
@@ -523,9 +553,9 @@ private:
       
       // // find all the opposite side node to be filled
       // search all the edges of this node, to fill and enqueue the opposite side, and record the fill
-      vector<int32_t> &nextKeyOfThisKey = isAtoB ? nextAtA : nextAtB;
+      ChunkedArray<Index> &nextKeyOfThisKey = isAtoB ? nextAtA : nextAtB;
       
-      for (int keyId = head[nid]; keyId >= 0; keyId = nextKeyOfThisKey[keyId]) {
+      for (uint32_t keyId = head[nid]; keyId != NIL; keyId = nextKeyOfThisKey[keyId]) {
         // now the opposite side node needs to be filled
         // fill and enqueue all next element of it
         if (keyId == prev) continue;
@@ -562,9 +592,9 @@ private:
       stack.pop();
       
       bool isAtoB = nid < ma;
-      const vector<int32_t> &nextKeyOfThisKey = isAtoB ? nextAtA : nextAtB;
+      const ChunkedArray<Index> &nextKeyOfThisKey = isAtoB ? nextAtA : nextAtB;
       
-      for (int keyId = head[nid]; keyId >= 0; keyId = nextKeyOfThisKey[keyId]) {
+      for (uint32_t keyId = head[nid]; keyId != NIL; keyId = nextKeyOfThisKey[keyId]) {
         if (keyId == prev) continue;
         
         const K &k = keys[keyId];
@@ -590,7 +620,7 @@ private:
     stack.push(make_pair(uint32_t(-1), root));
     connectivityForest.__set(root, root);
     
-    if (head[root] < 0 && maintainingDP) {
+    if (head[root] == NIL && maintainingDP) {
       memSet(root, randomized ? (randVal(root) & VDMASK) : 0);
       return;
     }
@@ -601,9 +631,9 @@ private:
       stack.pop();
       
       bool isAtoB = nid < ma;
-      const vector<int32_t> &nextKeyOfThisKey = isAtoB ? nextAtA : nextAtB;
+      const ChunkedArray<Index> &nextKeyOfThisKey = isAtoB ? nextAtA : nextAtB;
       
-      for (int keyId = head[nid]; keyId >= 0; keyId = nextKeyOfThisKey[keyId]) {
+      for (uint32_t keyId = head[nid]; keyId != NIL; keyId = nextKeyOfThisKey[keyId]) {
         if (keyId == prev) continue;
         
         const K &k = keys[keyId];
@@ -620,10 +650,15 @@ private:
   
   /// Fill *Othello* so that the query returns values as defined
   ///
-  /// Assume: edges and disjoint set are properly set up.
+  /// Assume: edges and disjoint set are properly set up. Without maintainDisjointSet, only the edges.
   /// Side effect: all values are properly set
   template<bool keepDigest = false>
   void fillValue() {
+    if (!maintainDisjointSet) {
+      fillValueByTraversal<keepDigest>();
+      return;
+    }
+    
     for (uint32_t i = 0; i < ma + mb; i++) {
       if (connectivityForest.isRoot(i)) {  // we can only fix one end's value in a cc of keys, then fix the roots'
         if ((DL || randomized) && maintainingDP) {
@@ -635,6 +670,27 @@ private:
     }
   }
   
+  /// fillValue with no disjoint set to tell the roots: each tree is filled from its first node, which is in array A
+  /// as every key has one end there, and its nodes are marked as reached. Also right after erases, which the disjoint
+  /// set does not follow. Nodes with no key are reset as in resetBuildState.
+  template<bool keepDigest>
+  void fillValueByTraversal() {
+    vector<bool> reached(ma + mb);
+    for (uint32_t i = 0; i < ma + mb; i++) {
+      if (reached[i]) continue;
+      
+      if (head[i] == NIL) {
+        if (maintainingDP && !keepDigest) memSet(i, randomized ? (randVal(i) & VDMASK) : 0);
+        continue;
+      }
+      
+      if ((DL || randomized) && maintainingDP) {
+        memSet(i, randomized ? randVal() | 1 : 1);
+      }
+      fillTreeDFS<true, true, keepDigest>(i, &reached);
+    }
+  }
+  
   inline void fillOnlyValue() {
     fillValue<true>();
   }
@@ -667,6 +723,7 @@ private:
   /// Side effect: 1) discard all memory except keys and values. 2) build fail, or
   /// all the values and disjoint set are properly set
   bool build() {
+    ScopedTimer timer("Othello build");
     tryCount = 0;
     
     bool built = false;
@@ -683,6 +740,8 @@ private:
     
     //printf("%08x %08x\n", Ha.s, Hb.s);
     if (built) {
+      if (!maintainDisjointSet) connectivityForest.release();
+      
       if (tryCount > 20) {
         cout << "Succ " << human(keyCnt) << " Keys, ma/mb = " << human(ma) << "/" << human(mb)    //
              << " keyT" << sizeof(K) * 8 << "b  valueT" << sizeof(V) * 8 << "b"     //
@@ -715,10 +774,11 @@ public:
   /// \param kv
   /// \return succeeded or not
   inline bool insert(pair<K, V> &&kv) {
+    ScopedTimer timer("Othello insert");
     assert(!isMember(kv.first));
-    int lastIndex = keyCnt;
+    uint32_t lastIndex = keyCnt;
     
-    if (keyCnt >= keys.size())
+    if (keyCnt >= mb)
       resizeKey(keyCnt + 1);
     keyCnt++;
     
@@ -738,6 +798,7 @@ public:
       }
     } else {  // acyclic, just add
       addEdge(lastIndex, ha, hb);
+      if (maintainDisjointSet) connectivityForest.merge(ha, hb);
       fixHalfTreeDFS<maintainDP, true>(keyCnt - 1, ha, hb);
     }
     
@@ -783,19 +844,20 @@ public:
   //*********AS A SET
   //****************************************
 public:
-  inline const vector<K> &getKeys() const {
+  /// the first size() elements are the keys
+  inline const ChunkedArray<K> &getKeys() const {
     return keys;
   }
   
-  inline const vector<V> &getValues() const {
+  inline const ChunkedArray<V> &getValues() const {
     return values;
   }
   
-  inline vector<V> &getValues() {
+  inline ChunkedArray<V> &getValues() {
     return values;
   }
   
-  inline const vector<uint32_t> &getIndexMemory() const {
+  inline const vector<Index> &getIndexMemory() const {
     return indMem;
   }
   
@@ -808,8 +870,10 @@ public:
     return (index < keyCnt && keys[index] == x);
   }
   
-  inline void erase(const K &k, int32_t keyId = -1) {
-    if (keyId == -1) {
+  /// erase k, whose key id is keyId if known. NIL: look it up, and do nothing if k is not a member
+  inline void erase(const K &k, uint32_t keyId = NIL) {
+    ScopedTimer timer("Othello erase");
+    if (keyId == NIL) {
       keyId = queryIndex(k);
       if (keyId >= keyCnt || !(keys[keyId] == k)) return;
     }
@@ -819,20 +883,20 @@ public:
     keyCnt--;
     
     // Delete the edge of keyId. By maintaining the linked lists on nodes ha and hb.
-    int32_t headA = head[ha];
+    uint32_t headA = head[ha];
     if (headA == keyId) {
       head[ha] = nextAtA[keyId];
     } else {
-      int t = headA;
+      uint32_t t = headA;
       while (nextAtA[t] != keyId)
         t = nextAtA[t];
       nextAtA[t] = nextAtA[nextAtA[t]];
     }
-    int32_t headB = head[hb];
+    uint32_t headB = head[hb];
     if (headB == keyId) {
       head[hb] = nextAtB[keyId];
     } else {
-      int t = headB;
+      uint32_t t = headB;
       while (nextAtB[t] != keyId)
         t = nextAtB[t];
       nextAtB[t] = nextAtB[nextAtB[t]];
@@ -852,7 +916,7 @@ public:
     if (head[hal] == keyCnt) {
       head[hal] = keyId;
     } else {
-      int t = head[hal];
+      uint32_t t = head[hal];
       while (nextAtA[t] != keyCnt)
         t = nextAtA[t];
       nextAtA[t] = keyId;
@@ -861,7 +925,7 @@ public:
     if (head[hbl] == keyCnt) {
       head[hbl] = keyId;
     } else {
-      int t = head[hbl];
+      uint32_t t = head[hbl];
       while (nextAtB[t] != keyCnt)
         t = nextAtB[t];
       nextAtB[t] = keyId;
@@ -938,12 +1002,29 @@ public:
     return ma * mb;
   }
   
+  /// everything allocated: the data plane cells, the keys and values, and the build state
   uint64_t getMemoryCost() const {
-    return mem.size() * sizeof(mem[0]) + keys.size() * sizeof(keys[0]) + values.size() * sizeof(values[0]) +
-           indMem.size() * sizeof(indMem[0]);
+    return getMemoryBreakdown().reserved();
+  }
+  
+  /// the keys, values and their links are used up to size(). the node arrays are used in full, ma + mb each
+  MemoryBreakdown getMemoryBreakdown() const {
+    MemoryBreakdown b;
+    b.add("object", sizeof(*this), sizeof(*this));
+    b.addVector("cells", mem);
+    b.add("keys", (uint64_t) keyCnt * sizeof(K), keys.getMemoryCost());
+    b.add("values", (uint64_t) keyCnt * sizeof(V), values.getMemoryCost());
+    b.add("key-links", (uint64_t) keyCnt * 2 * sizeof(Index), nextAtA.getMemoryCost() + nextAtB.getMemoryCost());
+    b.addVector("node-heads", head);
+    b.addVector("node-indices", indMem);
+    b.add("disjoint-set", connectivityForest.getMemoryCost(), connectivityForest.getMemoryCost());
+    return b;
   }
 };
 
+template<class K, class V, uint8_t L, uint8_t DL, bool maintainDP, bool maintainDisjointSet, bool randomized, class Index>
+const Index ControlPlaneOthello<K, V, L, DL, maintainDP, maintainDisjointSet, randomized, Index>::NIL;
+
 
 template<class K, class V, uint8_t L = sizeof(V) * 8>
 class OthelloMap : public ControlPlaneOthello<K, V, L, false, true> {
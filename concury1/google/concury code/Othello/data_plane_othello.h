@@ -116,13 +116,14 @@ public:
 public:
   DataPlaneOthello() {}
   
-  template<bool maintainDisjointSet, bool randomized>
-  explicit DataPlaneOthello(ControlPlaneOthello<K, V, L, DL, true, maintainDisjointSet, randomized> &cpOthello) {
+  template<bool maintainDisjointSet, bool randomized, class Index>
+  explicit DataPlaneOthello(ControlPlaneOthello<K, V, L, DL, true, maintainDisjointSet, randomized, Index> &cpOthello) {
     fullSync(cpOthello);
   }
   
-  template<bool maintainDisjointSet, bool randomized>
-  void fullSync(ControlPlaneOthello<K, V, L, DL, true, maintainDisjointSet, randomized> &cpOthello) {
+  template<bool maintainDisjointSet, bool randomized, class Index>
+  void fullSync(ControlPlaneOthello<K, V, L, DL, true, maintainDisjointSet, randomized, Index> &cpOthello) {
+    ScopedTimer timer("Othello fullSync");
     this->ma = cpOthello.ma;
     this->mb = cpOthello.mb;
     this->hab = cpOthello.hab;
@@ -130,8 +131,9 @@ public:
     this->hd = cpOthello.hd;
   }
   
-  template<bool maintainDisjointSet, bool randomized>
-  void fullSync(ControlPlaneOthello<K, V, L, DL, false, maintainDisjointSet, randomized> &cpOthello) {
+  template<bool maintainDisjointSet, bool randomized, class Index>
+  void fullSync(ControlPlaneOthello<K, V, L, DL, false, maintainDisjointSet, randomized, Index> &cpOthello) {
+    ScopedTimer timer("Othello fullSync");
     cpOthello.prepareDP();
     
     this->ma = cpOthello.ma;
@@ -144,6 +146,31 @@ public:
   virtual uint64_t getMemoryCost() const {
     return mem.size() * sizeof(mem[0]);
   }
+  
+  MemoryBreakdown getMemoryBreakdown() const {
+    MemoryBreakdown b;
+    b.add("object", sizeof(*this), sizeof(*this));
+    b.addVector("cells", mem);
+    return b;
+  }
+  
+  // the arrays as a switch holds them, one cell per table entry (see p4/table_programmer.h)
+  inline uint32_t getMa() const {
+    return ma;
+  }
+  
+  inline uint32_t getMb() const {
+    return mb;
+  }
+  
+  inline Hasher64<K> getH() const {
+    return hab;
+  }
+  
+  /// \param index in array A, or ma + the index in array B
+  inline uint64_t getCell(uint32_t index) const {
+    return memGet(index);
+  }
 };
 
 template<class K, class V, uint8_t L = sizeof(V) * 8, uint8_t DL = 6>
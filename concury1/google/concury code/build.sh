@@ -20,7 +20,28 @@ for name in concury silkroad maglevx; do
 		else
 			g++ -DNDEBUG -DNAME=\"$name\" -DVIP_NUM=128 -DCONN_NUM=$i farmhash/farmhash.cc common.cpp $name.cpp -o bin/$name.$i  -lstdc++ --std=c++17 -march=native -lpthread -O3 -mavx -maes
 			g++ -DFIX_DIP_NUM -DNDEBUG -DNAME=\"$name\" -DVIP_NUM=128 -DCONN_NUM=$i farmhash/farmhash.cc common.cpp $name.cpp -o bin/$name.$i.fix  -lstdc++ --std=c++17 -march=native -lpthread -O3 -mavx -maes
+			if [ "$name" = 'maglevx' ]; then
+				g++ -DCONCURRENT_READ -DNDEBUG -DNAME=\"$name.mt\" -DVIP_NUM=128 -DCONN_NUM=$i farmhash/farmhash.cc common.cpp $name.cpp -o bin/$name.$i.mt  -lstdc++ --std=c++17 -march=native -lpthread -O3 -mavx -maes
+			fi;
 		fi;
 		echo $name.$i
 	done
 done
+
+# the benchmark driver, once per algorithm, see lb_bench.sh
+for name in concury silkroad maglevx; do
+	if [ "$name" = 'concury' ]; then
+		g++ -DLB_BENCH -DNDEBUG -DNAME=\"lb_bench.$name\" -DVIP_NUM=128 -DCONN_NUM=16777216 farmhash/farmhash.cc md5/md5.cpp concury.common.cpp common.cpp lb_bench.cpp trace_replay.cpp workload.cpp scenario.cpp concury.cpp -o bin/lb_bench.$name  -lstdc++ --std=c++17 -march=native -lpthread -O3 -mavx -maes
+	else
+		g++ -DLB_BENCH -DNDEBUG -DNAME=\"lb_bench.$name\" -DVIP_NUM=128 -DCONN_NUM=16777216 farmhash/farmhash.cc common.cpp lb_bench.cpp trace_replay.cpp workload.cpp scenario.cpp $name.cpp -o bin/lb_bench.$name  -lstdc++ --std=c++17 -march=native -lpthread -O3 -mavx -maes
+	fi;
+	echo lb_bench.$name
+done
+
+# binary traces from text dumps and pcap files, for the replay of lb_bench and realTraceDistribution
+g++ -DNDEBUG trace_convert.cpp -o bin/trace_convert  -lstdc++ --std=c++14 -O3
+echo trace_convert
+
+# kernel microbenchmarks, also the Microbench target of CMakeLists.txt
+g++ -DNDEBUG -DNAME=\"microbench\" farmhash/farmhash.cc common.cpp microbench.cpp -o bin/microbench  -lstdc++ --std=c++14 -march=native -lpthread -O3 -mavx -maes
+echo microbench
@@ -4,18 +4,32 @@
  * Need the VIP:port list
  */
 #include "common.h"
+#include "json_writer.h"
 #include <csignal>
 #include <cstdarg>
 #include <gperftools/profiler.h>
 
+#ifndef LB_BENCH
 #ifndef FIX_DIP_NUM
 ofstream queryLog(NAME ".query.data", ios::app), addLog(NAME ".add.data", ios::app), memoryLog(NAME ".mem.data", ios::app), dynamicLog(NAME ".dynamic.data", ios::app);
 #else
 ofstream queryLog(NAME ".query.fix.data", ios::app), addLog(NAME ".add.fix.data", ios::app), memoryLog(NAME ".mem.fix.data", ios::app), dynamicLog(NAME ".dynamic.fix.data", ios::app);
 #endif
+#endif
 
 int Clocker::currentLevel = 0;
-list<Counter> Counter::counters;
+
+/// the scope timers of all threads, written when the program ends: after main, its thread locals and the root Clocker
+static struct ScopeTimerReport {
+  ScopeTimerReport() {
+    ScopeTimers::registry();
+  }
+  
+  ~ScopeTimerReport() {
+    writeScopeTimers(NAME);
+  }
+} scopeTimerReport;
+
 Clocker global("root");
 
 int stick_this_thread_to_core(int core_id) {
@@ -44,9 +58,7 @@ void sync_printf(const char *format, ...) {
 
 void sig_handler(int sig) {
 //  ProfilerStop();
-  for (auto &c:Counter::counters) {
-    c.lap();
-  }
+  Counter::print(cout, 0);
   exit(0);
 }
 
@@ -75,6 +87,14 @@ std::string human(uint64_t word) {
   return s;
 }
 
+MemoryBreakdown getHtMemoryBreakdown(uint16_t *const *ht) {
+  MemoryBreakdown b;
+  if (!ht) return b;
+  b.add("ht", VIP_NUM * sizeof(uint16_t *), heapBytes(ht));
+  for (int i = 0; i < VIP_NUM; ++i) b.add("ht", HT_SIZE * sizeof(uint16_t), heapBytes(ht[i]));
+  return b;
+}
+
 //! split a c-style string with delimineter chara.
 std::vector<std::string> split(const char *str, char deli) {
   std::istringstream ss(str);
@@ -86,11 +106,44 @@ std::vector<std::string> split(const char *str, char deli) {
   return ret;
 }
 
-string Counter::pad() const {
-  if (!Clocker::currentLevel) return "";
+static void writeScopeJson(JsonWriter &json, const string &name, const ScopeTimers::Report &r, double ticksPerNs) {
+  uint64_t childTicks = 0;
+  for (auto &c : r.children) childTicks += c.second.ticks;
+  
+  json.beginObject();
+  json.field("name", name).field("count", r.count);
+  json.field("total_ns", r.ticks / ticksPerNs).field("self_ns", (r.ticks - childTicks) / ticksPerNs);
+  json.field("max_ns", r.maxTicks / ticksPerNs);
+  json.key("children").beginArray();
+  for (auto &c : r.children) writeScopeJson(json, c.first, c.second, ticksPerNs);
+  json.endArray();
+  json.endObject();
+}
+
+static void writeScopeFolded(ostream &os, const string &stack, const ScopeTimers::Report &r, double ticksPerNs) {
+  uint64_t childTicks = 0;
+  for (auto &c : r.children) {
+    childTicks += c.second.ticks;
+    writeScopeFolded(os, stack + ";" + c.first, c.second, ticksPerNs);
+  }
+  os << stack << " " << uint64_t((r.ticks - childTicks) / ticksPerNs + 0.5) << endl;
+}
+
+void writeScopeTimers(const string &prefix) {
+  uint64_t dropped;
+  ScopeTimers::Report report = ScopeTimers::merged(dropped);
+  if (report.children.empty()) return;
+  double ticksPerNs = tscPerNs();
+  
+  ofstream jsonOut(prefix + ".timers.json");
+  JsonWriter json(jsonOut);
+  json.beginObject();
+  json.field("dropped_scopes", dropped);
+  json.key("scopes").beginArray();
+  for (auto &c : report.children) writeScopeJson(json, c.first, c.second, ticksPerNs);
+  json.endArray();
+  json.endObject();
   
-  ostringstream oss;
-  for (int i = 0; i < Clocker::currentLevel; ++i) oss << "| ";
-  oss << "  ";
-  return oss.str();
+  ofstream folded(prefix + ".timers.folded");
+  for (auto &c : report.children) writeScopeFolded(folded, c.first, c.second, ticksPerNs);
 }
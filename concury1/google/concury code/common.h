@@ -31,13 +31,19 @@
 #include <queue>
 #include <set>
 #include <list>
+#include <memory>
 
 #include "disjointset.h"
+#include "memory_breakdown.h"
 #include "hash.h"
 #include "lfsr64.h"
 #include "sha2/sha2.h"
 #include "md5/md5.h"
 #include "config.h"   // when work with p4
+#include "latency_histogram.h"
+#include "perf_counters.h"
+#include "counters.h"
+#include "scope_timer.h"
 
 //int VIP_NUM = 128;                       // must be power of 2
 //int VIP_MASK = (VIP_NUM - 1);
@@ -104,8 +110,56 @@ inline ostream& operator <<(ostream & os, Tuple3 const & tuple) {
   os << std::hex << tuple.src << ", " << tuple.protocol;
   return os;
 }
+
+struct Addr6_Port {  // 18B
+  uint8_t addr[16] = {0};
+  uint16_t port = 0;
+  
+  inline bool operator ==(const Addr6_Port& another) const {
+    return memcmp(addr, another.addr, sizeof(addr)) == 0 && port == another.port;
+  }
+  
+  inline bool operator <(const Addr6_Port& another) const {
+    int c = memcmp(addr, another.addr, sizeof(addr));
+    return c < 0 || (c == 0 && port < another.port);
+  }
+};
+
+inline ostream& operator <<(ostream & os, const Addr6_Port& addr) {
+  os << "[" << std::hex;
+  for (int i = 0; i < 16; i += 2) {
+    os << (i ? ":" : "") << ((addr.addr[i] << 8) | addr.addr[i + 1]);
+  }
+  os << "]:" << addr.port;
+  return os;
+}
+
+struct Tuple3v6 {  // 24B, the IPv6 counterpart of Tuple3
+  Addr6_Port src;
+  uint16_t protocol = 6;
+  uint32_t pad = 0;       // keeps the key a whole number of words. must stay zero, it is hashed
+  
+  inline bool operator ==(const Tuple3v6& another) const {
+    return src == another.src && protocol == another.protocol;
+  }
+  
+  inline bool operator <(const Tuple3v6& another) const {
+    return std::tie(src, protocol) < std::tie(another.src, another.protocol);
+  }
+};
+
+inline ostream& operator <<(ostream & os, Tuple3v6 const & tuple) {
+  os << tuple.src << ", " << std::hex << tuple.protocol;
+  return os;
+}
 #pragma pack(pop)
 
+static_assert(sizeof(Tuple3v6) == 24, "Tuple3v6 must be 3 words");
+
+template<>
+struct FixedWidthKey<Tuple3v6> : std::true_type {
+};
+
 template<int coreId = 0>
 inline void getVip(Addr_Port *vip) {
   static int addr = 0x0a800000 + coreId * 10;
@@ -138,6 +192,8 @@ inline int diff_us(timeval t1, timeval t2) {
 
 std::string human(uint64_t word);
 
+std::vector<std::string> split(const char *str, char deli);
+
 #ifndef _GNU_SOURCE
 #define _GNU_SOURCE 1
 #endif
@@ -151,6 +207,9 @@ void sync_printf(const char *format, ...);
 
 void commonInit();
 
+/// a [VIPInd][HT_SIZE] hash table, as allocated by initControlPlaneAndDataPlane
+MemoryBreakdown getHtMemoryBreakdown(uint16_t *const *ht);
+
 template<typename InType,
   template<typename U, typename alloc = allocator<U>> class InContainer,
   typename OutType = InType,
@@ -166,56 +225,8 @@ OutContainer<OutType> mapf(const InContainer<InType> &input, function<OutType(co
 #define NAME "concury"
 #endif
 
-/// for runtime statistics collection
-class Counter {
-public:
-  unordered_map<string, unordered_map<string, double>> mem;
-  static list<Counter> counters;
-  
-  static inline void count(const string &solution, const string &type, double acc = 1) {
-    #ifdef PROFILE
-    auto it = counters.back().mem.find(solution);
-    if (it == counters.back().mem.end()) {
-      counters.back().mem.insert(make_pair(solution, unordered_map<string, double>()));
-      it = counters.back().mem.find(solution);
-    }
-    
-    unordered_map<string, double> &typeToCount = it->second;
-    
-    if (typeToCount.find(type) == typeToCount.end())
-      typeToCount.insert(make_pair(type, uint64_t(0)));
-    
-    counters.back().mem[solution][type] += acc;
-    #endif
-  }
-  
-  ~Counter() {
-    lap();
-  }
-  
-  string pad() const;
-  
-  void lap() {
-    if (mem.empty()) return;
-    
-    #ifdef PROFILE
-//    cout << pad() << "**************** Hit counts: ****************" << endl;
-    
-    for (auto it = mem.begin(); it != mem.end(); ++it) {
-      const string &solution = it->first;
-      
-      for (auto iit = it->second.begin(); iit != it->second.end(); ++iit) {
-        const string type = iit->first;
-        cout << pad() << "->" <<  "[" << solution << "] [" << type << "] " << iit->second << endl;
-      }
-    }
-    
-//    cout << pad() << "*********************************************" << endl;
-    mem.clear();
-    #endif
-  }
-};
-
+/// wall time of a scope, the Counter events in it, and with ops its hardware counters per op (perf_counters.h). in
+/// PROFILE builds it is a scope of the ScopeTimers tree too, so the ScopedTimers in it nest under its name
 class Clocker {
   int level;
   struct timeval start;
@@ -225,21 +236,42 @@ class Clocker {
   int laps = 0;
   int us = 0;
 
+  uint64_t ops = 0;
+  unique_ptr<PerfCounters> perf;
+  PerfSample perfStart, perfTotal;
+
+  vector<double> countersStart;
+  int timerNode = -1;     // the root Clocker, a global, outlives the thread locals and stays out of the tree
+  uint64_t timerStart = 0;
+
 public:
-  explicit Clocker(const string &name) : name(name), level(currentLevel++) {
+  /// \param ops the operations the scope does: the counters are opened and printed per op. 0 for wall time only
+  explicit Clocker(const string &name, uint64_t ops = 0) : name(name), level(currentLevel++), ops(ops) {
     for (int i = 0; i < level; ++i) cout << "| ";
     cout << "++";
-    
-    gettimeofday(&start, nullptr);
     cout << " [" << name << "]" << endl;
     
-    Counter::counters.push_back({});
+    countersStart = Counter::totals();
+    
+    if (ops) {
+      perf.reset(new PerfCounters());
+      perfStart = perf->read();
+    }
+    
+    #ifdef PROFILE
+    if (level) {
+      timerNode = ScopeTimers::local().enter(ScopeTimers::intern(name));
+      timerStart = tscNow();
+    }
+    #endif
+    gettimeofday(&start, nullptr);
   }
   
   void lap() {
     timeval end;
     gettimeofday(&end, nullptr);
     us += diff_us(end, start);
+    if (perf) perfTotal += perf->read() - perfStart;
     
     output();
     
@@ -247,12 +279,15 @@ public:
   }
   
   void resume() {
+    if (perf) perfStart = perf->read();
     gettimeofday(&start, nullptr);
   }
   
   void stop() {
-    Counter::counters.back().lap();
-    Counter::counters.pop_back();
+    #ifdef PROFILE
+    if (level) ScopeTimers::local().exit(timerNode, tscNowOrdered() - timerStart);
+    #endif
+    Counter::print(cout, currentLevel, countersStart);
     
     lap();
     stopped = true;
@@ -270,9 +305,19 @@ public:
     cout << " [" << name << "]" << (laps ? "@" + to_string(laps) : "") << ": "
          << us / 1000 << "ms or " << us << "us"
          << endl;
+    
+    if (!perf || !ops) return;
+    for (int i = 0; i < level; ++i) cout << "| ";
+    cout << "   ";
+    if (perf->available()) perfTotal.printPerOp(cout, ops);
+    else cout << "perf counters unavailable, " << perf->unavailableReason();
+    cout << endl;
   }
   
   static int currentLevel;
 };
 
-extern ofstream queryLog, addLog, memoryLog, dynamicLog;
\ No newline at end of file
+#ifndef LB_BENCH
+/// results of the benchmark modes, appended to NAME ".*.data". the driver of lb_bench.h writes JSON only
+extern ofstream queryLog, addLog, memoryLog, dynamicLog;
+#endif
\ No newline at end of file
@@ -1,18 +1,39 @@
 #include "concury.common.h"
 
 // Data plane
-vector<DataPlaneOthello<Tuple3, uint16_t, 12, 0>> othelloForQuery(VIP_NUM); // 3-tuple -> DIPInd requires initialization
+vector<ConcuryDataPlane> othelloForQuery(VIP_NUM); // 3-tuple -> DIPInd requires initialization
 uint16_t **ht = 0;    // [VIPInd][DIPInd] -> DIP Addr_Port
 vector<DIP> dipPools[VIP_NUM];  // vipIndex, dipindex -> dip
 int dipNum[VIP_NUM];
 // !Data plane
 
 // Control plane
-vector<ControlPlaneOthello<Tuple3, uint16_t, 12, 0, false, false, false>> conn(
-  VIP_NUM);  // track the connections and their dipIndices
+vector<ConcuryControlPlane> conn(VIP_NUM);  // track the connections and their dipIndices
 uint16_t **newHt = 0;
 // !Control plane
 
+const Hasher32<Tuple3> flowHash(0xe2213);
+
+uint32_t learnConnections(LearningQueue &queue) {
+  vector<bool> touched(VIP_NUM, false);
+  uint32_t learned = 0;
+  
+  queue.drain([&](const LearnRequest &request) {
+    ConcuryControlPlane &c = conn[request.vipInd];
+    if (c.isMember(request.tuple)) return;
+    
+    ScopedLatency timer(LAT_INSERT);
+    c.insert(make_pair(request.tuple, request.htInd));
+    touched[request.vipInd] = true;
+    ++learned;
+  });
+  
+  for (int vipInd = 0; vipInd < VIP_NUM; ++vipInd) {
+    if (touched[vipInd]) updateDataPlaneCallBack(vipInd);
+  }
+  return learned;
+}
+
 void simulateConnectionAdd(int limit, int prestart) {
   int addr = 0x0a800000 + prestart % VIP_NUM;
   LFSRGen<Tuple3> tuple3Gen(0xe2211, CONN_NUM, prestart);
@@ -41,6 +62,7 @@ void simulateConnectionAdd(int limit, int prestart) {
     htInd &= (HT_SIZE - 1);
     
     // Step 4: add to control plane tracking table
+    ScopedLatency timer(LAT_INSERT);
     conn[vipInd].insert(make_pair(tuple, htInd));
   }
 
@@ -48,7 +70,9 @@ void simulateConnectionAdd(int limit, int prestart) {
   gettimeofday(&end, NULL);
   double diff = diff_us(end, start) / 1000.0;
   cout << "Control Plane Add " << limit << " connections " << diff << "ms" << endl;
+#ifndef LB_BENCH
   addLog << limit << " " << diff << endl;
+#endif
 }
 
 void simulateConnectionLeave() {
@@ -74,6 +98,7 @@ void simulateConnectionLeave() {
     if (!conn[vipInd].isMember(tuple)) {   // insert to the dipIndexTable to simulate the control plane
       throw exception();
     } else {
+      ScopedLatency timer(LAT_ERASE);
       conn[vipInd].erase(tuple);
       assert(!conn[vipInd].isMember(tuple));
     }
@@ -136,7 +161,7 @@ void simulateDipDown(int cnt) {
  *
  * assuming dip pools and conn have been properly constructed
  */
-void updateDataPlane(bool init) {
+void updateDataPlane(bool init, int onlyVip) {
   const static int M = HT_SIZE == 4096 ? 4099 : HT_SIZE == 512 ? 521 : 0;  // a prime number // 4093
   const static Hasher32<uint32_t> hash1(0xe2211), hash2(0xe2212);
   
@@ -147,7 +172,8 @@ void updateDataPlane(bool init) {
   uint64_t cpDpSynchronizationTime = 0;
   uint64_t migrationCalculationTime = 0;
   
-  for (uint16_t vipInd = 0; vipInd < VIP_NUM; ++vipInd) {
+  uint16_t firstVip = onlyVip < 0 ? 0 : onlyVip, lastVip = onlyVip < 0 ? VIP_NUM : onlyVip + 1;
+  for (uint16_t vipInd = firstVip; vipInd < lastVip; ++vipInd) {
     gettimeofday(&start, NULL);
     
     uint16_t dipCount = dipPools[vipInd].size();
@@ -161,7 +187,7 @@ void updateDataPlane(bool init) {
     // ** let dips take entries in turn with weight
     double allocatedWeight = 0;
     int allocatedEntries = 0;
-    uint16_t oneHtIndOf[dipPools[vipInd].size()];
+    vector<uint16_t> oneHtIndOf(dipCount, uint16_t(-1));   // -1: the DIP takes no entry, weight 0
     vector<uint16_t> entries(dipCount);
     
     for (int dipInd = 0; dipInd < dipCount; ++dipInd) {
@@ -206,7 +232,8 @@ void updateDataPlane(bool init) {
     unordered_map<uint16_t, uint16_t> migration;
     for (uint16_t htIndex = 0; htIndex < HT_SIZE; ++htIndex) {
       uint16_t dipIndex = ht[vipInd][htIndex];
-      if (dipIndex != newHt[vipInd][htIndex]) {
+      // a DIP left with no entry has nothing to keep its connections on: they follow the new owner
+      if (dipIndex != newHt[vipInd][htIndex] && dipIndex < dipCount && oneHtIndOf[dipIndex] != uint16_t(-1)) {
         migration.insert(make_pair(htIndex, oneHtIndOf[dipIndex]));
       }
     }
@@ -219,7 +246,9 @@ void updateDataPlane(bool init) {
     
     // ** now that all upcoming migrations are stored in the map, do the migration
     // *** traverse all the stored connections to check if the result is to be migrated
+    uint64_t composeStart = tscNow();
     conn[vipInd].compose(migration);
+    recordLatency(LAT_COMPOSE, tscNow() - composeStart);
     
     gettimeofday(&curr, NULL);
     diff = diff_us(curr, start);
@@ -275,7 +304,7 @@ void updateDataPlaneStupid(bool init) {
     // ** let dips take entries in turn with weight
     double allocatedWeight = 0;
     int allocatedEntries = 0;
-    uint16_t oneHtIndOf[dipPools[vipInd].size()];
+    vector<uint16_t> oneHtIndOf(dipCount, uint16_t(-1));   // -1: the DIP takes no entry, weight 0
     vector<uint16_t> entries(dipCount);
     
     for (int dipInd = 0; dipInd < dipCount; ++dipInd) {
@@ -320,7 +349,8 @@ void updateDataPlaneStupid(bool init) {
     unordered_map<uint16_t, uint16_t> migration;
     for (uint16_t htIndex = 0; htIndex < HT_SIZE; ++htIndex) {
       uint16_t dipIndex = ht[vipInd][htIndex];
-      if (dipIndex != newHt[vipInd][htIndex]) {
+      // a DIP left with no entry has nothing to keep its connections on: they follow the new owner
+      if (dipIndex != newHt[vipInd][htIndex] && dipIndex < dipCount && oneHtIndOf[dipIndex] != uint16_t(-1)) {
         migration.insert(make_pair(htIndex, oneHtIndOf[dipIndex]));
       }
     }
@@ -333,23 +363,27 @@ void updateDataPlaneStupid(bool init) {
     
     // ** now that all upcoming migrations are stored in the map, do the migration
     // *** traverse all the stored connections to check if the result is to be migrated
+    uint64_t composeStart = tscNow();
     conn[vipInd].compose(migration);
+    recordLatency(LAT_COMPOSE, tscNow() - composeStart);
     
     gettimeofday(&curr, NULL);
     diff = diff_us(curr, start);
     controlPlaneConstructionTime += diff;
   
     // Step3: write back the new ht and new othelloForQuery
-    ControlPlaneOthello<Tuple3, uint16_t, 12, 0, true, true, false> tmp(CONN_NUM / VIP_NUM);
+    ControlPlaneOthello<Tuple3, uint16_t, 12, CONCURY_DL, true, true, false> tmp(CONN_NUM / VIP_NUM);
     gettimeofday(&curr, NULL);
     memcpy(ht[vipInd], newHt[vipInd], HT_SIZE * sizeof(uint16_t));
     
+    uint64_t syncStart = tscNow();
     const auto &keys = conn[vipInd].getKeys();
     const auto &values = conn[vipInd].getValues();
     const int size = conn[vipInd].size();
     for (int i = 0; i < size; ++i) {
       tmp.insert(make_pair(keys[i], values[i]));
     }
+    recordLatency(LAT_SYNC, tscNow() - syncStart);
     
     gettimeofday(&curr, NULL);
     diff = diff_us(curr, start);
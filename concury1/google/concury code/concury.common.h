@@ -4,17 +4,92 @@
 #include "Othello/control_plane_othello.h"
 #include "Othello/data_plane_othello.h"
 
+typedef DataPlaneOthello<Tuple3, uint16_t, 12, CONCURY_DL> ConcuryDataPlane;
+typedef conditional<VIP_CONN_MAX && VIP_CONN_MAX < 65536, uint16_t, uint32_t>::type ConcuryKeyIndex;
+typedef ControlPlaneOthello<Tuple3, uint16_t, 12, CONCURY_DL, false, false, false, ConcuryKeyIndex> ConcuryControlPlane;
+
 // Data plane
-extern vector<DataPlaneOthello<Tuple3, uint16_t, 12, 0>> othelloForQuery;  // 3-tuple -> DIPInd  // requires initialization,
+extern vector<ConcuryDataPlane> othelloForQuery;  // 3-tuple -> DIPInd  // requires initialization,
 extern uint16_t **ht;    // [VIPInd][DIPInd] -> DIP Addr_Port
 extern vector<DIP> dipPools[VIP_NUM];
 // !Data plane
 
 // Control plane
-extern vector<ControlPlaneOthello<Tuple3, uint16_t, 12, 0, false, false, false>> conn;  // track the connections and their dipIndices
+extern vector<ConcuryControlPlane> conn;  // track the connections and their dipIndices
 extern uint16_t **newHt;
 // !Control plane
 
+/**
+ * New flows with CONCURY_DL > 0.
+ *
+ * A known flow passes the digest of its Othello cells and takes the fast path. A flow that fails the digest takes the
+ * slow path: its ht slot comes from flowHash, and it is queued for the control plane, which learns it with that same
+ * slot so its later packets keep their DIP. A new flow that passes the digest anyway (a false positive, at most
+ * about 2^-(DL-1), see digestBenchmark) is mapped to whatever slot its cells give, as every new flow is with DL = 0,
+ * and is not learned.
+ */
+extern const Hasher32<Tuple3> flowHash;
+
+/// \return whether the flow passed the digest. htInd is the ht slot either way
+template<class DP>
+inline bool concuryLookup(const DP &othello, const Tuple3 &tuple, uint16_t &htInd) {
+  if (othello.query(tuple, htInd)) {
+    htInd &= (HT_SIZE - 1);
+    return true;
+  }
+  
+  htInd = flowHash(tuple) & (HT_SIZE - 1);
+  return false;
+}
+
+struct LearnRequest {
+  Tuple3 tuple;
+  uint16_t vipInd;
+  uint16_t htInd;     // the slot the slow path gave the flow, kept when it is learned
+};
+
+/// from the slow path to the control plane. bounded: a flow that does not fit is queued again by its next packet
+class LearningQueue {
+public:
+  uint64_t dropped = 0;
+  
+  explicit LearningQueue(uint32_t capacity = 4 * LEARN_BATCH)
+    : ring(capacity) {
+  }
+  
+  inline bool push(const LearnRequest &request) {
+    if (tail - head == ring.size()) {
+      ++dropped;
+      return false;
+    }
+    ring[tail++ % ring.size()] = request;
+    return true;
+  }
+  
+  template<class F>
+  uint32_t drain(F f) {
+    uint32_t n = 0;
+    for (; head != tail; ++n) f(ring[head++ % ring.size()]);
+    return n;
+  }
+  
+  inline size_t size() const {
+    return tail - head;
+  }
+
+private:
+  vector<LearnRequest> ring;
+  uint64_t head = 0, tail = 0;
+};
+
+/**
+ * insert the queued flows into conn with the slots they were given, then sync the data plane of every VIP that got
+ * one through updateDataPlaneCallBack
+ *
+ * \return how many were learned. a flow queued twice before it was learned counts once
+ */
+uint32_t learnConnections(LearningQueue &queue);
+
 void updateDataPlaneCallBack(int vipInd);
 void configureDataPlane(int vipInd);
 
@@ -36,9 +111,9 @@ void simulateDipDown(int cnt);
  * update data plane to make the HT consistent with the dip weight,
  * while ensuring PCC.
  *
- * assuming dip pools and conn have been properly constructed
+ * assuming dip pools and conn have been properly constructed. onlyVip >= 0: that VIP alone, the others keep their ht
  */
-void updateDataPlane(bool mute = false);
+void updateDataPlane(bool mute = false, int onlyVip = -1);
 void updateDataPlaneStupid(bool mute = false);
 
 void testResillience();
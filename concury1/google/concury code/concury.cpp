@@ -7,21 +7,37 @@
 #endif
 
 #include "concury.common.h"
+#include "trace.h"
 //#include <gperftools/profiler.h>
 
+/// dp.: what the packet path reads. cp.: what only the control plane keeps
+MemoryBreakdown getMemoryBreakdown() {
+  MemoryBreakdown b;
+  for (int vipInd = 0; vipInd < VIP_NUM; ++vipInd) {
+    b.add(othelloForQuery[vipInd].getMemoryBreakdown(), "dp.othello.");
+    b.addVector("dp.dip-pools", dipPools[vipInd]);
+    b.add(conn[vipInd].getMemoryBreakdown(), "cp.othello.");
+  }
+  b.add(getHtMemoryBreakdown(ht), "dp.");
+  b.add(getHtMemoryBreakdown(newHt), "cp.");
+  return b;
+}
+
 void printMemoryUsage() {
-  uint64_t size = 0;
-  
-  for (int vipInd = 0; vipInd < VIP_NUM; ++vipInd)
-    size += othelloForQuery[vipInd].getMemoryCost();
+  MemoryBreakdown b = getMemoryBreakdown();
+  uint64_t size = b.reserved("dp.othello.cells");
   
   cout << "Othello memory usage: " << size << endl;
+  if (CONCURY_DL) {
+    cout << "of which digests (" << CONCURY_DL << " bits per cell): " << size * CONCURY_DL / (12 + CONCURY_DL) << endl;
+  }
   
-  // dipTable
-  size += VIP_NUM * HT_SIZE * sizeof(uint16_t) + DIP_NUM * sizeof(DIP);
-  
-  cout << "Total memory usage: " << size << endl;
-  memoryLog << CONN_NUM << " " << size << endl;
+  b.print(cout);
+  cout << "Total memory usage: " << b.reserved("dp.") << " data plane, " << b.reserved("cp.") << " control plane"
+       << endl;
+#ifndef LB_BENCH
+  memoryLog << CONN_NUM << " " << b.reserved("dp.") << endl;
+#endif
 }
 
 void configureDataPlane(int vipInd) {
@@ -29,6 +45,7 @@ void configureDataPlane(int vipInd) {
 
 void updateDataPlaneCallBack(int vipInd) {
   // Step3: write back the new ht and new othelloForQuery
+  ScopedLatency timer(LAT_SYNC);
   memcpy(ht[vipInd], newHt[vipInd], HT_SIZE * sizeof(uint16_t));
   othelloForQuery[vipInd].fullSync(conn[vipInd]);
 }
@@ -43,6 +60,11 @@ void updateDataPlaneCallBack(int vipInd) {
  * 4/16 byte src addr, 2 byte src port,
  * 4/16 byte dst addr, 2 byte dst port.
  */
+// the hardware counters of the serve threads, summed as they finish
+PerfSample servePerf;
+string servePerfUnavailable;
+mutex servePerfLock;
+
 void *serve(int *coreId) {
   const int id = *coreId;
   
@@ -50,6 +72,8 @@ void *serve(int *coreId) {
   LFSRGen<Tuple3> tuple3Gen(0xe2211, CONN_NUM, id * 10);
   
   stick_this_thread_to_core(id);
+  PerfCounters perf;
+  PerfSample perfStart = perf.read();
   
   struct timeval start, curr, last;
   gettimeofday(&start, NULL);
@@ -69,12 +93,15 @@ void *serve(int *coreId) {
     if (addr >= 0x0a800000 + VIP_NUM) addr = 0x0a800000;
     
     // Step 2: lookup the VIPTable to get VIPInd
+    bool sampled = sampleLookup();
+    uint64_t lookupStart = sampled ? tscNow() : 0;
     uint16_t vipInd = vip.addr & VIP_MASK;
     
     // Step 3: lookup corresponding Othello array
-    uint16_t htInd = othelloForQuery[vipInd].query(tuple);
-    htInd &= (HT_SIZE - 1);
+    uint16_t htInd;
+    concuryLookup(othelloForQuery[vipInd], tuple, htInd);
     DIP &dip = dipPools[vipInd][ht[vipInd][htInd]];
+    if (sampled) recordLatency(LAT_LOOKUP, tscNow() - lookupStart);
     
     assert(((dip.addr.addr ^ (0x0a000000 + (vipInd << 8))) < dipPools[vipInd].size() && dip.addr.port - vip.port >= 0 &&
             dip.addr.port - vip.port < dipPools[vipInd].size()));
@@ -95,6 +122,12 @@ void *serve(int *coreId) {
     }
   }
   
+  {
+    lock_guard<mutex> guard(servePerfLock);
+    servePerf += perf.read() - perfStart;
+    if (!perf.available()) servePerfUnavailable = perf.unavailableReason();
+  }
+  
   sync_printf("%d\b \b", stupid & 7);
   pthread_exit(NULL);
 }
@@ -110,6 +143,8 @@ void multiThreadServe(int NUM_THREADS = 6) {
   int rc;
   int t[] = {0, 1, 2, 3, 4, 5, 6, 7};
   
+  servePerf = PerfSample();
+  
   struct timeval start, curr, last;
   gettimeofday(&start, NULL);
   last = start;
@@ -129,10 +164,18 @@ void multiThreadServe(int NUM_THREADS = 6) {
   gettimeofday(&curr, NULL);
   int diff = diff_ms(curr, start);
   
+#ifndef LB_BENCH
   queryLog << NUM_THREADS << ' ' << CONN_NUM << ' ' << 5 * LOG_INTERVAL / (diff / 1000.0) << endl;
+#endif
+  
+  cout << NUM_THREADS << " serve threads: ";
+  if (servePerf.any()) servePerf.printPerOp(cout, uint64_t(NUM_THREADS) * 5 * LOG_INTERVAL);
+  else cout << "perf counters unavailable, " << servePerfUnavailable;
+  cout << endl;
 }
 
-void initControlPlaneAndDataPlane() {
+/// capacity: the connections the control plane is presized for
+void initControlPlaneAndDataPlane(int capacity = CONN_NUM) {
   if (ht) {
     for (int i = 0; i < VIP_NUM; ++i) {
       delete[] ht[i];
@@ -153,11 +196,11 @@ void initControlPlaneAndDataPlane() {
     memset(newHt[i], 0, sizeof(uint16_t[HT_SIZE]));
   }
   
-  othelloForQuery = vector<DataPlaneOthello<Tuple3, uint16_t, 12>>(VIP_NUM);
-  conn = vector<ControlPlaneOthello<Tuple3, uint16_t, 12, 0, false, false, false>>(VIP_NUM);
+  othelloForQuery = vector<ConcuryDataPlane>(VIP_NUM);
+  conn = vector<ConcuryControlPlane>(VIP_NUM);
   
   for (auto &o: conn) {
-    o.setMinimalKeyCapacity(CONN_NUM / VIP_NUM);
+    o.setMinimalKeyCapacity(capacity / VIP_NUM);
   }
   
   initDipPool();
@@ -206,6 +249,8 @@ void dynamicServe() {
   int i = 0, round = 0;
   bool found = false;
   int stupid = 0;
+  LearningQueue learning;
+  uint64_t slowPath = 0, learned = 0;
   
   while (round < 5) {
     double r = double(rand()) / RAND_MAX;
@@ -231,19 +276,28 @@ void dynamicServe() {
       uint16_t vipInd = vip.addr & VIP_MASK;
       
       // Step 3: lookup corresponding Othello array
-      uint16_t htInd = othelloForQuery[vipInd].query(tuple);
-      htInd &= (HT_SIZE - 1);
+      uint16_t htInd;
+      [[maybe_unused]] bool known = concuryLookup(othelloForQuery[vipInd], tuple, htInd);
       uint16_t dipInd = ht[vipInd][htInd];
       DIP &dip = dipPools[vipInd][dipInd];
       
       stupid += dip.addr.addr;   //prevent optimize
       
       // Step 4: add to control plane tracking table
+#if CONCURY_DL
+      if (!known) {   // the slow path: the data plane tells the new flows apart, only they go to the control plane
+        ++slowPath;
+        learning.push({tuple, vipInd, htInd});
+        if (learning.size() >= LEARN_BATCH) learned += learnConnections(learning);
+      }
+#else
       if (!conn[vipInd].isMember(tuple)) {   // insert to the dipIndexTable to simulate the control plane
+        ScopedLatency timer(LAT_INSERT);
         conn[vipInd].insert(make_pair(tuple, htInd));
         uint16_t out;
         assert(conn[vipInd].isMember(tuple) && conn[vipInd].query(tuple, out) && (out & (HT_SIZE - 1)) == htInd);
       }
+#endif
       
       i++;
       if (i == LOG_INTERVAL) {
@@ -255,6 +309,10 @@ void dynamicServe() {
         
         printf("Dynamic: %dM packets time: %dms, Average speed: %lfMpps, %lfnspp\n", mp, diff, mp * 1000.0 / diff,
                diff * 1.0 / mp);
+        if (CONCURY_DL) {
+          printf("Dynamic: %lu slow path packets, %lu flows learned, %lu learning drops\n", slowPath, learned,
+                 learning.dropped);
+        }
         
         last = curr;
       }
@@ -294,8 +352,8 @@ void dynamicThroughput() {
       uint16_t vipInd = vip.addr & VIP_MASK;
       
       // Step 3: lookup corresponding Othello array
-      uint16_t htInd = othelloForQuery[vipInd].query(tuple);
-      htInd &= (HT_SIZE - 1);
+      uint16_t htInd;
+      concuryLookup(othelloForQuery[vipInd], tuple, htInd);
       uint16_t dipInd = ht[vipInd][htInd];
       DIP &dip = dipPools[vipInd][dipInd];
       
@@ -312,9 +370,13 @@ void dynamicThroughput() {
     
     printf("%d\b \b", stupid & 7);
     
+#ifndef LB_BENCH
     dynamicLog << newConnPerSec << " " << LOG_INTERVAL * 1.0 * round / diff_ms(last, start) / 1000 << endl;
+#endif
   }
+#ifndef LB_BENCH
   dynamicLog.close();
+#endif
 }
 
 void controlPlaneToDataPlaneUpdate(bool stupid = false) {
@@ -327,6 +389,8 @@ void controlPlaneToDataPlaneUpdate(bool stupid = false) {
     simulateConnectionAdd(conn, 0);
     simulateUpdatePoolData();
   
+    Clocker clocker(string(stupid ? "updateDataPlaneStupid " : "updateDataPlane ") + to_string(conn) + " connections",
+                    conn);
     gettimeofday(&start, NULL);
     if (stupid) {
       updateDataPlaneStupid(true);
@@ -334,268 +398,191 @@ void controlPlaneToDataPlaneUpdate(bool stupid = false) {
       updateDataPlane(true);
     }
     gettimeofday(&last, NULL);
+    clocker.stop();
     
     updateTimeLog << double(conn) / VIP_NUM << " " << diff_us(last, start) / 1000.0 / VIP_NUM << endl;
   }
   updateTimeLog.close();
 }
 
-#include <dirent.h>
-
-void realTraceDistribution() {
-  vector<string> files = {"10000000_1675245202791893_8515757603400187904_n",
-                          "10000000_315017922212085_5340542123177410560_n",
-                          "10000000_1126364437446015_9003528496516956160_n",
-                          "10000000_1824528241117055_9163836690551275520_n",
-                          "10000000_1205089662884486_4400531437447544832_n",
-                          "10000000_1841586622752610_7085222864617472000_n",
-                          "10000000_999303383512627_9020671020960317440_n",
-                          "10000000_2112068879019036_2059714475182784512_n",
-                          "10000000_317769855254506_8152085306355482624_n",
-                          "10000000_874849092646205_6396562465437515776_n",
-                          "10000000_1131221593631705_3102062192782999552_n",
-                          "10000000_1153730474696090_4573827393541636096_n",
-                          "10000000_1845242222428687_4961643655967277056_n",
-                          "10000000_1760263417555467_8283342844110831616_n",
-                          "10000000_1748505545391570_478311528295038976_n",
-                          "10000000_710199019137690_802013974919905280_n",
-                          "10000000_1258287940869175_7157609341481123840_n",
-                          "10000000_1797978517114731_491547681198440448_n",
-                          "10000000_1774046189534986_5643490342935199744_n",
-                          "10000000_179070485868911_7075363629750550528_n",
-                          "10000000_187049201735537_3780633378777202688_n",
-                          "10000000_355175388155348_6317005317334892544_n",
-                          "10000000_1598190443808429_8228777891660300288_n",
-                          "10000000_678309828996854_5964461246194384896_n",
-                          "10000000_508052449399525_8150586586107478016_n",
-                          "10000000_1159082254171177_415917524773765120_n",
-                          "10000000_534355520093341_7344322620789096448_n",
-                          "10000000_203234523444661_6842751362095120384_n",
-                          "10000000_307429996305091_6874657140833779712_n",
-                          "10000000_524592414417737_5047483130043170816_n",
-                          "10000000_212042589215317_1476621812337999872_n",
-                          "10000000_1131555313598467_8353247688870854656_n",
-                          "10000000_1780019358939610_4406944991851577344_n",
-                          "10000000_314279128942772_7739701753687310336_n",
-                          "10000000_746548222149823_6388999809713307648_n",
-                          "10000000_1060741794041185_5328835365178441728_n",
-                          "10000000_1625999457709573_4615576421278941184_n",
-                          "10000000_960173747428241_1736251112207417344_n",
-                          "10000000_1036734099757766_2645296333568606208_n",
-                          "10000000_1791955251063261_4387576652146671616_n",
-                          "10000000_1767757513486500_7243604581135941632_n",
-                          "10000000_213386979075049_59238864711057408_n",
-                          "10000000_1671743229808085_3480275767328243712_n",
-                          "10000000_1718488578476736_5431868490988388352_n",
-                          "10000000_339414859744201_167000337197039616_n",
-                          "10000000_1809785802596124_8050214965631516672_n",
-                          "10000000_184714695299993_3873789106303533056_n",
-                          "10000000_874957972641054_6093210707732463616_n",
-                          "10000000_742256779261507_3886677530064715776_n",
-                          "10000000_1748847982043767_5709637868700303360_n",
-                          "10000000_345611362451985_4555093497815760896_n",
-                          "10000000_294849414232615_5404748297954918400_n",
-                          "10000000_1613355792298002_1903158587916550144_n",
-                          "10000000_550984961758163_1884426307098378240_n",
-                          "10000000_968040006640510_6543871528633630720_n",
-                          "10000000_1660141617635257_1672255764489568256_n",
-                          "10000000_531164263741040_3892132774185795584_n",
-                          "10000000_1114973748557320_951891862350725120_n",
-                          "14617643_1784635495140461_4570682060141756416_n",
-                          "10000000_129664584164086_8866151888790224896_n",
-                          "10000000_524433961088216_1467667685994135552_n",
-                          "10000000_266127410454664_8016642846956191744_n",
-                          "10000000_319449951752689_3300195601152475136_n",
-                          "10000000_278332312566597_6019585506466070528_n",
-                          "10000000_1804962226382521_5727967852816760832_n",
-                          "10000000_1548821955144709_3777473335114334208_n",
-                          "10000000_1222953157775723_1253235701370060800_n",
-                          "10000000_1145171122199387_6120026155656413184_n",
-                          "10000000_1856422027921701_345382505232203776_n",
-                          "10000000_775780395897194_5651293731576348672_n",
-                          "10000000_313211325712178_7528404755886899200_n",
-                          "10000000_628993100595769_5266511597257359360_n",
-                          "10000000_1187282747997483_2828168215601872896_n",
-                          "10000000_502136283329305_4399648722883969024_n",
-                          "10000000_1710522765935649_4815237141493710848_n",
-                          "10000000_171031600012430_1176606441063055360_n",
-                          "10000000_198981490525451_6490658752146964480_n",
-                          "10000000_1051116395004931_1234327404202164224_n",
-                          "10000000_680418635454326_8270441934879719424_n",
-                          "10000000_309927252697418_4372260206063648768_n",
-                          "10000000_316690778711605_3597602411155292160_n",
-                          "10000000_1858376451059570_5204218972144140288_n",
-                          "10000000_180192792424778_3639668635112308736_n",
-                          "10000000_269907053409188_4410276782666678272_n",
-                          "10000000_343875762615613_8237864311586816000_n",
-                          "10000000_1135412129884594_5253788031520866304_n",
-                          "10000000_201773673578497_7160814585379815424_n",
-                          "10000000_697441143741147_4416529086818549760_n",
-                          "10000000_543356745871674_105022704985309184_n",
-                          "10000000_182185332189778_3598915215153954816_n",
-                          "10000000_1771786686395126_7413961362260361216_n",
-                          "10000000_1077154542379892_8800742921306374144_n",
-                          "10000000_168001350320026_3919914963413499904_n",
-                          "10000000_1081920265255042_118751357493575680_n",
-                          "10000000_220627975019916_5597249363521830912_n",
-                          "10000000_190081798085241_1478338777054183424_n",
-                          "10000000_147986905661069_473989313726513152_n",
-                          "10000000_1590524424586041_8058355393241284608_n",
-                          "10000000_310877529274050_556295532956352512_n",
-                          "10000000_201320166964049_4891528740061839360_n",
-                          "10000000_315829812118910_7323133524188332032_n",
-                          "10000000_1155505047862000_830286026642554880_n",
-                          "10000000_677833785706897_2069219508391772160_n",
-                          "10000000_166965697088062_665438391478779904_n",
-                          "10000000_1335779299795908_7691730714202472448_n",
-                          "10000000_1505923789421638_9191910121511321600_n",
-                          "10000000_315846125444776_1579280352575225856_n",
-                          "10000000_1315209071846742_614222302338351104_n",
-                          "10000000_1142588245833386_2091626773681799168_n",
-                          "10000000_1184436554951550_2339952192074547200_n",
-                          "10000000_1666769796969180_483724471283220480_n",
-                          "10000000_1796611303950181_1507620468213940224_n",
-                          "10000000_1168208386603411_1059882943788351488_n",
-                          "10000000_548328045356823_6983019440589766656_n",
-                          "10000000_521663704699296_65830183516504064_n",
-                          "10000000_199230287172428_6748052126401822720_n",
-                          "10000000_1820021794909637_7286345291052089344_n",
-                          "10000000_1444668282214214_416408534024978432_n",
-                          "10000000_680387655453202_8136909073774804992_n",
-                          "10000000_548275975358081_2973436327518797824_n",
-                          "10000000_1186791651379848_9091336178010947584_n",
-                          "10000000_941687602642071_7603210802576752640_n",
-                          "10000000_1760388514211341_8058176593752752128_n",
-                          "10000000_891981430933523_3982776774772654080_n",
-                          "10000000_1101472646573941_876596064835076096_n",
-                          "10000000_1750251458549477_456153302388703232_n",
-                          "10000000_174065113038411_8187261749934686208_n",
-                          "10000000_271349786592291_9115125997568524288_n",
-                          "10000000_1024997837611340_4052115925095153664_n",
-                          "10000000_556197524572656_7974214767709519872_n",
-                          "10000000_265533280507399_2969103349762228224_n",
-                          "10000000_1201769326548404_1335200621023723520_n",
-                          "10000000_966944396748741_6632159121183342592_n",
-                          "10000000_1143630882382500_246491463062388736_n",
-                          "10000000_1796702823937633_1821569069879394304_n",
-                          "10000000_694307740708382_6880910291094208512_n",
-                          "10000000_1743045982610920_1811188786759991296_n",
-                          "10000000_568680446657598_3076514756643782656_n",
-                          "10000000_1143552135715387_8015653445404983296_n",
-                          "10000000_346146105727020_1668049466793394176_n",
-                          "10000000_1244586752247796_7494640012223315968_n",
-                          "10000000_125949021203041_7532206544973201408_n",
-                          "10000000_197264850702649_3379323677727260672_n",
-                          "10000000_311643299198437_2277716638486757376_n",
-                          "10000000_709288262552875_6448873526425288704_n",
-                          "10000000_1111136942304140_2945241421998718976_n",
-                          "10000000_1228071533905079_4554973556559052800_n",
-                          "10000000_1763529717222909_2570945600656769024_n",
-                          "10000000_827926610682313_3338542873057427456_n",
-                          "10000000_658629377633071_9017208594419941376_n",
-                          "10000000_1126157740807788_9176497571240083456_n",
-                          "10000000_1780052585574742_1126729153358331904_n",
-                          "10000000_989886571120372_6549768153658818560_n",
-                          "10000000_295547097496573_611013957473271808_n",
-                          "10000000_1426004984084107_2135017629977411584_n",
-                          "10000000_1715470935443971_2946659615904890880_n",
-                          "10000000_1683469628637720_1090616196455202816_n",
-                          "10000000_870476573054353_1385948691872874496_n",
-                          "10000000_102085486928524_1722343428282384384_n",
-                          "10000000_174335449678853_2972442497856307200_n",
-                          "10000000_1744414305823009_8137360912924278784_n",
-                          "10000000_1648231092134625_6724764259672129536_n",
-                          "10000000_1790779997845737_2692156106100178944_n",
-                          "10000000_985630901582597_8569964587506466816_n",
-                          "10000000_1162693237099346_3458915967252299776_n",
-                          "10000000_1464042536944373_1678263169606221824_n",
-                          "10000000_344642019214346_1644203606502539264_n",
-                          "10000000_653778358116241_3179748173958610944_n",
-                          "10000000_259427177787963_8206944081813700608_n",
-                          "10000000_1362163560468027_2832456096201834496_n",
-                          "10000000_541413376052709_1883284644661559296_n",
-                          "10000000_566786266838852_7007402687188697088_n",
-                          "10000000_350160131986663_3399420972166545408_n",
-                          "10000000_195483457553312_4403038693326061568_n",
-                          "10000000_1628311577467688_2017612946594594816_n",
-                          "10000000_334822546867168_5922635110909214720_n",
-                          "10000000_382818712105672_4714636028030222336_n",
-                          "10000000_342419666105495_1430571241709764608_n",
-                          "10000000_1038929352871690_5384801718213017600_n",
-                          "10000000_200578877038351_379756343977836544_n",
-                          "10000000_1790850881192364_6603761759494864896_n",
-                          "10000000_1816324715277875_2672787933898997760_n",
-                          "10000000_129846270812646_8801847853182877696_n",
-                          "10000000_317386941953529_3208815932797353984_n",
-                          "10000000_299305837122126_9015810668464439296_n",
-                          "10000000_1777731102440971_5229710612363214848_n",
-                          "10000000_183559712052298_4336301150723637248_n",
-                          "10000000_1696033614057058_6736609693575151616_n",
-                          "10000000_663462687155449_3109852374399713280_n",
-                          "10000000_109061086228826_5850819894760701952_n",
-                          "10000000_1808899912685934_4987401356525436928_n",
-                          "10000000_585561791637020_3162727514917306368_n",
-                          "10000000_680159795474169_3024252391995211776_n",
-                          "10000000_1107366899317220_5247577324127256576_n",
-                          "10000000_1581421308831863_370434907735851008_n",
-                          "10000000_1772802239628410_8677277549442629632_n",
-                          "10000000_1511721508841885_7197022151822540800_n",
-                          "10000000_336839476664872_4911134033112465408_n",
-                          "10000000_195396127551376_5398700713419210752_n",
-                          "10000000_160982387691347_3438488415597756416_n",
-                          "10000000_1420377624643296_8233176633956106240_n",
-                          "10000000_584373555084172_7981252144638459904_n",
-                          "10000000_1078578722260623_6998206019746660352_n",
-                          "10000000_1840726662829503_4255788677340332032_n",};
-  FILE *dipDistributionLog = fopen(NAME ".facebook.dist.data", "w");
-  uint32_t connOverDip[DIP_NUM];
+#ifdef KEY_WIDTH
+/**
+ * IPv4 against IPv6 keys on one VIP: bytes per connection of the control plane and the data plane,
+ * data plane query speed, and the cost of the key hash alone.
+ *
+ * log format: family keyBytes cpBytesPerConn dpBytesPerConn queryMpps hashNs
+ */
+template<class K>
+void keyWidthBenchmark(const char *family, ofstream &log) {
+  const int n = CONN_NUM / VIP_NUM;
+  const int rounds = 16;
   
-  for (int j = 0; j < DIP_NUM; ++j)
-    connOverDip[j] = 0;
+  vector<K> keys(n);
+  LFSRGen<decltype(K().src)> srcGen(0xe2211, n, 0);
+  for (auto &k : keys) srcGen.gen(&k.src);
   
-  int i = 0;
-  for (auto &name : files) {
-    ifstream trace("/home/sshi27/Downloads/dataset.processed/" + name);
-//    try {
-    while (trace && !trace.eof()) {
-      if (i >= 16 * 1024 * 1024) break;
-      
-      // Step 1: read 5-tuple of a packet
-      Tuple3 tuple;
-      Addr_Port vip;
-      trace >> tuple.src.addr >> tuple.src.port >> vip.addr >> vip.port >> tuple.protocol;
-      
-      // Step 2: lookup the VIPTable to get VIPInd
-      uint16_t vipInd = 0; // vip.addr & VIP_MASK;
+  ControlPlaneOthello<K, uint16_t, 12, 0, false, false, false> cp(n);
+  for (int i = 0; i < n; ++i) cp.insert(make_pair(keys[i], uint16_t(i & (HT_SIZE - 1))));
+  DataPlaneOthello<K, uint16_t, 12, 0> dp;
+  dp.fullSync(cp);
+  
+  struct timeval start, end;
+  uint64_t sum = 0;
+  
+  gettimeofday(&start, NULL);
+  for (int r = 0; r < rounds; ++r)
+    for (int i = 0; i < n; ++i) sum += dp.query(keys[i]);
+  gettimeofday(&end, NULL);
+  double mpps = double(rounds) * n / diff_us(end, start);
+  
+  const Hasher64<K> hasher;
+  gettimeofday(&start, NULL);
+  for (int r = 0; r < rounds; ++r)
+    for (int i = 0; i < n; ++i) sum += hasher(keys[i]);
+  gettimeofday(&end, NULL);
+  double hashNs = diff_us(end, start) * 1000.0 / rounds / n;
+  
+  double cpBytes = double(cp.getMemoryCost()) / n, dpBytes = double(dp.getMemoryCost()) / n;
+  cout << family << ": key " << sizeof(K) << "B, control plane " << cpBytes << "B/conn, data plane " << dpBytes
+       << "B/conn, query " << mpps << "Mpps, hash " << hashNs << "ns (" << (sum & 1) << ")" << endl;
+  log << family << " " << sizeof(K) << " " << cpBytes << " " << dpBytes << " " << mpps << " " << hashNs << endl;
+}
+#endif
+
+#ifdef DIGEST
+/**
+ * The digest filter of one VIP at a digest width DL: data plane bytes per connection and the overhead over DL = 0,
+ * the share of new flows that pass the digest anyway, and the lookup speed of known flows (the fast path), of new
+ * flows (the slow path, without learning), and of known flows with 1 new flow in 64 that is queued and learned in
+ * batches of LEARN_BATCH. The mix is timed without the learning, which is the control plane inserting the batch and
+ * syncing the data plane, timed apart per learned flow. Every new flow of the mix comes back 4 times: a later packet
+ * that gets another slot than the first one is a PCC violation, which only a false positive can cause.
+ *
+ * log format: DL dpBytesPerConn overhead falsePositiveRate knownMpps newMpps mixedMpps learnUsPerFlow pccViolations
+ */
+template<uint8_t DL>
+double digestBenchmark(ofstream &log, double dpBytesWithoutDigest) {
+  const int n = CONN_NUM / VIP_NUM;
+  const int rounds = 16;
+  
+  vector<Tuple3> known(n), fresh(n);
+  LFSRGen<Tuple3> tuple3Gen(0xe2211, 2 * n, 0);
+  for (auto &k : known) tuple3Gen.gen(&k);
+  for (auto &k : fresh) tuple3Gen.gen(&k);
+  
+  ControlPlaneOthello<Tuple3, uint16_t, 12, DL, false, false, false> cp(n);
+  for (int i = 0; i < n; ++i) cp.insert(make_pair(known[i], uint16_t(i & (HT_SIZE - 1))));
+  DataPlaneOthello<Tuple3, uint16_t, 12, DL> dp;
+  dp.fullSync(cp);
+  double dpBytes = double(dp.getMemoryCost()) / n;
+  
+  uint16_t htInd;
+  uint64_t passed = 0, sum = 0;
+  for (auto &k : fresh) passed += dp.query(k, htInd);
+  
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  for (int r = 0; r < rounds; ++r)
+    for (int i = 0; i < n; ++i) sum += concuryLookup(dp, known[i], htInd) + htInd;
+  gettimeofday(&end, NULL);
+  double knownMpps = double(rounds) * n / diff_us(end, start);
+  
+  gettimeofday(&start, NULL);
+  for (int r = 0; r < rounds; ++r)
+    for (int i = 0; i < n; ++i) sum += concuryLookup(dp, fresh[i], htInd) + htInd;
+  gettimeofday(&end, NULL);
+  double freshMpps = double(rounds) * n / diff_us(end, start);
+  
+  const int freshNum = n / 16;
+  vector<uint16_t> firstSlot(freshNum, uint16_t(-1));
+  LearningQueue learning;
+  uint64_t learned = 0, violations = 0, learnUs = 0;
+  struct timeval learnStart, learnEnd;
+  gettimeofday(&start, NULL);
+  for (int r = 0; r < rounds; ++r) {
+    for (int i = 0; i < n; ++i) {
+      if ((i & 63) != 63) {
+        sum += concuryLookup(dp, known[i], htInd) + htInd;
+        continue;
+      }
       
-      // Step 3: lookup corresponding Othello array
-      uint16_t htInd;
-      conn[vipInd].query(tuple, htInd);
-      htInd &= (HT_SIZE - 1);
-      uint16_t dipInd = ht[vipInd][htInd];
-      DIP &dip = dipPools[vipInd][dipInd];
+      int j = (r * n + i) / 64 % freshNum;
+      bool passedDigest = concuryLookup(dp, fresh[j], htInd);
+      if (firstSlot[j] == uint16_t(-1)) firstSlot[j] = htInd;
+      else violations += firstSlot[j] != htInd;
+      sum += htInd;
       
-      // Step 4: add to control plane tracking table
-      if (!conn[vipInd].isMember(tuple)) {   // insert to the dipIndexTable to simulate the control plane
-        conn[vipInd].insert(make_pair(tuple, htInd));
-        uint16_t out;
-        assert(conn[vipInd].isMember(tuple) && conn[vipInd].query(tuple, out) && (out & (HT_SIZE - 1)) == htInd);
-        
-        fprintf(dipDistributionLog, "%u %u %u\n", (uint32_t) vipInd, (uint32_t) htInd, (uint32_t) dipInd);
-        connOverDip[dipInd] += 1;
-        i++;
-      }
+      if (passedDigest) continue;
+      learning.push({fresh[j], 0, htInd});
+      if (learning.size() < LEARN_BATCH) continue;
+      gettimeofday(&learnStart, NULL);
+      learning.drain([&](const LearnRequest &request) {
+        if (cp.isMember(request.tuple)) return;
+        cp.insert(make_pair(request.tuple, request.htInd));
+        ++learned;
+      });
+      dp.fullSync(cp);
+      gettimeofday(&learnEnd, NULL);
+      learnUs += diff_us(learnEnd, learnStart);
     }
-//    } catch (exception &e) {
-//      cerr << e.what() << endl;
-//    }
-    
-    try {
-      trace.close();
-    } catch (exception &e) {
+  }
+  gettimeofday(&end, NULL);
+  double mixedMpps = double(rounds) * n / (diff_us(end, start) - learnUs);
+  double learnUsPerFlow = learned ? double(learnUs) / learned : 0;
+  
+  double overhead = dpBytesWithoutDigest ? dpBytes / dpBytesWithoutDigest - 1 : 0;
+  double fpRate = double(passed) / n;
+  cout << "DL " << (int) DL << ": data plane " << dpBytes << "B/conn (+" << overhead * 100 << "%), false positives "
+       << fpRate * 100 << "%, known " << knownMpps << "Mpps, new " << freshMpps << "Mpps, mixed " << mixedMpps
+       << "Mpps, " << learned << " learned at " << learnUsPerFlow << "us/flow, " << violations << " PCC violations ("
+       << (sum & 1) << ")" << endl;
+  log << (int) DL << " " << dpBytes << " " << overhead << " " << fpRate << " " << knownMpps << " " << freshMpps << " "
+      << mixedMpps << " " << learnUsPerFlow << " " << violations << endl;
+  return dpBytes;
+}
+#endif
+
+/// the DIP distribution of the connections of a trace (trace.h), as mockTraceDistribution does for LFSR ones. the
+/// processed Facebook traces convert with trace_convert text
+void realTraceDistribution(const char *path) {
+  FILE *dipDistributionLog = fopen(NAME ".facebook.dist.data", "w");
+  uint32_t connOverDip[DIP_NUM];
+
+  for (int j = 0; j < DIP_NUM; ++j)
+    connOverDip[j] = 0;
+
+  MappedTrace trace(path);
+  const TraceRecord *records = trace.records();
+  int i = 0;
+  for (uint64_t r = 0; r < trace.size() && i < 16 * 1024 * 1024; ++r) {
+    // Step 1: read 5-tuple of a packet
+    Tuple3 tuple;
+    tuple.src.addr = records[r].srcAddr;
+    tuple.src.port = records[r].srcPort;
+    tuple.protocol = records[r].protocol;
+
+    // Step 2: lookup the VIPTable to get VIPInd
+    uint16_t vipInd = 0; // vip.addr & VIP_MASK;
+
+    // Step 3: lookup corresponding Othello array
+    uint16_t htInd;
+    conn[vipInd].query(tuple, htInd);
+    htInd &= (HT_SIZE - 1);
+    uint16_t dipInd = ht[vipInd][htInd];
+    DIP &dip = dipPools[vipInd][dipInd];
+
+    // Step 4: add to control plane tracking table
+    if (!conn[vipInd].isMember(tuple)) {   // insert to the dipIndexTable to simulate the control plane
+      conn[vipInd].insert(make_pair(tuple, htInd));
+      uint16_t out;
+      assert(conn[vipInd].isMember(tuple) && conn[vipInd].query(tuple, out) && (out & (HT_SIZE - 1)) == htInd);
+
+      fprintf(dipDistributionLog, "%u %u %u\n", (uint32_t) vipInd, (uint32_t) htInd, (uint32_t) dipInd);
+      connOverDip[dipInd] += 1;
+      i++;
     }
   }
-  
+
   fclose(dipDistributionLog);
 }
 
@@ -645,10 +632,131 @@ void mockTraceDistribution() {
   fclose(dipDistributionLog);
 }
 
+/// memory against the connection count, from what is allocated after adding them: NAME ".memcurve.data"
+void memoryCurve() {
+  ofstream curveLog(NAME ".memcurve.data");
+  for (int conns = 1024; conns <= CONN_NUM; conns *= 2) {
+    initControlPlaneAndDataPlane();
+    simulateConnectionAdd(conns, 0);
+    updateDataPlane(true);
+    
+    MemoryBreakdown b = getMemoryBreakdown();
+    b.log(curveLog, conns);
+    cout << conns << " connections: " << b.reserved("dp.") << "B data plane, " << b.reserved("cp.")
+         << "B control plane, " << double(b.reserved()) / conns << "B/conn" << endl;
+  }
+}
+
+#ifdef LB_BENCH
+#include "lb_bench.h"
+
+class ConcuryLoadBalancer : public LoadBalancer {
+  static inline Addr_Port route(const Tuple5 &packet) {
+    uint16_t vipInd = packet.dst.addr & VIP_MASK;
+    uint16_t htInd;
+    concuryLookup(othelloForQuery[vipInd], *(const Tuple3 *) &packet.src, htInd);
+    return dipPools[vipInd][ht[vipInd][htInd]].addr;
+  }
+
+public:
+  const char *name() const override {
+    return "concury";
+  }
+  
+  void init(int capacity) override {
+    initControlPlaneAndDataPlane(capacity);
+  }
+  
+  /// into the control plane, then every data plane syncs
+  void addConnections(int count) override {
+    simulateConnectionAdd(count, 0);
+    for (int vipInd = 0; vipInd < VIP_NUM; ++vipInd) updateDataPlaneCallBack(vipInd);
+  }
+  
+  /// each with the slot the data plane gives it now, the one its packets so far went to: the control plane answers
+  /// nothing sensible for a key it does not hold. only the VIPs that got one sync
+  void addConnections(const vector<Tuple5> &packets) override {
+    vector<bool> added(VIP_NUM);
+    for (const Tuple5 &packet : packets) {
+      uint16_t vipInd = packet.dst.addr & VIP_MASK;
+      Tuple3 tuple = *(const Tuple3 *) &packet.src;
+      if (conn[vipInd].isMember(tuple)) continue;
+      
+      uint16_t htInd;
+      concuryLookup(othelloForQuery[vipInd], tuple, htInd);
+      ScopedLatency timer(LAT_INSERT);
+      conn[vipInd].insert(make_pair(tuple, htInd));
+      added[vipInd] = true;
+    }
+    for (int vipInd = 0; vipInd < VIP_NUM; ++vipInd) {
+      if (added[vipInd]) updateDataPlaneCallBack(vipInd);
+    }
+  }
+  
+  Addr_Port lookup(const Tuple5 &packet) override {
+    return route(packet);
+  }
+  
+  void lookupBatch(const Tuple5 *packets, int n, Addr_Port *dips) override {
+    for (int i = 0; i < n; ++i) dips[i] = route(packets[i]);
+  }
+  
+  void updateWeights() override {
+    simulateUpdatePoolData();
+    updateDataPlane(true);
+  }
+  
+  vector<DIP> dips(int vipInd) override {
+    return dipPools[vipInd];
+  }
+  
+  /// the ht of the VIP alone is rebuilt, its control plane composed and its data plane synced
+  void setWeights(int vipInd, const vector<int> &weights) override {
+    for (size_t i = 0; i < weights.size(); ++i) dipPools[vipInd][i].weight = weights[i];
+    updateDataPlane(true, vipInd);
+  }
+  
+  MemoryBreakdown getMemoryBreakdown() const override {
+    return ::getMemoryBreakdown();
+  }
+};
+#endif
+
 int main(int argc, char **argv) {
+#ifdef LB_BENCH
+  ConcuryLoadBalancer lb;
+  return benchmarkMain(argc, argv, lb);
+#endif
+  
   cout << "--init" << endl;
   init();
 
+#ifdef KEY_WIDTH
+  cout << "--keyWidthBenchmark" << endl;
+  ofstream keyWidthLog(NAME ".keywidth.data");
+  keyWidthBenchmark<Tuple3>("ipv4", keyWidthLog);
+  keyWidthBenchmark<Tuple3v6>("ipv6", keyWidthLog);
+  return 0;
+#endif
+
+#ifdef MEMORY_CURVE
+  cout << "--memoryCurve" << endl;
+  memoryCurve();
+  return 0;
+#endif
+
+#ifdef DIGEST
+  cout << "--digestBenchmark" << endl;
+  ofstream digestLog(NAME ".digest.data");
+  double dpBytes = digestBenchmark<0>(digestLog, 0);
+  digestBenchmark<4>(digestLog, dpBytes);
+  digestBenchmark<6>(digestLog, dpBytes);
+  digestBenchmark<8>(digestLog, dpBytes);
+  digestBenchmark<12>(digestLog, dpBytes);
+  digestBenchmark<16>(digestLog, dpBytes);
+  return 0;
+#endif
+
 #ifdef DIST
   ofstream connHtDistLog("concury.ht.dist.data");
   for (int htInd = 0; htInd < HT_SIZE; ++htInd) {
@@ -663,7 +771,7 @@ int main(int argc, char **argv) {
   connDipWeightLog.close();
 
   cout << "--realTraceDistribution" << endl;
-  realTraceDistribution();
+  realTraceDistribution(argc > 1 ? argv[1] : "facebook.trace");
 
   cout << "--mockTraceDistribution" << endl;
   mockTraceDistribution();
@@ -673,7 +781,12 @@ int main(int argc, char **argv) {
   cout << "--simulateUpdatePoolData" << endl;
   simulateUpdatePoolData();
   cout << "--updateDataPlane" << endl;
-  updateDataPlane();
+  {
+    uint64_t tracked = 0;
+    for (const ConcuryControlPlane &c : conn) tracked += c.size();
+    Clocker clocker("updateDataPlane, per connection", tracked);
+    updateDataPlane();
+  }
   cout << "--printMemoryUsage" << endl;
   printMemoryUsage();
 
@@ -685,6 +798,12 @@ int main(int argc, char **argv) {
   multiThreadServe(4);
   multiThreadServe(8);
   
+  cout << "--latency" << endl;
+  ofstream latencyLog(NAME ".latency.data");
+  printLatencies(cout);
+  logLatencies(latencyLog, "static");
+  resetLatencies();
+  
   if (CONN_NUM == 16777216) {
     cout << "--dynamicThroughput" << endl;
     dynamicThroughput();
@@ -704,6 +823,10 @@ int main(int argc, char **argv) {
 //  }
   cout << "--dynamicServe" << endl;
   dynamicServe();
+  
+  cout << "--latency" << endl;
+  printLatencies(cout);
+  logLatencies(latencyLog, "dynamic");
 #endif
   return 0;
 }
@@ -19,3 +19,19 @@
 
 #define HT_SIZE (512)                    // must be power of 2
 #define STO_NUM (CONN_NUM)                // simulate control plane
+
+#ifndef CONCURY_DL
+#define CONCURY_DL (0)                    // digest bits per Othello cell. 0: no filter, every flow is taken as known
+#endif
+
+#ifndef VIP_CONN_MAX
+#define VIP_CONN_MAX (0)                  // most connections a VIP ever holds, 0 if unbounded. below 65536, key ids are 16 bits
+#endif
+
+#ifndef LEARN_BATCH
+#define LEARN_BATCH (1024)                // new flows queued by the slow path before the control plane learns them
+#endif
+
+#ifndef LATENCY_SAMPLE_BITS
+#define LATENCY_SAMPLE_BITS (10)          // one lookup of every 2^bits is timed into the lookup latency histogram
+#endif
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+/*! \file counters.h
+ *  Event counts for PROFILE builds: named counters registered once, counted in per-thread slots, summed and printed
+ *  by Clocker when its scope ends.
+ */
+
+/**
+ * A named event count. Declare it once, at namespace scope or static in a function, and add to it where the event
+ * happens:
+ *
+ *   static const Counter grows("Cuckoo", "grow");
+ *   ...
+ *   grows.add();
+ *
+ * Registering takes a lock and allocates, add is one add to a slot of the calling thread and compiles to nothing
+ * without PROFILE. Counters of the same solution and type share their id, so one declared static in a header counts as
+ * one over all translation units.
+ */
+class Counter {
+public:
+  static const int MAX = 256;
+
+private:
+  /// the counts of one thread, cache line aligned so that no two threads share a line. registered while the thread
+  /// lives, added to the retired counts when it exits
+  struct alignas(64) Slots {
+    double value[MAX] = {};
+    
+    Slots() {
+      Registry &r = registry();
+      lock_guard<mutex> guard(r.lock);
+      r.live.push_back(this);
+    }
+    
+    ~Slots() {
+      Registry &r = registry();
+      lock_guard<mutex> guard(r.lock);
+      for (int i = 0; i < MAX; ++i) r.retired[i] += value[i];
+      r.live.erase(find(r.live.begin(), r.live.end(), this));
+    }
+    
+    static inline Slots &local() {
+      static thread_local Slots slots;
+      return slots;
+    }
+  };
+  
+  struct Registry {
+    mutex lock;
+    vector<pair<string, string>> names;   // by id
+    vector<Slots *> live;
+    double retired[MAX] = {};
+  };
+  
+  static Registry &registry() {
+    static Registry r;
+    return r;
+  }
+  
+  int id;
+
+public:
+  Counter(const string &solution, const string &type) {
+    Registry &r = registry();
+    lock_guard<mutex> guard(r.lock);
+    auto it = find(r.names.begin(), r.names.end(), make_pair(solution, type));
+    if (it == r.names.end()) {
+      if (r.names.size() == MAX) throw runtime_error("More than Counter::MAX counters! ");
+      it = r.names.insert(it, make_pair(solution, type));
+    }
+    id = int(it - r.names.begin());
+  }
+  
+  inline void add(double acc = 1) const {
+    #ifdef PROFILE
+    Slots::local().value[id] += acc;
+    #endif
+  }
+  
+  /// the counts of all threads, the exited ones included, by id. exact while no thread counts
+  static vector<double> totals() {
+    Registry &r = registry();
+    lock_guard<mutex> guard(r.lock);
+    vector<double> sum(r.retired, r.retired + r.names.size());
+    for (Slots *s : r.live) {
+      for (size_t i = 0; i < sum.size(); ++i) sum[i] += s->value[i];
+    }
+    return sum;
+  }
+  
+  /// one line per counter that moved since the totals since, "->[solution] [type] count", indented for a Clocker of
+  /// the given level
+  static void print(ostream &os, int level, const vector<double> &since = vector<double>()) {
+    vector<double> now = totals();
+    Registry &r = registry();
+    lock_guard<mutex> guard(r.lock);
+    for (size_t i = 0; i < now.size(); ++i) {
+      double d = now[i] - (i < since.size() ? since[i] : 0);
+      if (d == 0) continue;
+      for (int l = 0; l < level; ++l) os << "| ";
+      os << "  ->[" << r.names[i].first << "] [" << r.names[i].second << "] " << d << endl;
+    }
+  }
+};
@@ -3,6 +3,8 @@
 #include <vector>
 #include <cinttypes>
 
+#include "memory_breakdown.h"
+
 using namespace std;
 /*! \file disjointset.h
  *  Disjoint Set data structure.
@@ -50,6 +52,20 @@ public:
     mem.resize(n, -1);
   }
   
+  //! n elements, each a set of its own.
+  inline void assign(size_t n) {
+    mem.assign(n, -1);
+  }
+  
+  //! free the memory. assign before using it again.
+  inline void release() {
+    vector<int>().swap(mem);
+  }
+  
+  inline uint64_t getMemoryCost() const {
+    return heapBytes(mem.data());
+  }
+  
   DisjointSet() {}
   
   explicit DisjointSet(unsigned long capacity) {
@@ -127,8 +127,51 @@ inline ostream &operator<<(ostream &os, Tuple3 const &tuple) {
   return os;
 }
 
+struct Addr6_Port {  // 18B
+  uint8_t addr[16] = {0};
+  uint16_t port = 0;
+  
+  inline bool operator==(const Addr6_Port &another) const {
+    return memcmp(addr, another.addr, sizeof(addr)) == 0 && port == another.port;
+  }
+  
+  inline bool operator<(const Addr6_Port &another) const {
+    int c = memcmp(addr, another.addr, sizeof(addr));
+    return c < 0 || (c == 0 && port < another.port);
+  }
+};
+
+inline ostream &operator<<(ostream &os, const Addr6_Port &addr) {
+  os << "[" << std::hex;
+  for (int i = 0; i < 16; i += 2) {
+    os << (i ? ":" : "") << ((addr.addr[i] << 8) | addr.addr[i + 1]);
+  }
+  os << "]:" << addr.port;
+  return os;
+}
+
+struct Tuple3v6 {  // 24B, the IPv6 counterpart of Tuple3
+  Addr6_Port src;
+  uint16_t protocol = 6;
+  uint32_t pad = 0;       // keeps the key a whole number of words. must stay zero, it is hashed
+  
+  inline bool operator==(const Tuple3v6 &another) const {
+    return src == another.src && protocol == another.protocol;
+  }
+  
+  inline bool operator<(const Tuple3v6 &another) const {
+    return std::tie(src, protocol) < std::tie(another.src, another.protocol);
+  }
+};
+
+inline ostream &operator<<(ostream &os, Tuple3v6 const &tuple) {
+  os << tuple.src << ", " << std::hex << tuple.protocol;
+  return os;
+}
 #pragma pack(pop)
 
+static_assert(sizeof(Tuple3v6) == 24, "Tuple3v6 must be 3 words");
+
 inline int diff_ms(timeval t1, timeval t2) {
   return (((t1.tv_sec - t2.tv_sec) * 1000000) + (t1.tv_usec - t2.tv_usec)) / 1000;
 }
@@ -359,6 +402,10 @@ public:
 #include "hash.h"
 #include "lfsr64.h"
 
+template<>
+struct FixedWidthKey<Tuple3v6> : std::true_type {
+};
+
 inline void getVip(Addr_Port *vip) {
   static uint addr = (211U << 24) + 127;
   static uint16_t port = 0;
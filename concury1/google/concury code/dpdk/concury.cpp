@@ -1,18 +1,27 @@
+#include <rte_cycles.h>
+
 #include "common.h"
 #include "Othello/control_plane_othello.h"
 #include "Othello/data_plane_othello.h"
 //#include <gperftools/profiler.h>
 #include "concury.h"
+#include "main.h"
+#include "qsbr.h"
+#include "ctl_proto.h"
 
 // Data plane
-MySimpleArray<DataPlaneOthello<Tuple3, uint16_t, 12, 0>> othelloForQuery; // 3-tuple -> DIPInd requires initialization
-MySimpleArray<MySimpleArray<uint16_t>> ht;    // [VIPInd][DIPInd] -> DIP Addr_Port
-MySimpleArray<MySimpleArray<DIP>> dipPools;  // vipIndex, dipindex -> dip
-MySimpleArray<int> dipNum;
+MySimpleArray<ConcuryVip *> vipTable;  // vipIndex -> published version, nullptr while the VIP is down
 // !Data plane
 
 // Control plane
+MySimpleArray<MySimpleArray<uint16_t>> ht;    // [VIPInd][DIPInd] -> DIP Addr_Port, as last published
+MySimpleArray<MySimpleArray<DIP>> dipPools;  // vipIndex, dipindex -> dip. a removed dip stays as a weight 0 tombstone
+MySimpleArray<int> dipNum;
+MySimpleArray<uint8_t> vipUp;
+MySimpleArray<uint8_t> vipDirty;   // touched by the control batch being applied
+vector<ConcuryVip *> retiredVips;  // replaced, freed after the next grace period
 MySimpleArray<ControlPlaneOthello<Tuple3, uint16_t, 12, 0, true, false, true>> conn;  // track the connections and their dipIndices
+MySimpleArray<ControlPlaneOthello<Tuple3v6, uint16_t, 12, 0, true, false, true>> connV6;
 MySimpleArray<MySimpleArray<uint16_t>> newHt;
 // !Control plane
 
@@ -55,6 +64,29 @@ void simulateConnectionAdd(int limit, int prestart) {
   }
 }
 
+void simulateConnectionAddV6(int limit, int prestart) {
+  uint addr = (211U << 24) + (prestart & VIP_MASK);
+  LFSRGen<Addr6_Port> addrGen(0xe2211, CONN_NUM, prestart);
+  
+  limit = limit ? limit : STO_NUM;
+  
+  cout << "Size of v6 key set: " << limit << endl;
+  
+  for (int i = 0; i < limit; i++) {
+    Tuple3v6 tuple;   // protocol and pad keep their defaults, only the address and port are random
+    addrGen.gen(&tuple.src);
+    
+    uint16_t vipInd = addr++ & VIP_MASK;
+    if (addr >= (211U << 24) + VIP_NUM) addr = 211U << 24;
+    
+    uint16_t htInd;
+    connV6[vipInd].query(tuple, htInd);
+    htInd &= (HT_SIZE - 1);
+    
+    connV6[vipInd].insert(make_pair(tuple, htInd));
+  }
+}
+
 void simulateConnectionLeave() {
   int addr = 0x0a800000;
   LFSRGen<Tuple3> tuple3Gen(0xe2211, CONN_NUM, 0);
@@ -135,121 +167,146 @@ void simulateDipDown(int cnt) {
   }
 }
 
+// accumulated over the VIPs of one updateDataPlane call, in us
+struct DataPlaneUpdateTimes {
+  uint64_t controlPlaneConstruction = 0;
+  uint64_t cpDpSynchronization = 0;
+  uint64_t migrationCalculation = 0;
+};
+
 /**
- * update data plane to make the HT consistent with the dip weight,
- * while ensuring PCC.
+ * Rebuild the HT of one VIP from the weights of its dip pool, migrate its connections and publish it.
  *
- * assuming dip pools and conn have been properly constructed
+ * returns the count of HT entries that changed hands
  */
-void updateDataPlane(bool init) {
+static int updateVipDataPlane(uint16_t vipInd, bool init, DataPlaneUpdateTimes &times) {
   const static int M = HT_SIZE == 4096 ? 4099 : HT_SIZE == 512 ? 521 : 0;  // a prime number // 4093
-  const static Hasher32<uint32_t> hash1(0xe2211), hash2(0xe2212);
+  const static Hasher32<uint32_t> hash2(0xe2212);
   
-  int diff, migrationSum = 0;
-  struct timeval start, curr, end;
+  int diff;
+  struct timeval start, curr;
   
-  uint64_t controlPlaneConstructionTime = 0;
-  uint64_t cpDpSynchronizationTime = 0;
-  uint64_t migrationCalculationTime = 0;
+  gettimeofday(&start, NULL);
   
-  for (uint16_t vipInd = 0; vipInd < VIP_NUM; ++vipInd) {
-    gettimeofday(&start, NULL);
-    
-    uint16_t dipCount = dipPools[vipInd].capacity;
-    
-    // Step1: construct new HT
-    // ** sum weight and cal entriesPerWeight
-    uint64_t weightSum = 0;
-    for (int dipInd = 0; dipInd < dipCount; ++dipInd)
-      weightSum += dipPools[vipInd][dipInd].weight;
-    
-    // ** let dips take entries in turn with weight
-    double allocatedWeight = 0;
-    int allocatedEntries = 0;
-    uint16_t oneHtIndOf[dipPools[vipInd].capacity];
-    MySimpleArray<uint16_t> entries(dipCount);
+  uint16_t dipCount = dipPools[vipInd].capacity;
+  
+  // Step1: construct new HT
+  // ** sum weight and cal entriesPerWeight
+  uint64_t weightSum = 0;
+  for (int dipInd = 0; dipInd < dipCount; ++dipInd)
+    weightSum += dipPools[vipInd][dipInd].weight;
+  
+  if (!vipUp[vipInd] || weightSum == 0) {   // nothing to balance to, the workers see the VIP as absent
+    publishVip(vipInd, nullptr);
+    return 0;
+  }
+  
+  // ** let dips take entries in turn with weight
+  double allocatedWeight = 0;
+  int allocatedEntries = 0;
+  uint16_t oneHtIndOf[dipCount];
+  std::fill(oneHtIndOf, oneHtIndOf + dipCount, uint16_t(-1));
+  MySimpleArray<uint16_t> entries(dipCount);
 
 //    cout << "start. weightSum: " << weightSum << endl;
-    
-    for (int dipInd = 0; dipInd < dipCount; ++dipInd) {
-      int w = dipPools[vipInd][dipInd].weight;
-      entries[dipInd] = (allocatedWeight + w) * HT_SIZE / weightSum - allocatedEntries + 0.5;
+  
+  for (int dipInd = 0; dipInd < dipCount; ++dipInd) {
+    int w = dipPools[vipInd][dipInd].weight;
+    entries[dipInd] = (allocatedWeight + w) * HT_SIZE / weightSum - allocatedEntries + 0.5;
 //      cout << "dipInd: " << dipInd << ", w " << w << ", entries: " << entries[dipInd] << " allocated: "
 //           << allocatedWeight << " " << allocatedEntries << " wired: " << allocatedWeight + w << endl;
-      allocatedEntries += entries[dipInd];
-      allocatedWeight += w;
-    }
-    
-    int entriesToAllocate = allocatedEntries;
-    assert(entriesToAllocate == HT_SIZE);
-    MySimpleArray<uint32_t> tryCount;
-    tryCount.resize(dipCount, 0);
-    
-    newHt[vipInd].fill(-1);
-    while (entriesToAllocate)
-      for (int dipInd = 0; dipInd < dipCount; ++dipInd) {
-        if (entries[dipInd]) {
-          uint32_t h1 = dipInd, h2 = hash2(dipInd);
-          int offset = h1 % M;
-          int skip = h2 % (M - 1) + 1;
-          
-          while (true) {
-            tryCount[dipInd]++;
-            int htInd = (offset + tryCount[dipInd] * skip) % M;
-            if (htInd >= HT_SIZE || newHt[vipInd][htInd] != uint16_t(-1)) {
-              continue;
-            }
-            
-            newHt[vipInd][htInd] = dipInd;
-            
-            if (entries[dipInd] == 1) oneHtIndOf[dipInd] = htInd;
-            --entries[dipInd];
-            --entriesToAllocate;
-            break;
+    allocatedEntries += entries[dipInd];
+    allocatedWeight += w;
+  }
+  
+  int entriesToAllocate = allocatedEntries;
+  assert(entriesToAllocate == HT_SIZE);
+  MySimpleArray<uint32_t> tryCount;
+  tryCount.resize(dipCount, 0);
+  
+  newHt[vipInd].fill(-1);
+  while (entriesToAllocate)
+    for (int dipInd = 0; dipInd < dipCount; ++dipInd) {
+      if (entries[dipInd]) {
+        uint32_t h1 = dipInd, h2 = hash2(dipInd);
+        int offset = h1 % M;
+        int skip = h2 % (M - 1) + 1;
+        
+        while (true) {
+          tryCount[dipInd]++;
+          int htInd = (offset + tryCount[dipInd] * skip) % M;
+          if (htInd >= HT_SIZE || newHt[vipInd][htInd] != uint16_t(-1)) {
+            continue;
           }
+          
+          newHt[vipInd][htInd] = dipInd;
+          
+          if (entries[dipInd] == 1) oneHtIndOf[dipInd] = htInd;
+          --entries[dipInd];
+          --entriesToAllocate;
+          break;
         }
       }
-    
-    assert(allocatedEntries == HT_SIZE);
-    // Step2: compare old and new ht, remember all changed entries, and migrate connections by traversing
-    unordered_map<uint16_t, uint16_t> migration;
-    for (uint16_t htIndex = 0; htIndex < HT_SIZE; ++htIndex) {
-      uint16_t dipIndex = ht[vipInd][htIndex];
-      if (dipIndex != newHt[vipInd][htIndex]) {
-        migration.insert(make_pair(htIndex, oneHtIndOf[dipIndex]));
-      }
     }
-    
-    migrationSum += migration.size();
-    
-    gettimeofday(&curr, NULL);
-    diff = diff_us(curr, start);
-    migrationCalculationTime += diff;
-    
-    // ** now that all upcoming migrations are stored in the map, do the migration
-    // *** traverse all the stored connections to check if the result is to be migrated
-    conn[vipInd].compose(migration);
-    
-    gettimeofday(&curr, NULL);
-    diff = diff_us(curr, start);
-    controlPlaneConstructionTime += diff;
-    start = curr;
-    
-    if (init) configureDataPlane(vipInd);
-    updateDataPlaneCallBack(vipInd);
-    
-    gettimeofday(&curr, NULL);
-    diff = diff_us(curr, start);
-    cpDpSynchronizationTime += diff;
+  
+  assert(allocatedEntries == HT_SIZE);
+  // Step2: compare old and new ht, remember all changed entries, and migrate connections by traversing
+  unordered_map<uint16_t, uint16_t> migration;
+  for (uint16_t htIndex = 0; htIndex < HT_SIZE; ++htIndex) {
+    uint16_t dipIndex = ht[vipInd][htIndex];
+    if (dipIndex != newHt[vipInd][htIndex]) {
+      // a DIP that got no entry this time (removed, or weight 0) has nowhere to keep its connections: -1 drops them
+      migration.insert(make_pair(htIndex, dipIndex < dipCount ? oneHtIndOf[dipIndex] : uint16_t(-1)));
+    }
+  }
+  
+  gettimeofday(&curr, NULL);
+  diff = diff_us(curr, start);
+  times.migrationCalculation += diff;
+  
+  // ** now that all upcoming migrations are stored in the map, do the migration
+  // *** traverse all the stored connections to check if the result is to be migrated
+  conn[vipInd].compose(migration);
+  if (app.v6) connV6[vipInd].compose(migration);
+  
+  gettimeofday(&curr, NULL);
+  diff = diff_us(curr, start);
+  times.controlPlaneConstruction += diff;
+  start = curr;
+  
+  if (init) configureDataPlane(vipInd);
+  updateDataPlaneCallBack(vipInd);
+  
+  gettimeofday(&curr, NULL);
+  diff = diff_us(curr, start);
+  times.cpDpSynchronization += diff;
+  
+  return migration.size();
+
+}
+
+/**
+ * update data plane to make the HT consistent with the dip weight,
+ * while ensuring PCC.
+ *
+ * assuming dip pools and conn have been properly constructed
+ */
+void updateDataPlane(bool init) {
+  DataPlaneUpdateTimes times;
+  int migrationSum = 0;
+  
+  for (uint16_t vipInd = 0; vipInd < VIP_NUM; ++vipInd) {
+    migrationSum += updateVipDataPlane(vipInd, init, times);
   }
+  reclaimVips();
   
   if (!init) {
     cout << "ht entries change count: " << migrationSum << ", ratio: " << double(migrationSum) / VIP_NUM / HT_SIZE
          << endl;
     
-    cout << "Control Plane Construction Time: " << controlPlaneConstructionTime / 1000.0 / VIP_NUM << "ms" << endl;
-    cout << "Migration Calculation Time: " << migrationCalculationTime / 1000.0 / VIP_NUM << "ms" << endl;
-    cout << "Control Plane -> Data Plane Synchronization Time: " << cpDpSynchronizationTime / 1000.0 / VIP_NUM << "ms"
+    cout << "Control Plane Construction Time: " << times.controlPlaneConstruction / 1000.0 / VIP_NUM << "ms" << endl;
+    cout << "Migration Calculation Time: " << times.migrationCalculation / 1000.0 / VIP_NUM << "ms" << endl;
+    cout << "Control Plane -> Data Plane Synchronization Time: " << times.cpDpSynchronization / 1000.0 / VIP_NUM << "ms"
          << endl;
   }
 }
@@ -405,9 +462,133 @@ void configureDataPlane(int vipInd) {
 }
 
 void updateDataPlaneCallBack(int vipInd) {
-  // Step3: write back the new ht and new othelloForQuery
+  // Step3: write back the new ht, and publish it with the new othellos as a new version of the VIP
   ht[vipInd] = newHt[vipInd];
-  othelloForQuery[vipInd].fullSync(conn[vipInd]);
+  
+  ConcuryVip *vip = new ConcuryVip;
+  vip->ht = ht[vipInd];
+  vip->dips = dipPools[vipInd];
+  vip->othello.fullSync(conn[vipInd]);
+  if (app.v6) vip->othelloV6.fullSync(connV6[vipInd]);
+  publishVip(vipInd, vip);
+}
+
+void publishVip(int vipInd, ConcuryVip *vip) {
+  ConcuryVip *old = vipTable[vipInd];
+  __atomic_store_n(&vipTable[vipInd], vip, __ATOMIC_RELEASE);
+  if (old) retiredVips.push_back(old);
+}
+
+uint64_t reclaimVips() {
+  if (retiredVips.empty()) return 0;
+  
+  uint64_t start = rte_rdtsc();
+  app_qsbr_synchronize(&app_qsbr);
+  uint64_t waited = rte_rdtsc() - start;
+  
+  for (ConcuryVip *vip : retiredVips) delete vip;
+  retiredVips.clear();
+  return waited;
+}
+
+static int findDip(uint16_t vipInd, uint32_t addr, uint16_t port) {
+  MySimpleArray<DIP> &dips = dipPools[vipInd];
+  for (int i = 0; i < dips.capacity; ++i) {
+    if (dips[i].addr.addr == addr && dips[i].addr.port == port) return i;
+  }
+  return -1;
+}
+
+// a slot of weight 0 that owns no entry of the published HT is free: its connections went with the update that took
+// its entries. one deleted in the batch being applied still owns them until the commit, and is not reused
+static int addDip(uint16_t vipInd, uint32_t addr, uint16_t port, int weight) {
+  MySimpleArray<DIP> &dips = dipPools[vipInd];
+  vector<bool> owner(dips.capacity);
+  for (int htInd = 0; htInd < HT_SIZE; ++htInd) {
+    if (ht[vipInd][htInd] < dips.capacity) owner[ht[vipInd][htInd]] = true;
+  }
+  
+  int slot = -1;
+  for (int i = 0; i < dips.capacity && slot < 0; ++i) {
+    if (dips[i].weight == 0 && !owner[i]) slot = i;
+  }
+  
+  if (slot < 0) {
+    if (dips.capacity >= (1U << 12)) return -1;   // dip indices must fit the HT
+    MySimpleArray<DIP> grown(dips.capacity + 1);
+    for (int i = 0; i < dips.capacity; ++i) grown[i] = dips[i];
+    slot = dips.capacity;
+    dips = grown;
+  }
+  
+  dips[slot] = {{addr, port}, weight};
+  return slot;
+}
+
+static void clearVip(uint16_t vipInd) {
+  while (conn[vipInd].size()) conn[vipInd].eraseAt(conn[vipInd].size() - 1);
+  if (app.v6) {
+    while (connV6[vipInd].size()) connV6[vipInd].eraseAt(connV6[vipInd].size() - 1);
+  }
+  dipPools[vipInd].resize(0);
+  ht[vipInd].fill(-1);
+}
+
+uint16_t app_ctl_apply(const struct app_ctl_op *ops, uint16_t n_ops) {
+  uint16_t i;
+  for (i = 0; i < n_ops; ++i) {
+    const app_ctl_op &op = ops[i];
+    if (op.vip >= VIP_NUM) break;
+    
+    int dipInd = op.opcode == APP_CTL_ADD_VIP || op.opcode == APP_CTL_DEL_VIP ? -1 : findDip(op.vip, op.addr, op.port);
+    bool ok = true;
+    switch (op.opcode) {
+      case APP_CTL_SET_WEIGHT:
+        ok = vipUp[op.vip] && dipInd >= 0 && dipPools[op.vip][dipInd].weight > 0 && op.weight > 0;
+        if (ok) dipPools[op.vip][dipInd].weight = op.weight;
+        break;
+      case APP_CTL_ADD_DIP:
+        ok = vipUp[op.vip] && op.weight > 0 && (dipInd < 0 || dipPools[op.vip][dipInd].weight == 0);
+        if (ok && dipInd >= 0) {
+          dipPools[op.vip][dipInd].weight = op.weight;   // the same dip coming back
+        } else if (ok) {
+          ok = addDip(op.vip, op.addr, op.port, op.weight) >= 0;
+        }
+        break;
+      case APP_CTL_DEL_DIP:
+        ok = vipUp[op.vip] && dipInd >= 0 && dipPools[op.vip][dipInd].weight > 0;
+        if (ok) dipPools[op.vip][dipInd].weight = 0;
+        break;
+      case APP_CTL_ADD_VIP:
+        ok = !vipUp[op.vip];
+        if (ok) vipUp[op.vip] = 1;
+        break;
+      case APP_CTL_DEL_VIP:
+        ok = vipUp[op.vip];
+        if (ok) {
+          vipUp[op.vip] = 0;
+          clearVip(op.vip);
+        }
+        break;
+      default:
+        ok = false;
+    }
+    if (!ok) break;
+    
+    vipDirty[op.vip] = 1;
+  }
+  return i;
+}
+
+uint64_t app_ctl_commit(void) {
+  DataPlaneUpdateTimes times;
+  for (uint16_t vipInd = 0; vipInd < VIP_NUM; ++vipInd) {
+    if (vipDirty[vipInd]) {
+      updateVipDataPlane(vipInd, false, times);
+      vipDirty[vipInd] = 0;
+    }
+  }
+  return reclaimVips();
 }
 
 void initControlPlaneAndDataPlane() {
@@ -419,7 +600,9 @@ void initControlPlaneAndDataPlane() {
     newHt[i].resize(HT_SIZE);
   }
   
-  othelloForQuery.resize(VIP_NUM);
+  vipTable.resize(VIP_NUM, nullptr);
+  vipUp.resize(VIP_NUM, 1);
+  vipDirty.resize(VIP_NUM, 0);
   conn.resize(VIP_NUM);
   
   for (int i = 0; i < conn.capacity; ++i) {
@@ -427,6 +610,14 @@ void initControlPlaneAndDataPlane() {
     o.setMinimalKeyCapacity(CONN_NUM / VIP_NUM);
   }
   
+  if (app.v6) {
+    connV6.resize(VIP_NUM);
+    
+    for (int i = 0; i < connV6.capacity; ++i) {
+      connV6[i].setMinimalKeyCapacity(CONN_NUM / VIP_NUM);
+    }
+  }
+  
   initDipPool();
 }
 
@@ -446,6 +637,10 @@ int concury_init(int argc, char **argv) {
   
   cout << "--simulateConnectionAdd" << endl;
   simulateConnectionAdd();
+  if (app.v6) {
+    cout << "--simulateConnectionAddV6" << endl;
+    simulateConnectionAddV6();
+  }
   cout << "--updateDataPlane" << endl;
   updateDataPlane();
   
@@ -5,21 +5,54 @@
 #include "Othello/data_plane_othello.h"
 
 // Data plane
-extern MySimpleArray<DataPlaneOthello<Tuple3, uint16_t, 12, 0>> othelloForQuery;  // 3-tuple -> DIPInd  // requires initialization,
-extern MySimpleArray<MySimpleArray<uint16_t>> ht;    // [VIPInd][DIPInd] -> DIP Addr_Port
-extern MySimpleArray<MySimpleArray<DIP>> dipPools;
+/**
+ * Everything a worker reads for one VIP. A version is never modified once published: the control plane builds a new
+ * one, swaps the pointer in vipTable and frees the old one after a grace period (see qsbr.h).
+ */
+struct ConcuryVip {
+  DataPlaneOthello<Tuple3, uint16_t, 12, 0> othello;      // 3-tuple -> HT index
+  DataPlaneOthello<Tuple3v6, uint16_t, 12, 0> othelloV6;  // empty unless --v6
+  MySimpleArray<uint16_t> ht;                              // HT index -> dip index
+  MySimpleArray<DIP> dips;
+};
+
+extern MySimpleArray<ConcuryVip *> vipTable;
+
+inline ConcuryVip *concury_vip(uint16_t vipInd) {
+  return __atomic_load_n(&vipTable[vipInd], __ATOMIC_ACQUIRE);
+}
 // !Data plane
 
 // Control plane
+extern MySimpleArray<MySimpleArray<uint16_t>> ht;    // [VIPInd][DIPInd] -> DIP Addr_Port
+extern MySimpleArray<MySimpleArray<DIP>> dipPools;
 extern MySimpleArray<ControlPlaneOthello<Tuple3, uint16_t, 12, 0, true, false, true>> conn;  // track the connections and their dipIndices
+extern MySimpleArray<ControlPlaneOthello<Tuple3v6, uint16_t, 12, 0, true, false, true>> connV6;
 extern MySimpleArray<MySimpleArray<uint16_t>> newHt;
 // !Control plane
 
 void updateDataPlaneCallBack(int vipInd);
+
+/**
+ * Make vip the version the workers see. The replaced one is retired, not freed
+ */
+void publishVip(int vipInd, ConcuryVip *vip);
+
+/**
+ * Wait for a grace period and free the versions retired so far. Only the control plane thread calls it.
+ * returns the TSC cycles spent waiting
+ */
+uint64_t reclaimVips();
 void configureDataPlane(int vipInd);
 
 void simulateConnectionAdd(int count = 0, int prestart = 0);
 
+/**
+ * The IPv6 counterpart. The v6 connections of a VIP share its DIP pool and HT with the v4 ones,
+ * only the Othello tables are separate.
+ */
+void simulateConnectionAddV6(int count = 0, int prestart = 0);
+
 void simulateConnectionLeave();
 
 /**
@@ -64,10 +97,11 @@ inline DIP concury_lookup(uint16_t vipInd, uint32_t srcAddr, uint16_t srcPort, u
   };
   
   // Step 3: lookup corresponding Othello array
-  uint16_t htInd = othelloForQuery[vipInd].query(tuple);
+  ConcuryVip *vip = concury_vip(vipInd);
+  uint16_t htInd = vip->othello.query(tuple);
 //  cout << "Ht index: " << htInd << endl;
   htInd &= (HT_SIZE - 1);
   
-  return dipPools[vipInd][ht[vipInd][htInd]];
+  return vip->dips[vip->ht[htInd]];
 }
 #endif /* CONCURY_COMMON_H_ */
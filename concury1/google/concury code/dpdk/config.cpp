@@ -80,7 +80,38 @@ static const char usage[] =
   "           F = I/O TX lcore write burst size to NIC TX (default value is %u)   \n"
   "    --pos-lb POS : Position of the 1-byte field within the input packet used by\n"
   "           the I/O RX lcores to identify the worker lcore for the current      \n"
-  "           packet (default value is %u)                                        \n";
+  "           packet (default value is %u)                                        \n"
+  "    --batch N|auto : Number of packets a worker prefetches and looks up at a  \n"
+  "           time, independent of the read burst size (default value is %u). \n"
+  "           auto: workers take partial bursts from their input rings and grow \n"
+  "           or shrink the batch with the ring occupancy                         \n"
+  "    --fwd none|dnat|ipip|gue : Rewrite the packet toward the selected DIP:    \n"
+  "           rewrite the destination in place, or encapsulate in IP-in-IP or   \n"
+  "           GUE/UDP (default value is none, the packet is sent back as is)    \n"
+  "    --rtc : Run-to-completion mode. Every --rx lcore polls its own RSS queues, \n"
+  "           looks the packets up and transmits them on its own TX queue of the  \n"
+  "           input port. No worker lcores and no SW rings; --w and --tx must not \n"
+  "           be given                                                            \n"
+  "    --v6 : Dual stack. IPv6/TCP packets are keyed by their 128-bit source     \n"
+  "           address and port and the VIP by the low bits of the destination.   \n"
+  "           Without it every packet is parsed as IPv4                           \n"
+  "    --ctl LCORE : Serve the control channel (live VIP/DIP updates, see         \n"
+  "           ctl_proto.h) on LCORE, which must not be used by --rx/--tx/--w     \n"
+  "    --ctl-sock PATH : UNIX socket of the control channel                     \n"
+  "           (default value is " APP_DEFAULT_CTL_SOCK ")                          \n"
+  "    --telemetry-ms MS : Export the per-lcore counters to shared memory every MS\n"
+  "           milliseconds, 0 turns the export off (default value is %u). Read  \n"
+  "           them with telemetry_reader                                          \n"
+  "    --telemetry-shm NAME : POSIX shared memory object of the export            \n"
+  "           (default value is " APP_DEFAULT_TELEMETRY_SHM ")                     \n"
+  "    --gen LCORE : NIC-free harness. The ports of --rx/--tx become ring ports  \n"
+  "           (run with --no-pci) and LCORE generates the traffic into them     \n"
+  "    --sink LCORE : Harness lcore that drains the ring ports and prints the   \n"
+  "           received rate and latency. Both must not be used by --rx/--tx/--w \n"
+  "    --gen-rate MPPS : Offered load of the generator, 0 is as fast as the     \n"
+  "           rings take it (default value is 0)                                \n"
+  "    --gen-trace PATH : Generate the keys of a trace (src.addr src.port       \n"
+  "           vip.addr vip.port protocol per line) instead of the LFSR stream   \n";
 
 void
 app_print_usage(void) {
@@ -95,7 +126,9 @@ app_print_usage(void) {
          APP_DEFAULT_BURST_SIZE_WORKER_WRITE,
          APP_DEFAULT_BURST_SIZE_IO_TX_READ,
          APP_DEFAULT_BURST_SIZE_IO_TX_WRITE,
-         APP_DEFAULT_IO_RX_LB_POS
+         APP_DEFAULT_IO_RX_LB_POS,
+         APP_DEFAULT_WORKER_BATCH_SIZE,
+         APP_DEFAULT_TELEMETRY_MS
   );
 }
 
@@ -580,6 +613,134 @@ parse_arg_pos_lb(const char *arg) {
   return 0;
 }
 
+static int
+parse_arg_batch(const char *arg) {
+  uint32_t x;
+  char *endpt;
+  
+  if (strnlen(arg, APP_ARG_NUMERICAL_SIZE_CHARS + 1) == APP_ARG_NUMERICAL_SIZE_CHARS + 1) {
+    return -1;
+  }
+  
+  if (!strcmp(arg, "auto")) {
+    app.worker_batch_adaptive = 1;
+    app.worker_batch_size = APP_DEFAULT_WORKER_BATCH_SIZE;
+    return 0;
+  }
+  
+  errno = 0;
+  x = strtoul(arg, &endpt, 10);
+  if (errno != 0 || endpt == arg || *endpt != '\0') {
+    return -2;
+  }
+  
+  if ((x == 0) || (x > APP_MBUF_ARRAY_SIZE)) {
+    return -3;
+  }
+  
+  app.worker_batch_adaptive = 0;
+  app.worker_batch_size = x;
+  
+  return 0;
+}
+
+/* indexed by app_fwd_mode */
+static const char *fwd_modes[] = {"none", "dnat", "ipip", "gue"};
+
+static int
+parse_arg_fwd(const char *arg) {
+  for (uint8_t i = 0; i < RTE_DIM(fwd_modes); i++) {
+    if (!strcmp(arg, fwd_modes[i])) {
+      app.fwd_mode = i;
+      return 0;
+    }
+  }
+  
+  return -1;
+}
+
+static int
+parse_arg_lcore(const char *arg, uint32_t *lcore_out) {
+  uint32_t lcore;
+  
+  errno = 0;
+  lcore = strtoul(arg, NULL, 0);
+  if (errno != 0) {
+    return -1;
+  }
+  
+  if (lcore >= APP_MAX_LCORES) {
+    return -2;
+  }
+  
+  if (rte_lcore_is_enabled(lcore) == 0) {
+    return -3;
+  }
+  
+  *lcore_out = lcore;
+  return 0;
+}
+
+static int
+parse_arg_ctl_sock(const char *arg) {
+  if (strnlen(arg, APP_CTL_SOCK_PATH_MAX) == APP_CTL_SOCK_PATH_MAX) {
+    return -1;
+  }
+  
+  strcpy(app.ctl_sock, arg);
+  return 0;
+}
+
+static int
+parse_arg_telemetry_ms(const char *arg) {
+  uint32_t x;
+  char *endpt;
+  
+  errno = 0;
+  x = strtoul(arg, &endpt, 10);
+  if (errno != 0 || endpt == arg || *endpt != '\0') {
+    return -1;
+  }
+  
+  app.telemetry_ms = x;
+  return 0;
+}
+
+static int
+parse_arg_telemetry_shm(const char *arg) {
+  if (arg[0] != '/' || strnlen(arg, APP_TM_SHM_NAME_MAX) == APP_TM_SHM_NAME_MAX) {
+    return -1;
+  }
+  
+  strcpy(app.telemetry_shm, arg);
+  return 0;
+}
+
+static int
+parse_arg_gen_rate(const char *arg) {
+  double x;
+  char *endpt;
+  
+  errno = 0;
+  x = strtod(arg, &endpt);
+  if (errno != 0 || endpt == arg || *endpt != '\0' || x < 0) {
+    return -1;
+  }
+  
+  app.gen_mpps = x;
+  return 0;
+}
+
+static int
+parse_arg_gen_trace(const char *arg) {
+  if (strnlen(arg, APP_GEN_TRACE_PATH_MAX) == APP_GEN_TRACE_PATH_MAX) {
+    return -1;
+  }
+  
+  strcpy(app.gen_trace, arg);
+  return 0;
+}
+
 static int
 parse_arg_nk(const char *arg) {
   uint64_t x;
@@ -596,6 +757,47 @@ parse_arg_nk(const char *arg) {
   
   return 0;
 }
+/* Turn the I/O lcores given by --rx into run-to-completion lcores, each owning one TX queue on every RX port */
+static int
+app_assign_rtc_lcores(void) {
+  uint32_t lcore, i;
+  uint16_t tx_queue = 0;
+  
+  for (lcore = 0; lcore < APP_MAX_LCORES; lcore++) {
+    struct app_lcore_params *lp = &app.lcore_params[lcore];
+    
+    if (lp->type == e_APP_LCORE_WORKER) {
+      return -1;
+    }
+    if (lp->type != e_APP_LCORE_IO) {
+      continue;
+    }
+    
+    /* io and rtc share the union, so take the RX queues out before resetting it */
+    decltype(lp->rtc.nic_queues) nic_queues;
+    uint32_t n_queues = lp->io.rx.n_nic_queues;
+    for (i = 0; i < n_queues; i++) {
+      nic_queues[i].port = lp->io.rx.nic_queues[i].port;
+      nic_queues[i].queue = lp->io.rx.nic_queues[i].queue;
+    }
+    
+    memset(&lp->rtc, 0, sizeof(lp->rtc));
+    for (i = 0; i < n_queues; i++) {
+      lp->rtc.nic_queues[i] = nic_queues[i];
+      app.nic_tx_port_mask[nic_queues[i].port] = 1;   // packets are sent back on the input port
+    }
+    lp->rtc.n_nic_queues = n_queues;
+    lp->rtc.tx_queue = tx_queue++;
+    lp->type = e_APP_LCORE_RTC;
+  }
+  
+  if (tx_queue == 0) {
+    return -2;
+  }
+  
+  return 0;
+}
+
 /* Parse the argument given in the command line of the application */
 int
 app_parse_args(int argc, char **argv) {
@@ -611,6 +813,18 @@ app_parse_args(int argc, char **argv) {
     {"bsz",    1, 0, 0},
     {"Nk",     1, 0, 0},
     {"ratio",     1, 0, 0},
+    {"batch",  1, 0, 0},
+    {"fwd",    1, 0, 0},
+    {"rtc",    0, 0, 0},
+    {"v6",     0, 0, 0},
+    {"ctl",    1, 0, 0},
+    {"ctl-sock", 1, 0, 0},
+    {"telemetry-ms", 1, 0, 0},
+    {"telemetry-shm", 1, 0, 0},
+    {"gen",    1, 0, 0},
+    {"sink",   1, 0, 0},
+    {"gen-rate", 1, 0, 0},
+    {"gen-trace", 1, 0, 0},
     {NULL,     0, 0, 0}
   };
   uint32_t arg_w = 0;
@@ -621,6 +835,16 @@ app_parse_args(int argc, char **argv) {
   uint32_t arg_bsz = 0;
 //  uint32_t arg_pos_lb = 0;
   uint32_t arg_nk = 0;
+  uint32_t arg_batch = 0;
+  uint32_t arg_ctl = 0;
+  uint32_t arg_ctl_sock = 0;
+  uint32_t arg_telemetry_ms = 0;
+  uint32_t arg_telemetry_shm = 0;
+  uint32_t ctl_lcore = 0;
+  uint32_t arg_gen = 0;
+  uint32_t arg_sink = 0;
+  uint32_t gen_lcore = 0;
+  uint32_t sink_lcore = 0;
   
   argvopt = argv;
   
@@ -703,6 +927,101 @@ app_parse_args(int argc, char **argv) {
             return -1;
           }
         }
+        
+        if (!strcmp(lgopts[option_index].name, "batch")) {
+          arg_batch = 1;
+          ret = parse_arg_batch(optarg);
+          if (ret) {
+            printf("Incorrect value for --batch argument (%d)\n", ret);
+            return -1;
+          }
+        }
+        
+        if (!strcmp(lgopts[option_index].name, "fwd")) {
+          ret = parse_arg_fwd(optarg);
+          if (ret) {
+            printf("Incorrect value for --fwd argument (%d)\n", ret);
+            return -1;
+          }
+        }
+        
+        if (!strcmp(lgopts[option_index].name, "rtc")) {
+          app.rtc = 1;
+        }
+        
+        if (!strcmp(lgopts[option_index].name, "v6")) {
+          app.v6 = 1;
+        }
+        
+        if (!strcmp(lgopts[option_index].name, "ctl")) {
+          arg_ctl = 1;
+          ret = parse_arg_lcore(optarg, &ctl_lcore);
+          if (ret) {
+            printf("Incorrect value for --ctl argument (%d)\n", ret);
+            return -1;
+          }
+        }
+        
+        if (!strcmp(lgopts[option_index].name, "ctl-sock")) {
+          arg_ctl_sock = 1;
+          ret = parse_arg_ctl_sock(optarg);
+          if (ret) {
+            printf("Incorrect value for --ctl-sock argument (%d)\n", ret);
+            return -1;
+          }
+        }
+        
+        if (!strcmp(lgopts[option_index].name, "telemetry-ms")) {
+          arg_telemetry_ms = 1;
+          ret = parse_arg_telemetry_ms(optarg);
+          if (ret) {
+            printf("Incorrect value for --telemetry-ms argument (%d)\n", ret);
+            return -1;
+          }
+        }
+        
+        if (!strcmp(lgopts[option_index].name, "telemetry-shm")) {
+          arg_telemetry_shm = 1;
+          ret = parse_arg_telemetry_shm(optarg);
+          if (ret) {
+            printf("Incorrect value for --telemetry-shm argument (%d)\n", ret);
+            return -1;
+          }
+        }
+        
+        if (!strcmp(lgopts[option_index].name, "gen")) {
+          arg_gen = 1;
+          ret = parse_arg_lcore(optarg, &gen_lcore);
+          if (ret) {
+            printf("Incorrect value for --gen argument (%d)\n", ret);
+            return -1;
+          }
+        }
+        
+        if (!strcmp(lgopts[option_index].name, "sink")) {
+          arg_sink = 1;
+          ret = parse_arg_lcore(optarg, &sink_lcore);
+          if (ret) {
+            printf("Incorrect value for --sink argument (%d)\n", ret);
+            return -1;
+          }
+        }
+        
+        if (!strcmp(lgopts[option_index].name, "gen-rate")) {
+          ret = parse_arg_gen_rate(optarg);
+          if (ret) {
+            printf("Incorrect value for --gen-rate argument (%d)\n", ret);
+            return -1;
+          }
+        }
+        
+        if (!strcmp(lgopts[option_index].name, "gen-trace")) {
+          ret = parse_arg_gen_trace(optarg);
+          if (ret) {
+            printf("Incorrect value for --gen-trace argument (%d)\n", ret);
+            return -1;
+          }
+        }
         break;
       
       default:
@@ -711,11 +1030,59 @@ app_parse_args(int argc, char **argv) {
   }
   
   /* Check that all mandatory arguments are provided */
-  if ((arg_rx == 0) || (arg_tx == 0) || (arg_w == 0) || (arg_nk == 0)) {
+  if ((arg_rx == 0) || (arg_nk == 0) || (!app.rtc && ((arg_tx == 0) || (arg_w == 0)))) {
     printf("Not all mandatory arguments are present\n");
     return -1;
   }
   
+  if (app.rtc) {
+    if ((arg_tx != 0) || (arg_w != 0)) {
+      printf("--tx and --w are not used in run-to-completion mode\n");
+      return -1;
+    }
+    if ((ret = app_assign_rtc_lcores()) < 0) {
+      printf("Cannot assign run-to-completion lcores (%d)\n", ret);
+      return -1;
+    }
+  }
+  
+  /* the control lcore polls a socket, it cannot share its lcore with the data path */
+  if (arg_ctl) {
+    if (app.lcore_params[ctl_lcore].type != e_APP_LCORE_DISABLED) {
+      printf("--ctl lcore %u is already used by the data path\n", ctl_lcore);
+      return -1;
+    }
+    app.lcore_params[ctl_lcore].type = e_APP_LCORE_CTL;
+  }
+  
+  /* the harness lcores spin on their rings, the same holds for them */
+  if (arg_gen != arg_sink) {
+    printf("--gen and --sink go together\n");
+    return -1;
+  }
+  if (arg_gen) {
+    if (app.lcore_params[gen_lcore].type != e_APP_LCORE_DISABLED ||
+        app.lcore_params[sink_lcore].type != e_APP_LCORE_DISABLED || gen_lcore == sink_lcore) {
+      printf("--gen lcore %u and --sink lcore %u must be distinct and unused\n", gen_lcore, sink_lcore);
+      return -1;
+    }
+    app.lcore_params[gen_lcore].type = e_APP_LCORE_GEN;
+    app.lcore_params[sink_lcore].type = e_APP_LCORE_SINK;
+    app.harness = 1;
+  }
+  
+  if (arg_ctl_sock == 0) {
+    strcpy(app.ctl_sock, APP_DEFAULT_CTL_SOCK);
+  }
+  
+  if (arg_telemetry_ms == 0) {
+    app.telemetry_ms = APP_DEFAULT_TELEMETRY_MS;
+  }
+  
+  if (arg_telemetry_shm == 0) {
+    strcpy(app.telemetry_shm, APP_DEFAULT_TELEMETRY_SHM);
+  }
+  
   /* Assign default values for the optional arguments not provided */
   if (arg_rsz == 0) {
     app.nic_rx_ring_size = APP_DEFAULT_NIC_RX_RING_SIZE;
@@ -733,7 +1100,14 @@ app_parse_args(int argc, char **argv) {
     app.burst_size_worker_write = APP_DEFAULT_BURST_SIZE_WORKER_WRITE;
   }
   
+  if (arg_batch == 0) {
+    app.worker_batch_size = APP_DEFAULT_WORKER_BATCH_SIZE;
+    app.worker_batch_adaptive = 0;
+  }
+  
   app.pos_lb = APP_DEFAULT_IO_RX_LB_POS;
+  app.tunnel_src = APP_DEFAULT_TUNNEL_SRC;
+  app.gue_port = APP_DEFAULT_GUE_PORT;
   
   /* Check cross-consistency of arguments */
   if ((ret = app_check_lpm_table()) < 0) {
@@ -779,6 +1153,18 @@ int app_get_lcore_for_nic_rx(uint16_t port, uint8_t queue, uint32_t *lcore_out)
     struct app_lcore_params_io *lp = &app.lcore_params[lcore].io;
     uint32_t i;
     
+    if (app.lcore_params[lcore].type == e_APP_LCORE_RTC) {
+      struct app_lcore_params_rtc *lp_rtc = &app.lcore_params[lcore].rtc;
+      
+      for (i = 0; i < lp_rtc->n_nic_queues; i++) {
+        if ((lp_rtc->nic_queues[i].port == port) && (lp_rtc->nic_queues[i].queue == queue)) {
+          *lcore_out = lcore;
+          return 0;
+        }
+      }
+      continue;
+    }
+    
     if (app.lcore_params[lcore].type != e_APP_LCORE_IO) {
       continue;
     }
@@ -873,6 +1259,21 @@ uint32_t app_get_lcores_worker(void) {
   return count;
 }
 
+uint32_t app_get_lcores_rtc(void) {
+  uint32_t lcore, count;
+  
+  count = 0;
+  for (lcore = 0; lcore < APP_MAX_LCORES; lcore++) {
+    if (app.lcore_params[lcore].type != e_APP_LCORE_RTC) {
+      continue;
+    }
+    
+    count++;
+  }
+  
+  return count;
+}
+
 void app_print_params(void) {
   unsigned port, queue, lcore, rule, i, j;
   
@@ -921,6 +1322,25 @@ void app_print_params(void) {
     printf(";\n");
   }
   
+  /* Print run-to-completion lcore params */
+  for (lcore = 0; lcore < APP_MAX_LCORES; lcore++) {
+    struct app_lcore_params_rtc *lp = &app.lcore_params[lcore].rtc;
+    
+    if (app.lcore_params[lcore].type != e_APP_LCORE_RTC) {
+      continue;
+    }
+    
+    printf("RTC lcore %u (socket %u): ", lcore, rte_lcore_to_socket_id(lcore));
+    
+    printf("RX ports  ");
+    for (i = 0; i < lp->n_nic_queues; i++) {
+      printf("(%u, %u)  ",
+             (unsigned) lp->nic_queues[i].port,
+             (unsigned) lp->nic_queues[i].queue);
+    }
+    printf("; TX queue %u;\n", (unsigned) lp->tx_queue);
+  }
+  
   /* Print worker lcore RX params */
   for (lcore = 0; lcore < APP_MAX_LCORES; lcore++) {
     struct app_lcore_params_worker *lp = &app.lcore_params[lcore].worker;
@@ -953,6 +1373,26 @@ void app_print_params(void) {
   }
   printf(";\n");
   
+  printf("Forwarding mode: %s\n", fwd_modes[app.fwd_mode]);
+  printf("Dual stack: %s\n", app.v6 ? "on" : "off");
+  
+  for (lcore = 0; lcore < APP_MAX_LCORES; lcore++) {
+    if (app.lcore_params[lcore].type == e_APP_LCORE_CTL) {
+      printf("Control lcore %u on %s\n", lcore, app.ctl_sock);
+    }
+  }
+  
+  if (app.harness) {
+    printf("Harness: generator at %.3f Mpps%s, keys from %s\n", app.gen_mpps, app.gen_mpps > 0 ? "" : " (unthrottled)",
+           app.gen_trace[0] ? app.gen_trace : "the LFSR stream");
+  }
+  
+  if (app.telemetry_ms) {
+    printf("Telemetry: every %u ms to shm %s\n", app.telemetry_ms, app.telemetry_shm);
+  } else {
+    printf("Telemetry: off\n");
+  }
+  
   /* Print I/O TX lcore params */
   for (lcore = 0; lcore < APP_MAX_LCORES; lcore++) {
     struct app_lcore_params_io *lp = &app.lcore_params[lcore].io;
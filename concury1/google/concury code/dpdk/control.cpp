@@ -0,0 +1,151 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <rte_common.h>
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+
+#include "main.h"
+#include "qsbr.h"
+#include "ctl_proto.h"
+
+/**
+ * The control lcore: serves ctl_proto.h requests on a UNIX socket and publishes their effect to the workers.
+ *
+ * Requests are handled one at a time, so the control plane state has a single writer. A request is one batch:
+ * all its ops are applied first, then the VIPs it touched are rebuilt and published, and one grace period covers
+ * them all. The workers never wait for the control plane.
+ */
+
+#ifndef APP_CTL_MAX_CLIENTS
+#define APP_CTL_MAX_CLIENTS     8
+#endif
+
+#ifndef APP_CTL_STATS_MS
+#define APP_CTL_STATS_MS        1000
+#endif
+
+struct app_qsbr app_qsbr = {1};
+
+static int app_ctl_listen(const char *path) {
+  struct sockaddr_un addr;
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  unlink(path);
+  
+  if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, APP_CTL_MAX_CLIENTS) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+struct app_ctl_stats {
+  uint64_t requests;
+  uint64_t ops;
+  uint64_t apply_tsc;
+  uint64_t grace_tsc;
+};
+
+// returns 0 when the request was answered, -1 when the client is gone
+static int app_ctl_serve(int fd, uint8_t *buf, size_t buf_size, struct app_ctl_stats *stats) {
+  struct app_ctl_hdr *hdr = (struct app_ctl_hdr *) buf;
+  struct app_ctl_reply reply;
+  
+  ssize_t len = recv(fd, buf, buf_size, 0);
+  if (len <= 0) {
+    return -1;
+  }
+  
+  memset(&reply, 0, sizeof(reply));
+  if ((size_t) len < sizeof(*hdr) || hdr->magic != APP_CTL_MAGIC || hdr->n_ops > APP_CTL_MAX_OPS ||
+      (size_t) len != sizeof(*hdr) + hdr->n_ops * sizeof(struct app_ctl_op)) {
+    reply.status = APP_CTL_EMSG;
+  } else {
+    uint64_t t0 = rte_rdtsc();
+    reply.seq = hdr->seq;
+    reply.applied = app_ctl_apply((struct app_ctl_op *) (hdr + 1), hdr->n_ops);
+    reply.status = reply.applied == hdr->n_ops ? APP_CTL_OK : APP_CTL_EOP;
+    
+    uint64_t grace = app_ctl_commit();
+    uint64_t apply = rte_rdtsc() - t0 - grace;
+    reply.apply_us = (uint32_t) (apply * 1000000 / rte_get_tsc_hz());
+    reply.grace_us = (uint32_t) (grace * 1000000 / rte_get_tsc_hz());
+    
+    stats->requests++;
+    stats->ops += reply.applied;
+    stats->apply_tsc += apply;
+    stats->grace_tsc += grace;
+  }
+  
+  return send(fd, &reply, sizeof(reply), 0) == sizeof(reply) ? 0 : -1;
+}
+
+void app_lcore_main_loop_ctl(void) {
+  static uint8_t buf[sizeof(struct app_ctl_hdr) + APP_CTL_MAX_OPS * sizeof(struct app_ctl_op)];
+  struct pollfd fds[1 + APP_CTL_MAX_CLIENTS];
+  struct app_ctl_stats stats;
+  uint32_t n_fds = 1;
+  
+  fds[0].fd = app_ctl_listen(app.ctl_sock);
+  fds[0].events = POLLIN;
+  if (fds[0].fd < 0) {
+    rte_panic("Cannot listen on control socket %s: %s\n", app.ctl_sock, strerror(errno));
+  }
+  
+  memset(&stats, 0, sizeof(stats));
+  uint64_t stats_tsc = rte_rdtsc();
+  
+  for (;;) {
+    int ret = poll(fds, n_fds, APP_CTL_STATS_MS);
+    
+    if (ret > 0 && (fds[0].revents & POLLIN)) {
+      int fd = accept(fds[0].fd, NULL, NULL);
+      if (fd >= 0 && n_fds < RTE_DIM(fds)) {
+        fds[n_fds].fd = fd;
+        fds[n_fds].events = POLLIN;
+        fds[n_fds].revents = 0;   // served from the next poll on
+        n_fds++;
+      } else if (fd >= 0) {
+        close(fd);
+      }
+    }
+    
+    for (uint32_t i = 1; ret > 0 && i < n_fds; i++) {
+      if (fds[i].revents == 0) {
+        continue;
+      }
+      if ((fds[i].revents & POLLIN) && app_ctl_serve(fds[i].fd, buf, sizeof(buf), &stats) == 0) {
+        continue;
+      }
+      close(fds[i].fd);
+      fds[i--] = fds[--n_fds];
+    }
+    
+    uint64_t now = rte_rdtsc();
+    if (now - stats_tsc >= rte_get_tsc_hz() * APP_CTL_STATS_MS / 1000) {
+      if (stats.requests) {
+        double secs = (double) (now - stats_tsc) / rte_get_tsc_hz();
+        printf("\t\tControl lcore %u: %.0f updates/s in %.0f requests/s, apply %.1f us, grace period %.1f us per request\n",
+               rte_lcore_id(), stats.ops / secs, stats.requests / secs,
+               (double) stats.apply_tsc * 1e6 / rte_get_tsc_hz() / stats.requests,
+               (double) stats.grace_tsc * 1e6 / rte_get_tsc_hz() / stats.requests);
+      }
+      memset(&stats, 0, sizeof(stats));
+      stats_tsc = now;
+    }
+  }
+}
@@ -0,0 +1,179 @@
+/**
+ * Load generator for the control channel of the DPDK app (see ctl_proto.h). Needs no DPDK.
+ *
+ * It adds its own DIPs to the first VIPs, then sends batches of weight changes (or DIP removals and re-additions with
+ * -m churn) as fast as the control lcore answers them, and reports updates/s and the request latency.
+ * The DIPs it added are removed again at the end.
+ *
+ * build: g++ -O2 -o build/ctl_client ctl_client.cpp
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <vector>
+#include <algorithm>
+#include <random>
+
+#include "ctl_proto.h"
+
+using namespace std;
+
+struct ClientConfig {
+  const char *sock = "/tmp/concury.sock";
+  int vips = 16;          // VIP indices 0 .. vips-1
+  int dips = 8;           // added per VIP
+  int batch = 16;
+  int seconds = 10;
+  bool churn = false;
+};
+
+static int conn_fd;
+static uint32_t seq = 0;
+
+static double now_us() {
+  timeval t;
+  gettimeofday(&t, nullptr);
+  return t.tv_sec * 1e6 + t.tv_usec;
+}
+
+static bool request(const vector<app_ctl_op> &ops, app_ctl_reply &reply) {
+  static uint8_t buf[sizeof(app_ctl_hdr) + APP_CTL_MAX_OPS * sizeof(app_ctl_op)];
+  app_ctl_hdr *hdr = (app_ctl_hdr *) buf;
+  hdr->magic = APP_CTL_MAGIC;
+  hdr->n_ops = (uint16_t) ops.size();
+  hdr->seq = ++seq;
+  memcpy(hdr + 1, ops.data(), ops.size() * sizeof(app_ctl_op));
+  
+  size_t len = sizeof(app_ctl_hdr) + ops.size() * sizeof(app_ctl_op);
+  if (send(conn_fd, buf, len, 0) != (ssize_t) len) return false;
+  if (recv(conn_fd, &reply, sizeof(reply), 0) != sizeof(reply)) return false;
+  return reply.seq == hdr->seq;
+}
+
+static app_ctl_op dipOp(uint8_t opcode, int vip, int dip, uint16_t weight) {
+  app_ctl_op op;
+  memset(&op, 0, sizeof(op));
+  op.opcode = opcode;
+  op.vip = (uint16_t) vip;
+  op.addr = 0x0b000000 + (vip << 8) + dip;   // 11.0.vip.dip, clear of the simulated pools
+  op.port = 80;
+  op.weight = weight;
+  return op;
+}
+
+// add or remove all the client's DIPs, a VIP per request
+static bool setupDips(const ClientConfig &cfg, uint8_t opcode) {
+  for (int vip = 0; vip < cfg.vips; ++vip) {
+    vector<app_ctl_op> ops;
+    for (int dip = 0; dip < cfg.dips; ++dip) ops.push_back(dipOp(opcode, vip, dip, 16));
+    
+    app_ctl_reply reply;
+    if (!request(ops, reply) || reply.status != APP_CTL_OK) {
+      fprintf(stderr, "%s DIPs of VIP %d failed (status %u, %u applied)\n",
+              opcode == APP_CTL_ADD_DIP ? "adding" : "removing", vip, reply.status, reply.applied);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void usage(const char *prg) {
+  fprintf(stderr, "%s [-s SOCK] [-v VIPS] [-d DIPS_PER_VIP] [-b BATCH] [-t SECONDS] [-m weight|churn]\n", prg);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  ClientConfig cfg;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:v:d:b:t:m:")) != -1) {
+    switch (opt) {
+      case 's': cfg.sock = optarg; break;
+      case 'v': cfg.vips = atoi(optarg); break;
+      case 'd': cfg.dips = atoi(optarg); break;
+      case 'b': cfg.batch = atoi(optarg); break;
+      case 't': cfg.seconds = atoi(optarg); break;
+      case 'm': cfg.churn = !strcmp(optarg, "churn"); break;
+      default: usage(argv[0]);
+    }
+  }
+  if (cfg.vips <= 0 || cfg.dips <= 0 || cfg.dips > 255 || cfg.batch <= 0 || cfg.batch > APP_CTL_MAX_OPS) usage(argv[0]);
+  
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, cfg.sock, sizeof(addr.sun_path) - 1);
+  conn_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (conn_fd < 0 || connect(conn_fd, (sockaddr *) &addr, sizeof(addr)) < 0) {
+    perror(cfg.sock);
+    return 1;
+  }
+  
+  if (!setupDips(cfg, APP_CTL_ADD_DIP)) return 1;
+  
+  mt19937 rng(0xe2211);
+  vector<uint8_t> removed(cfg.vips * cfg.dips, 0);
+  vector<double> latency;
+  uint64_t updates = 0, applyUs = 0, graceUs = 0;
+  
+  double start = now_us(), end = start + cfg.seconds * 1e6, t;
+  while ((t = now_us()) < end) {
+    vector<app_ctl_op> ops;
+    vector<int> touched;
+    for (int i = 0; i < cfg.batch; ++i) {
+      int vip = rng() % cfg.vips, dip = rng() % cfg.dips, id = vip * cfg.dips + dip;
+      if (!cfg.churn) {
+        ops.push_back(dipOp(APP_CTL_SET_WEIGHT, vip, dip, (uint16_t) (1 + rng() % 32)));
+      } else if (dip != 0 && find(touched.begin(), touched.end(), id) == touched.end()) {
+        // dip 0 always stays so no VIP ends up empty, and one op per dip and batch keeps the ops independent
+        ops.push_back(dipOp(removed[id] ? APP_CTL_ADD_DIP : APP_CTL_DEL_DIP, vip, dip, 16));
+        removed[id] = !removed[id];
+        touched.push_back(id);
+      }
+    }
+    if (ops.empty()) continue;
+    
+    app_ctl_reply reply;
+    if (!request(ops, reply) || reply.status != APP_CTL_OK) {
+      fprintf(stderr, "request %u failed (status %u, %u applied)\n", seq, reply.status, reply.applied);
+      return 1;
+    }
+    latency.push_back(now_us() - t);
+    updates += reply.applied;
+    applyUs += reply.apply_us;
+    graceUs += reply.grace_us;
+  }
+  double secs = (now_us() - start) / 1e6;
+  
+  // churn may have left some removed
+  for (int i = 0; i < cfg.vips * cfg.dips; ++i) {
+    if (removed[i]) {
+      app_ctl_reply reply;
+      request({dipOp(APP_CTL_ADD_DIP, i / cfg.dips, i % cfg.dips, 16)}, reply);
+    }
+  }
+  setupDips(cfg, APP_CTL_DEL_DIP);
+  
+  size_t n = latency.size();
+  if (n == 0) {
+    fprintf(stderr, "no request completed\n");
+    return 1;
+  }
+  sort(latency.begin(), latency.end());
+  double sum = 0;
+  for (double l : latency) sum += l;
+  
+  printf("%s, batch %d over %d VIPs: %.0f updates/s, %.0f requests/s\n", cfg.churn ? "churn" : "weight", cfg.batch,
+         cfg.vips, updates / secs, n / secs);
+  printf("latency us: avg %.1f  p50 %.1f  p99 %.1f  max %.1f; server apply %.1f  grace period %.1f\n", sum / n,
+         latency[n / 2], latency[n * 99 / 100], latency[n - 1], (double) applyUs / n, (double) graceUs / n);
+  
+  close(conn_fd);
+  return 0;
+}
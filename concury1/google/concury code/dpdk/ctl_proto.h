@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Wire format of the control channel, shared by the control lcore and ctl_client.
+ *
+ * One request is one datagram on a SOCK_SEQPACKET UNIX socket: an app_ctl_hdr followed by n_ops app_ctl_op.
+ * The ops are applied in order until the first one that fails, then everything applied is published to the workers
+ * at once, and the request is answered with one app_ctl_reply. Host byte order, packed.
+ *
+ * A VIP is named by its index (address & VIP_MASK), a DIP by its address and port within the VIP.
+ */
+
+#define APP_CTL_MAGIC           0xc0c7
+#define APP_CTL_MAX_OPS         1024
+
+enum app_ctl_opcode {
+  APP_CTL_SET_WEIGHT = 1,   // vip, dip, weight > 0
+  APP_CTL_ADD_DIP,          // vip, dip, weight > 0. a removed dip comes back in its old slot
+  APP_CTL_DEL_DIP,          // vip, dip. its connections are dropped
+  APP_CTL_ADD_VIP,          // vip. serves again once it has a dip
+  APP_CTL_DEL_VIP           // vip. its dips and connections are dropped
+};
+
+enum app_ctl_status {
+  APP_CTL_OK = 0,
+  APP_CTL_EMSG,             // malformed request, nothing applied
+  APP_CTL_EOP               // op #applied failed, the ones before it were applied
+};
+
+struct app_ctl_hdr {
+  uint16_t magic;
+  uint16_t n_ops;
+  uint32_t seq;             // echoed in the reply
+} __attribute__((__packed__));
+
+struct app_ctl_op {         // 12B
+  uint8_t opcode;
+  uint8_t pad;
+  uint16_t vip;
+  uint32_t addr;
+  uint16_t port;
+  uint16_t weight;
+} __attribute__((__packed__));
+
+struct app_ctl_reply {
+  uint32_t seq;
+  uint16_t applied;
+  uint16_t status;
+  uint32_t apply_us;        // control plane work: HT rebuild, migration, new data plane versions
+  uint32_t grace_us;        // waiting for the workers to drop the old versions
+} __attribute__((__packed__));
@@ -41,6 +41,7 @@
 #include "../main.h"
 #include "../common.h"
 #include "maglev.h"
+#include "../rewrite.h"
 
 #define OFFSETOF(type, field)    ((unsigned long) &(((type *) 0)->field))
 
@@ -54,10 +55,6 @@
 #define APP_LCORE_WORKER_FLUSH       1000000
 #endif
 
-#ifndef APP_STATS
-#define APP_STATS                    100000
-#endif
-
 #define APP_IO_RX_DROP_ALL_PACKETS   0
 #define APP_WORKER_DROP_ALL_PACKETS  0
 #define APP_IO_TX_DROP_ALL_PACKETS   0
@@ -115,31 +112,21 @@ app_lcore_io_rx_buffer_to_send(struct app_lcore_params_io *lp, uint32_t worker,
   
   ret = rte_ring_sp_enqueue_bulk(lp->rx.rings[worker], (void **) lp->rx.mbuf_out[worker].array, bsz, nullptr);  // only copy the pointers of the packets. The worker should prefetch the data again. The packet is currently prefetched into all level of caches in io thread. so the packet is found in the L3 cache if the prefetch finishes before the poll.
   
+  APP_TM_ADD(lp->tm, ring_enq, 1);
   if (unlikely(ret == 0)) {  // FIXME discard packets if fail
     uint32_t k;
     for (k = 0; k < bsz; k++) {
       struct rte_mbuf *m = lp->rx.mbuf_out[worker].array[k];
       rte_pktmbuf_free(m);
     }
+    APP_TM_ADD(lp->tm, ring_full, 1);
+    APP_TM_ADD(lp->tm, ring_full_drops, bsz);
+  } else {
+    APP_TM_ADD(lp->tm, tx_pkts, bsz);
   }
   
   lp->rx.mbuf_out[worker].n_mbufs = 0;
   lp->rx.mbuf_out_flush[worker] = 0;       // TODO meaning of this? will skip flush when it is 0
-
-#if APP_STATS
-  lp->rx.rings_iters[worker]++;
-  if (likely(ret == bsz)) {
-    lp->rx.rings_count[worker]++;
-  }
-  if (unlikely(lp->rx.rings_iters[worker] == APP_STATS)) {
-    unsigned lcore = rte_lcore_id();
-    
-    printf("\tI/O RX %u out (worker %u): enq success rate = %.2f\n", lcore, (unsigned) worker,
-           ((double) lp->rx.rings_count[worker]) / ((double) lp->rx.rings_iters[worker]));
-    lp->rx.rings_iters[worker] = 0;
-    lp->rx.rings_count[worker] = 0;
-  }
-#endif
 }
 
 static inline void
@@ -158,25 +145,11 @@ app_lcore_io_rx(struct app_lcore_params_io *lp, uint32_t n_workers, uint32_t bsz
     if (unlikely(n_mbufs == 0)) {
       continue;
     }
-
-#if APP_STATS
-    lp->rx.nic_queues_iters[i]++;
-    lp->rx.nic_queues_count[i] += n_mbufs;
-    if (unlikely(lp->rx.nic_queues_iters[i] == (APP_STATS * 100))) {
-      struct rte_eth_stats stats{};
-      unsigned lcore = rte_lcore_id();
-      
-      rte_eth_stats_get(port, &stats);
-      
-      printf("I/O RX %u in (NIC port %u): NIC drop ratio = %.2f avg burst size = %.2f\n",
-             lcore, port, (double) stats.imissed / (double) (stats.imissed + stats.ipackets),
-             ((double) lp->rx.nic_queues_count[i]) / ((double) lp->rx.nic_queues_iters[i]));
-      lp->rx.nic_queues_iters[i] = 0;
-      lp->rx.nic_queues_count[i] = 0;
-      
-      rte_eth_stats_reset(port);
-    }
-#endif
+    
+    // the NIC drop ratio comes from the port counters, which the telemetry thread reads
+    APP_TM_ADD(lp->tm, rx_pkts, n_mbufs);
+    APP_TM_ADD(lp->tm, rx_bursts, 1);
+    APP_TM_TSC(rx_start);
 
 #if APP_IO_RX_DROP_ALL_PACKETS
     for (j = 0; j < n_mbufs; j ++) {
@@ -265,6 +238,9 @@ app_lcore_io_rx(struct app_lcore_params_io *lp, uint32_t n_workers, uint32_t bsz
       
       app_lcore_io_rx_buffer_to_send(lp, worker, mbuf, bsz_wr);
     }
+    
+    APP_TM_TSC(rx_end);
+    APP_TM_STAGE(lp->tm, APP_TM_STAGE_RX, rx_start, rx_end);
   }
 }
 
@@ -281,12 +257,17 @@ static inline void app_lcore_io_rx_flush(struct app_lcore_params_io *lp, uint32_
     
     ret = rte_ring_sp_enqueue_bulk(lp->rx.rings[worker], (void **) lp->rx.mbuf_out[worker].array, lp->rx.mbuf_out[worker].n_mbufs, nullptr);
     
+    APP_TM_ADD(lp->tm, ring_enq, 1);
     if (unlikely(ret == 0)) {
       uint32_t k;
       for (k = 0; k < lp->rx.mbuf_out[worker].n_mbufs; k++) {
         struct rte_mbuf *pkt_to_free = lp->rx.mbuf_out[worker].array[k];
         rte_pktmbuf_free(pkt_to_free);
       }
+      APP_TM_ADD(lp->tm, ring_full, 1);
+      APP_TM_ADD(lp->tm, ring_full_drops, lp->rx.mbuf_out[worker].n_mbufs);
+    } else {
+      APP_TM_ADD(lp->tm, tx_pkts, lp->rx.mbuf_out[worker].n_mbufs);
     }
     
     lp->rx.mbuf_out[worker].n_mbufs = 0;
@@ -341,20 +322,12 @@ app_lcore_io_tx(struct app_lcore_params_io *lp, uint32_t n_workers, uint32_t bsz
         continue;
       }
       
+      APP_TM_TSC(tx_start);
       n_pkts = rte_eth_tx_burst(port, 0, lp->tx.mbuf_out[port].array, (uint16_t) n_mbufs);
-
-#if APP_STATS
-      lp->tx.nic_ports_iters[port]++;
-      lp->tx.nic_ports_count[port] += n_pkts;
-      if (unlikely(lp->tx.nic_ports_iters[port] == APP_STATS)) {
-        unsigned lcore = rte_lcore_id();
-        
-        printf("\t\t\tI/O TX %u out (port %u): avg burst size = %.2f\n", lcore, port,
-               ((double) lp->tx.nic_ports_count[port]) / ((double) lp->tx.nic_ports_iters[port]));
-        lp->tx.nic_ports_iters[port] = 0;
-        lp->tx.nic_ports_count[port] = 0;
-      }
-#endif
+      APP_TM_TSC(tx_end);
+      APP_TM_STAGE(lp->tm, APP_TM_STAGE_TX, tx_start, tx_end);
+      APP_TM_ADD(lp->tm, tx_pkts, n_pkts);
+      APP_TM_ADD(lp->tm, tx_drops, n_mbufs - n_pkts);
       
       if (unlikely(n_pkts < n_mbufs)) {
         uint32_t k;
@@ -383,6 +356,8 @@ static inline void app_lcore_io_tx_flush(struct app_lcore_params_io *lp) {
     }
     
     n_pkts = rte_eth_tx_burst(port, 0, lp->tx.mbuf_out[port].array, (uint16_t) lp->tx.mbuf_out[port].n_mbufs);
+    APP_TM_ADD(lp->tm, tx_pkts, n_pkts);
+    APP_TM_ADD(lp->tm, tx_drops, lp->tx.mbuf_out[port].n_mbufs - n_pkts);
     
     if (unlikely(n_pkts < lp->tx.mbuf_out[port].n_mbufs)) {
       uint32_t k;
@@ -399,6 +374,8 @@ static inline void app_lcore_io_tx_flush(struct app_lcore_params_io *lp) {
 
 Hasher32<Tuple3> hasher[2] = {{(uint) rand()},
                               {(uint) rand()}};
+Hasher32<Tuple3v6> hasherV6[2] = {{(uint) rand()},
+                                  {(uint) rand()}};
 
 static void app_lcore_main_loop_io() {
   uint32_t lcore = rte_lcore_id();
@@ -413,6 +390,8 @@ static void app_lcore_main_loop_io() {
   
   uint8_t pos_lb = app.pos_lb;
   
+  lp->tm = &app_tm[lcore];
+  
   for (;;) {
     if (APP_LCORE_IO_FLUSH && (unlikely(i == APP_LCORE_IO_FLUSH))) {
       if (likely(lp->rx.n_nic_queues > 0)) {
@@ -441,132 +420,211 @@ static void app_lcore_main_loop_io() {
 static uint64_t cnt = 0;
 static uint64_t inserted = 0;
 
-static inline void app_lcore_worker(struct app_lcore_params_worker *lp, uint32_t bsz_rd, uint32_t bsz_wr) {
+// parse an IPv4/TCP packet into its VIP and the 64-bit digest of its Tuple3
+static inline uint64_t app_pkt_key_v4(uint8_t *data, uint *vip_out, uint16_t *port_out) {
+  struct ipv4_hdr *ipv4_hdr;
+  struct tcp_hdr *tcp_hdr;
+  
+  uint32_t ipv4_dst, pos, ipv4_src;
+  uint16_t tcp_port_dst, tcp_port_src;
+  
+  ipv4_hdr = (struct ipv4_hdr *) (data + sizeof(struct ether_hdr));
+  ipv4_dst = rte_be_to_cpu_32(ipv4_hdr->dst_addr);   // important !! switch ending
+  ipv4_src = rte_be_to_cpu_32(ipv4_hdr->src_addr);
+  
+  tcp_hdr = (struct tcp_hdr *) (data + sizeof(struct ether_hdr) + sizeof(struct ipv4_hdr));
+  
+  tcp_port_src = rte_be_to_cpu_16(tcp_hdr->src_port);
+  tcp_port_dst = rte_be_to_cpu_16(tcp_hdr->dst_port);
+  
+  uint vipInd = ipv4_dst & VIP_MASK;
+  Tuple3 tuple = {
+    src: {ipv4_src, tcp_port_src},
+    protocol: 6
+  };
+  
+  if (app.ratio && cnt % app.ratio == 0) {
+    vipInd = rand() & VIP_MASK;
+    tuple = {
+      src: {(uint) rand(), (uint16_t) rand()},
+      protocol: 6
+    };
+  }
+  
+  cnt++;
+  
+  *vip_out = vipInd;
+  *port_out = tcp_port_src;
+  uint64_t hash = hasher[0](tuple);
+  hash |= uint64_t(hasher[1](tuple)) << 32;
+  return hash;
+}
+
+// IPv6/TCP without extension headers. a dual-stack VIP is indexed by the low bits of its v6 address.
+// the tables only keep the digest, so a v6 connection costs the same as a v4 one
+static inline uint64_t app_pkt_key_v6(uint8_t *data, uint *vip_out, uint16_t *port_out) {
+  struct ipv6_hdr *ipv6_hdr = (struct ipv6_hdr *) (data + sizeof(struct ether_hdr));
+  struct tcp_hdr *tcp_hdr = (struct tcp_hdr *) (ipv6_hdr + 1);
+  uint32_t dst_low;
+  memcpy(&dst_low, ipv6_hdr->dst_addr + 12, sizeof(dst_low));
+  
+  Tuple3v6 tuple;
+  memcpy(tuple.src.addr, ipv6_hdr->src_addr, sizeof(tuple.src.addr));   // network order, the key is opaque
+  tuple.src.port = rte_be_to_cpu_16(tcp_hdr->src_port);
+  
+  cnt++;
+  
+  *vip_out = rte_be_to_cpu_32(dst_low) & VIP_MASK;
+  *port_out = tuple.src.port;
+  uint64_t hash = hasherV6[0](tuple);
+  hash |= uint64_t(hasherV6[1](tuple)) << 32;
+  return hash;
+}
+
+// parse one packet and look its connection up. returns the port the DIP sits behind, and the DIP in dip_out.
+// shared by the pipelined worker and the run-to-completion lcores
+static inline uint32_t app_pkt_lookup(uint8_t *data, DIP **dip_out, struct app_tm_lcore *tm) {
+  uint vipInd;
+  uint16_t tcp_port_src;
+  uint64_t hash;
+  
+  if (unlikely(app.v6 && ((struct ether_hdr *) data)->ether_type == rte_cpu_to_be_16(ETHER_TYPE_IPv6))) {
+    hash = app_pkt_key_v6(data, &vipInd, &tcp_port_src);
+  } else {
+    hash = app_pkt_key_v4(data, &vipInd, &tcp_port_src);
+  }
+  APP_TM_ADD(tm, lookups, 1);
+  APP_TM_ADD(tm, vip_lookups[vipInd % APP_TM_MAX_VIPS], 1);
+  
+  // Step 3: lookup connectionTracking table
+  uint16_t htInd;
+  
+  if (connTrackingTables[vipInd].Find(hash, htInd)) {
+    // done with right dip
+  } else {
+    // Step 4: lookup consistent hashing table to get the dip and insert back
+    inserted++;
+//    if (inserted % (1024 * 1024) == 0) {
+//    cout << "inserting: #" << human(inserted) << ", cnt: " << human(cnt) << endl;
+//    cout << "ip parse: " << ipv4_src << "->" << ipv4_dst << " desired: 0 ~ unbounded -> 3539992576" << endl;
+//    cout << "tcp parse: " << tcp_port_src << "->" << tcp_port_dst << " desired: 0/32767 -> 0/127" << endl;
+  
+//    if (inserted > 100 ) exit(0);
+//    }
+    
+    htInd = ht[vipInd][hash & (HT_SIZE - 1)];
+    const uint64_t *tmp = connTrackingTables[vipInd].Insert(hash, htInd);
+    if (tmp != &hash) {
+      cout << "full - rebuild: " << hash << " " << (tmp ? *tmp : 0) << endl;
+      unordered_map<uint64_t, uint16_t, Hasher32<uint64_t>> map = connTrackingTables[vipInd].toMap();
+      map.insert(make_pair(hash, htInd));
+      
+      bool succ = false;
+      
+      while (!succ) {
+        succ = true;
+        
+        connTrackingTables[vipInd] = ControlPlaneCuckooMap<uint64_t, uint16_t, uint8_t, false>(
+          connTrackingTables[vipInd].EntryCount() * 2);
+        
+        for (auto it = map.begin(); it != map.end(); ++it) {
+          auto *result = connTrackingTables[vipInd].Insert(it->first, it->second);
+          
+          if (result != &it->first) {
+            succ = false;
+            break;
+          }
+        }
+      }
+    }
+  }
+  
+  DIP &dip = dipPools[vipInd][ht[vipInd][htInd]];
+  
+//  cout << "Ht index: " << htInd << " DIP: " << dip << endl;
+  
+//  cout << ipv4_src << "@" << tcp_port_src << "-> #" << (ipv4_dst & VIP_MASK) << " lookup result: "
+//       << dip.addr.addr << endl;
+  
+  *dip_out = &dip;
+  return (dip.addr.addr ^ tcp_port_src) & 1;
+}
+
+static inline void app_lcore_worker(struct app_lcore_params_worker *lp, uint32_t bsz_rd, uint32_t bsz_wr, uint8_t adaptive,
+                                    uint8_t fwd_mode) {
   for (uint32_t i = 0; i < lp->n_rings_in; i++) {
     struct rte_ring *ring_in = lp->rings_in[i];
+    uint32_t n_mbufs = bsz_rd;
+    int ret;
     
     // copy pointers from ring to mbuf_in. always start at the beginning of the mbuf_in array. no need to reset the array after reading from it.
-    int ret = rte_ring_sc_dequeue_bulk(ring_in, (void **) lp->mbuf_in.array, bsz_rd, nullptr);
-    
-    if (unlikely(ret == 0)) {
-      continue;
+    if (adaptive) {
+      unsigned avail;
+      
+      // take whatever is there instead of waiting for a full bulk
+      n_mbufs = rte_ring_sc_dequeue_burst(ring_in, (void **) lp->mbuf_in.array, bsz_rd, &avail);
+      if (unlikely(n_mbufs == 0)) {
+        continue;
+      }
+      
+      // a backlog of another burst: bigger batches keep more misses in flight. a drained ring: smaller ones
+      if (avail >= bsz_rd) {
+        lp->batch_size = RTE_MIN(lp->batch_size * 2, bsz_rd);
+      } else if (avail == 0) {
+        lp->batch_size = RTE_MAX(lp->batch_size / 2, (uint32_t) APP_WORKER_BATCH_MIN);
+      }
+    } else {
+      ret = rte_ring_sc_dequeue_bulk(ring_in, (void **) lp->mbuf_in.array, bsz_rd, nullptr);
+      if (unlikely(ret == 0)) {
+        continue;
+      }
     }
 
 #if APP_WORKER_DROP_ALL_PACKETS
-    for (j = 0; j < bsz_rd; j ++) {
+    for (j = 0; j < n_mbufs; j ++) {
       struct rte_mbuf *pkt = lp->mbuf_in.array[j];
       rte_pktmbuf_free(pkt);
     }
 
     continue;
 #endif
+
+    APP_TM_ADD(lp->tm, rx_pkts, n_mbufs);
+    APP_TM_ADD(lp->tm, rx_bursts, 1);
     
-    const int batch_size = 24;  // should be divided by 144
-    MySimpleArray<uint8_t *> packets(batch_size);
-    MySimpleArray<uint32_t> outPorts(batch_size);
+    const uint32_t batch_size = lp->batch_size;
+    uint8_t **packets = lp->packets;
+    uint32_t *outPorts = lp->out_ports;
+    DIP **dips = lp->dips;
     
-    for (uint32_t base = 0; base < bsz_rd; base += batch_size) {
-      for (uint32_t j = 0; j < batch_size; ++j) {
-        APP_WORKER_PREFETCH1(packets[j] = (uint8_t *) lp->mbuf_in.array[base + j]);   // buffer
+    for (uint32_t base = 0; base < n_mbufs; base += batch_size) {
+      uint32_t end = RTE_MIN(base + batch_size, n_mbufs);   // the last batch may be short
+      APP_TM_ADD(lp->tm, batches, 1);
+      APP_TM_ADD(lp->tm, batch_slots, batch_size);
+      APP_TM_TSC(t_lookup);
+      
+      for (uint32_t j = base; j < end; ++j) {
+        APP_WORKER_PREFETCH1(packets[j] = (uint8_t *) lp->mbuf_in.array[j]);   // buffer
       }
-      for (uint32_t j = 0; j < batch_size; ++j) {
+      for (uint32_t j = base; j < end; ++j) {
         APP_WORKER_PREFETCH1(packets[j] = rte_pktmbuf_mtod((rte_mbuf *) packets[j], uint8_t * ));
       }
-      for (uint32_t j = 0; j < batch_size; ++j) {
-        struct ipv4_hdr *ipv4_hdr;
-        struct tcp_hdr *tcp_hdr;
-        
-        uint32_t ipv4_dst, pos, ipv4_src;
-        uint16_t tcp_port_dst, tcp_port_src;
-        
-        ipv4_hdr = (struct ipv4_hdr *) (packets[j] + sizeof(struct ether_hdr));
-        ipv4_dst = rte_be_to_cpu_32(ipv4_hdr->dst_addr);   // important !! switch ending
-        ipv4_src = rte_be_to_cpu_32(ipv4_hdr->src_addr);
-        
-        tcp_hdr = (struct tcp_hdr *) (packets[j] + sizeof(struct ether_hdr) + sizeof(struct ipv4_hdr));
-        
-        tcp_port_src = rte_be_to_cpu_16(tcp_hdr->src_port);
-        tcp_port_dst = rte_be_to_cpu_16(tcp_hdr->dst_port);
-        
-        uint vipInd = ipv4_dst & VIP_MASK;
-        Tuple3 tuple = {
-          src: {ipv4_src, tcp_port_src},
-          protocol: 6
-        };
-        
-        if (app.ratio && cnt % app.ratio == 0) {
-          vipInd = rand() & VIP_MASK;
-          tuple = {
-            src: {(uint) rand(), (uint16_t) rand()},
-            protocol: 6
-          };
-        }
-        
-        cnt++;
-        
-        // Step 3: lookup connectionTracking table
-        uint16_t htInd;
-        uint64_t hash = hasher[0](tuple);
-        hash |= uint64_t(hasher[1](tuple)) << 32;
-        
-        if (connTrackingTables[vipInd].Find(hash, htInd)) {
-          // done with right dip
-        } else {
-          // Step 4: lookup consistent hashing table to get the dip and insert back
-          inserted++;
-//          if (inserted % (1024 * 1024) == 0) {
-//          cout << "inserting: #" << human(inserted) << ", cnt: " << human(cnt) << endl;
-//          cout << "ip parse: " << ipv4_src << "->" << ipv4_dst << " desired: 0 ~ unbounded -> 3539992576" << endl;
-//          cout << "tcp parse: " << tcp_port_src << "->" << tcp_port_dst << " desired: 0/32767 -> 0/127" << endl;
-
-//          if (inserted > 100 ) exit(0);
-//          }
-          
-          htInd = ht[vipInd][hash & (HT_SIZE - 1)];
-          const uint64_t *tmp = connTrackingTables[vipInd].Insert(hash, htInd);
-          if (tmp != &hash) {
-            cout << "full - rebuild: " << hash << " " << (tmp ? *tmp : 0) << endl;
-            unordered_map<uint64_t, uint16_t, Hasher32<uint64_t>> map = connTrackingTables[vipInd].toMap();
-            map.insert(make_pair(hash, htInd));
-            
-            bool succ = false;
-            
-            while (!succ) {
-              succ = true;
-              
-              connTrackingTables[vipInd] = ControlPlaneCuckooMap<uint64_t, uint16_t, uint8_t, false>(
-                connTrackingTables[vipInd].EntryCount() * 2);
-              
-              for (auto it = map.begin(); it != map.end(); ++it) {
-                auto *result = connTrackingTables[vipInd].Insert(it->first, it->second);
-                
-                if (result != &it->first) {
-                  succ = false;
-                  break;
-                }
-              }
-            }
-          }
-        }
-        
-        DIP &dip = dipPools[vipInd][ht[vipInd][htInd]];
-
-//        cout << "Ht index: " << htInd << " DIP: " << dip << endl;
-        
-        outPorts[j] = (dip.addr.addr ^ tcp_port_src) & 1;
-        
-        uint32_t port = outPorts[j];
-//        cout << ipv4_src << "@" << tcp_port_src << "-> #" << (ipv4_dst & VIP_MASK) << " lookup result: "
-//             << dip.addr.addr << "@" << port << endl;
+      for (uint32_t j = base; j < end; ++j) {
+        outPorts[j] = app_pkt_lookup(packets[j], &dips[j], lp->tm);
       }
-      for (uint32_t j = 0; j < batch_size; ++j) {
-      
+      APP_TM_TSC(t_rewrite);
+      APP_TM_STAGE(lp->tm, APP_TM_STAGE_LOOKUP, t_lookup, t_rewrite);
+      if (fwd_mode != e_APP_FWD_NONE) {
+        for (uint32_t j = base; j < end; ++j) {
+          app_rewrite(lp->mbuf_in.array[j], dips[j], fwd_mode);
+        }
       }
-      for (uint32_t j = 0; j < batch_size; ++j) {
-        uint32_t port = lp->mbuf_in.array[base +
-                                          j]->port; //((base + j) / 1) & 1; // outPorts[j] // lp->mbuf_in.array[base + j]->port;
+      APP_TM_TSC(t_tx);
+      APP_TM_STAGE(lp->tm, APP_TM_STAGE_REWRITE, t_rewrite, t_tx);
+      for (uint32_t j = base; j < end; ++j) {
+        uint32_t port = lp->mbuf_in.array[j]->port; //outPorts[j]; //((base + j) / 1) & 1; // outPorts[j] // lp->mbuf_in.array[base + j]->port;
         uint pos = lp->mbuf_out[port].n_mbufs;
-        lp->mbuf_out[port].array[pos++] = lp->mbuf_in.array[base + j];
+        lp->mbuf_out[port].array[pos++] = lp->mbuf_in.array[j];
         
         if (likely(pos < bsz_wr)) {
           lp->mbuf_out[port].n_mbufs = pos;
@@ -574,32 +632,27 @@ static inline void app_lcore_worker(struct app_lcore_params_worker *lp, uint32_t
         }
         // once when we have one bulk, enqueue them right away. if we don't, just buffer until a flush
         ret = rte_ring_sp_enqueue_bulk(lp->rings_out[port], (void **) lp->mbuf_out[port].array, bsz_wr, nullptr);
-
-#if APP_STATS
-        lp->rings_out_iters[port]++;
-        if (likely(ret == bsz_wr)) {
-          lp->rings_out_count[port]++;
-        }
-        if (lp->rings_out_iters[port] == APP_STATS) {
-          printf("\t\tWorker %u out (NIC port %u): enq success rate = %.2f\n", (unsigned) lp->worker_id, port,
-                 ((double) lp->rings_out_count[port]) / ((double) lp->rings_out_iters[port]));
-          lp->rings_out_iters[port] = 0;
-          lp->rings_out_count[port] = 0;
-        }
-#endif
         
         // FIXME current solution: if enqueue failed (The number of objects enqueued is 0), just delete the packets
+        APP_TM_ADD(lp->tm, ring_enq, 1);
         if (unlikely(ret == 0)) {
           uint32_t k;
           for (k = 0; k < bsz_wr; k++) {
             struct rte_mbuf *pkt_to_free = lp->mbuf_out[port].array[k];
             rte_pktmbuf_free(pkt_to_free);
           }
+          APP_TM_ADD(lp->tm, ring_full, 1);
+          APP_TM_ADD(lp->tm, ring_full_drops, bsz_wr);
+        } else {
+          APP_TM_ADD(lp->tm, tx_pkts, bsz_wr);
         }
         
         lp->mbuf_out[port].n_mbufs = 0;  // always clear the array after a bulk. no partial commit in poll mode
         lp->mbuf_out_flush[port] = outPorts[j];
       }
+      
+      APP_TM_TSC(t_end);
+      APP_TM_STAGE(lp->tm, APP_TM_STAGE_TX, t_tx, t_end);
     }
 //
 //    // pre-fill the pipeline
@@ -708,12 +761,17 @@ static inline void app_lcore_worker_flush(struct app_lcore_params_worker *lp) {
     
     ret = rte_ring_sp_enqueue_bulk(lp->rings_out[port], (void **) lp->mbuf_out[port].array, lp->mbuf_out[port].n_mbufs, nullptr);
     
+    APP_TM_ADD(lp->tm, ring_enq, 1);
     if (unlikely(ret == 0)) {
       uint32_t k;
       for (k = 0; k < lp->mbuf_out[port].n_mbufs; k++) {
         struct rte_mbuf *pkt_to_free = lp->mbuf_out[port].array[k];
         rte_pktmbuf_free(pkt_to_free);
       }
+      APP_TM_ADD(lp->tm, ring_full, 1);
+      APP_TM_ADD(lp->tm, ring_full_drops, lp->mbuf_out[port].n_mbufs);
+    } else {
+      APP_TM_ADD(lp->tm, tx_pkts, lp->mbuf_out[port].n_mbufs);
     }
     
     lp->mbuf_out[port].n_mbufs = 0;
@@ -728,6 +786,11 @@ static void app_lcore_main_loop_worker() {
   
   uint32_t bsz_rd = app.burst_size_worker_read;
   uint32_t bsz_wr = app.burst_size_worker_write;
+  uint8_t adaptive = app.worker_batch_adaptive;
+  uint8_t fwd_mode = app.fwd_mode;
+  
+  lp->batch_size = RTE_MIN(app.worker_batch_size, bsz_rd);
+  lp->tm = &app_tm[lcore];
   
   for (;;) {
     if (APP_LCORE_WORKER_FLUSH && (unlikely(i == APP_LCORE_WORKER_FLUSH))) {
@@ -735,12 +798,87 @@ static void app_lcore_main_loop_worker() {
       i = 0;
     }
     
-    app_lcore_worker(lp, bsz_rd, bsz_wr);
+    app_lcore_worker(lp, bsz_rd, bsz_wr, adaptive, fwd_mode);
     
     i++;
   }
 }
 
+// run-to-completion: rx burst -> lookup -> tx burst on this lcore's own tx queue. no rings, no hand-off between cores
+static inline void app_lcore_rtc(struct app_lcore_params_rtc *lp, uint32_t bsz_rd) {
+  const uint32_t batch_size = app.worker_batch_size;
+  const uint8_t fwd_mode = app.fwd_mode;
+  uint8_t **packets = lp->packets;
+  DIP **dips = lp->dips;
+  
+  for (uint32_t i = 0; i < lp->n_nic_queues; i++) {
+    uint16_t port = lp->nic_queues[i].port;
+    uint8_t queue = lp->nic_queues[i].queue;
+    uint32_t n_mbufs, n_pkts;
+    
+    n_mbufs = rte_eth_rx_burst(port, queue, lp->mbuf_in.array, (uint16_t) bsz_rd);
+    if (unlikely(n_mbufs == 0)) {
+      continue;
+    }
+    APP_TM_ADD(lp->tm, rx_pkts, n_mbufs);
+    APP_TM_ADD(lp->tm, rx_bursts, 1);
+    
+    // the nic returns partial bursts, so the last batch may be short
+    for (uint32_t base = 0; base < n_mbufs; base += batch_size) {
+      uint32_t end = RTE_MIN(base + batch_size, n_mbufs);
+      APP_TM_ADD(lp->tm, batches, 1);
+      APP_TM_ADD(lp->tm, batch_slots, batch_size);
+      APP_TM_TSC(t_lookup);
+      
+      for (uint32_t j = base; j < end; ++j) {
+        APP_WORKER_PREFETCH1(packets[j] = (uint8_t *) lp->mbuf_in.array[j]);
+      }
+      for (uint32_t j = base; j < end; ++j) {
+        APP_WORKER_PREFETCH1(packets[j] = rte_pktmbuf_mtod((rte_mbuf *) packets[j], uint8_t * ));
+      }
+      for (uint32_t j = base; j < end; ++j) {
+        lp->mbuf_in.hashes[j] = app_pkt_lookup(packets[j], &dips[j], lp->tm);   // keep the result, like outPorts in the worker
+      }
+      APP_TM_TSC(t_rewrite);
+      APP_TM_STAGE(lp->tm, APP_TM_STAGE_LOOKUP, t_lookup, t_rewrite);
+      if (fwd_mode != e_APP_FWD_NONE) {
+        for (uint32_t j = base; j < end; ++j) {
+          app_rewrite(lp->mbuf_in.array[j], dips[j], fwd_mode);
+        }
+      }
+      APP_TM_TSC(t_end);
+      APP_TM_STAGE(lp->tm, APP_TM_STAGE_REWRITE, t_rewrite, t_end);
+    }
+    
+    // same as the pipelined mode: the packet goes back on its input port
+    APP_TM_TSC(tx_start);
+    n_pkts = rte_eth_tx_burst(port, lp->tx_queue, lp->mbuf_in.array, (uint16_t) n_mbufs);
+    APP_TM_TSC(tx_end);
+    APP_TM_STAGE(lp->tm, APP_TM_STAGE_TX, tx_start, tx_end);
+    APP_TM_ADD(lp->tm, tx_pkts, n_pkts);
+    APP_TM_ADD(lp->tm, tx_drops, n_mbufs - n_pkts);
+    if (unlikely(n_pkts < n_mbufs)) {
+      uint32_t k;
+      for (k = n_pkts; k < n_mbufs; k++) {
+        rte_pktmbuf_free(lp->mbuf_in.array[k]);
+      }
+    }
+  }
+}
+
+static void app_lcore_main_loop_rtc() {
+  uint32_t lcore = rte_lcore_id();
+  struct app_lcore_params_rtc *lp = &app.lcore_params[lcore].rtc;
+  
+  uint32_t bsz_rd = app.burst_size_io_rx_read;
+  
+  lp->tm = &app_tm[lcore];
+  
+  for (;;) {
+    app_lcore_rtc(lp, bsz_rd);
+  }
+}
+
 int app_lcore_main_loop(__attribute__((unused)) void *arg) {
   struct app_lcore_params *lp;
   unsigned lcore;
@@ -758,6 +896,25 @@ int app_lcore_main_loop(__attribute__((unused)) void *arg) {
     app_lcore_main_loop_worker();
   }
   
+  if (lp->type == e_APP_LCORE_RTC) {
+    printf("Logical core %u (run-to-completion, TX queue %u) main loop.\n", lcore, (unsigned) lp->rtc.tx_queue);
+    app_lcore_main_loop_rtc();
+  }
+  
+  if (lp->type == e_APP_LCORE_CTL) {
+    printf("Logical core %u: the control channel is not supported by cuckoolb.\n", lcore);
+  }
+  
+  if (lp->type == e_APP_LCORE_GEN) {
+    printf("Logical core %u (harness generator) main loop.\n", lcore);
+    app_lcore_main_loop_gen();
+  }
+  
+  if (lp->type == e_APP_LCORE_SINK) {
+    printf("Logical core %u (harness sink) main loop.\n", lcore);
+    app_lcore_main_loop_sink();
+  }
+  
   return 0;
 }
 
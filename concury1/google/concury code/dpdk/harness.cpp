@@ -0,0 +1,387 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_debug.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_memcpy.h>
+#include <rte_mempool.h>
+#include <rte_mbuf.h>
+#include <rte_ring.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_tcp.h>
+#include <rte_ethdev.h>
+#include <rte_eth_ring.h>
+
+#include "main.h"
+#include "common.h"
+
+/**
+ * NIC-free harness: the data path runs unmodified on net_ring ports, which are plain rte_rings underneath.
+ *
+ * The generator lcore synthesizes 64B IPv4/TCP packets into the RX rings of the ports, the sink lcore drains their TX
+ * rings. Nothing is looped back, so the sink sees exactly what the data path forwarded. The generator stamps every
+ * packet with the TSC in udata64, which no stage of the data path touches, and the sink turns it into the latency.
+ *
+ * The keys are precomputed, so the generator only copies a template and patches four fields. By default they are the
+ * LFSR stream simulateConnectionAdd tracks, with --gen-trace they are read from a trace in the text format of
+ * concury.cpp (src.addr src.port vip.addr vip.port protocol, decimal).
+ */
+
+#define APP_HARNESS_PKT_LEN     60      // 64B on the wire with the FCS
+#define APP_LAT_SUB_BITS        3       // 8 linear sub-buckets per power of two, < 12.5% error
+#define APP_LAT_BUCKETS         (64 << APP_LAT_SUB_BITS)
+
+struct app_gen_key {
+  uint32_t src_addr;      // all in network order, as written into the packet
+  uint32_t dst_addr;
+  uint16_t src_port;
+  uint16_t dst_port;
+  uint16_t ip_cksum;
+  uint16_t pad;
+};
+
+struct app_lat_hist {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  uint64_t buckets[APP_LAT_BUCKETS];
+};
+
+static struct {
+  /* generator -> data path, one ring per RX queue */
+  struct rte_ring *rx[APP_MAX_NIC_PORTS * APP_MAX_RX_QUEUES_PER_NIC_PORT];
+  uint16_t rx_port[APP_MAX_NIC_PORTS * APP_MAX_RX_QUEUES_PER_NIC_PORT];
+  uint32_t n_rx;
+  
+  /* data path -> sink, one ring per TX queue */
+  struct rte_ring *tx[APP_MAX_NIC_PORTS * APP_MAX_TX_QUEUES_PER_NIC_PORT];
+  uint32_t n_tx;
+  
+  struct app_gen_key *keys;
+  uint32_t n_keys;
+  uint8_t tmpl[RTE_CACHE_LINE_SIZE] __rte_cache_aligned;
+  
+  uint32_t gen_lcore;
+} harness;
+
+static uint32_t app_harness_n_tx_queues(uint16_t port) {
+  if (app.nic_tx_port_mask[port] == 0) {
+    return 0;
+  }
+  return app.rtc ? app_get_lcores_rtc() : 1;   // the same as app_init_nics
+}
+
+static struct rte_ring *app_harness_ring(const char *dir, uint16_t port, uint32_t queue, uint32_t size) {
+  char name[32];
+  struct rte_ring *ring;
+  
+  snprintf(name, sizeof(name), "harness_%s_%u_%u", dir, port, queue);
+  ring = rte_ring_create(name, size, rte_socket_id(), RING_F_SP_ENQ | RING_F_SC_DEQ);
+  if (ring == NULL) {
+    rte_panic("Cannot create harness ring %s\n", name);
+  }
+  return ring;
+}
+
+static void app_harness_init_ports(void) {
+  uint16_t port, n_ports = 0;
+  
+  if (rte_eth_dev_count_avail() != 0) {
+    rte_panic("The harness needs the port ids to itself, run it with --no-pci\n");
+  }
+  
+  for (port = 0; port < APP_MAX_NIC_PORTS; port++) {
+    if (app_get_nic_rx_queues_per_port(port) > 0 || app.nic_tx_port_mask[port]) {
+      n_ports = port + 1;
+    }
+  }
+  
+  // ring ports are numbered in creation order, so ports unused by --rx/--tx still get one
+  for (port = 0; port < n_ports; port++) {
+    struct rte_ring *rx[APP_MAX_RX_QUEUES_PER_NIC_PORT], *tx[APP_MAX_TX_QUEUES_PER_NIC_PORT];
+    uint32_t n_rx = app_get_nic_rx_queues_per_port(port), n_tx = app_harness_n_tx_queues(port), q;
+    char name[32];
+    int ret;
+    
+    for (q = 0; q < RTE_MAX(n_rx, 1U); q++) {
+      rx[q] = app_harness_ring("rx", port, q, app.nic_rx_ring_size);
+      if (q < n_rx) {
+        harness.rx_port[harness.n_rx] = port;
+        harness.rx[harness.n_rx++] = rx[q];
+      }
+    }
+    for (q = 0; q < RTE_MAX(n_tx, 1U); q++) {
+      tx[q] = app_harness_ring("tx", port, q, app.nic_tx_ring_size);
+      if (q < n_tx) {
+        harness.tx[harness.n_tx++] = tx[q];
+      }
+    }
+    
+    snprintf(name, sizeof(name), "harness%u", port);
+    ret = rte_eth_from_rings(name, rx, RTE_MAX(n_rx, 1U), tx, RTE_MAX(n_tx, 1U), rte_socket_id());
+    if (ret != port) {
+      rte_panic("Cannot create ring port %u (%d)\n", port, ret);
+    }
+  }
+  
+  if (harness.n_rx == 0 || harness.n_tx == 0) {
+    rte_panic("The harness needs at least one RX queue and one TX port\n");
+  }
+}
+
+static void app_harness_set_key(struct app_gen_key *key, uint32_t src_addr, uint16_t src_port, uint32_t vip_addr,
+                                uint16_t vip_port) {
+  const struct ipv4_hdr *tmpl_ip = (const struct ipv4_hdr *) (harness.tmpl + sizeof(struct ether_hdr));
+  struct ipv4_hdr ip = *tmpl_ip;
+  
+  key->src_addr = rte_cpu_to_be_32(src_addr);
+  key->dst_addr = rte_cpu_to_be_32(vip_addr);
+  key->src_port = rte_cpu_to_be_16(src_port);
+  key->dst_port = rte_cpu_to_be_16(vip_port);
+  
+  ip.src_addr = key->src_addr;
+  ip.dst_addr = key->dst_addr;
+  ip.hdr_checksum = 0;
+  key->ip_cksum = rte_ipv4_cksum(&ip);   // so DNAT patches a valid checksum. the TCP one stays 0
+}
+
+static void app_harness_init_template(void) {
+  struct ether_hdr *eth = (struct ether_hdr *) harness.tmpl;
+  struct ipv4_hdr *ip = (struct ipv4_hdr *) (eth + 1);
+  struct tcp_hdr *tcp = (struct tcp_hdr *) (ip + 1);
+  
+  memset(harness.tmpl, 0, sizeof(harness.tmpl));
+  eth->d_addr.addr_bytes[0] = 0x02;   // locally administered
+  eth->s_addr.addr_bytes[0] = 0x02;
+  eth->s_addr.addr_bytes[5] = 0x01;
+  eth->ether_type = rte_cpu_to_be_16(ETHER_TYPE_IPv4);
+  
+  ip->version_ihl = 0x45;
+  ip->total_length = rte_cpu_to_be_16(sizeof(struct ipv4_hdr) + sizeof(struct tcp_hdr));
+  ip->fragment_offset = rte_cpu_to_be_16(0x4000);   // DF
+  ip->time_to_live = 64;
+  ip->next_proto_id = 6;
+  
+  tcp->data_off = 0x50;
+  tcp->tcp_flags = 0x10;   // ACK, the flows are established
+  tcp->rx_win = rte_cpu_to_be_16(0xffff);
+}
+
+static void app_harness_init_keys(void) {
+  extern uint STO_NUM, CONN_NUM, VIP_NUM, VIP_MASK;
+  uint32_t max_keys = app.gen_trace[0] ? APP_GEN_MAX_KEYS : RTE_MIN((uint32_t) STO_NUM, (uint32_t) APP_GEN_MAX_KEYS);
+  
+  harness.keys = (struct app_gen_key *) rte_zmalloc("harness_keys", max_keys * sizeof(struct app_gen_key),
+                                                    RTE_CACHE_LINE_SIZE);
+  if (harness.keys == NULL) {
+    rte_panic("Cannot allocate %u harness keys\n", max_keys);
+  }
+  
+  if (app.gen_trace[0]) {
+    FILE *trace = fopen(app.gen_trace, "r");
+    uint32_t src_addr, vip_addr;
+    uint16_t src_port, vip_port, protocol;
+    
+    if (trace == NULL) {
+      rte_panic("Cannot open trace %s: %s\n", app.gen_trace, strerror(errno));
+    }
+    while (harness.n_keys < max_keys &&
+           fscanf(trace, "%u %hu %u %hu %hu", &src_addr, &src_port, &vip_addr, &vip_port, &protocol) == 5) {
+      app_harness_set_key(&harness.keys[harness.n_keys++], src_addr, src_port, vip_addr, vip_port);
+    }
+    fclose(trace);
+    if (harness.n_keys == 0) {
+      rte_panic("No keys in trace %s\n", app.gen_trace);
+    }
+  } else {
+    // the stream of simulateConnectionAdd, so every lookup hits a tracked connection
+    uint32_t vip_addr = 211U << 24;
+    uint16_t vip_port = 0;
+    LFSRGen<Tuple3> tuple3Gen(0xe2211, CONN_NUM, 0);
+    
+    for (; harness.n_keys < max_keys; harness.n_keys++) {
+      Tuple3 tuple;
+      tuple3Gen.gen(&tuple);
+      app_harness_set_key(&harness.keys[harness.n_keys], tuple.src.addr, tuple.src.port, vip_addr++,
+                          vip_port++ & VIP_MASK);
+      if (vip_addr >= (211U << 24) + VIP_NUM) vip_addr = 211U << 24;
+    }
+  }
+}
+
+void app_harness_init(void) {
+  uint32_t lcore;
+  
+  if (!app.harness) {
+    return;
+  }
+  
+  for (lcore = 0; lcore < APP_MAX_LCORES; lcore++) {
+    if (app.lcore_params[lcore].type == e_APP_LCORE_GEN) {
+      harness.gen_lcore = lcore;
+    }
+  }
+  
+  app_harness_init_ports();
+  app_harness_init_template();
+  app_harness_init_keys();
+  
+  printf("Harness: %u RX rings, %u TX rings, %u keys from %s\n", harness.n_rx, harness.n_tx, harness.n_keys,
+         app.gen_trace[0] ? app.gen_trace : "the LFSR stream");
+}
+
+void app_lcore_main_loop_gen(void) {
+  uint32_t lcore = rte_lcore_id();
+  struct app_tm_lcore *tm = &app_tm[lcore];
+  struct rte_mempool *pool = app.lcore_params[lcore].pool;
+  struct rte_mbuf *burst[APP_GEN_BURST];
+  uint32_t key = 0, ring = 0;
+  
+  // token bucket on the TSC, a burst at a time. 0 is unthrottled
+  double cycles_per_burst = app.gen_mpps > 0 ? rte_get_tsc_hz() * APP_GEN_BURST / (app.gen_mpps * 1e6) : 0;
+  double next = (double) rte_rdtsc();
+  
+  for (;;) {
+    uint64_t now = rte_rdtsc();
+    if (cycles_per_burst > 0) {
+      if (now < next) {
+        continue;
+      }
+      next += cycles_per_burst;
+      if (next < now) {   // fell behind, do not make up for it with a burst of bursts
+        next = (double) now;
+      }
+    }
+    
+    if (unlikely(rte_pktmbuf_alloc_bulk(pool, burst, APP_GEN_BURST) != 0)) {
+      continue;   // the data path holds the whole pool, it is the bottleneck
+    }
+    
+    uint16_t port = harness.rx_port[ring];
+    for (uint32_t i = 0; i < APP_GEN_BURST; i++) {
+      struct rte_mbuf *m = burst[i];
+      const struct app_gen_key *k = &harness.keys[key];
+      uint8_t *data = rte_pktmbuf_mtod(m, uint8_t *);
+      
+      if (++key == harness.n_keys) {
+        key = 0;
+      }
+      rte_memcpy(data, harness.tmpl, sizeof(harness.tmpl));
+      struct ipv4_hdr *ip = (struct ipv4_hdr *) (data + sizeof(struct ether_hdr));
+      struct tcp_hdr *tcp = (struct tcp_hdr *) (ip + 1);
+      ip->src_addr = k->src_addr;
+      ip->dst_addr = k->dst_addr;
+      ip->hdr_checksum = k->ip_cksum;
+      tcp->src_port = k->src_port;
+      tcp->dst_port = k->dst_port;
+      
+      m->data_len = APP_HARNESS_PKT_LEN;
+      m->pkt_len = APP_HARNESS_PKT_LEN;
+      m->port = port;   // the ring PMD leaves it alone
+      m->udata64 = now;
+    }
+    
+    uint32_t n = rte_ring_sp_enqueue_burst(harness.rx[ring], (void **) burst, APP_GEN_BURST, NULL);
+    APP_TM_ADD(tm, ring_enq, 1);
+    APP_TM_ADD(tm, tx_pkts, n);
+    if (unlikely(n < APP_GEN_BURST)) {
+      APP_TM_ADD(tm, ring_full, 1);
+      APP_TM_ADD(tm, ring_full_drops, APP_GEN_BURST - n);
+      for (uint32_t i = n; i < APP_GEN_BURST; i++) {
+        rte_pktmbuf_free(burst[i]);
+      }
+    }
+    
+    if (++ring == harness.n_rx) {
+      ring = 0;
+    }
+  }
+}
+
+static inline uint32_t app_lat_bucket(uint64_t cycles) {
+  if (cycles < (1 << APP_LAT_SUB_BITS)) {
+    return (uint32_t) cycles;
+  }
+  uint32_t msb = 63 - __builtin_clzll(cycles);
+  return ((msb - APP_LAT_SUB_BITS + 1) << APP_LAT_SUB_BITS) +
+         (uint32_t) ((cycles >> (msb - APP_LAT_SUB_BITS)) & ((1 << APP_LAT_SUB_BITS) - 1));
+}
+
+static inline uint64_t app_lat_bucket_floor(uint32_t bucket) {
+  if (bucket < (1 << APP_LAT_SUB_BITS)) {
+    return bucket;
+  }
+  uint32_t msb = (bucket >> APP_LAT_SUB_BITS) - 1 + APP_LAT_SUB_BITS;
+  return ((uint64_t) (1 << APP_LAT_SUB_BITS) + (bucket & ((1 << APP_LAT_SUB_BITS) - 1))) << (msb - APP_LAT_SUB_BITS);
+}
+
+static uint64_t app_lat_percentile(const struct app_lat_hist *h, double p) {
+  uint64_t target = (uint64_t) (h->count * p), seen = 0;
+  for (uint32_t b = 0; b < APP_LAT_BUCKETS; b++) {
+    seen += h->buckets[b];
+    if (seen > target) {
+      return app_lat_bucket_floor(b);
+    }
+  }
+  return h->max;
+}
+
+void app_lcore_main_loop_sink(void) {
+  uint32_t lcore = rte_lcore_id();
+  struct app_tm_lcore *tm = &app_tm[lcore];
+  const struct app_tm_lcore *gen = &app_tm[harness.gen_lcore];
+  struct rte_mbuf *burst[APP_GEN_BURST];
+  uint64_t hz = rte_get_tsc_hz();
+  double us = 1e6 / hz;
+  
+  static struct app_lat_hist hist;   // 4KB, off the lcore stack
+  uint64_t last = rte_rdtsc(), last_rx = 0, last_offered = 0, last_drops = 0, rx = 0;
+  
+  for (;;) {
+    for (uint32_t r = 0; r < harness.n_tx; r++) {
+      uint32_t n = rte_ring_sc_dequeue_burst(harness.tx[r], (void **) burst, APP_GEN_BURST, NULL);
+      if (n == 0) {
+        continue;
+      }
+      
+      uint64_t now = rte_rdtsc();
+      for (uint32_t i = 0; i < n; i++) {
+        uint64_t lat = now - burst[i]->udata64;
+        hist.buckets[app_lat_bucket(lat)]++;
+        hist.sum += lat;
+        hist.max = RTE_MAX(hist.max, lat);
+        rte_pktmbuf_free(burst[i]);
+      }
+      hist.count += n;
+      rx += n;
+      APP_TM_ADD(tm, rx_pkts, n);
+      APP_TM_ADD(tm, rx_bursts, 1);
+    }
+    
+    uint64_t now = rte_rdtsc();
+    if (now - last < hz) {
+      continue;
+    }
+    
+    // the generator's counters are read racily, the same as the telemetry export does
+    double secs = (double) (now - last) / hz;
+    uint64_t offered = gen->tx_pkts + gen->ring_full_drops, drops = gen->ring_full_drops;
+    printf("harness: rx %.3f Mpps  offered %.3f Mpps  injection drops %.0f/s  latency us: avg %.2f  p50 %.2f  "
+           "p99 %.2f  max %.2f\n", (rx - last_rx) / secs / 1e6, (offered - last_offered) / secs / 1e6,
+           (drops - last_drops) / secs, hist.count ? (double) hist.sum / hist.count * us : 0.0,
+           app_lat_percentile(&hist, 0.5) * us, app_lat_percentile(&hist, 0.99) * us, hist.max * us);
+    fflush(stdout);
+    
+    memset(&hist, 0, sizeof(hist));
+    last = now;
+    last_rx = rx;
+    last_offered = offered;
+    last_drops = drops;
+  }
+}
@@ -12,6 +12,29 @@
 #include <iostream>
 #include "farmhash.h"
 
+//! \brief Marks a key type as fixed width: a POD whose size is a multiple of 8 bytes and whose padding is always zero.
+//! Such keys skip the generic byte-length switch and are hashed word by word by hashWords.
+template<class K>
+struct FixedWidthKey : std::false_type {
+};
+
+//! \brief 64x64->128 multiply folded to 64 bits.
+inline uint64_t mum64(uint64_t a, uint64_t b) {
+  __uint128_t r = (__uint128_t) a * b;
+  return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
+
+//! \brief Hashes exactly W 64-bit words. The loop is fully unrolled for the widths used by the keys (1..4).
+//! Multiply based rather than CRC based, so two seeds give two independent hashes as Othello requires.
+template<int W>
+inline uint64_t hashWords(const uint64_t *k, uint64_t seed) {
+  uint64_t h = seed ^ 0xa0761d6478bd642fULL;
+  for (int i = 0; i < W; i++) {
+    h = mum64(k[i] ^ 0xe7037ed1a0b428dbULL, h ^ 0x8ebc6af09c88c6e3ULL);
+  }
+  return mum64(h ^ 0x589965cc75374cc3ULL, (W * 8) ^ seed);
+}
+
 //! \brief A hash function that hashes keyType to uint32_t. When SSE4.2 support is found, use sse4.2 instructions, otherwise use default hash function  std::hash.
 template<class K>
 class Hasher32 {
@@ -57,6 +80,9 @@ public:
   
   inline uint32_t operator()(const K &k0) const {
     static_assert(sizeof(K) <= 32, "K length should be 32/64/96/128/160/192/224/256 bits");
+    if (FixedWidthKey<K>::value) {
+      return (uint32_t) hashWords<sizeof(K) / 8>((const uint64_t *) &k0, s);
+    }
     
     uint32_t crc1 = ~0;
     const uint64_t *base = getBase<K>(k0);
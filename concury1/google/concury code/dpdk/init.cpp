@@ -365,6 +365,9 @@ static void app_init_nics(void) {
     
     n_rx_queues = app_get_nic_rx_queues_per_port(port);     // actually no doc is about the packet distribution of packets into queues. so always use one queue at one port. It is specified from the command line
     n_tx_queues = app.nic_tx_port_mask[port];  // 0 or 1. always single queue for tx
+    if (app.rtc && n_tx_queues) {
+      n_tx_queues = app_get_lcores_rtc();      // run-to-completion: one tx queue per lcore, so no lock on tx
+    }
     
     if ((n_rx_queues == 0) && (n_tx_queues == 0)) {
       continue;
@@ -379,7 +382,15 @@ static void app_init_nics(void) {
       local_port_conf.txmode.offloads |= DEV_TX_OFFLOAD_MBUF_FAST_FREE;
     }
     
+    // encapsulation writes a fresh outer header. let the nic checksum it when it can, software otherwise
+    if ((app.fwd_mode == e_APP_FWD_IPIP || app.fwd_mode == e_APP_FWD_GUE) &&
+        (dev_info.tx_offload_capa & DEV_TX_OFFLOAD_IPV4_CKSUM)) {
+      local_port_conf.txmode.offloads |= DEV_TX_OFFLOAD_IPV4_CKSUM;
+      app.nic_tx_ip_cksum[port] = 1;
+    }
+    
     local_port_conf.rx_adv_conf.rss_conf.rss_hf &= dev_info.flow_type_rss_offloads;
+    local_port_conf.rxmode.offloads &= dev_info.rx_offload_capa;   // e.g. no checksum offload on ring ports
     
     if (local_port_conf.rx_adv_conf.rss_conf.rss_hf != port_conf.rx_adv_conf.rss_conf.rss_hf) {
       printf("Port %u modified RSS hash function based on hardware support,"
@@ -424,7 +435,21 @@ static void app_init_nics(void) {
     /* Init TX queues */
     txq_conf = dev_info.default_txconf;
     txq_conf.offloads = local_port_conf.txmode.offloads;
-    if (app.nic_tx_port_mask[port] == 1) {
+    if (app.rtc && app.nic_tx_port_mask[port] == 1) {
+      for (lcore = 0; lcore < APP_MAX_LCORES; lcore++) {
+        if (app.lcore_params[lcore].type != e_APP_LCORE_RTC) {
+          continue;
+        }
+        
+        queue = (uint8_t) app.lcore_params[lcore].rtc.tx_queue;
+        socket = rte_lcore_to_socket_id(lcore);
+        printf("Initializing NIC port %u TX queue %u ...\n", port, queue);
+        ret = rte_eth_tx_queue_setup(port, queue, (uint16_t) app.nic_tx_ring_size, socket, &txq_conf);
+        if (ret < 0) {
+          rte_panic("Cannot init TX queue %u for port %d (%d)\n", queue, port, ret);
+        }
+      }
+    } else if (app.nic_tx_port_mask[port] == 1) {
       app_get_lcore_for_nic_tx(port, &lcore);
       socket = rte_lcore_to_socket_id(lcore);
       printf("Initializing NIC port %u TX queue 0 ...\n", port);
@@ -452,7 +477,9 @@ void app_init(void) {
   app_init_lpm_tables();
   app_init_rings_rx();
   app_init_rings_tx();
+  app_harness_init();
   app_init_nics();
+  app_telemetry_init();
   
   extInit();
   
@@ -195,6 +195,50 @@
 #error "APP_DEFAULT_BURST_SIZE_WORKER_WRITE is too big"
 #endif
 
+/* Worker batches: packets of a burst are prefetched and looked up this many at a time */
+#ifndef APP_DEFAULT_WORKER_BATCH_SIZE
+#define APP_DEFAULT_WORKER_BATCH_SIZE  24
+#endif
+#if (APP_DEFAULT_WORKER_BATCH_SIZE > APP_MBUF_ARRAY_SIZE)
+#error "APP_DEFAULT_WORKER_BATCH_SIZE is too big"
+#endif
+
+/* lower bound of the adaptive batch size */
+#ifndef APP_WORKER_BATCH_MIN
+#define APP_WORKER_BATCH_MIN  4
+#endif
+
+/* Forwarding stage: outer header of the IPIP/GUE encapsulation */
+#ifndef APP_DEFAULT_TUNNEL_SRC
+#define APP_DEFAULT_TUNNEL_SRC  0x0a000001    // 10.0.0.1
+#endif
+
+#ifndef APP_DEFAULT_GUE_PORT
+#define APP_DEFAULT_GUE_PORT    6080
+#endif
+
+/* Control channel, see ctl_proto.h */
+#ifndef APP_DEFAULT_CTL_SOCK
+#define APP_DEFAULT_CTL_SOCK    "/tmp/concury.sock"
+#endif
+
+#ifndef APP_CTL_SOCK_PATH_MAX
+#define APP_CTL_SOCK_PATH_MAX   108     // sun_path
+#endif
+
+/* NIC-free harness, see harness.cpp */
+#ifndef APP_GEN_MAX_KEYS
+#define APP_GEN_MAX_KEYS        (1 << 20)   // the generator cycles through at most this many keys
+#endif
+
+#ifndef APP_GEN_BURST
+#define APP_GEN_BURST           32
+#endif
+
+#ifndef APP_GEN_TRACE_PATH_MAX
+#define APP_GEN_TRACE_PATH_MAX  256
+#endif
+
 /* Load balancing logic */
 #ifndef APP_DEFAULT_IO_RX_LB_POS
 #define APP_DEFAULT_IO_RX_LB_POS 29
@@ -206,6 +250,8 @@
 #include <inttypes.h>
 #include <rte_config.h>
 
+#include "telemetry.h"
+
 struct app_mbuf_array {
   struct rte_mbuf *array[APP_MBUF_ARRAY_SIZE];
   uint64_t hashes[APP_MBUF_ARRAY_SIZE];
@@ -215,7 +261,19 @@ struct app_mbuf_array {
 enum app_lcore_type {
   e_APP_LCORE_DISABLED = 0,
   e_APP_LCORE_IO,
-  e_APP_LCORE_WORKER
+  e_APP_LCORE_WORKER,
+  e_APP_LCORE_RTC,
+  e_APP_LCORE_CTL,
+  e_APP_LCORE_GEN,      // harness: traffic into the ring ports
+  e_APP_LCORE_SINK      // harness: traffic out of them
+};
+
+/* what the forwarding stage does to a packet after the lookup, see rewrite.h */
+enum app_fwd_mode {
+  e_APP_FWD_NONE = 0,   // send back unmodified
+  e_APP_FWD_DNAT,
+  e_APP_FWD_IPIP,
+  e_APP_FWD_GUE
 };
 
 struct app_lcore_params_io {
@@ -237,12 +295,6 @@ struct app_lcore_params_io {
     /* buffer from io thread to worker. the reason for this is to even the loads between workers */
     struct app_mbuf_array mbuf_out[APP_MAX_WORKER_LCORES];
     uint8_t mbuf_out_flush[APP_MAX_WORKER_LCORES];
-    
-    /* Stats */
-    uint32_t nic_queues_count[APP_MAX_NIC_RX_QUEUES_PER_IO_LCORE];
-    uint32_t nic_queues_iters[APP_MAX_NIC_RX_QUEUES_PER_IO_LCORE];
-    uint32_t rings_count[APP_MAX_WORKER_LCORES];
-    uint32_t rings_iters[APP_MAX_WORKER_LCORES];
   } rx;
   
   /* I/O TX */
@@ -257,13 +309,10 @@ struct app_lcore_params_io {
     /* Internal buffers */
     struct app_mbuf_array mbuf_out[APP_MAX_NIC_TX_PORTS_PER_IO_LCORE];
     uint8_t mbuf_out_flush[APP_MAX_NIC_TX_PORTS_PER_IO_LCORE];
-    
-    /* Stats */
-    uint32_t rings_count[APP_MAX_NIC_PORTS][APP_MAX_WORKER_LCORES];
-    uint32_t rings_iters[APP_MAX_NIC_PORTS][APP_MAX_WORKER_LCORES];
-    uint32_t nic_ports_count[APP_MAX_NIC_TX_PORTS_PER_IO_LCORE];
-    uint32_t nic_ports_iters[APP_MAX_NIC_TX_PORTS_PER_IO_LCORE];
   } tx;
+  
+  /* Telemetry, this lcore's entry of app_tm */
+  struct app_tm_lcore *tm;
 };
 
 struct app_lcore_params_worker {
@@ -281,17 +330,42 @@ struct app_lcore_params_worker {
   struct app_mbuf_array mbuf_out[APP_MAX_NIC_PORTS];
   uint8_t mbuf_out_flush[APP_MAX_NIC_PORTS];
   
-  /* Stats */
-  uint32_t rings_in_count[APP_MAX_IO_LCORES];
-  uint32_t rings_in_iters[APP_MAX_IO_LCORES];
-  uint32_t rings_out_count[APP_MAX_NIC_PORTS];
-  uint32_t rings_out_iters[APP_MAX_NIC_PORTS];
+  /* Scratch for one burst, allocated once with the lcore params */
+  uint8_t *packets[APP_MBUF_ARRAY_SIZE];
+  uint32_t out_ports[APP_MBUF_ARRAY_SIZE];
+  struct DIP *dips[APP_MBUF_ARRAY_SIZE];
+  uint32_t batch_size;
+  
+  /* Telemetry, this lcore's entry of app_tm */
+  struct app_tm_lcore *tm;
+};
+
+/* run-to-completion: the lcore polls its own RSS queues, looks the packets up and transmits them itself */
+struct app_lcore_params_rtc {
+  /* NIC RX queues, taken over from --rx */
+  struct {
+    uint16_t port;
+    uint8_t queue;
+  } nic_queues[APP_MAX_NIC_RX_QUEUES_PER_IO_LCORE];
+  uint32_t n_nic_queues;
+  
+  /* the TX queue owned by this lcore. the same queue id is used on every TX port */
+  uint16_t tx_queue;
+  
+  /* Internal buffers. packets go back on the input port, so the burst is transmitted from mbuf_in as is */
+  struct app_mbuf_array mbuf_in;
+  uint8_t *packets[APP_MBUF_ARRAY_SIZE];
+  struct DIP *dips[APP_MBUF_ARRAY_SIZE];
+  
+  /* Telemetry, this lcore's entry of app_tm */
+  struct app_tm_lcore *tm;
 };
 
 struct app_lcore_params {
   union {
     struct app_lcore_params_io io;
     struct app_lcore_params_worker worker;
+    struct app_lcore_params_rtc rtc;
   };
   enum app_lcore_type type;
   struct rte_mempool *pool;
@@ -333,11 +407,39 @@ struct app_params {
   uint32_t burst_size_worker_read;
   uint32_t burst_size_worker_write;
   
+  /* worker batch size, and whether it follows the input ring occupancy */
+  uint32_t worker_batch_size;
+  uint8_t worker_batch_adaptive;
+  
   /* for load balancing
    * The position of the 1-byte field within the input packet used by the I/O RX lcores to identify the worker lcore for the current packet.
    * */
   uint8_t pos_lb;
   uint32_t ratio;
+  
+  /* run-to-completion mode, see app_lcore_params_rtc */
+  uint8_t rtc;
+  
+  /* dual stack: IPv6 packets are parsed and looked up in their own Tuple3v6 tables */
+  uint8_t v6;
+  
+  /* forwarding stage */
+  uint8_t fwd_mode;
+  uint32_t tunnel_src;
+  uint16_t gue_port;
+  uint8_t nic_tx_ip_cksum[APP_MAX_NIC_PORTS];   // the PMD computes the outer IPv4 checksum
+  
+  /* control channel, served by the e_APP_LCORE_CTL lcore if there is one */
+  char ctl_sock[APP_CTL_SOCK_PATH_MAX];
+  
+  /* telemetry export, see telemetry.h. interval 0 turns it off */
+  uint32_t telemetry_ms;
+  char telemetry_shm[APP_TM_SHM_NAME_MAX];
+  
+  /* NIC-free harness, on with a generator lcore */
+  uint8_t harness;
+  double gen_mpps;                            // 0: as fast as the rings take it
+  char gen_trace[APP_GEN_TRACE_PATH_MAX];     // empty: the LFSR key stream
 } __rte_cache_aligned;
 
 extern struct app_params app;
@@ -363,6 +465,24 @@ uint32_t app_get_lcores_io_rx(void);
 
 uint32_t app_get_lcores_worker(void);
 
+uint32_t app_get_lcores_rtc(void);
+
+void app_lcore_main_loop_ctl(void);
+
+/* implemented by the load balancer: apply the ops of one control request in order, returns how many were applied */
+uint16_t app_ctl_apply(const struct app_ctl_op *ops, uint16_t n_ops);
+
+/* publish everything applied since the last commit to the workers and reclaim what it replaced.
+ * returns the TSC cycles spent waiting for the grace period */
+uint64_t app_ctl_commit(void);
+
+/* NIC-free harness: ring ports in place of the NICs, created before app_init_nics configures them */
+void app_harness_init(void);
+
+void app_lcore_main_loop_gen(void);
+
+void app_lcore_main_loop_sink(void);
+
 void app_print_params(void);
 
 #endif /* _MAIN_H_ */
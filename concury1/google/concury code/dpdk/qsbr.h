@@ -0,0 +1,52 @@
+#pragma once
+
+#include <rte_common.h>
+#include <rte_atomic.h>
+#include <rte_pause.h>
+
+#include "main.h"
+
+/**
+ * Quiescent-state based reclamation of the published data plane versions. Same scheme as rte_rcu_qsbr, which
+ * only exists from DPDK 19.05 on.
+ *
+ * A reader lcore reports a quiescent state between two bursts, when it holds no pointer into a published version.
+ * The writer publishes, bumps the token and waits until every online reader has reported a token at least that new.
+ * After that no reader can still be using a version that was replaced before the bump.
+ */
+
+struct app_qsbr_cnt {
+  volatile uint64_t cnt;    // last token seen, 0 while offline
+} __rte_cache_aligned;
+
+struct app_qsbr {
+  volatile uint64_t token;
+  struct app_qsbr_cnt lcores[APP_MAX_LCORES];
+} __rte_cache_aligned;
+
+extern struct app_qsbr app_qsbr;
+
+static inline void app_qsbr_online(struct app_qsbr *q, uint32_t lcore) {
+  __atomic_store_n(&q->lcores[lcore].cnt, __atomic_load_n(&q->token, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+  rte_smp_mb();   // visible before the first read of a published pointer
+}
+
+static inline void app_qsbr_offline(struct app_qsbr *q, uint32_t lcore) {
+  __atomic_store_n(&q->lcores[lcore].cnt, 0, __ATOMIC_RELEASE);
+}
+
+static inline void app_qsbr_quiescent(struct app_qsbr *q, uint32_t lcore) {
+  __atomic_store_n(&q->lcores[lcore].cnt, __atomic_load_n(&q->token, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
+
+// writer side. returns immediately when no reader is online, e.g. during initialization
+static inline void app_qsbr_synchronize(struct app_qsbr *q) {
+  uint64_t t = __atomic_add_fetch(&q->token, 1, __ATOMIC_SEQ_CST);
+  
+  for (uint32_t lcore = 0; lcore < APP_MAX_LCORES; lcore++) {
+    uint64_t c;
+    while ((c = __atomic_load_n(&q->lcores[lcore].cnt, __ATOMIC_ACQUIRE)) != 0 && c < t) {
+      rte_pause();
+    }
+  }
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <rte_mbuf.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_tcp.h>
+#include <rte_udp.h>
+
+#include "main.h"
+#include "common.h"
+
+/**
+ * Forwarding stage: rewrite a looked-up packet toward its DIP.
+ *
+ * DNAT rewrites the destination address and port in place and patches the IP and TCP checksums incrementally.
+ * IPIP and GUE prepend the outer headers into the mbuf headroom, the payload is never copied.
+ * The outer IP checksum is left to the NIC when the PMD advertises DEV_TX_OFFLOAD_IPV4_CKSUM.
+ *
+ * assuming IPv4/TCP without IP options or IPv6/TCP without extension headers, the same as the parser.
+ * the DIPs are IPv4, so an IPv6 packet is only tunnelled (6in4 or GUE), DNAT leaves it alone.
+ */
+
+#define APP_IPPROTO_IPIP        4
+#define APP_IPPROTO_UDP         17
+#define APP_IPPROTO_IPV6        41
+
+struct app_gue_hdr {   // GUE variant 0, no optional fields
+  uint8_t ver_c_hlen;
+  uint8_t proto_ctype;
+  uint16_t flags;
+} __attribute__((__packed__));
+
+// RFC 1624: HC' = ~(~HC + ~m + m'). all values as stored in the packet
+static inline uint16_t app_cksum_adjust16(uint16_t cksum, uint16_t old_val, uint16_t new_val) {
+  uint32_t sum = (uint16_t) ~cksum + (uint16_t) ~old_val + new_val;
+  sum = (sum & 0xffff) + (sum >> 16);
+  sum = (sum & 0xffff) + (sum >> 16);
+  return (uint16_t) ~sum;
+}
+
+static inline uint16_t app_cksum_adjust32(uint16_t cksum, uint32_t old_val, uint32_t new_val) {
+  cksum = app_cksum_adjust16(cksum, (uint16_t) (old_val >> 16), (uint16_t) (new_val >> 16));
+  return app_cksum_adjust16(cksum, (uint16_t) old_val, (uint16_t) new_val);
+}
+
+static inline void app_set_ip_cksum(struct rte_mbuf *m, struct ipv4_hdr *ip, uint8_t hw_cksum) {
+  ip->hdr_checksum = 0;
+  if (hw_cksum) {
+    m->l2_len = sizeof(struct ether_hdr);
+    m->l3_len = sizeof(struct ipv4_hdr);
+    m->ol_flags |= PKT_TX_IPV4 | PKT_TX_IP_CKSUM;
+  } else {
+    ip->hdr_checksum = rte_ipv4_cksum(ip);
+  }
+}
+
+static inline uint8_t app_is_ipv6(const struct ether_hdr *eth) {
+  return eth->ether_type == rte_cpu_to_be_16(ETHER_TYPE_IPv6);
+}
+
+static inline void app_rewrite_dnat(struct rte_mbuf *m, const DIP *dip) {
+  if (unlikely(app_is_ipv6(rte_pktmbuf_mtod(m, struct ether_hdr *)))) {
+    return;
+  }
+  struct ipv4_hdr *ip = rte_pktmbuf_mtod_offset(m, struct ipv4_hdr *, sizeof(struct ether_hdr));
+  struct tcp_hdr *tcp = (struct tcp_hdr *) (ip + 1);
+  uint32_t new_addr = rte_cpu_to_be_32(dip->addr.addr);
+  uint16_t new_port = rte_cpu_to_be_16(dip->addr.port);
+  
+  // the address is in the pseudo header, so both checksums change with it
+  uint16_t tcp_cksum = app_cksum_adjust32(tcp->cksum, ip->dst_addr, new_addr);
+  tcp->cksum = app_cksum_adjust16(tcp_cksum, tcp->dst_port, new_port);
+  ip->hdr_checksum = app_cksum_adjust32(ip->hdr_checksum, ip->dst_addr, new_addr);
+  
+  ip->dst_addr = new_addr;
+  tcp->dst_port = new_port;
+}
+
+// prepend an outer IPv4 header (and whatever follows it, hdr_len bytes in total) in front of the inner one.
+// returns the outer header, or nullptr if the headroom is exhausted
+static inline struct ipv4_hdr *app_encap_ipv4(struct rte_mbuf *m, const DIP *dip, uint16_t hdr_len, uint8_t proto) {
+  struct ether_hdr *eth_in = rte_pktmbuf_mtod(m, struct ether_hdr *);
+  uint16_t inner_len;
+  uint8_t tos;
+  if (unlikely(app_is_ipv6(eth_in))) {
+    struct ipv6_hdr *inner = (struct ipv6_hdr *) (eth_in + 1);
+    inner_len = rte_be_to_cpu_16(inner->payload_len) + sizeof(struct ipv6_hdr);
+    tos = (uint8_t) (rte_be_to_cpu_32(inner->vtc_flow) >> 20);
+  } else {
+    struct ipv4_hdr *inner = (struct ipv4_hdr *) (eth_in + 1);
+    inner_len = rte_be_to_cpu_16(inner->total_length);
+    tos = inner->type_of_service;
+  }
+  
+  struct ether_hdr *eth = (struct ether_hdr *) rte_pktmbuf_prepend(m, hdr_len);
+  if (unlikely(eth == nullptr)) {
+    return nullptr;
+  }
+  *eth = *eth_in;   // only the 14B L2 header moves
+  eth->ether_type = rte_cpu_to_be_16(ETHER_TYPE_IPv4);
+  
+  struct ipv4_hdr *outer = (struct ipv4_hdr *) (eth + 1);
+  outer->version_ihl = 0x45;
+  outer->type_of_service = tos;
+  outer->total_length = rte_cpu_to_be_16(inner_len + hdr_len);
+  outer->packet_id = 0;
+  outer->fragment_offset = rte_cpu_to_be_16(0x4000);   // DF
+  outer->time_to_live = 64;
+  outer->next_proto_id = proto;
+  outer->src_addr = rte_cpu_to_be_32(app.tunnel_src);
+  outer->dst_addr = rte_cpu_to_be_32(dip->addr.addr);
+  return outer;
+}
+
+static inline void app_encap_ipip(struct rte_mbuf *m, const DIP *dip, uint8_t hw_cksum) {
+  uint8_t proto = app_is_ipv6(rte_pktmbuf_mtod(m, struct ether_hdr *)) ? APP_IPPROTO_IPV6 : APP_IPPROTO_IPIP;
+  struct ipv4_hdr *outer = app_encap_ipv4(m, dip, sizeof(struct ipv4_hdr), proto);
+  if (likely(outer != nullptr)) {
+    app_set_ip_cksum(m, outer, hw_cksum);
+  }
+}
+
+static inline void app_encap_gue(struct rte_mbuf *m, const DIP *dip, uint8_t hw_cksum) {
+  const uint16_t hdr_len = sizeof(struct ipv4_hdr) + sizeof(struct udp_hdr) + sizeof(struct app_gue_hdr);
+  
+  // flow entropy in the source port, so the DIP side can RSS on the outer header
+  struct ether_hdr *eth_in = rte_pktmbuf_mtod(m, struct ether_hdr *);
+  uint8_t inner_proto;
+  uint32_t src;
+  struct tcp_hdr *tcp;
+  if (unlikely(app_is_ipv6(eth_in))) {
+    struct ipv6_hdr *inner = (struct ipv6_hdr *) (eth_in + 1);
+    uint32_t words[4];
+    memcpy(words, inner->src_addr, sizeof(words));
+    src = words[0] ^ words[1] ^ words[2] ^ words[3];
+    tcp = (struct tcp_hdr *) (inner + 1);
+    inner_proto = APP_IPPROTO_IPV6;
+  } else {
+    struct ipv4_hdr *inner = (struct ipv4_hdr *) (eth_in + 1);
+    src = inner->src_addr;
+    tcp = (struct tcp_hdr *) (inner + 1);
+    inner_proto = APP_IPPROTO_IPIP;
+  }
+  uint16_t entropy = (uint16_t) (src ^ (src >> 16) ^ tcp->src_port) | rte_cpu_to_be_16(0xc000);
+  
+  struct ipv4_hdr *outer = app_encap_ipv4(m, dip, hdr_len, APP_IPPROTO_UDP);
+  if (unlikely(outer == nullptr)) {
+    return;
+  }
+  
+  struct udp_hdr *udp = (struct udp_hdr *) (outer + 1);
+  struct app_gue_hdr *gue = (struct app_gue_hdr *) (udp + 1);
+  
+  udp->src_port = entropy;
+  udp->dst_port = rte_cpu_to_be_16(app.gue_port);
+  udp->dgram_len = rte_cpu_to_be_16(rte_be_to_cpu_16(outer->total_length) - sizeof(struct ipv4_hdr));
+  udp->dgram_cksum = 0;   // optional over IPv4
+  
+  gue->ver_c_hlen = 0;
+  gue->proto_ctype = inner_proto;
+  gue->flags = 0;
+  
+  app_set_ip_cksum(m, outer, hw_cksum);
+}
+
+static inline void app_rewrite(struct rte_mbuf *m, const DIP *dip, uint8_t fwd_mode) {
+  if (unlikely(dip == nullptr)) {   // the VIP is down, nothing to rewrite to
+    return;
+  }
+  
+  switch (fwd_mode) {
+    case e_APP_FWD_DNAT:
+      app_rewrite_dnat(m, dip);
+      break;
+    case e_APP_FWD_IPIP:
+      app_encap_ipip(m, dip, app.nic_tx_ip_cksum[m->port]);
+      break;
+    case e_APP_FWD_GUE:
+      app_encap_gue(m, dip, app.nic_tx_ip_cksum[m->port]);
+      break;
+    default:
+      break;
+  }
+}
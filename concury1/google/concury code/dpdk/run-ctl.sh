@@ -0,0 +1,4 @@
+#!/usr/bin/env bash
+# run-to-completion on lcores 0-7, lcore 8 serves live VIP/DIP updates on /tmp/concury.sock
+# drive it from another shell: g++ -O2 -o build/ctl_client ctl_client.cpp && ./build/ctl_client -b 16 -m churn
+make -j8 && ./build/dpdk -l 0-8 -n 4 "${@:2}" -- --rx "(0,0,0),(0,1,1),(0,2,2),(0,3,3),(0,4,4),(0,5,5),(0,6,6),(0,7,7)" --rtc --ctl 8 --Nk $1
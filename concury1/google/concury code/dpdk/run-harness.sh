@@ -0,0 +1,6 @@
+#!/usr/bin/env bash
+# NIC-free: port 0 is a ring port, lcore 1 generates into its 4 RSS queues, lcores 0,2,3,4 forward run-to-completion
+# and lcore 5 drains the TX rings and prints rate and latency. the same command line for both data paths:
+# ./run-harness.sh concury|maglev CONN_NUM [EAL args]
+cd "$(dirname "$0")" && [ "$1" == maglev ] && cd cuckoolb
+make -j8 && ./build/dpdk -l 0-5 -n 4 --no-pci "${@:3}" -- --rx "(0,0,0),(0,1,2),(0,2,3),(0,3,4)" --rtc --gen 1 --sink 5 --Nk $2
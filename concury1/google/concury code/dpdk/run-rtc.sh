@@ -0,0 +1,4 @@
+#!/usr/bin/env bash
+# run-to-completion: every lcore owns one RSS queue of port 0 and one TX queue, no worker lcores
+# without a NIC, pass null/ring vdevs to EAL, e.g. ./run-rtc.sh 1000000 --vdev=net_null0
+make -j8 && ./build/dpdk -l 0-7 -n 4 "${@:2}" -- --rx "(0,0,0),(0,1,1),(0,2,2),(0,3,3),(0,4,4),(0,5,5),(0,6,6),(0,7,7)" --rtc --Nk $1
@@ -0,0 +1,110 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include <rte_common.h>
+#include <rte_atomic.h>
+#include <rte_cycles.h>
+#include <rte_debug.h>
+#include <rte_lcore.h>
+#include <rte_ethdev.h>
+
+#include "main.h"
+#include "telemetry.h"
+
+/**
+ * Telemetry export: a control thread (not an lcore) snapshots app_tm and the NIC counters into shared memory.
+ *
+ * The copy races with the lcores incrementing their counters. That is fine: each counter is an aligned 64-bit word,
+ * so it is read whole, and a snapshot is a few increments behind at worst. The sequence lock only keeps the reader
+ * from mixing two snapshots.
+ */
+
+static_assert(APP_MAX_LCORES <= APP_TM_MAX_LCORES, "APP_TM_MAX_LCORES is too small");
+static_assert(sizeof(struct app_tm_lcore) % APP_TM_CACHE_LINE == 0, "app_tm_lcore shares a cache line");
+
+struct app_tm_lcore app_tm[APP_TM_MAX_LCORES];
+
+static struct app_tm_region *app_tm_region;
+
+static void app_telemetry_snapshot(struct app_tm_region *r) {
+  r->seq++;
+  rte_smp_wmb();
+  
+  r->tsc = rte_rdtsc();
+  for (uint16_t port = 0; port < r->n_ports; port++) {
+    struct rte_eth_stats stats;
+    if (rte_eth_stats_get(port, &stats) != 0) {
+      continue;
+    }
+    r->ports[port].ipackets = stats.ipackets;
+    r->ports[port].opackets = stats.opackets;
+    r->ports[port].imissed = stats.imissed;
+    r->ports[port].ierrors = stats.ierrors;
+    r->ports[port].oerrors = stats.oerrors;
+    r->ports[port].rx_nombuf = stats.rx_nombuf;
+  }
+  
+  // word by word, so no counter is torn by a wider copy
+  const volatile uint64_t *src = (const volatile uint64_t *) app_tm;
+  uint64_t *dst = (uint64_t *) r->lcores;
+  for (size_t i = 0; i < sizeof(app_tm) / sizeof(uint64_t); i++) {
+    dst[i] = src[i];
+  }
+  
+  rte_smp_wmb();
+  r->seq++;
+}
+
+static void *app_telemetry_main(void *arg) {
+  struct app_tm_region *r = (struct app_tm_region *) arg;
+  
+  for (;;) {
+    usleep(r->interval_ms * 1000);
+    app_telemetry_snapshot(r);
+  }
+  return NULL;
+}
+
+void app_telemetry_init(void) {
+  pthread_t tid;
+  int fd, ret;
+  
+  if (app.telemetry_ms == 0) {
+    return;
+  }
+  
+  fd = shm_open(app.telemetry_shm, O_CREAT | O_RDWR, 0644);
+  if (fd < 0 || ftruncate(fd, sizeof(struct app_tm_region)) < 0) {
+    rte_panic("Cannot create telemetry region %s: %s\n", app.telemetry_shm, strerror(errno));
+  }
+  app_tm_region = (struct app_tm_region *) mmap(NULL, sizeof(struct app_tm_region), PROT_READ | PROT_WRITE,
+                                                MAP_SHARED, fd, 0);
+  close(fd);
+  if (app_tm_region == MAP_FAILED) {
+    rte_panic("Cannot map telemetry region %s: %s\n", app.telemetry_shm, strerror(errno));
+  }
+  
+  struct app_tm_region *r = app_tm_region;
+  memset(r, 0, sizeof(*r));
+  r->tsc_hz = rte_get_tsc_hz();
+  r->interval_ms = app.telemetry_ms;
+  r->n_ports = RTE_MIN(rte_eth_dev_count_avail(), (uint16_t) APP_TM_MAX_PORTS);
+  for (uint32_t lcore = 0; lcore < APP_MAX_LCORES; lcore++) {
+    r->lcore_type[lcore] = (uint8_t) app.lcore_params[lcore].type;
+  }
+  app_telemetry_snapshot(r);
+  
+  rte_smp_wmb();
+  r->magic = APP_TM_MAGIC;   // last, a reader that maps the region early waits for it
+  
+  ret = rte_ctrl_thread_create(&tid, "telemetry", NULL, app_telemetry_main, r);
+  if (ret != 0) {
+    rte_panic("Cannot start the telemetry thread (%d)\n", ret);
+  }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Per-lcore telemetry of the data path, and the shared memory snapshot it is exported through.
+ *
+ * Every lcore owns one app_tm_lcore and is its only writer: plain increments, no atomics, no shared cache lines,
+ * nothing printed. A control thread copies all of them into a POSIX shared memory region every --telemetry-ms,
+ * together with the NIC counters, under a sequence lock. telemetry_reader.cpp maps the region and turns two
+ * snapshots into rates. The counters only grow, so a reader never resets anything.
+ *
+ * This header is the layout of the region as well, so it needs no DPDK.
+ */
+
+#ifndef APP_TELEMETRY
+#define APP_TELEMETRY           1       // per-lcore counters
+#endif
+
+#ifndef APP_TELEMETRY_CYCLES
+#define APP_TELEMETRY_CYCLES    1       // and TSC cycles per stage, a few rdtsc per batch
+#endif
+
+#define APP_TM_MAGIC            0x636f6e63746d3031ULL   // "conctm01"
+#define APP_TM_MAX_LCORES       128     // RTE_MAX_LCORE of the default config
+#define APP_TM_MAX_PORTS        32      // RTE_MAX_ETHPORTS
+#define APP_TM_MAX_VIPS         1024    // lookups of VIP index i are counted in i % APP_TM_MAX_VIPS
+#define APP_TM_CACHE_LINE       64
+
+#ifndef APP_DEFAULT_TELEMETRY_MS
+#define APP_DEFAULT_TELEMETRY_MS    1000
+#endif
+
+#ifndef APP_DEFAULT_TELEMETRY_SHM
+#define APP_DEFAULT_TELEMETRY_SHM   "/concury-telemetry"
+#endif
+
+#define APP_TM_SHM_NAME_MAX     64
+
+enum app_tm_stage {
+  APP_TM_STAGE_RX = 0,    // I/O RX: spreading a NIC burst over the worker rings
+  APP_TM_STAGE_LOOKUP,    // parse and look up, prefetches included
+  APP_TM_STAGE_REWRITE,   // forwarding stage, see rewrite.h
+  APP_TM_STAGE_TX,        // enqueue to the TX rings, or the NIC TX burst
+  APP_TM_N_STAGES
+};
+
+static const char *const app_tm_stage_names[APP_TM_N_STAGES] = {"rx", "lookup", "rewrite", "tx"};
+
+/* indexed by app_lcore_type of main.h */
+static const char *const app_tm_lcore_types[] = {"-", "io", "worker", "rtc", "ctl", "gen", "sink"};
+
+struct app_tm_lcore {
+  uint64_t rx_pkts;               // from the NIC (I/O RX, RTC) or the input rings (worker)
+  uint64_t rx_bursts;             // non-empty bursts
+  uint64_t tx_pkts;               // accepted by the NIC, or enqueued to a ring
+  uint64_t tx_drops;              // refused by the NIC and freed
+  uint64_t ring_enq;              // bulk enqueues to a SW ring
+  uint64_t ring_full;             // of which failed because the ring was full
+  uint64_t ring_full_drops;       // packets freed because of that
+  uint64_t lookups;
+  uint64_t lookup_misses;         // the VIP was down or had no weight, the packet was freed
+  uint64_t batches;               // lookup batches
+  uint64_t batch_slots;           // sum of the batch sizes, so batch fill = lookups / batch_slots
+  uint64_t cycles[APP_TM_N_STAGES];
+  uint64_t vip_lookups[APP_TM_MAX_VIPS];
+} __attribute__((aligned(APP_TM_CACHE_LINE)));
+
+struct app_tm_port {
+  uint64_t ipackets;
+  uint64_t opackets;
+  uint64_t imissed;
+  uint64_t ierrors;
+  uint64_t oerrors;
+  uint64_t rx_nombuf;
+};
+
+struct app_tm_region {
+  uint64_t magic;
+  volatile uint64_t seq;          // odd while a snapshot is being written
+  uint64_t tsc;                   // when the snapshot was taken
+  uint64_t tsc_hz;
+  uint32_t interval_ms;
+  uint32_t n_ports;
+  uint8_t lcore_type[APP_TM_MAX_LCORES];
+  struct app_tm_port ports[APP_TM_MAX_PORTS];
+  struct app_tm_lcore lcores[APP_TM_MAX_LCORES];
+} __attribute__((aligned(APP_TM_CACHE_LINE)));
+
+#if APP_TELEMETRY
+#define APP_TM_ADD(tm, field, n)    ((tm)->field += (n))
+#else
+#define APP_TM_ADD(tm, field, n)
+#endif
+
+#if APP_TELEMETRY && APP_TELEMETRY_CYCLES
+#define APP_TM_TSC(var)                 uint64_t var = rte_rdtsc()
+#define APP_TM_STAGE(tm, stage, from, to)   ((tm)->cycles[stage] += (to) - (from))
+#else
+#define APP_TM_TSC(var)
+#define APP_TM_STAGE(tm, stage, from, to)
+#endif
+
+/* written by the owning lcore only, see runtime.cpp */
+extern struct app_tm_lcore app_tm[APP_TM_MAX_LCORES];
+
+/* map the region and start the exporter thread. nothing happens with --telemetry-ms 0 */
+void app_telemetry_init(void);
@@ -0,0 +1,183 @@
+/**
+ * Reader of the telemetry region exported by the DPDK app (see telemetry.h). Needs no DPDK, and never touches the
+ * lcores' own counters, only the snapshot the telemetry thread copied out.
+ *
+ * Every -i ms it takes a consistent snapshot and prints the rates since the previous one: per lcore and in total,
+ * per NIC port, and the busiest VIPs.
+ *
+ * build: g++ -O2 -o build/telemetry_reader telemetry_reader.cpp -lrt
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+
+#include "telemetry.h"
+
+using namespace std;
+
+struct ReaderConfig {
+  const char *shm = APP_DEFAULT_TELEMETRY_SHM;
+  int intervalMs = 1000;
+  int count = 0;          // 0: until interrupted
+  int topVips = 8;
+  bool perLcore = true;
+};
+
+// seqlock read side, see app_telemetry_snapshot
+static bool snapshot(const app_tm_region *r, app_tm_region *out) {
+  for (int tries = 0; tries < 1000; ++tries) {
+    uint64_t seq = r->seq;
+    if (seq & 1) {
+      usleep(100);
+      continue;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    memcpy((void *) out, (const void *) r, sizeof(*out));
+    atomic_thread_fence(memory_order_acquire);
+    if (r->seq == seq) return true;
+  }
+  return false;
+}
+
+static double perSec(uint64_t now, uint64_t then, double secs) {
+  return (now - then) / secs;
+}
+
+static double ratio(uint64_t num, uint64_t den) {
+  return den ? (double) num / den : 0.0;
+}
+
+// the per-interval deltas of one lcore, or of all of them
+static app_tm_lcore delta(const app_tm_lcore &now, const app_tm_lcore &then) {
+  app_tm_lcore d;
+  const uint64_t *a = (const uint64_t *) &now, *b = (const uint64_t *) &then;
+  uint64_t *c = (uint64_t *) &d;
+  for (size_t i = 0; i < sizeof(d) / sizeof(uint64_t); ++i) c[i] = a[i] - b[i];
+  return d;
+}
+
+static void accumulate(app_tm_lcore &sum, const app_tm_lcore &d) {
+  const uint64_t *a = (const uint64_t *) &d;
+  uint64_t *c = (uint64_t *) &sum;
+  for (size_t i = 0; i < sizeof(sum) / sizeof(uint64_t); ++i) c[i] += a[i];
+}
+
+static void printLcore(const char *name, const char *type, const app_tm_lcore &d, double secs) {
+  uint64_t pkts = max(d.rx_pkts, d.tx_pkts);
+  printf("%-6s %-7s %8.3f %8.3f %9.0f %9.0f %8.3f %6.2f%% %6.1f%%", name, type, d.rx_pkts / secs / 1e6,
+         d.tx_pkts / secs / 1e6, (d.tx_drops + d.ring_full_drops) / secs, d.ring_full / secs, d.lookups / secs / 1e6,
+         100 * ratio(d.lookup_misses, d.lookups), 100 * ratio(d.lookups, d.batch_slots));
+  for (int s = 0; s < APP_TM_N_STAGES; ++s) printf(" %7.1f", ratio(d.cycles[s], pkts));
+  printf("\n");
+}
+
+static void usage(const char *prg) {
+  fprintf(stderr, "%s [-n SHM_NAME] [-i INTERVAL_MS] [-c COUNT] [-v TOP_VIPS] [-a]\n", prg);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  ReaderConfig cfg;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:i:c:v:a")) != -1) {
+    switch (opt) {
+      case 'n': cfg.shm = optarg; break;
+      case 'i': cfg.intervalMs = atoi(optarg); break;
+      case 'c': cfg.count = atoi(optarg); break;
+      case 'v': cfg.topVips = atoi(optarg); break;
+      case 'a': cfg.perLcore = false; break;
+      default: usage(argv[0]);
+    }
+  }
+  if (cfg.intervalMs <= 0 || cfg.count < 0 || cfg.topVips < 0) usage(argv[0]);
+  
+  int fd = shm_open(cfg.shm, O_RDONLY, 0);
+  if (fd < 0) {
+    perror(cfg.shm);
+    return 1;
+  }
+  const app_tm_region *region = (const app_tm_region *) mmap(nullptr, sizeof(app_tm_region), PROT_READ, MAP_SHARED,
+                                                             fd, 0);
+  close(fd);
+  if (region == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  while (region->magic != APP_TM_MAGIC) usleep(10000);   // the app is still initializing
+  
+  // ~1MB each, keep them off the stack
+  vector<app_tm_region> snaps(2);
+  app_tm_region *prev = &snaps[0], *curr = &snaps[1];
+  if (!snapshot(region, prev)) {
+    fprintf(stderr, "no consistent snapshot, is the exporter stuck?\n");
+    return 1;
+  }
+  printf("%s: snapshots every %u ms, reading every %d ms\n", cfg.shm, region->interval_ms, cfg.intervalMs);
+  
+  for (int n = 0; cfg.count == 0 || n < cfg.count;) {
+    usleep(cfg.intervalMs * 1000);
+    if (!snapshot(region, curr) || curr->tsc == prev->tsc) continue;   // nothing new yet
+    ++n;
+    
+    double secs = (double) (curr->tsc - prev->tsc) / curr->tsc_hz;
+    printf("\n--- %.3f s\n", secs);
+    printf("%-6s %-7s %8s %8s %9s %9s %8s %7s %7s", "lcore", "type", "rx Mpps", "tx Mpps", "drops/s", "full/s",
+           "lkp Mpps", "miss", "fill");
+    for (int s = 0; s < APP_TM_N_STAGES; ++s) printf(" %7s", app_tm_stage_names[s]);
+    printf("   (cycles/pkt)\n");
+    
+    app_tm_lcore total;
+    memset(&total, 0, sizeof(total));
+    for (int lcore = 0; lcore < APP_TM_MAX_LCORES; ++lcore) {
+      uint8_t type = curr->lcore_type[lcore];
+      if (type == 0 || type >= sizeof(app_tm_lcore_types) / sizeof(app_tm_lcore_types[0])) continue;
+      
+      app_tm_lcore d = delta(curr->lcores[lcore], prev->lcores[lcore]);
+      accumulate(total, d);
+      if (cfg.perLcore && (d.rx_pkts || d.tx_pkts || d.lookups)) {
+        char name[8];
+        snprintf(name, sizeof(name), "%d", lcore);
+        printLcore(name, app_tm_lcore_types[type], d, secs);
+      }
+    }
+    printLcore("total", "", total, secs);
+    
+    for (uint32_t port = 0; port < curr->n_ports; ++port) {
+      const app_tm_port &a = curr->ports[port], &b = prev->ports[port];
+      uint64_t missed = a.imissed - b.imissed, received = a.ipackets - b.ipackets;
+      printf("port %u: rx %.3f Mpps  tx %.3f Mpps  NIC drop ratio %.4f  ierrors %.0f/s  oerrors %.0f/s  "
+             "no mbuf %.0f/s\n", port, perSec(a.ipackets, b.ipackets, secs) / 1e6,
+             perSec(a.opackets, b.opackets, secs) / 1e6, ratio(missed, missed + received),
+             perSec(a.ierrors, b.ierrors, secs), perSec(a.oerrors, b.oerrors, secs),
+             perSec(a.rx_nombuf, b.rx_nombuf, secs));
+    }
+    
+    if (cfg.topVips && total.lookups) {
+      vector<int> vips(APP_TM_MAX_VIPS);
+      for (int i = 0; i < APP_TM_MAX_VIPS; ++i) vips[i] = i;
+      int k = min(cfg.topVips, APP_TM_MAX_VIPS);
+      partial_sort(vips.begin(), vips.begin() + k, vips.end(),
+                   [&](int a, int b) { return total.vip_lookups[a] > total.vip_lookups[b]; });
+      printf("top VIPs:");
+      for (int i = 0; i < k && total.vip_lookups[vips[i]]; ++i) {
+        printf("  #%d %.1f%%", vips[i], 100 * ratio(total.vip_lookups[vips[i]], total.lookups));
+      }
+      printf("\n");
+    }
+    fflush(stdout);
+    
+    swap(prev, curr);
+  }
+  
+  munmap((void *) region, sizeof(app_tm_region));
+  return 0;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <type_traits>
+
+using namespace std;
+
+/*! \file json_writer.h
+ *  Streams JSON to an ostream: objects, arrays, strings and numbers, with the commas and quoting done here.
+ */
+
+class JsonWriter {
+  ostream &os;
+  vector<bool> empty;     // per open object or array: nothing written into it yet
+  bool afterKey = false;
+  
+  void separate() {
+    if (afterKey) {
+      afterKey = false;
+      return;
+    }
+    if (empty.empty()) return;
+    if (!empty.back()) os << ",";
+    empty.back() = false;
+  }
+  
+  JsonWriter &open(char c) {
+    separate();
+    os << c;
+    empty.push_back(true);
+    return *this;
+  }
+  
+  JsonWriter &close(char c) {
+    empty.pop_back();
+    os << c;
+    if (empty.empty()) os << "\n";
+    return *this;
+  }
+
+public:
+  explicit JsonWriter(ostream &os) : os(os) {}
+  
+  JsonWriter &beginObject() {
+    return open('{');
+  }
+  
+  JsonWriter &endObject() {
+    return close('}');
+  }
+  
+  JsonWriter &beginArray() {
+    return open('[');
+  }
+  
+  JsonWriter &endArray() {
+    return close(']');
+  }
+  
+  JsonWriter &key(const string &k) {
+    value(k);
+    os << ":";
+    afterKey = true;
+    return *this;
+  }
+  
+  JsonWriter &value(const string &s) {
+    separate();
+    os << '"';
+    for (char c : s) {
+      if (c == '"' || c == '\\') os << '\\' << c;
+      else if (c == '\n') os << "\\n";
+      else if ((unsigned char) c < 0x20) os << ' ';
+      else os << c;
+    }
+    os << '"';
+    return *this;
+  }
+  
+  JsonWriter &value(const char *s) {
+    return value(string(s));
+  }
+  
+  JsonWriter &value(bool b) {
+    separate();
+    os << (b ? "true" : "false");
+    return *this;
+  }
+  
+  /// integers as they are, doubles with 9 significant digits. NaN and infinities, which JSON lacks, are null
+  template<class T>
+  typename enable_if<is_arithmetic<T>::value, JsonWriter &>::type value(T v) {
+    separate();
+    if (is_integral<T>::value) {
+      if (is_signed<T>::value) os << (long long) v;
+      else os << (unsigned long long) v;
+    } else if (!std::isfinite((double) v)) {
+      os << "null";
+    } else {
+      streamsize precision = os.precision(9);
+      os << (double) v;
+      os.precision(precision);
+    }
+    return *this;
+  }
+  
+  template<class T>
+  JsonWriter &field(const string &k, const T &v) {
+    return key(k).value(v);
+  }
+};
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <algorithm>
+#include <x86intrin.h>
+
+using namespace std;
+
+/*! \file latency_histogram.h
+ *  Latency distributions of the load balancer operations: log-bucketed histograms of TSC ticks, one set per thread,
+ *  merged when read. Needs config.h for LATENCY_SAMPLE_BITS.
+ */
+
+/// the TSC. not serializing, so a sample also holds the 20-30 cycles of the two reads and some out-of-order slack
+inline uint64_t tscNow() {
+  return __rdtsc();
+}
+
+/// TSC ticks per ns, measured once against CLOCK_MONOTONIC over 20ms
+inline double tscPerNs() {
+  static const double ticksPerNs = [] {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint64_t c0 = tscNow();
+    do {
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+    } while ((t1.tv_sec - t0.tv_sec) * 1000000000LL + (t1.tv_nsec - t0.tv_nsec) < 20000000);
+    uint64_t c1 = tscNow();
+    return double(c1 - c0) / ((t1.tv_sec - t0.tv_sec) * 1E9 + (t1.tv_nsec - t0.tv_nsec));
+  }();
+  return ticksPerNs;
+}
+
+/**
+ * HDR-style histogram of uint64_t values: exact below 2^SUB_BITS, then 2^SUB_BITS buckets per power of two, so a
+ * percentile is off by at most 1/2^SUB_BITS (3%) of its value. Recording is an index computation and an increment,
+ * and the counts are a fixed array: nothing is allocated after construction.
+ */
+class LatencyHistogram {
+public:
+  static const int SUB_BITS = 5;
+  static const int SUB = 1 << SUB_BITS;
+  static const int BUCKETS = (64 - SUB_BITS + 1) * SUB;
+
+private:
+  uint64_t counts[BUCKETS];
+  uint64_t total = 0, maxValue = 0;
+  
+  static inline int bucketOf(uint64_t v) {
+    if (v < SUB) return int(v);
+    int e = 63 - __builtin_clzll(v);
+    return ((e - SUB_BITS + 1) << SUB_BITS) | int((v >> (e - SUB_BITS)) & (SUB - 1));
+  }
+  
+  /// the largest value bucket i holds
+  static uint64_t highestOf(int i) {
+    if (i < SUB) return uint64_t(i);
+    int shift = (i >> SUB_BITS) - 1;
+    uint64_t low = uint64_t(SUB + (i & (SUB - 1))) << shift;
+    return low + (uint64_t(1) << shift) - 1;
+  }
+
+public:
+  LatencyHistogram() {
+    reset();
+  }
+  
+  inline void record(uint64_t v) {
+    ++counts[bucketOf(v)];
+    ++total;
+    if (v > maxValue) maxValue = v;
+  }
+  
+  void merge(const LatencyHistogram &other) {
+    for (int i = 0; i < BUCKETS; ++i) counts[i] += other.counts[i];
+    total += other.total;
+    maxValue = std::max(maxValue, other.maxValue);
+  }
+  
+  void reset() {
+    memset(counts, 0, sizeof(counts));
+    total = 0;
+    maxValue = 0;
+  }
+  
+  inline uint64_t count() const {
+    return total;
+  }
+  
+  inline uint64_t max() const {
+    return maxValue;
+  }
+  
+  /// \param q in [0, 1]
+  /// \return the smallest value that q of the values are at most, to the bucket. 0 if empty
+  uint64_t percentile(double q) const {
+    if (total == 0) return 0;
+    uint64_t rank = std::max<uint64_t>(1, uint64_t(q * total + 0.5));
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+      seen += counts[i];
+      if (seen >= rank) return std::min(highestOf(i), maxValue);
+    }
+    return maxValue;
+  }
+  
+  /// percentile of a histogram of TSC ticks, in ns
+  double percentileNs(double q) const {
+    return percentile(q) / tscPerNs();
+  }
+  
+  double maxNs() const {
+    return maxValue / tscPerNs();
+  }
+};
+
+/**
+ * The operations timed. compose is a weight change applied to the tracked connections of one VIP: compose of the
+ * Concury control plane, Compose of a Maglev conn table, the new pool version of a SilkRoad VIP. sync is the
+ * control plane to data plane copy of one VIP. Lookups are sampled, see sampleLookup; the rest are all timed.
+ */
+enum LatencyOp {
+  LAT_LOOKUP, LAT_INSERT, LAT_ERASE, LAT_COMPOSE, LAT_SYNC, LAT_OPS
+};
+
+static const char *const LATENCY_OP_NAMES[LAT_OPS] = {"lookup", "insert", "erase", "compose", "sync"};
+
+/// the histograms of one thread. registered while the thread lives, merged into the retired ones when it exits
+struct ThreadLatencies {
+  LatencyHistogram histograms[LAT_OPS];
+  uint32_t lookupCountdown = 1;
+  
+  struct Registry {
+    mutex lock;
+    vector<ThreadLatencies *> live;
+    LatencyHistogram retired[LAT_OPS];
+  };
+  
+  static Registry &registry() {
+    static Registry r;
+    return r;
+  }
+  
+  ThreadLatencies() {
+    Registry &r = registry();
+    lock_guard<mutex> guard(r.lock);
+    r.live.push_back(this);
+  }
+  
+  ~ThreadLatencies() {
+    Registry &r = registry();
+    lock_guard<mutex> guard(r.lock);
+    for (int op = 0; op < LAT_OPS; ++op) r.retired[op].merge(histograms[op]);
+    r.live.erase(find(r.live.begin(), r.live.end(), this));
+  }
+  
+  static inline ThreadLatencies &local() {
+    static thread_local ThreadLatencies latencies;
+    return latencies;
+  }
+};
+
+inline void recordLatency(LatencyOp op, uint64_t ticks) {
+  ThreadLatencies::local().histograms[op].record(ticks);
+}
+
+/// whether to time this lookup: true for one of every 2^LATENCY_SAMPLE_BITS calls of the thread
+inline bool sampleLookup() {
+  uint32_t &countdown = ThreadLatencies::local().lookupCountdown;
+  if (--countdown) return false;
+  countdown = 1U << LATENCY_SAMPLE_BITS;
+  return true;
+}
+
+/// times its scope into the histogram of op, if on
+class ScopedLatency {
+  LatencyOp op;
+  uint64_t start;
+
+public:
+  explicit ScopedLatency(LatencyOp op, bool on = true) : op(op), start(on ? tscNow() : 0) {}
+  
+  ~ScopedLatency() {
+    if (start) recordLatency(op, tscNow() - start);
+  }
+};
+
+/// all threads of op merged, the exited ones included. exact while no thread records
+inline LatencyHistogram mergedLatency(LatencyOp op) {
+  ThreadLatencies::Registry &r = ThreadLatencies::registry();
+  lock_guard<mutex> guard(r.lock);
+  LatencyHistogram merged = r.retired[op];
+  for (ThreadLatencies *t : r.live) merged.merge(t->histograms[op]);
+  return merged;
+}
+
+/// forget everything recorded so far, for the next phase of a benchmark. call it while no thread records
+inline void resetLatencies() {
+  ThreadLatencies::Registry &r = ThreadLatencies::registry();
+  lock_guard<mutex> guard(r.lock);
+  for (int op = 0; op < LAT_OPS; ++op) {
+    r.retired[op].reset();
+    for (ThreadLatencies *t : r.live) t->histograms[op].reset();
+  }
+}
+
+/// one line per operation recorded: count, p50, p99, p99.9 and max in ns
+inline void printLatencies(ostream &os) {
+  ios::fmtflags flags = os.flags();
+  streamsize precision = os.precision(1);
+  os << fixed;
+  for (int op = 0; op < LAT_OPS; ++op) {
+    LatencyHistogram h = mergedLatency(LatencyOp(op));
+    if (!h.count()) continue;
+    os << LATENCY_OP_NAMES[op] << ": " << h.count() << " timed, p50: " << h.percentileNs(0.5) << "ns, p99: "
+       << h.percentileNs(0.99) << "ns, p99.9: " << h.percentileNs(0.999) << "ns, max: " << h.maxNs() << "ns" << endl;
+  }
+  os.flags(flags);
+  os.precision(precision);
+}
+
+/// the same, as space separated columns after phase: the format of the .latency.data logs
+inline void logLatencies(ostream &os, const string &phase) {
+  ios::fmtflags flags = os.flags();
+  streamsize precision = os.precision(1);
+  os << fixed;
+  for (int op = 0; op < LAT_OPS; ++op) {
+    LatencyHistogram h = mergedLatency(LatencyOp(op));
+    if (!h.count()) continue;
+    os << phase << " " << LATENCY_OP_NAMES[op] << " " << h.count() << " " << h.percentileNs(0.5) << " "
+       << h.percentileNs(0.99) << " " << h.percentileNs(0.999) << " " << h.maxNs() << endl;
+  }
+  os.flags(flags);
+  os.precision(precision);
+}
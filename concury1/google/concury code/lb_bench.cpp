@@ -0,0 +1,291 @@
+/**
+ * The benchmark driver: one load balancer (see lb_bench.h) over a list of connection counts. For each count it times
+ * the bulk add, single and batched lookups of the added connections and the weight updates, counts the connections of
+ * a sample that an update moves to another DIP, and takes the memory from getMemoryBreakdown. The latency histograms
+ * (latency_histogram.h) are reset per count: the single lookups are sampled into them here, the inserts, erases,
+ * composes and syncs of the balancer are all timed where it does them.
+ *
+ * The results are one JSON object: the algorithm, the compile time config, the parameters, and a run per connection
+ * count. build.sh builds it with each algorithm, lb_bench.sh runs all three over the same counts.
+ */
+#include "lb_bench.h"
+#include "json_writer.h"
+#include "workload.h"
+
+struct BenchParams {
+  vector<int> conns;
+  uint64_t packets = 16 << 20;
+  int batch = 32;
+  int updates = 4;
+  string json = NAME ".bench.json";
+  
+  bool skewed = false;      // any of the workload arguments: the lookups run a generated Workload
+  WorkloadParams workload;
+};
+
+static bool parseParams(int argc, char **argv, BenchParams &p) {
+  for (int i = 1; i < argc; i += 2) {
+    string arg = argv[i];
+    if (i + 1 == argc) {
+      cerr << arg << " needs a value" << endl;
+      return false;
+    }
+    const char *value = argv[i + 1];
+    
+    if (arg == "--conns") {
+      for (const string &s : split(value, ',')) p.conns.push_back(atoi(s.c_str()));
+    } else if (arg == "--packets") {
+      p.packets = strtoull(value, nullptr, 10);
+    } else if (arg == "--batch") {
+      p.batch = atoi(value);
+    } else if (arg == "--updates") {
+      p.updates = atoi(value);
+    } else if (arg == "--json") {
+      p.json = value;
+    } else if (arg == "--flow-skew") {
+      p.workload.flowSkew = atof(value);
+      p.skewed = true;
+    } else if (arg == "--vip-skew") {
+      p.workload.vipSkew = atof(value);
+      p.skewed = true;
+    } else if (arg == "--arrivals") {
+      p.workload.arrivals = atof(value);
+      p.skewed = true;
+    } else if (arg == "--lifetime") {
+      if (!p.workload.lifetime.parse(value)) {
+        cerr << "--lifetime " << value << ": forever, fixed:<mean>, exp:<mean> or pareto:<mean>[:<shape>]" << endl;
+        return false;
+      }
+      p.skewed = true;
+    } else {
+      cerr << "unknown argument " << arg << endl;
+      return false;
+    }
+  }
+  
+  if (p.conns.empty()) p.conns.push_back(CONN_NUM);
+  for (int conns : p.conns) {
+    if (conns <= 0 || conns > CONN_NUM) {
+      cerr << "--conns " << conns << ": must be in 1.." << CONN_NUM << ", the CONN_NUM of this build" << endl;
+      return false;
+    }
+  }
+  if (p.packets == 0 || p.batch <= 0 || p.updates < 0) {
+    cerr << "--packets and --batch must be positive, --updates not negative" << endl;
+    return false;
+  }
+  if (p.workload.flowSkew < 0 || p.workload.vipSkew < 0 || p.workload.arrivals < 0 || p.workload.arrivals > 1) {
+    cerr << "--flow-skew and --vip-skew must not be negative, --arrivals in 0..1" << endl;
+    return false;
+  }
+  return true;
+}
+
+/// the first n connections, in the order simulateConnectionAdd adds them
+static vector<Tuple5> connections(int n) {
+  vector<Tuple5> packets(n);
+  unsigned addr = 0x0a800000;
+  LFSRGen<Tuple3> tuple3Gen(0xe2211, CONN_NUM, 0);
+  
+  for (Tuple5 &tuple : packets) {
+    tuple3Gen.gen((Tuple3 *) &tuple.src);
+    tuple.dst.addr = addr++;
+    tuple.dst.port = 0;
+    if (addr >= 0x0a800000 + VIP_NUM) addr = 0x0a800000;
+  }
+  return packets;
+}
+
+static void writeMemory(JsonWriter &json, const MemoryBreakdown &memory) {
+  json.beginObject();
+  json.field("dp_used", memory.used("dp.")).field("dp_reserved", memory.reserved("dp."));
+  json.field("cp_used", memory.used("cp.")).field("cp_reserved", memory.reserved("cp."));
+  json.key("components").beginArray();
+  for (const MemoryComponent &c : memory.components) {
+    json.beginObject().field("name", c.name).field("used", c.used).field("reserved", c.reserved).endObject();
+  }
+  json.endArray();
+  json.endObject();
+}
+
+/// p50/p99/p99.9/max per operation recorded, in ns
+static void writeLatency(JsonWriter &json) {
+  json.beginObject();
+  for (int op = 0; op < LAT_OPS; ++op) {
+    LatencyHistogram h = mergedLatency(LatencyOp(op));
+    if (!h.count()) continue;
+    json.key(LATENCY_OP_NAMES[op]).beginObject();
+    json.field("count", h.count()).field("p50_ns", h.percentileNs(0.5)).field("p99_ns", h.percentileNs(0.99));
+    json.field("p999_ns", h.percentileNs(0.999)).field("max_ns", h.maxNs());
+    json.endObject();
+  }
+  json.endObject();
+}
+
+static void run(LoadBalancer &lb, const BenchParams &p, int conns, JsonWriter &json) {
+  struct timeval start, end;
+  int stupid = 0;
+  
+  // skewed: the whole workload is generated before anything is timed, and the new connections are presized for
+  Workload workload;
+  if (p.skewed) {
+    WorkloadParams params = p.workload;
+    params.connections = conns;
+    params.packets = p.packets;
+    workload = generateWorkload(params);
+  }
+  resetLatencies();
+  
+  gettimeofday(&start, NULL);
+  lb.init(conns + (int) workload.opens.size());
+  gettimeofday(&end, NULL);
+  double initMs = diff_us(end, start) / 1000.0;
+  
+  gettimeofday(&start, NULL);
+  if (p.skewed) lb.addConnections(workload.initial);
+  else lb.addConnections(conns);
+  gettimeofday(&end, NULL);
+  double addMs = diff_us(end, start) / 1000.0;
+  
+  vector<Tuple5> packets = p.skewed ? workload.packets : connections(conns);
+  const vector<Tuple5> &added = p.skewed ? workload.initial : packets;
+  
+  gettimeofday(&start, NULL);
+  for (uint64_t i = 0, j = 0; i < p.packets; ++i) {
+    bool sampled = sampleLookup();
+    uint64_t lookupStart = sampled ? tscNow() : 0;
+    stupid += lb.lookup(packets[j]).addr;   //prevent optimize
+    if (sampled) recordLatency(LAT_LOOKUP, tscNow() - lookupStart);
+    if (++j == packets.size()) j = 0;
+  }
+  gettimeofday(&end, NULL);
+  double lookupNs = diff_us(end, start) * 1000.0 / p.packets;
+  
+  vector<Addr_Port> dips(p.batch);
+  gettimeofday(&start, NULL);
+  for (uint64_t done = 0, j = 0; done < p.packets;) {
+    int n = (int) min<uint64_t>(p.batch, min<uint64_t>(p.packets - done, packets.size() - j));
+    lb.lookupBatch(&packets[j], n, dips.data());
+    stupid += dips[0].addr;
+    done += n;
+    j += n;
+    if (j == packets.size()) j = 0;
+  }
+  gettimeofday(&end, NULL);
+  double batchNs = diff_us(end, start) * 1000.0 / p.packets;
+  
+  MemoryBreakdown memory = lb.getMemoryBreakdown();
+  
+  // up to 64K connections spread over all of them. all of them keep their DIP across an update but those of a DIP
+  // whose new weight is 0, which is drained
+  vector<Tuple5> sample;
+  for (int i = 0; i < conns; i += max(1, conns >> 16)) sample.push_back(added[i]);
+  vector<Addr_Port> before(sample.size()), after(sample.size());
+  uint64_t updateUs = 0, violations = 0, drained = 0;
+  for (int u = 0; u < p.updates; ++u) {
+    lb.lookupBatch(sample.data(), (int) sample.size(), before.data());
+    gettimeofday(&start, NULL);
+    lb.updateWeights();
+    gettimeofday(&end, NULL);
+    updateUs += diff_us(end, start);
+    lb.lookupBatch(sample.data(), (int) sample.size(), after.data());
+    
+    vector<vector<DIP>> pools(VIP_NUM);
+    for (int vipInd = 0; vipInd < VIP_NUM; ++vipInd) pools[vipInd] = lb.dips(vipInd);
+    for (size_t i = 0; i < sample.size(); ++i) {
+      if (before[i] == after[i]) continue;
+      
+      int weight = 0;
+      for (const DIP &dip : pools[sample[i].dst.addr & VIP_MASK]) {
+        if (dip.addr == before[i]) weight = dip.weight;
+      }
+      if (weight > 0) ++violations;
+      else ++drained;
+    }
+  }
+  double updateMs = p.updates ? updateUs / 1000.0 / p.updates : 0;
+  
+  printf("%d\b \b", stupid & 7);
+  cout << dec << lb.name() << ", " << conns << " connections: add " << addMs * 1E6 / conns << "ns/conn, lookup "
+       << lookupNs << "ns, batch of " << p.batch << " " << batchNs << "ns, update " << updateMs << "ms, " << violations
+       << " PCC violations, " << drained << " drained, data plane " << double(memory.reserved("dp.")) / conns << "B/conn" << endl;
+  if (p.skewed) {
+    cout << "  workload: " << packets.size() << " packets, " << workload.opens.size() << " new connections, "
+         << workload.closes.size() << " closed" << endl;
+  }
+  printLatencies(cout);
+  
+  json.beginObject();
+  json.field("conns", conns);
+  json.field("init_ms", initMs);
+  json.field("add_ms", addMs).field("add_ns_per_conn", addMs * 1E6 / conns);
+  json.field("lookup_ns", lookupNs).field("lookup_mpps", 1000 / lookupNs);
+  json.field("batch_lookup_ns", batchNs).field("batch_lookup_mpps", 1000 / batchNs);
+  json.field("update_ms", updateMs);
+  json.field("checked", (uint64_t) sample.size() * p.updates);
+  json.field("violations", violations).field("drained", drained);
+  if (p.skewed) {
+    json.field("new_connections", (uint64_t) workload.opens.size());
+    json.field("closed_connections", (uint64_t) workload.closes.size());
+  }
+  json.key("memory");
+  writeMemory(json, memory);
+  json.key("latency");
+  writeLatency(json);
+  json.endObject();
+}
+
+int benchmarkMain(int argc, char **argv, LoadBalancer &lb) {
+  if (argc > 1 && string(argv[1]) == "replay") return replayMain(argc - 1, argv + 1, lb);
+  if (argc > 1 && string(argv[1]) == "scenario") return scenarioMain(argc - 1, argv + 1, lb);
+  
+  BenchParams p;
+  if (!parseParams(argc, argv, p)) return 1;
+  
+  commonInit();
+  
+  ofstream out(p.json);
+  if (!out) {
+    cerr << "cannot write " << p.json << endl;
+    return 1;
+  }
+  
+  JsonWriter json(out);
+  json.beginObject();
+  json.field("algorithm", lb.name()).field("name", NAME);
+  
+  json.key("config").beginObject();
+  json.field("vip_num", VIP_NUM).field("conn_num", CONN_NUM).field("dip_num", DIP_NUM).field("ht_size", HT_SIZE);
+  json.field("concury_dl", CONCURY_DL).field("vip_conn_max", VIP_CONN_MAX);
+#ifdef FIX_DIP_NUM
+  json.field("fix_dip_num", true);
+#else
+  json.field("fix_dip_num", false);
+#endif
+#ifdef NDEBUG
+  json.field("asserts", false);
+#else
+  json.field("asserts", true);
+#endif
+  json.field("compiler", __VERSION__);
+  json.endObject();
+  
+  json.key("params").beginObject();
+  json.field("packets", p.packets).field("batch", p.batch).field("updates", p.updates);
+  json.field("latency_sample_bits", LATENCY_SAMPLE_BITS);
+  if (p.skewed) {
+    json.key("workload").beginObject();
+    json.field("flow_skew", p.workload.flowSkew).field("vip_skew", p.workload.vipSkew);
+    json.field("arrivals", p.workload.arrivals).field("lifetime", p.workload.lifetime.str());
+    json.endObject();
+  }
+  json.endObject();
+  
+  json.key("runs").beginArray();
+  for (int conns : p.conns) run(lb, p, conns, json);
+  json.endArray();
+  json.endObject();
+  
+  cout << "results in " << p.json << endl;
+  return 0;
+}
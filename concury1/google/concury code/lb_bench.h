@@ -0,0 +1,100 @@
+#pragma once
+
+#include "common.h"
+
+/**
+ * What the benchmark driver (lb_bench.cpp) runs a load balancer through. concury.cpp, maglevx.cpp and silkroad.cpp
+ * implement it over the tables they already keep when built with -DLB_BENCH, and hand it to benchmarkMain; one build
+ * holds one of them, their globals share names.
+ *
+ * The connections are those simulateConnectionAdd draws: sources from LFSRGen<Tuple3>(0xe2211, CONN_NUM), VIPs in
+ * turn from 0x0a800000. CONN_NUM is the most a run can add, VIP_NUM and HT_SIZE stay compile time.
+ */
+class LoadBalancer {
+public:
+  virtual ~LoadBalancer() {}
+  
+  virtual const char *name() const = 0;
+  
+  /// fresh DIP pools, and tables presized for capacity connections
+  virtual void init(int capacity) = 0;
+  
+  /// add the first count connections, servable by lookup when this returns
+  virtual void addConnections(int count) = 0;
+  
+  /// add these connections, distinct, the way lookup would take them as new ones. for the replay of a trace
+  virtual void addConnections(const vector<Tuple5> &packets) = 0;
+  
+  /// \return the DIP the packet goes to
+  virtual Addr_Port lookup(const Tuple5 &packet) = 0;
+  
+  /// lookup of n packets in one call, to leave the virtual call out of the per-packet cost
+  virtual void lookupBatch(const Tuple5 *packets, int n, Addr_Port *dips) {
+    for (int i = 0; i < n; ++i) dips[i] = lookup(packets[i]);
+  }
+  
+  /// new weights for every DIP, applied the way the balancer keeps the added connections on their DIPs
+  virtual void updateWeights() = 0;
+  
+  /// the DIPs of the VIP 0x0a800000 + vipInd, with their weights. lookup returns the addr of one of them
+  virtual vector<DIP> dips(int vipInd) = 0;
+  
+  /// weights[j] for DIP j of dips(vipInd), applied as updateWeights applies its. for the scenarios, see scenarioMain
+  virtual void setWeights(int vipInd, const vector<int> &weights) = 0;
+  
+  virtual MemoryBreakdown getMemoryBreakdown() const = 0;
+};
+
+/**
+ * Sweep lb over connection counts and write the results as JSON, or with "replay" as the first argument replay a
+ * trace, see replayMain, with "scenario" run a scenario, see scenarioMain. Arguments, all optional:
+ *   --conns n[,n...]   connection counts, each at most CONN_NUM           (default CONN_NUM)
+ *   --packets n        lookups timed per count, single and batched         (default 16M)
+ *   --batch n          packets per lookupBatch call                        (default 32)
+ *   --updates n        weight updates per count, see violations below      (default 4)
+ *   --json file        where the results go                                (default NAME ".bench.json")
+ *
+ * With any of these the connections and the packets are a generated Workload (workload.h) instead of the LFSRGen
+ * ones cycled over the VIPs in turn:
+ *   --flow-skew s      Zipf exponent of the connection popularity          (default 0, uniform)
+ *   --vip-skew s       Zipf exponent of the VIP popularity                 (default 0, uniform)
+ *   --arrivals r       new connections per packet                          (default 0)
+ *   --lifetime d       forever, fixed:<mean>, exp:<mean> or pareto:<mean>[:<shape>], in packets
+ *                                                                          (default forever)
+ * --conns is then the connections live at the start, --packets the length of the workload. The new ones are looked up
+ * as they come, learned by the balancers that learn on a miss; the closed ones stay in the tables.
+ *
+ * Of the connections of a sample that an update puts on another DIP, drained counts those whose DIP has weight 0 after
+ * it, which have to move, and violations the others, which break PCC.
+ *
+ * \return the exit code for main
+ */
+int benchmarkMain(int argc, char **argv, LoadBalancer &lb);
+
+/**
+ * Replay a binary trace (trace.h) through lb from many threads, see trace_replay.cpp. Arguments:
+ *   --trace file       the trace, from trace_convert                      (required)
+ *   --threads n        replay threads, pinned to cores 0..n-1             (default 1)
+ *   --batch n          packets per lookupBatch call                        (default 32)
+ *   --pace p           full: as fast as possible. recorded: at the times of the trace, which needs a pcap one
+ *                                                                          (default full)
+ *   --speed x          recorded pace sped up x times                       (default 1)
+ *   --loops n          full pace passes over the trace                     (default 1)
+ *   --json file        where the results go                                (default NAME ".replay.json")
+ *
+ * The distinct connections of the trace must fit the CONN_NUM of the build. The packet indices take 4B per packet.
+ *
+ * \return the exit code for main
+ */
+int replayMain(int argc, char **argv, LoadBalancer &lb);
+
+/**
+ * Run lb through a timeline of DIP failures, weight changes and traffic, see scenario.cpp for the file format, and
+ * report the lookup throughput, the latency of the updates and the PCC violations per interval. Arguments:
+ *   --file f           the scenario                                       (required)
+ *   --batch n          packets per lookupBatch call                        (default 32)
+ *   --json file        where the results go                                (default NAME ".scenario.json")
+ *
+ * \return the exit code for main
+ */
+int scenarioMain(int argc, char **argv, LoadBalancer &lb);
@@ -0,0 +1,22 @@
+#!/bin/bash
+# the benchmark driver of each algorithm (see lb_bench.h), as built by build.sh, with the same arguments, e.g.
+#   ./lb_bench.sh --conns 1048576,4194304,16777216 --packets 50000000
+# the results of all of them go to $OUT as one JSON array
+
+OUT=${OUT:-lb_bench.json}
+
+for name in concury maglevx silkroad; do
+	bin/lb_bench.$name --json bin/lb_bench.$name.json "$@" || exit 1
+done
+
+{
+	echo "["
+	sep=""
+	for name in concury maglevx silkroad; do
+		printf "%s" "$sep"
+		cat bin/lb_bench.$name.json
+		sep=","
+	done
+	echo "]"
+} > "$OUT"
+echo "$OUT"
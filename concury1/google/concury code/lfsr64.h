@@ -4,6 +4,63 @@
 #include <cstdint>
 #include <cstring>
 #include <cinttypes>
+#include <algorithm>
+#include <stdexcept>
+
+/// the feedback taps of a word of tailLength bytes, 0 for a whole word: a maximal length Galois LFSR each
+inline uint64_t lfsrTaps(uint32_t tailLength) {
+  switch (tailLength) {
+    case 0:
+      return 0xD800000000000000ULL;
+    case 1:
+      return 0xB8;
+    case 2:
+      return 0xB400;
+    case 3:
+      return 0xD80000;
+    case 4:
+      return 0x80200003;
+    case 5:
+      return 0x9C00000000ULL;
+    case 6:
+      return (1ULL << 47) + (1ULL << 43) + (1ULL << 40) + (1ULL << 38);
+    case 7:
+      return (1ULL << 55) + (1ULL << 53) + (1ULL << 51) + (1ULL << 48);
+    default:
+      throw std::runtime_error("impossible");
+  }
+}
+
+/**
+ * A shift of a word is linear over GF(2): a 64 x 64 bit matrix M, kept as its columns, the image of bit c in column c.
+ * power[j] is M^(2^j), so that s shifts are the powers of the set bits of s, at most 64 matrix-vector products.
+ */
+struct LFSRJumpTable {
+  uint64_t power[64][64];
+  
+  explicit LFSRJumpTable(uint64_t taps) {
+    power[0][0] = taps;
+    for (int c = 1; c < 64; ++c) power[0][c] = 1ULL << (c - 1);
+    
+    for (int j = 1; j < 64; ++j) {
+      for (int c = 0; c < 64; ++c) power[j][c] = apply(power[j - 1], power[j - 1][c]);
+    }
+  }
+  
+  static inline uint64_t apply(const uint64_t *m, uint64_t x) {
+    uint64_t y = 0;
+    for (; x; x &= x - 1) y ^= m[__builtin_ctzll(x)];
+    return y;
+  }
+  
+  /// x shifted steps times
+  inline uint64_t advance(uint64_t x, uint64_t steps) const {
+    for (int j = 0; steps; ++j, steps >>= 1) {
+      if (steps & 1) x = apply(power[j], x);
+    }
+    return x;
+  }
+};
 
 template<typename returnType>     // returnType maybe struct, so can be arbitrarily long
 class LFSRGen    // gen as Linear-feedback shift register
@@ -54,10 +111,7 @@ public:
     
     prest = prestart;
     reset();
-    
-    while (currentid < prest) {
-      shift();
-    }
+    jump(prest);
   }
   
   inline void gen(returnType *ret) {
@@ -65,6 +119,68 @@ public:
     shift();
   }
   
+  /**
+   * the next n values into out, the same as n gen. A long run is cut into LANES stretches, each started by a jump, and
+   * the words of all stretches are shifted side by side, a loop the compiler vectorizes.
+   */
+  void genN(returnType *out, uint64_t n) {
+    static const int LANES = 8;
+    static const int WORDS = (sizeof(returnType) + 7) / 8;
+    
+    while (n) {
+      // without a wind in between: maxvalue 0 never winds, currentid just wraps
+      uint64_t m = maxvalue ? std::min<uint64_t>(n, maxvalue - currentid) : n;
+      uint64_t stretch = m / LANES;
+      n -= m;
+      
+      if (stretch < 1024) {     // the jumps would cost more than they save
+        for (; m; --m) gen(out++);
+        continue;
+      }
+      
+      uint64_t lanes[WORDS][LANES], taps[WORDS];
+      for (int i = 0; i < WORDS; i++) {
+        taps[i] = wordTaps(i);
+        for (int j = 0; j < LANES; j++) lanes[i][j] = table(i).advance(regArray[i], j * stretch);
+      }
+      
+      uint64_t words[WORDS];
+      for (uint64_t t = 0; t < stretch; t++) {
+        for (int j = 0; j < LANES; j++) {
+          for (int i = 0; i < WORDS; i++) words[i] = lanes[i][j];
+          memcpy((void *) (out + j * stretch + t), (void *) words, sizeof(returnType));
+        }
+        
+        for (int i = 0; i < WORDS; i++) {
+          for (int j = 0; j < LANES; j++) {
+            uint64_t lsb = lanes[i][j] & 1;
+            lanes[i][j] = (lanes[i][j] >> 1) ^ ((-lsb) & taps[i]);
+          }
+        }
+      }
+      
+      // the last stretch ends where the whole run does
+      for (int i = 0; i < WORDS; i++) regArray[i] = lanes[i][LANES - 1];
+      currentid += LANES * stretch;
+      if (currentid == maxvalue) reset();
+      out += LANES * stretch;
+      n += m - LANES * stretch;
+    }
+  }
+  
+  /// skips n values in O(log n), winding at maxvalue as gen does
+  void jump(uint64_t n) {
+    if (maxvalue) {
+      n = (currentid + n) % maxvalue;
+      reset();
+    }
+    
+    for (uint32_t i = 0; i < returnLength; i++) {
+      regArray[i] = table(i).advance(regArray[i], n);
+    }
+    currentid += n;
+  }
+  
   void reset() {
     currentid = 0;
     
@@ -74,46 +190,24 @@ public:
   }
 
 private:
+  inline uint64_t wordTaps(uint32_t i) const {
+    return tailLength && i == returnLength - 1 ? lfsrTaps(tailLength) : lfsrTaps(0);
+  }
+  
+  /// the jump table of word i, built at its first use
+  inline const LFSRJumpTable &table(uint32_t i) const {
+    static const LFSRJumpTable whole(lfsrTaps(0));
+    if (!tailLength || i != returnLength - 1) return whole;
+    
+    static const LFSRJumpTable tail(lfsrTaps(sizeof(returnType) % 8));
+    return tail;
+  }
+  
   inline void shift() {
     for (int i = 0; i < returnLength; i++) {
       uint64_t lsb = regArray[i] & 1LL;
       regArray[i] >>= 1;
-      
-      if ((tailLength) && (i == returnLength - 1)) {
-        if (lsb) {
-          uint64_t taps;
-          switch (tailLength) {
-            case 1:
-              taps = 0xB8;
-              break;
-            case 2:
-              taps = 0xB400;
-              break;
-            case 3:
-              taps = 0xD80000;
-              break;
-            case 4:
-              taps = 0x80200003;
-              break;
-            case 5:
-              taps = 0x9C00000000ULL;
-              break;
-            case 6:
-              taps = (1ULL << 47) + (1ULL << 43) + (1ULL << 40) + (1ULL << 38);
-              break;
-            case 7:
-              taps = (1ULL << 55) + (1ULL << 53) + (1ULL << 51) + (1ULL << 48);
-              break;
-            default:
-              throw runtime_error("impossible");
-          }
-          
-          regArray[i] ^= taps;
-        }
-      } else {
-        regArray[i] ^=
-          (-lsb) & 0xD800000000000000ULL;  // every element is an independent Linear-feedback shift register
-      }
+      regArray[i] ^= (-lsb) & wordTaps(i);   // every element is an independent Linear-feedback shift register
     }
     
     currentid++;
@@ -2,33 +2,53 @@
 //#include "libcuckoo/cuckoohash_map.hh"
 #include "CuckooPresized/control_plane_cuckoo_map.h"
 #include "hash.h"
+#include <pthread.h>
 
-static ControlPlaneCuckooMap<uint64_t, uint16_t, uint8_t, false> *connTrackingTable;    // digest of 5-tuple to version: 16 -> 6
+// CONCURRENT_READ: the conn tables take lock-free Finds from many reader
+// threads while one writer updates them, see multiThreadServe
+#ifdef CONCURRENT_READ
+typedef ControlPlaneCuckooMap<uint64_t, uint16_t, uint8_t, false, 2, 4, true> ConnTable;
+#else
+typedef ControlPlaneCuckooMap<uint64_t, uint16_t, uint8_t, false> ConnTable;
+#endif
+
+static ConnTable *connTrackingTable;    // digest of 5-tuple to version: 16 -> 6
 uint16_t **ht = 0;    // [VIPInd][DIPInd] -> DIP Addr_Port
 vector<DIP> dipPools[VIP_NUM];  // vipIndex, dipindex -> dip
 uint16_t **newHt = 0;
 int dipNum[VIP_NUM];
+static int connCapacity = CONN_NUM;    // connections the conn tables are presized for
 
 static Hasher32<Tuple5> hasher[2];
 
+static const Counter collisions("Maglevx", "collision"), insertFails("Maglevx", "insert fail");
+
+/// dp.: what the packet path reads. cp.: what only the control plane keeps
+MemoryBreakdown getMemoryBreakdown() {
+  MemoryBreakdown b;
+  for (int i = 0; i < VIP_NUM; ++i) {
+    b.add(connTrackingTable[i].getMemoryBreakdown(), "dp.conn-table.");
+    b.addVector("dp.dip-pools", dipPools[i]);
+  }
+  b.add(getHtMemoryBreakdown(ht), "dp.");
+  b.add(getHtMemoryBreakdown(newHt), "cp.");
+  return b;
+}
+
 void printMemoryUsage() {
-  uint64_t size = 0;
+  MemoryBreakdown b = getMemoryBreakdown();
   
   int count = 0;
   for (int i = 0; i < VIP_NUM; ++i)
     count += connTrackingTable[i].EntryCount();
   
-  cout << "ConnTrackingTable size: " << (size = count * sizeof(pair<uint64_t, uint16_t>))
-       << endl;
-  size *= 1.1;
-  
-  cout << "HT table size: " << VIP_NUM * HT_SIZE * sizeof(uint16_t) + DIP_NUM * sizeof(DIP);
-  // dipTable
-  size += VIP_NUM * HT_SIZE * sizeof(uint16_t) + DIP_NUM * sizeof(DIP);
-  
-  cout << " Total memory usage: " << size << endl;
+  cout << "ConnTrackingTable entries: " << count << ", size: " << b.reserved("dp.conn-table.") << endl;
+  b.print(cout);
+  cout << "Total memory usage: " << b.reserved("dp.") << endl;
   
-  memoryLog << CONN_NUM << " " << size << endl;
+#ifndef LB_BENCH
+  memoryLog << CONN_NUM << " " << b.reserved("dp.") << endl;
+#endif
 }
 
 /**
@@ -60,6 +80,8 @@ void serve() {
     if (addr >= 0x0a800000 + VIP_NUM) addr = 0x0a800000;
     
     // Step 2: lookup the VIPTable to get VIPInd
+    bool sampled = sampleLookup();
+    uint64_t lookupStart = sampled ? tscNow() : 0;
     uint16_t vipInd = tuple.dst.addr & VIP_MASK;
     
     // Step 3: lookup connectionTracking table
@@ -67,18 +89,23 @@ void serve() {
     uint64_t hash = hasher[0](tuple);
     hash |= uint64_t(hasher[1](tuple)) << 32;
     
-    if (connTrackingTable[vipInd].Find(hash, htInd)) {
-      // done with right dip
-    } else {
+    bool found = connTrackingTable[vipInd].Find(hash, htInd);
+    if (!found) {
       miss++;
-      // Step 4: lookup consistent hashing table to get the dip and insert back
+      // Step 4: lookup consistent hashing table to get the dip
       htInd = ht[vipInd][hash & (HT_SIZE - 1)];
+    }
+    
+    DIP &dip = dipPools[vipInd][ht[vipInd][htInd]];
+    if (sampled) recordLatency(LAT_LOOKUP, tscNow() - lookupStart);
+    
+    // and insert back, timed as an insert rather than as part of the lookup
+    if (!found) {
+      ScopedLatency timer(LAT_INSERT);
       connTrackingTable[vipInd].Insert(hash, htInd);
       uint16_t tmp;
       assert(connTrackingTable[vipInd].Find(hash, tmp) && tmp == htInd);
     }
-    
-    DIP &dip = dipPools[vipInd][ht[vipInd][htInd]];
     assert(((dip.addr.addr ^ (0x0a000000 + (vipInd << 8))) < dipPools[vipInd].size() &&
             dip.addr.port - tuple.dst.port >= 0 && dip.addr.port - tuple.dst.port < dipPools[vipInd].size()));
     
@@ -100,7 +127,9 @@ void serve() {
   sync_printf("%d\b \b", stupid & 7);
   gettimeofday(&curr, NULL);
   int diff = diff_ms(curr, start);
+#ifndef LB_BENCH
   queryLog << 1 << " " << CONN_NUM << " " << 5 * LOG_INTERVAL / (diff / 1000.0) << endl;
+#endif
 }
 
 /**
@@ -123,7 +152,7 @@ void simulateConnectionAdd(int limit = 0, int prestart = 0) {
   const int repeat = 1 + 8192 / STO_NUM;
   for (int j = 0; j < repeat; ++j) {
     for (int i = 0; i < VIP_NUM; ++i)
-      connTrackingTable[i].Clear(CONN_NUM / VIP_NUM);
+      connTrackingTable[i].Clear(connCapacity / VIP_NUM);
     
     unsigned addr = 0x0a800000 + prestart % VIP_NUM;
     LFSRGen<Tuple3> tuple3Gen(0xe2211, CONN_NUM, prestart);
@@ -146,16 +175,20 @@ void simulateConnectionAdd(int limit = 0, int prestart = 0) {
       
       // Step 4: lookup consistent hashing table to get the dip and insert back
       dipInd = ht[vipInd][hash & (HT_SIZE - 1)];
+      uint64_t insertStart = tscNow();
       connTrackingTable[vipInd].Insert(hash, dipInd);
+      recordLatency(LAT_INSERT, tscNow() - insertStart);
       uint16_t tmp;
       assert(connTrackingTable[vipInd].Find(hash, tmp));
-      if (tmp != dipInd) Counter::count("Maglevx", "collision");
+      if (tmp != dipInd) collisions.add();
     }
   }
   
   gettimeofday(&curr, NULL);
   double diff = diff_us(curr, start) / 1000.0;
+#ifndef LB_BENCH
   addLog << limit << " " << diff / repeat << endl;
+#endif
 }
 
 void checkCollision() {
@@ -220,9 +253,9 @@ void simulateUpdatePoolData() {
  * update data plane to make the HT consistent with the dip weight,
  * while ensuring PCC (by modifying the mapped decode to make the flows go to the correct dip, after HT entry reassign)
  *
- * assuming dip pools and conn have been properly constructed
+ * assuming dip pools and conn have been properly constructed. onlyVip >= 0: that VIP alone, the others keep their ht
  */
-void updateDataPlane(bool mute = false) {
+void updateDataPlane(bool mute = false, int onlyVip = -1) {
   const static int M = HT_SIZE == 4096 ? 4099 : HT_SIZE == 512 ? 521 : 0;  // a prime number // 4093
   const static Hasher32<uint32_t> hash1(0xe2211), hash2(0xe2212);
   
@@ -232,7 +265,8 @@ void updateDataPlane(bool mute = false) {
   uint64_t controlPlaneConstructionTime = 0;
   uint64_t cpDpSynchronizationTime = 0;
   
-  for (uint16_t vipInd = 0; vipInd < VIP_NUM; ++vipInd) {
+  uint16_t firstVip = onlyVip < 0 ? 0 : onlyVip, lastVip = onlyVip < 0 ? VIP_NUM : onlyVip + 1;
+  for (uint16_t vipInd = firstVip; vipInd < lastVip; ++vipInd) {
     gettimeofday(&start, NULL);
     memset(newHt[vipInd], -1, sizeof(uint16_t) * HT_SIZE);
     uint16_t dipCount = dipPools[vipInd].size();
@@ -246,7 +280,7 @@ void updateDataPlane(bool mute = false) {
     // ** let dips take entries in turn with weight
     double allocatedWeight = 0;
     int allocatedEntries = 0;
-    uint16_t oneHtIndOf[dipPools[vipInd].size()];
+    vector<uint16_t> oneHtIndOf(dipCount, uint16_t(-1));   // -1: the DIP takes no entry, weight 0
     
     for (int dipInd = 0; dipInd < dipCount; ++dipInd) {
       int w = dipPools[vipInd][dipInd].weight;
@@ -274,7 +308,8 @@ void updateDataPlane(bool mute = false) {
     unordered_map<uint16_t, uint16_t> migration;
     for (uint16_t htIndex = 0; htIndex < HT_SIZE; ++htIndex) {
       uint16_t dipIndex = ht[vipInd][htIndex];
-      if (dipIndex != newHt[vipInd][htIndex]) {
+      // a DIP left with no entry has nothing to keep its connections on: they follow the new owner
+      if (dipIndex != newHt[vipInd][htIndex] && dipIndex < dipCount && oneHtIndOf[dipIndex] != uint16_t(-1)) {
         migration.insert(make_pair(htIndex, oneHtIndOf[dipIndex]));
       }
     }
@@ -287,10 +322,14 @@ void updateDataPlane(bool mute = false) {
     start = curr;
     
     // Step3: write back the new ht, and discard migrations
+    uint64_t syncStart = tscNow();
     memcpy(ht[vipInd], newHt[vipInd], HT_SIZE * sizeof(uint16_t));
+    recordLatency(LAT_SYNC, tscNow() - syncStart);
     
     // assume no collision, do the migration via traverse
+    uint64_t composeStart = tscNow();
     connTrackingTable[vipInd].Compose(migration);
+    recordLatency(LAT_COMPOSE, tscNow() - composeStart);
     
     gettimeofday(&curr, NULL);
     diff = diff_us(curr, start);
@@ -330,8 +369,9 @@ void initDipPool() {
 /**
  * reset ht and hash seed
  * init dip pool and update data plane
+ * capacity: the connections the conn tables are presized for
  */
-void initControlPlaneAndDataPlane() {
+void initControlPlaneAndDataPlane(int capacity = CONN_NUM) {
   if (ht) {
     for (int i = 0; i < VIP_NUM; ++i) {
       delete[] ht[i];
@@ -345,7 +385,7 @@ void initControlPlaneAndDataPlane() {
   
   ht = new uint16_t *[VIP_NUM];
   newHt = new uint16_t *[VIP_NUM];
-  connTrackingTable = new ControlPlaneCuckooMap<uint64_t, uint16_t, uint8_t, false>[VIP_NUM];
+  connTrackingTable = new ConnTable[VIP_NUM];
   
   for (int i = 0; i < VIP_NUM; ++i) {
     ht[i] = new uint16_t[HT_SIZE];
@@ -353,8 +393,9 @@ void initControlPlaneAndDataPlane() {
     memset(ht[i], 0, sizeof(uint16_t[HT_SIZE]));
     memset(newHt[i], 0, sizeof(uint16_t[HT_SIZE]));
     
-    connTrackingTable[i].Clear(CONN_NUM / VIP_NUM);
+    connTrackingTable[i].Clear(capacity / VIP_NUM);
   }
+  connCapacity = capacity;
   
   hasher[0].setSeed(rand());
   hasher[1].setSeed(rand());
@@ -405,6 +446,7 @@ void dynamicThroughput() {
       } else {
         // Step 4: lookup consistent hashing table to get the dip and insert back
         htInd = ht[vipInd][hash & (HT_SIZE - 1)];
+        ScopedLatency timer(LAT_INSERT);
         connTrackingTable[vipInd].Insert(hash, htInd);
         uint16_t tmp;
         assert(connTrackingTable[vipInd].Find(hash, tmp) && tmp == htInd);
@@ -420,11 +462,188 @@ void dynamicThroughput() {
     
     printf("%d\b \b", stupid & 7);
     
+#ifndef LB_BENCH
     dynamicLog << newConnPerSec << " " << LOG_INTERVAL * 1.0 * round / diff_ms(last, start) / 1000 << endl;
+#endif
   }
+#ifndef LB_BENCH
   dynamicLog.close();
+#endif
 }
 
+#ifdef CONCURRENT_READ
+static std::atomic<int> runningReaders;
+static uint32_t readerMiss[16];
+
+/**
+ * reader core: serve LOG_INTERVAL packets of the stored connections from the
+ * shared conn tables. A miss means the writer has the connection in flight,
+ * it is served from the consistent hashing table instead and never inserted.
+ */
+void *concurrentServe(int *readerId) {
+  // core 0 is the writer's. with fewer cores than NUM_THREADS + 1 the readers share them round robin
+  int core = (*readerId + 1) % int(sysconf(_SC_NPROCESSORS_ONLN));
+  int rc = stick_this_thread_to_core(core);
+  if (rc) sync_printf("reader %d: cannot pin to core %d: %s\n", *readerId, core, strerror(rc));
+  
+  unsigned prestart = *readerId * (STO_NUM / 16);
+  int addr = 0x0a800000 + prestart % VIP_NUM;
+  LFSRGen<Tuple3> tuple3Gen(0xe2211, STO_NUM, prestart);
+  uint32_t miss = 0;
+  int stupid = 0;
+  
+  for (int i = 0; i < LOG_INTERVAL; ++i) {
+    Tuple5 tuple;
+    tuple3Gen.gen((Tuple3 *) &tuple.src);
+    tuple.dst.addr = addr++;
+    tuple.dst.port = 0;
+    if (addr >= 0x0a800000 + VIP_NUM) addr = 0x0a800000;
+    
+    bool sampled = sampleLookup();
+    uint64_t lookupStart = sampled ? tscNow() : 0;
+    uint16_t vipInd = tuple.dst.addr & VIP_MASK;
+    uint16_t htInd;
+    uint64_t hash = hasher[0](tuple);
+    hash |= uint64_t(hasher[1](tuple)) << 32;
+    
+    if (!connTrackingTable[vipInd].Find(hash, htInd)) {
+      miss++;
+      htInd = ht[vipInd][hash & (HT_SIZE - 1)];
+    }
+    
+    DIP &dip = dipPools[vipInd][ht[vipInd][htInd]];
+    if (sampled) recordLatency(LAT_LOOKUP, tscNow() - lookupStart);
+    stupid += dip.addr.addr;   //prevent optimize
+  }
+  
+  readerMiss[*readerId] = miss;
+  runningReaders--;
+  sync_printf("%d\b \b", stupid & 7);
+  return 0;
+}
+
+/**
+ * the single writer, on core 0: while readers are running, keep removing a
+ * stored connection and inserting it back. Re-inserting goes through the
+ * cuckoo path moves again, and leaves the tables as they were for the next run.
+ */
+void *concurrentUpdate(uint64_t *updates) {
+  int rc = stick_this_thread_to_core(0);
+  if (rc) sync_printf("writer: cannot pin to core 0: %s\n", strerror(rc));
+  
+  int addr = 0x0a800000;
+  LFSRGen<Tuple3> tuple3Gen(0xe2211, STO_NUM, 0);
+  
+  while (runningReaders > 0) {
+    Tuple5 tuple;
+    tuple3Gen.gen((Tuple3 *) &tuple.src);
+    tuple.dst.addr = addr++;
+    tuple.dst.port = 0;
+    if (addr >= 0x0a800000 + VIP_NUM) addr = 0x0a800000;
+    
+    uint16_t vipInd = tuple.dst.addr & VIP_MASK;
+    uint64_t hash = hasher[0](tuple);
+    hash |= uint64_t(hasher[1](tuple)) << 32;
+    
+    uint16_t htInd;
+    if (!connTrackingTable[vipInd].Find(hash, htInd)) continue;
+    uint64_t start = tscNow();
+    connTrackingTable[vipInd].Remove(hash);
+    uint64_t removed = tscNow();
+    connTrackingTable[vipInd].Insert(hash, htInd);
+    recordLatency(LAT_ERASE, removed - start);
+    recordLatency(LAT_INSERT, tscNow() - removed);
+    (*updates)++;
+  }
+  
+  return 0;
+}
+
+/**
+ * serving with multi-cores: NUM_THREADS readers share the conn tables with a
+ * concurrently updating writer
+ */
+void multiThreadServe(int NUM_THREADS) {
+  pthread_t threads[16], writer;
+  int t[16];
+  uint64_t updates = 0;
+  
+  runningReaders = NUM_THREADS;
+  
+  struct timeval start, curr;
+  gettimeofday(&start, NULL);
+  
+  pthread_create(&writer, NULL, (void *(*)(void *)) concurrentUpdate, &updates);
+  for (int i = 0; i < NUM_THREADS; i++) {
+    t[i] = i;
+    int rc = pthread_create(threads + i, NULL, (void *(*)(void *)) concurrentServe, t + i);
+    if (rc) {
+      printf("ERROR; return code from pthread_create() is %d\n", rc);
+      exit(-1);
+    }
+  }
+  
+  for (int i = 0; i < NUM_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  gettimeofday(&curr, NULL);
+  pthread_join(writer, NULL);
+  
+  uint64_t miss = 0;
+  for (int i = 0; i < NUM_THREADS; i++) {
+    miss += readerMiss[i];
+  }
+  
+  double diff = diff_us(curr, start) / 1E6;
+  cout << NUM_THREADS << " readers: " << NUM_THREADS * (LOG_INTERVAL / 1E6) / diff << "Mpps, miss: " << miss
+       << ", writer: " << updates / 1E6 / diff << "M updates/s" << endl;
+#ifndef LB_BENCH
+  queryLog << NUM_THREADS << " " << CONN_NUM << " " << NUM_THREADS * LOG_INTERVAL / diff << endl;
+#endif
+}
+#endif
+
+#ifndef CONCURRENT_READ
+/**
+ * insert 4x the presized number of connections into one conn table, so that
+ * it has to grow online twice, and log the insert latency distribution.
+ * Concurrent-read tables never grow, so there is nothing to measure there
+ */
+void growthInsertLatency() {
+  ofstream growLog(NAME ".grow.data");
+  ConnTable table(CONN_NUM / VIP_NUM);
+  LatencyHistogram latency;
+  
+  LFSRGen<Tuple3> tuple3Gen(0xe2211, 4 * CONN_NUM / VIP_NUM, 0);
+  for (int i = 0; i < 4 * CONN_NUM / VIP_NUM; ++i) {
+    Tuple5 tuple;
+    tuple3Gen.gen((Tuple3 *) &tuple.src);
+    tuple.dst.addr = 0x0a800000;
+    tuple.dst.port = 0;
+    
+    uint64_t hash = hasher[0](tuple);
+    hash |= uint64_t(hasher[1](tuple)) << 32;
+    
+    uint64_t start = tscNow();
+    bool inserted = table.Insert(hash, hash & (HT_SIZE - 1)) != nullptr;
+    latency.record(tscNow() - start);
+    
+    if (!inserted) insertFails.add();
+  }
+  
+  cout << "entries: " << table.EntryCount() << ", insert p50: " << latency.percentileNs(0.5)
+       << "ns, p99: " << latency.percentileNs(0.99)
+       << "ns, p99.9: " << latency.percentileNs(0.999)
+       << "ns, max: " << latency.maxNs() << "ns" << endl;
+  
+  for (double p : {0.5, 0.9, 0.99, 0.999, 0.9999}) {
+    growLog << p << " " << latency.percentileNs(p) << endl;
+  }
+  growLog << 1 << " " << latency.maxNs() << endl;
+  growLog.close();
+}
+#endif
+
 void controlPlaneToDataPlaneUpdate() {
   ofstream updateTimeLog(NAME ".update.data");
   for (int conn = 1024 * 1024; conn <= CONN_NUM; conn *= 2) {
@@ -435,9 +654,11 @@ void controlPlaneToDataPlaneUpdate() {
     simulateConnectionAdd(conn, 0);
     simulateUpdatePoolData();
     
+    Clocker clocker("updateDataPlane " + to_string(conn) + " connections", conn);
     gettimeofday(&start, NULL);
     updateDataPlane(true);
     gettimeofday(&last, NULL);
+    clocker.stop();
     
     updateTimeLog << double(conn) / VIP_NUM << " " << diff_us(last, start) / 1000.0 / VIP_NUM << endl;
   }
@@ -445,13 +666,127 @@ void controlPlaneToDataPlaneUpdate() {
 }
 
 
+/// memory against the connection count, from what is allocated after adding them: NAME ".memcurve.data"
+void memoryCurve() {
+  ofstream curveLog(NAME ".memcurve.data");
+  for (int conns = 1024; conns <= CONN_NUM; conns *= 2) {
+    initControlPlaneAndDataPlane();
+    simulateConnectionAdd(conns, 0);
+    
+    MemoryBreakdown b = getMemoryBreakdown();
+    b.log(curveLog, conns);
+    cout << conns << " connections: " << b.reserved("dp.") << "B data plane, " << b.reserved("cp.")
+         << "B control plane, " << double(b.reserved()) / conns << "B/conn" << endl;
+  }
+}
+
+#ifdef LB_BENCH
+#include "lb_bench.h"
+
+class MaglevLoadBalancer : public LoadBalancer {
+  /// a connection the table misses is new: it takes its DIP from ht and is tracked from then on, as in serve
+  static inline Addr_Port route(const Tuple5 &tuple) {
+    uint16_t vipInd = tuple.dst.addr & VIP_MASK;
+    uint16_t htInd;
+    uint64_t hash = hasher[0](tuple);
+    hash |= uint64_t(hasher[1](tuple)) << 32;
+    
+    if (!connTrackingTable[vipInd].Find(hash, htInd)) {
+      htInd = ht[vipInd][hash & (HT_SIZE - 1)];
+      ScopedLatency timer(LAT_INSERT);
+      connTrackingTable[vipInd].Insert(hash, htInd);
+    }
+    return dipPools[vipInd][ht[vipInd][htInd]].addr;
+  }
+
+public:
+  const char *name() const override {
+    return "maglev";
+  }
+  
+  void init(int capacity) override {
+    initControlPlaneAndDataPlane(capacity);
+  }
+  
+  void addConnections(int count) override {
+    simulateConnectionAdd(count, 0);
+  }
+  
+  void addConnections(const vector<Tuple5> &packets) override {
+    for (const Tuple5 &packet : packets) route(packet);
+  }
+  
+  Addr_Port lookup(const Tuple5 &packet) override {
+    return route(packet);
+  }
+  
+  void lookupBatch(const Tuple5 *packets, int n, Addr_Port *dips) override {
+    for (int i = 0; i < n; ++i) dips[i] = route(packets[i]);
+  }
+  
+  void updateWeights() override {
+    simulateUpdatePoolData();
+    updateDataPlane(true);
+  }
+  
+  vector<DIP> dips(int vipInd) override {
+    return dipPools[vipInd];
+  }
+  
+  /// the ht of the VIP alone is rebuilt, and its conn table composed
+  void setWeights(int vipInd, const vector<int> &weights) override {
+    for (size_t i = 0; i < weights.size(); ++i) dipPools[vipInd][i].weight = weights[i];
+    updateDataPlane(true, vipInd);
+  }
+  
+  MemoryBreakdown getMemoryBreakdown() const override {
+    return ::getMemoryBreakdown();
+  }
+};
+#endif
+
 int main(int argc, char **argv) {
+#ifdef LB_BENCH
+  MaglevLoadBalancer lb;
+  return benchmarkMain(argc, argv, lb);
+#endif
+  
   init();
+
+#ifdef MEMORY_CURVE
+  cout << "--memoryCurve" << endl;
+  memoryCurve();
+  return 0;
+#endif
 //  cout << "checkCollision" << endl;
 //  checkCollision();
   simulateConnectionAdd();
   printMemoryUsage();
-  serve();
+  {
+    Clocker clocker("serve, per packet", 5 * LOG_INTERVAL);
+    serve();
+  }
+  
+  cout << "--latency" << endl;
+  ofstream latencyLog(NAME ".latency.data");
+  printLatencies(cout);
+  logLatencies(latencyLog, "static");
+  resetLatencies();
+  
+#ifndef CONCURRENT_READ
+  cout << "--growthInsertLatency" << endl;
+  growthInsertLatency();
+#else
+  cout << "--multiThreadServe" << endl;
+  for (int readers = 1; readers <= 16; readers *= 2) {
+    multiThreadServe(readers);
+  }
+  
+  cout << "--latency" << endl;
+  printLatencies(cout);
+  logLatencies(latencyLog, "concurrent");
+  resetLatencies();
+#endif
   
   // Clean control plane and data plane
   initControlPlaneAndDataPlane();
@@ -464,6 +799,10 @@ int main(int argc, char **argv) {
     initControlPlaneAndDataPlane();
     cout << "--controlPlaneToDataPlaneUpdate" << endl;
     controlPlaneToDataPlaneUpdate();
+    
+    cout << "--latency" << endl;
+    printLatencies(cout);
+    logLatencies(latencyLog, "dynamic");
   }
   return 0;
 }
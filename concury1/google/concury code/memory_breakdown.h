@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <iomanip>
+#include <malloc.h>
+
+using namespace std;
+
+/*! \file memory_breakdown.h
+ *  What the load balancer structures really hold in memory, component by component.
+ */
+
+/// bytes the allocator handed out for p: malloc_usable_size plus the chunk header. 0 for nullptr
+inline uint64_t heapBytes(const void *p) {
+  return p ? malloc_usable_size(const_cast<void *>(p)) + sizeof(size_t) : 0;
+}
+
+/// used: the bytes that hold live entries. reserved: the bytes allocated for them, capacity slack and allocator
+/// rounding included, so the sum of reserved is what a host has to provide
+struct MemoryComponent {
+  string name;
+  uint64_t used;
+  uint64_t reserved;
+};
+
+class MemoryBreakdown {
+public:
+  vector<MemoryComponent> components;
+  
+  /// add to the component of that name, or append it
+  MemoryBreakdown &add(const string &name, uint64_t used, uint64_t reserved) {
+    for (MemoryComponent &c : components) {
+      if (c.name != name) continue;
+      c.used += used;
+      c.reserved += reserved;
+      return *this;
+    }
+    components.push_back({name, used, reserved});
+    return *this;
+  }
+  
+  /// add every component of other, named prefix + its name. summing the breakdowns of all VIPs merges them by name
+  MemoryBreakdown &add(const MemoryBreakdown &other, const string &prefix = "") {
+    for (const MemoryComponent &c : other.components) add(prefix + c.name, c.used, c.reserved);
+    return *this;
+  }
+  
+  /// size() elements used, the heap block reserved; recursing into vectors of vectors
+  template<class T>
+  MemoryBreakdown &addVector(const string &name, const vector<T> &v) {
+    uint64_t used = 0, reserved = 0;
+    vectorBytes(v, used, reserved);
+    return add(name, used, reserved);
+  }
+  
+  /// of the components whose name starts with prefix
+  uint64_t used(const string &prefix = "") const {
+    uint64_t sum = 0;
+    for (const MemoryComponent &c : components) {
+      if (c.name.compare(0, prefix.size(), prefix) == 0) sum += c.used;
+    }
+    return sum;
+  }
+  
+  uint64_t reserved(const string &prefix = "") const {
+    uint64_t sum = 0;
+    for (const MemoryComponent &c : components) {
+      if (c.name.compare(0, prefix.size(), prefix) == 0) sum += c.reserved;
+    }
+    return sum;
+  }
+  
+  void print(ostream &os) const {
+    for (const MemoryComponent &c : components) {
+      os << "  " << setw(28) << left << c.name << right << " used " << setw(12) << c.used << " reserved "
+         << setw(12) << c.reserved << endl;
+    }
+    os << "  " << setw(28) << left << "total" << right << " used " << setw(12) << used() << " reserved "
+       << setw(12) << reserved() << endl;
+  }
+  
+  /// one line per component: conns name used reserved, the format of the .memcurve.data logs
+  void log(ostream &os, uint64_t conns) const {
+    for (const MemoryComponent &c : components) os << conns << " " << c.name << " " << c.used << " " << c.reserved << "\n";
+    os << conns << " total " << used() << " " << reserved() << endl;
+  }
+
+private:
+  template<class T>
+  static void vectorBytes(const vector<T> &v, uint64_t &used, uint64_t &reserved) {
+    used += v.size() * sizeof(T);
+    reserved += heapBytes(v.data());
+  }
+  
+  template<class T>
+  static void vectorBytes(const vector<vector<T>> &v, uint64_t &used, uint64_t &reserved) {
+    used += v.size() * sizeof(vector<T>);
+    reserved += heapBytes(v.data());
+    for (const vector<T> &inner : v) vectorBytes(inner, used, reserved);
+  }
+};
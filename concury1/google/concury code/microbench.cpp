@@ -0,0 +1,396 @@
+/**
+ * Kernel microbenchmarks: the primitives under the end-to-end numbers of concury.cpp, maglevx.cpp and silkroad.cpp,
+ * each timed on its own, so that a change in Mpps can be traced to the primitive that moved.
+ *
+ *   hasher64        Hasher64<Tuple3>, the hash of getIndices
+ *   getIndices      hash and map a key to its cells in array A and array B
+ *   memGet          read one cell, at the cells of the keys in key order
+ *   query           DataPlaneOthello::query, getIndices and two memGet
+ *   insert          ControlPlaneOthello::insert into a table presized for all keys
+ *   erase           ControlPlaneOthello::erase of every key
+ *   compose         ControlPlaneOthello::compose moving a sixteenth of the values, per key
+ *   representative  DisjointSet::representative over a forest of 2 * keys nodes, path compressed by the warmup
+ *   cuckooFind      DataPlaneCuckooMap::Find of keys all present, the conn table of silkroad.cpp
+ *   lfsrGen         LFSRGen<Tuple3>::gen of all keys, how the benchmarks draw their connections
+ *   lfsrGenN        LFSRGen<Tuple3>::genN of all keys at once
+ *
+ * The Othello is the one of Concury: ConcuryControlPlane, but with 32-bit key ids so that any key count fits.
+ *
+ * Each kernel runs over a list of key counts, from an L1 resident structure to a DRAM resident one; the bytes column
+ * is what the kernel reads. Per key count: one untimed warmup, then --reps timed repetitions. A repetition of a read
+ * kernel is at least --ops operations over the keys in turn; one of a mutating kernel is one pass over all keys on a
+ * table rebuilt before it, untimed. Repetitions slower than the median by more than 3 median absolute deviations are
+ * outliers (an interrupt, a page fault, a migration to another core) and left out of the mean, unless within 5% of
+ * it. ns/op and Mops are of the median.
+ *
+ * Arguments, all optional:
+ *   --keys n[,n...]     key counts                   (default 1024,16384,262144,4194304)
+ *   --reps n            timed repetitions            (default 9)
+ *   --ops n             operations per read rep      (default 1M)
+ *   --kernels a[,b...]  only these kernels           (default all)
+ *   --json file         where the results go         (default NAME ".json")
+ */
+#include "concury.common.h"
+#include "presized_cuckoo/control_plane_cuckoo_map.h"
+#include "json_writer.h"
+
+typedef ControlPlaneOthello<Tuple3, uint16_t, 12, CONCURY_DL, false, false, false> BenchControlPlane;
+
+/// what the data plane does between its public calls, exposed
+class ProbedDataPlane : public ConcuryDataPlane {
+public:
+  using ConcuryDataPlane::getIndices;
+  using ConcuryDataPlane::memGet;
+};
+
+typedef ControlPlaneCuckooMap<Tuple5, uint8_t> BenchCuckooControlPlane;   // default layout, as the conn tables of silkroad.cpp
+typedef DataPlaneCuckooMap<Tuple5, uint8_t> BenchCuckooDataPlane;
+
+struct BenchParams {
+  vector<int> keys;
+  int reps = 9;
+  uint64_t ops = 1 << 20;
+  vector<string> kernels;
+  string json = NAME ".json";
+  
+  bool selected(const string &kernel) const {
+    return kernels.empty() || find(kernels.begin(), kernels.end(), kernel) != kernels.end();
+  }
+};
+
+static bool parseParams(int argc, char **argv, BenchParams &p) {
+  for (int i = 1; i < argc; i += 2) {
+    string arg = argv[i];
+    if (i + 1 == argc) {
+      cerr << arg << " needs a value" << endl;
+      return false;
+    }
+    const char *value = argv[i + 1];
+    
+    if (arg == "--keys") {
+      for (const string &s : split(value, ',')) p.keys.push_back(atoi(s.c_str()));
+    } else if (arg == "--reps") {
+      p.reps = atoi(value);
+    } else if (arg == "--ops") {
+      p.ops = strtoull(value, nullptr, 10);
+    } else if (arg == "--kernels") {
+      p.kernels = split(value, ',');
+    } else if (arg == "--json") {
+      p.json = value;
+    } else {
+      cerr << "unknown argument " << arg << endl;
+      return false;
+    }
+  }
+  
+  if (p.keys.empty()) p.keys = {1024, 16384, 262144, 4194304};
+  for (int keys : p.keys) {
+    if (keys <= 0) {
+      cerr << "--keys " << keys << ": must be positive" << endl;
+      return false;
+    }
+  }
+  if (p.reps <= 0 || p.ops == 0) {
+    cerr << "--reps and --ops must be positive" << endl;
+    return false;
+  }
+  return true;
+}
+
+/// the repetitions of one kernel at one key count, in ns/op
+struct Sample {
+  vector<double> ns;
+  double median, min, mean, mad;
+  int outliers;
+};
+
+static Sample summarize(vector<double> ns) {
+  Sample s;
+  sort(ns.begin(), ns.end());
+  s.ns = ns;
+  s.median = ns[ns.size() / 2];
+  s.min = ns[0];
+  
+  vector<double> deviations;
+  for (double x : ns) deviations.push_back(fabs(x - s.median));
+  sort(deviations.begin(), deviations.end());
+  s.mad = deviations[deviations.size() / 2];
+  
+  double sum = 0, limit = s.median + max(3 * s.mad, 0.05 * s.median);
+  int kept = 0;
+  for (double x : ns) {
+    if (x > limit) continue;
+    sum += x;
+    ++kept;
+  }
+  s.mean = sum / kept;
+  s.outliers = (int) ns.size() - kept;
+  return s;
+}
+
+static volatile uint64_t sink;    // what the kernels computed, so that none of it is optimized away
+
+static inline uint64_t nowNs() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/**
+ * One warmup and reps timed repetitions of run, each ops operations long, with prepare before each of them untimed.
+ * run returns something derived from what it computed. Timed in ns rather than with gettimeofday, since a
+ * repetition of a mutating kernel on 1K keys takes a few us.
+ */
+template<class Prepare, class Run>
+static Sample measure(int reps, uint64_t ops, Prepare prepare, Run run) {
+  vector<double> ns;
+  
+  for (int r = -1; r < reps; ++r) {
+    prepare();
+    uint64_t start = nowNs();
+    sink += run();
+    uint64_t end = nowNs();
+    if (r >= 0) ns.push_back(double(end - start) / ops);
+  }
+  return summarize(ns);
+}
+
+/// ops read operations over n keys in turn, at least one pass
+static uint64_t readOps(const BenchParams &p, int n) {
+  return max<uint64_t>(p.ops, n);
+}
+
+static void report(JsonWriter &json, const string &kernel, int keys, uint64_t bytes, uint64_t ops, const Sample &s) {
+  cout << dec << left << setw(16) << kernel << right << setw(10) << keys << setw(12) << bytes << fixed
+       << setprecision(2) << setw(10) << s.median << setw(10) << s.min << setw(10) << s.mean << setw(10) << s.mad
+       << setw(10) << 1000 / s.median << setw(6) << s.outliers << defaultfloat << endl;
+  
+  json.beginObject();
+  json.field("kernel", kernel).field("keys", keys).field("bytes", bytes).field("ops_per_rep", ops);
+  json.field("ns_per_op", s.median).field("ops_per_s", 1E9 / s.median);
+  json.field("min_ns", s.min).field("mean_ns", s.mean).field("mad_ns", s.mad).field("outliers", s.outliers);
+  json.key("reps_ns").beginArray();
+  for (double x : s.ns) json.value(x);
+  json.endArray();
+  json.endObject();
+}
+
+static vector<Tuple3> makeKeys(int n) {
+  vector<Tuple3> keys(n);
+  LFSRGen<Tuple3> tuple3Gen(0xe2211, n, 0);
+  tuple3Gen.genN(keys.data(), n);
+  return keys;
+}
+
+static void fill(BenchControlPlane &cp, const vector<Tuple3> &keys) {
+  for (uint32_t i = 0; i < keys.size(); ++i) cp.insert(make_pair(keys[i], uint16_t(i & 0xfff)));
+}
+
+static void benchOthello(const BenchParams &p, int n, JsonWriter &json) {
+  vector<Tuple3> keys = makeKeys(n);
+  uint64_t ops = readOps(p, n);
+  
+  unique_ptr<BenchControlPlane> cp(new BenchControlPlane(n));
+  fill(*cp, keys);
+  ProbedDataPlane dp;
+  dp.fullSync(*cp);
+  
+  if (p.selected("hasher64")) {
+    Hasher64<Tuple3> h = dp.getH();
+    Sample s = measure(p.reps, ops, [] {}, [&] {
+      uint64_t x = 0;
+      for (uint64_t i = 0, j = 0; i < ops; ++i) {
+        x += h(keys[j]);
+        if (++j == keys.size()) j = 0;
+      }
+      return x;
+    });
+    report(json, "hasher64", n, keys.size() * sizeof(Tuple3), ops, s);
+  }
+  
+  if (p.selected("getIndices")) {
+    Sample s = measure(p.reps, ops, [] {}, [&] {
+      uint64_t x = 0;
+      for (uint64_t i = 0, j = 0; i < ops; ++i) {
+        x += dp.getIndices(keys[j]);
+        if (++j == keys.size()) j = 0;
+      }
+      return x;
+    });
+    report(json, "getIndices", n, keys.size() * sizeof(Tuple3), ops, s);
+  }
+  
+  if (p.selected("memGet")) {
+    vector<uint32_t> cells;
+    for (const Tuple3 &k : keys) {
+      uint64_t hash = dp.getIndices(k);
+      cells.push_back(uint32_t(hash));
+      cells.push_back(uint32_t(hash >> 32));
+    }
+    Sample s = measure(p.reps, ops, [] {}, [&] {
+      uint64_t x = 0;
+      for (uint64_t i = 0, j = 0; i < ops; ++i) {
+        x += dp.memGet(cells[j]);
+        if (++j == cells.size()) j = 0;
+      }
+      return x;
+    });
+    report(json, "memGet", n, dp.getMemoryCost(), ops, s);
+  }
+  
+  if (p.selected("query")) {
+    Sample s = measure(p.reps, ops, [] {}, [&] {
+      uint64_t x = 0;
+      uint16_t v;
+      for (uint64_t i = 0, j = 0; i < ops; ++i) {
+        x += dp.query(keys[j], v) + v;
+        if (++j == keys.size()) j = 0;
+      }
+      return x;
+    });
+    report(json, "query", n, dp.getMemoryCost(), ops, s);
+  }
+  
+  if (p.selected("insert")) {
+    Sample s = measure(p.reps, n, [&] {
+      cp.reset();
+      cp.reset(new BenchControlPlane(n));
+    }, [&] {
+      fill(*cp, keys);
+      return (uint64_t) cp->size();
+    });
+    report(json, "insert", n, cp->getMemoryCost(), n, s);
+  }
+  
+  if (p.selected("erase")) {
+    Sample s = measure(p.reps, n, [&] {
+      if (cp->size() == 0) fill(*cp, keys);
+    }, [&] {
+      for (const Tuple3 &k : keys) cp->erase(k);
+      return (uint64_t) cp->size();
+    });
+    report(json, "erase", n, cp->getMemoryCost(), n, s);
+  }
+  
+  if (p.selected("compose")) {
+    unordered_map<uint16_t, uint16_t> migration;
+    for (uint16_t v = 0; v < 0x1000; v += 16) migration[v] = uint16_t((v + 1) & 0xfff);
+    Sample s = measure(p.reps, n, [&] {
+      if (cp->size() == 0) fill(*cp, keys);
+    }, [&] {
+      cp->compose(migration);
+      return (uint64_t) cp->size();
+    });
+    report(json, "compose", n, cp->getMemoryCost(), n, s);
+  }
+}
+
+static void benchDisjointSet(const BenchParams &p, int n, JsonWriter &json) {
+  if (!p.selected("representative")) return;
+  
+  // the connectivity forest of an Othello: ma + mb nodes, an edge per key
+  int nodes = 2 * n;
+  DisjointSet ds(nodes);
+  mt19937 rng(0xe2211);
+  for (int i = 0; i < n; ++i) ds.merge(int(rng() % nodes), int(rng() % nodes));
+  vector<int> queries(n);
+  for (int &q : queries) q = int(rng() % nodes);
+  
+  uint64_t ops = readOps(p, n);
+  Sample s = measure(p.reps, ops, [] {}, [&] {
+    uint64_t x = 0;
+    for (uint64_t i = 0, j = 0; i < ops; ++i) {
+      x += ds.representative(queries[j]);
+      if (++j == queries.size()) j = 0;
+    }
+    return x;
+  });
+  report(json, "representative", n, ds.getMemoryCost(), ops, s);
+}
+
+static void benchCuckoo(const BenchParams &p, int n, JsonWriter &json) {
+  if (!p.selected("cuckooFind")) return;
+  
+  vector<Tuple5> keys;
+  unique_ptr<BenchCuckooControlPlane> cp(new BenchCuckooControlPlane(n));
+  unique_ptr<BenchCuckooDataPlane> dp(new BenchCuckooDataPlane(*cp));
+  cp->SetAssociated(*dp);
+  
+  Tuple5 tuple;
+  tuple.dst.addr = 0x0a800000;
+  tuple.dst.port = 0;
+  for (const Tuple3 &k : makeKeys(n)) {
+    memcpy(&tuple.src, &k, sizeof(Tuple3));
+    if (!cp->Insert(tuple, uint8_t(keys.size()))) break;
+    keys.push_back(tuple);
+  }
+  
+  uint64_t ops = readOps(p, n);
+  Sample s = measure(p.reps, ops, [] {}, [&] {
+    uint64_t x = 0;
+    uint8_t version;
+    for (uint64_t i = 0, j = 0; i < ops; ++i) {
+      x += dp->Find(keys[j], &version) + version;
+      if (++j == keys.size()) j = 0;
+    }
+    return x;
+  });
+  report(json, "cuckooFind", n, dp->getMemoryBreakdown().reserved(), ops, s);
+}
+
+static void benchLFSR(const BenchParams &p, int n, JsonWriter &json) {
+  vector<Tuple3> keys(n);
+  LFSRGen<Tuple3> tuple3Gen(0xe2211, n, 0);
+  
+  if (p.selected("lfsrGen")) {
+    Sample s = measure(p.reps, n, [&] { tuple3Gen.reset(); }, [&] {
+      for (Tuple3 &k : keys) tuple3Gen.gen(&k);
+      return keys[n - 1].src.addr;
+    });
+    report(json, "lfsrGen", n, n * sizeof(Tuple3), n, s);
+  }
+  
+  if (p.selected("lfsrGenN")) {
+    Sample s = measure(p.reps, n, [&] { tuple3Gen.reset(); }, [&] {
+      tuple3Gen.genN(keys.data(), n);
+      return keys[n - 1].src.addr;
+    });
+    report(json, "lfsrGenN", n, n * sizeof(Tuple3), n, s);
+  }
+}
+
+int main(int argc, char **argv) {
+  BenchParams p;
+  if (!parseParams(argc, argv, p)) return 1;
+  
+  commonInit();
+  
+  ofstream out(p.json);
+  if (!out) {
+    cerr << "cannot write " << p.json << endl;
+    return 1;
+  }
+  
+  JsonWriter json(out);
+  json.beginObject();
+  json.field("name", NAME).field("compiler", __VERSION__);
+  json.key("params").beginObject();
+  json.field("reps", p.reps).field("ops", p.ops);
+  json.endObject();
+  
+  cout << left << setw(16) << "kernel" << right << setw(10) << "keys" << setw(12) << "bytes" << setw(10) << "ns/op"
+       << setw(10) << "min" << setw(10) << "mean" << setw(10) << "mad" << setw(10) << "Mops" << setw(6) << "out"
+       << endl;
+  json.key("results").beginArray();
+  for (int n : p.keys) {
+    benchOthello(p, n, json);
+    benchDisjointSet(p, n, json);
+    benchCuckoo(p, n, json);
+    benchLFSR(p, n, json);
+  }
+  json.endArray();
+  json.endObject();
+  
+  cout << "results in " << p.json << endl;
+  return 0;
+}
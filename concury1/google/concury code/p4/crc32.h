@@ -0,0 +1,180 @@
+/*!
+ \file crc32.h
+ The crc32 of BMv2 (CRC-32/IEEE, the one of zlib) in several implementations that return bit-identical results.
+
+ - crc32Bytewise: the byte-at-a-time loop over table_crc32 that Hasher32 started with, kept as the reference
+ - crc32Slice8 / crc32Slice16: slicing-by-8/16, 8 or 16 bytes per step through 8 or 16 independent table lookups
+ - crc32Clmul: carry-less multiplication (PCLMULQDQ). The keys are short, so there is no 4x128-bit folding: every 8
+   bytes are folded into the 32-bit state by x^64 and reduced with the bit-reflected Barrett step, 3 multiplications
+
+ crc32() dispatches on what the CPU supports, checked once per process. crc_bench.cpp checks every
+ implementation against the reference and measures them.
+ */
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <wmmintrin.h>
+#include <smmintrin.h>
+
+const static uint32_t table_crc32[] = { 0x00000000, 0x04C11DB7, 0x09823B6E, 0x0D4326D9, 0x130476DC, 0x17C56B6B, 0x1A864DB2, 0x1E475005, 0x2608EDB8, 0x22C9F00F, 0x2F8AD6D6, 0x2B4BCB61, 0x350C9B64, 0x31CD86D3, 0x3C8EA00A, 0x384FBDBD, 0x4C11DB70, 0x48D0C6C7, 0x4593E01E, 0x4152FDA9, 0x5F15ADAC, 0x5BD4B01B, 0x569796C2, 0x52568B75, 0x6A1936C8, 0x6ED82B7F, 0x639B0DA6, 0x675A1011, 0x791D4014, 0x7DDC5DA3, 0x709F7B7A, 0x745E66CD, 0x9823B6E0, 0x9CE2AB57, 0x91A18D8E, 0x95609039, 0x8B27C03C, 0x8FE6DD8B, 0x82A5FB52, 0x8664E6E5, 0xBE2B5B58, 0xBAEA46EF, 0xB7A96036, 0xB3687D81, 0xAD2F2D84, 0xA9EE3033, 0xA4AD16EA, 0xA06C0B5D, 0xD4326D90, 0xD0F37027, 0xDDB056FE, 0xD9714B49, 0xC7361B4C, 0xC3F706FB, 0xCEB42022, 0xCA753D95, 0xF23A8028, 0xF6FB9D9F, 0xFBB8BB46, 0xFF79A6F1, 0xE13EF6F4, 0xE5FFEB43, 0xE8BCCD9A, 0xEC7DD02D, 0x34867077, 0x30476DC0, 0x3D044B19, 0x39C556AE, 0x278206AB, 0x23431B1C, 0x2E003DC5, 0x2AC12072, 0x128E9DCF, 0x164F8078, 0x1B0CA6A1, 0x1FCDBB16, 0x018AEB13, 0x054BF6A4, 0x0808D07D, 0x0CC9CDCA, 0x7897AB07, 0x7C56B6B0, 0x71159069, 0x75D48DDE, 0x6B93DDDB, 0x6F52C06C, 0x6211E6B5, 0x66D0FB02, 0x5E9F46BF, 0x5A5E5B08, 0x571D7DD1, 0x53DC6066, 0x4D9B3063, 0x495A2DD4, 0x44190B0D, 0x40D816BA, 0xACA5C697, 0xA864DB20, 0xA527FDF9, 0xA1E6E04E, 0xBFA1B04B, 0xBB60ADFC, 0xB6238B25, 0xB2E29692, 0x8AAD2B2F, 0x8E6C3698, 0x832F1041, 0x87EE0DF6, 0x99A95DF3, 0x9D684044, 0x902B669D, 0x94EA7B2A, 0xE0B41DE7, 0xE4750050, 0xE9362689, 0xEDF73B3E, 0xF3B06B3B, 0xF771768C, 0xFA325055, 0xFEF34DE2, 0xC6BCF05F, 0xC27DEDE8, 0xCF3ECB31, 0xCBFFD686, 0xD5B88683, 0xD1799B34, 0xDC3ABDED, 0xD8FBA05A, 0x690CE0EE, 0x6DCDFD59, 0x608EDB80, 0x644FC637, 0x7A089632, 0x7EC98B85, 0x738AAD5C, 0x774BB0EB, 0x4F040D56, 0x4BC510E1, 0x46863638, 0x42472B8F, 0x5C007B8A, 0x58C1663D, 0x558240E4, 0x51435D53, 0x251D3B9E, 0x21DC2629, 0x2C9F00F0, 0x285E1D47, 0x36194D42, 0x32D850F5, 0x3F9B762C, 0x3B5A6B9B, 0x0315D626, 0x07D4CB91, 0x0A97ED48, 0x0E56F0FF, 0x1011A0FA, 0x14D0BD4D, 0x19939B94, 0x1D528623, 0xF12F560E, 0xF5EE4BB9, 0xF8AD6D60, 0xFC6C70D7, 0xE22B20D2, 0xE6EA3D65, 0xEBA91BBC, 0xEF68060B, 0xD727BBB6, 0xD3E6A601, 0xDEA580D8, 0xDA649D6F, 0xC423CD6A, 0xC0E2D0DD, 0xCDA1F604, 0xC960EBB3, 0xBD3E8D7E, 0xB9FF90C9, 0xB4BCB610, 0xB07DABA7, 0xAE3AFBA2, 0xAAFBE615, 0xA7B8C0CC, 0xA379DD7B, 0x9B3660C6, 0x9FF77D71, 0x92B45BA8, 0x9675461F, 0x8832161A, 0x8CF30BAD, 0x81B02D74, 0x857130C3, 0x5D8A9099, 0x594B8D2E, 0x5408ABF7, 0x50C9B640, 0x4E8EE645, 0x4A4FFBF2, 0x470CDD2B, 0x43CDC09C, 0x7B827D21, 0x7F436096, 0x7200464F, 0x76C15BF8, 0x68860BFD, 0x6C47164A, 0x61043093, 0x65C52D24, 0x119B4BE9, 0x155A565E, 0x18197087, 0x1CD86D30, 0x029F3D35, 0x065E2082, 0x0B1D065B, 0x0FDC1BEC, 0x3793A651, 0x3352BBE6, 0x3E119D3F, 0x3AD08088, 0x2497D08D, 0x2056CD3A, 0x2D15EBE3, 0x29D4F654, 0xC5A92679, 0xC1683BCE, 0xCC2B1D17, 0xC8EA00A0, 0xD6AD50A5, 0xD26C4D12, 0xDF2F6BCB, 0xDBEE767C, 0xE3A1CBC1, 0xE760D676, 0xEA23F0AF, 0xEEE2ED18, 0xF0A5BD1D, 0xF464A0AA, 0xF9278673, 0xFDE69BC4, 0x89B8FD09, 0x8D79E0BE, 0x803AC667, 0x84FBDBD0, 0x9ABC8BD5, 0x9E7D9662, 0x933EB0BB, 0x97FFAD0C, 0xAFB010B1, 0xAB710D06, 0xA6322BDF, 0xA2F33668, 0xBCB4666D, 0xB8757BDA, 0xB5365D03, 0xB1F740B4 };
+
+template<typename T>
+T reflect(T data, int nBits) {
+  T reflection = static_cast<T>(0x00);
+  int bit;
+  
+  // Reflect the data about the center bit.
+  for (bit = 0; bit < nBits; ++bit) {
+    // If the LSB bit is set, set the reflection of it.
+    if (data & 0x01) {
+      reflection |= (static_cast<T>(1) << ((nBits - 1) - bit));
+    }
+    data = (data >> 1);
+  }
+  
+  return reflection;
+}
+
+//! the reference: MSB-first table, input and output reflected, as in the CRC model of the P4 spec
+inline uint32_t crc32Bytewise(const void *buf, size_t len) {
+  const char *p = (const char *) buf;
+  uint32_t remainder = 0xFFFFFFFF;
+  uint32_t final_xor_value = 0xFFFFFFFF;
+  for (unsigned int byte = 0; byte < len; byte++) {
+    int data = reflect<uint32_t>(p[byte], 8) ^ (remainder >> 24);
+    remainder = table_crc32[data] ^ (remainder << 8);
+  }
+  return reflect<uint32_t>(remainder, 32) ^ final_xor_value;
+}
+
+//! the reflected tables of slicing-by-16. t[k][b] is the CRC of byte b followed by k zero bytes
+struct Crc32SliceTables {
+  uint32_t t[16][256];
+  
+  constexpr Crc32SliceTables()
+      : t() {
+    for (uint32_t b = 0; b < 256; ++b) {
+      uint32_t crc = b;
+      for (int bit = 0; bit < 8; ++bit) {
+        crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+      }
+      t[0][b] = crc;
+    }
+    for (int k = 1; k < 16; ++k) {
+      for (uint32_t b = 0; b < 256; ++b) {
+        t[k][b] = (t[k - 1][b] >> 8) ^ t[0][t[k - 1][b] & 0xFF];
+      }
+    }
+  }
+};
+
+static constexpr Crc32SliceTables crc32Tables{};
+
+//! the state is the reflected remainder before the final xor, the same for every *Update below
+inline uint32_t crc32TailUpdate(uint32_t crc, const uint8_t *p, size_t len) {
+  while (len--) {
+    crc = (crc >> 8) ^ crc32Tables.t[0][(crc ^ *p++) & 0xFF];
+  }
+  return crc;
+}
+
+inline uint32_t crc32Slice8Step(uint32_t crc, uint64_t v) {
+  const uint32_t (*t)[256] = crc32Tables.t;
+  v ^= crc;
+  return t[7][v & 0xFF] ^ t[6][(v >> 8) & 0xFF] ^ t[5][(v >> 16) & 0xFF] ^ t[4][(v >> 24) & 0xFF]
+         ^ t[3][(v >> 32) & 0xFF] ^ t[2][(v >> 40) & 0xFF] ^ t[1][(v >> 48) & 0xFF] ^ t[0][v >> 56];
+}
+
+inline uint32_t crc32Slice8Update(uint32_t crc, const uint8_t *p, size_t len) {
+  for (; len >= 8; p += 8, len -= 8) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    crc = crc32Slice8Step(crc, v);
+  }
+  return crc32TailUpdate(crc, p, len);
+}
+
+inline uint32_t crc32Slice16Update(uint32_t crc, const uint8_t *p, size_t len) {
+  const uint32_t (*t)[256] = crc32Tables.t;
+  for (; len >= 16; p += 16, len -= 16) {
+    uint64_t v, w;
+    memcpy(&v, p, 8);
+    memcpy(&w, p + 8, 8);
+    v ^= crc;
+    crc = t[15][v & 0xFF] ^ t[14][(v >> 8) & 0xFF] ^ t[13][(v >> 16) & 0xFF] ^ t[12][(v >> 24) & 0xFF]
+          ^ t[11][(v >> 32) & 0xFF] ^ t[10][(v >> 40) & 0xFF] ^ t[9][(v >> 48) & 0xFF] ^ t[8][v >> 56]
+          ^ t[7][w & 0xFF] ^ t[6][(w >> 8) & 0xFF] ^ t[5][(w >> 16) & 0xFF] ^ t[4][(w >> 24) & 0xFF]
+          ^ t[3][(w >> 32) & 0xFF] ^ t[2][(w >> 40) & 0xFF] ^ t[1][(w >> 48) & 0xFF] ^ t[0][w >> 56];
+  }
+  return crc32Slice8Update(crc, p, len);
+}
+
+/*!
+ PCLMULQDQ works on bit-reflected operands, so the constants are the reflected ones shifted left by one:
+ x^64 mod P to fold the first 4 bytes of a word over the last 4, then mu = x^64 / P and P itself for the Barrett step
+ that turns the folded 64 bits into the 32-bit remainder.
+ */
+#define CRC32_CLMUL_X64       0x163CD6124ULL
+#define CRC32_CLMUL_MU        0x1F7011641ULL
+#define CRC32_CLMUL_POLY      0x1DB710641ULL
+
+__attribute__((target("pclmul,sse4.1")))
+inline uint32_t crc32ClmulReduce(__m128i x) {
+  const __m128i mask32 = _mm_setr_epi32(-1, 0, 0, 0);
+  const __m128i k = _mm_set_epi64x(CRC32_CLMUL_MU, CRC32_CLMUL_POLY);
+  __m128i t1 = _mm_clmulepi64_si128(_mm_and_si128(x, mask32), k, 0x10);
+  __m128i t2 = _mm_clmulepi64_si128(_mm_and_si128(t1, mask32), k, 0x00);
+  return (uint32_t) _mm_extract_epi32(_mm_xor_si128(x, t2), 1);
+}
+
+__attribute__((target("pclmul,sse4.1")))
+inline uint32_t crc32ClmulUpdate(uint32_t crc, const uint8_t *p, size_t len) {
+  const __m128i x64 = _mm_cvtsi64_si128((long long) CRC32_CLMUL_X64);
+  for (; len >= 8; p += 8, len -= 8) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    v ^= crc;
+    __m128i folded = _mm_clmulepi64_si128(_mm_cvtsi32_si128((int) (uint32_t) v), x64, 0x00);
+    crc = crc32ClmulReduce(_mm_xor_si128(folded, _mm_cvtsi32_si128((int) (v >> 32))));
+  }
+  if (len >= 4) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    crc = crc32ClmulReduce(_mm_cvtsi32_si128((int) (crc ^ v)));
+    p += 4;
+    len -= 4;
+  }
+  return crc32TailUpdate(crc, p, len);
+}
+
+inline uint32_t crc32Slice8(const void *buf, size_t len) {
+  return ~crc32Slice8Update(0xFFFFFFFF, (const uint8_t *) buf, len);
+}
+
+inline uint32_t crc32Slice16(const void *buf, size_t len) {
+  return ~crc32Slice16Update(0xFFFFFFFF, (const uint8_t *) buf, len);
+}
+
+inline uint32_t crc32Clmul(const void *buf, size_t len) {
+  return ~crc32ClmulUpdate(0xFFFFFFFF, (const uint8_t *) buf, len);
+}
+
+typedef uint32_t (*Crc32Function)(const void *buf, size_t len);
+
+inline bool crc32HasClmul() {
+  static const bool has = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+  return has;
+}
+
+//! the fastest implementation on this CPU, by crc_bench: clmul, or slice16 without PCLMULQDQ
+inline Crc32Function crc32Select() {
+  return crc32HasClmul() ? crc32Clmul : crc32Slice16;
+}
+
+//! the same choice as crc32Select, on a flag rather than through a pointer so the hash inlines into its caller
+inline uint32_t crc32(const void *buf, size_t len) {
+  static const bool clmul = crc32HasClmul();
+  return clmul ? crc32Clmul(buf, len) : crc32Slice16(buf, len);
+}
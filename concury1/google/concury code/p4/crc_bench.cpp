@@ -0,0 +1,158 @@
+/**
+ * The CRC-32 implementations of crc32.h: a differential test against crc32Bytewise, the table loop Hasher32 used to
+ * run, then ns/key of each on the keys the switch hashes.
+ *
+ * The keys are built the way Hasher32 builds them before hashing, which is the field list of the hash in
+ * load_balance.p4: source address + seed and source port in network order, the protocol and a zero byte. TCP and UDP
+ * differ in the protocol only. The IPv6 tuple and the plain 32-bit key (the other branch of Hasher32) are covered too.
+ *
+ * Exits with 1 on any mismatch.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <random>
+#include <sys/time.h>
+
+#include "../common.h"
+#include "crc32.h"
+
+using namespace std;
+
+struct Impl {
+  const char *name;
+  Crc32Function f;
+};
+
+static vector<Impl> impls() {
+  vector<Impl> v = {{"bytewise", crc32Bytewise}, {"slice8", crc32Slice8}, {"slice16", crc32Slice16}};
+  if (crc32HasClmul()) v.push_back({"clmul", crc32Clmul});
+  v.push_back({"dispatch", crc32});
+  return v;
+}
+
+// what Hasher32::operator()(const Tuple3 &) hashes, without libtins
+static Tuple3 p4Key(Tuple3 t, uint32_t seed) {
+  t.src.addr = __builtin_bswap32(t.src.addr + seed);
+  t.src.port = __builtin_bswap16(t.src.port);
+  return t;
+}
+
+struct KeySet {
+  const char *name;
+  size_t len;
+  vector<uint8_t> bytes;    // n keys of len bytes, back to back
+};
+
+static vector<KeySet> keySets(size_t n) {
+  mt19937_64 rng(0xe2211);
+  vector<KeySet> sets = {{"tuple3/tcp", sizeof(Tuple3), {}}, {"tuple3/udp", sizeof(Tuple3), {}},
+                         {"tuple3v6", sizeof(Tuple3v6), {}}, {"uint32", sizeof(uint32_t), {}}};
+  for (KeySet &s : sets) s.bytes.resize(n * s.len);
+  
+  for (size_t i = 0; i < n; ++i) {
+    Tuple3 t;
+    t.src.addr = (uint32_t) rng();
+    t.src.port = (uint16_t) rng();
+    uint32_t seed = (uint32_t) rng();
+    
+    t.protocol = 6;
+    Tuple3 k = p4Key(t, seed);
+    memcpy(&sets[0].bytes[i * sizeof(Tuple3)], &k, sizeof(k));
+    t.protocol = 17;
+    k = p4Key(t, seed);
+    memcpy(&sets[1].bytes[i * sizeof(Tuple3)], &k, sizeof(k));
+    
+    Tuple3v6 t6;
+    for (uint8_t &b : t6.src.addr) b = (uint8_t) rng();
+    t6.src.port = (uint16_t) rng();
+    memcpy(&sets[2].bytes[i * sizeof(Tuple3v6)], &t6, sizeof(t6));
+    
+    uint32_t u = (uint32_t) rng() + seed;
+    memcpy(&sets[3].bytes[i * sizeof(uint32_t)], &u, sizeof(u));
+  }
+  return sets;
+}
+
+static uint64_t differential(const vector<Impl> &all, const vector<KeySet> &sets) {
+  uint64_t mismatches = 0, checks = 0;
+  
+  const char *check = "123456789";
+  for (const Impl &impl : all) {
+    ++checks;
+    if (impl.f(check, 9) != 0xCBF43926) {
+      printf("%s: check value %08x\n", impl.name, impl.f(check, 9));
+      ++mismatches;
+    }
+  }
+  
+  // every length up to a few slices, at every alignment
+  mt19937_64 rng(1);
+  vector<uint8_t> buf(256 + 8);
+  for (int round = 0; round < 200; ++round) {
+    for (uint8_t &b : buf) b = (uint8_t) rng();
+    for (size_t offset = 0; offset < 8; ++offset) {
+      for (size_t len = 0; len <= 256; ++len) {
+        uint32_t expected = crc32Bytewise(&buf[offset], len);
+        for (const Impl &impl : all) {
+          ++checks;
+          if (impl.f(&buf[offset], len) == expected) continue;
+          if (mismatches++ < 10) printf("%s: mismatch at length %zu offset %zu\n", impl.name, len, offset);
+        }
+      }
+    }
+  }
+  
+  for (const KeySet &s : sets) {
+    size_t n = s.bytes.size() / s.len;
+    for (size_t i = 0; i < n; ++i) {
+      const uint8_t *key = &s.bytes[i * s.len];
+      uint32_t expected = crc32Bytewise(key, s.len);
+      for (const Impl &impl : all) {
+        ++checks;
+        if (impl.f(key, s.len) == expected) continue;
+        if (mismatches++ < 10) printf("%s: mismatch on %s key %zu\n", impl.name, s.name, i);
+      }
+    }
+  }
+  
+  printf("differential: %lu checks, %lu mismatches\n", checks, mismatches);
+  return mismatches;
+}
+
+static double nsPerKey(Crc32Function f, const KeySet &s, int rounds, uint32_t &sink) {
+  size_t n = s.bytes.size() / s.len;
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  uint32_t x = 0;
+  for (int r = 0; r < rounds; ++r) {
+    for (size_t i = 0; i < n; ++i) x += f(&s.bytes[i * s.len], s.len);
+  }
+  gettimeofday(&end, NULL);
+  sink += x;
+  return diff_us(end, start) * 1000.0 / ((double) n * rounds);
+}
+
+int main(int argc, char **argv) {
+  size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : (1 << 20);
+  int rounds = argc > 2 ? atoi(argv[2]) : 8;
+  
+  vector<Impl> all = impls();
+  vector<KeySet> sets = keySets(n);
+  
+  if (differential(all, sets)) return 1;
+  printf("dispatch: %s\n", crc32Select() == crc32Clmul ? "clmul" : "slice16");
+  
+  uint32_t sink = 0;
+  printf("%-10s", "ns/key");
+  for (const KeySet &s : sets) printf(" %12s", s.name);
+  printf("\n");
+  for (const Impl &impl : all) {
+    printf("%-10s", impl.name);
+    for (const KeySet &s : sets) printf(" %12.2f", nsPerKey(impl.f, s, rounds, sink));
+    printf("\n");
+  }
+  printf("(%08x)\n", sink);
+  return 0;
+}
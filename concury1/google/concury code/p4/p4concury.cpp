@@ -8,6 +8,7 @@
 
 #include "hash.h"
 #include "../concury.common.h"
+#include "table_programmer.h"
 
 using namespace std;
 using namespace Tins;
@@ -125,7 +126,7 @@ public:
       
 #ifndef NDEBUG
       runtime::BmMtEntry entry = getEntry(tableName, handle);
-      assert(match_params == entry.match_key);
+      assert(keys.empty() || match_params == entry.match_key);
       assert(mapf(entry.action_entry.action_data, function<uint64_t(const string&)>([](const string& key) {return bmStrToInt(key);})) == mapf(action_data, function<uint64_t(const string&)>([](const string& key) {return bmStrToInt(key);})));
 #endif
     } catch (runtime::InvalidTableOperation &ito) {
@@ -160,6 +161,47 @@ private:
 
 Client client;
 
+/// BMv2 has no batch call, a batch is sent op by op over the one Thrift connection
+class ThriftBackend : public SwitchBackend {
+public:
+  explicit ThriftBackend(Client &client)
+      : client(client) {
+  }
+  
+  int apply(vector<TableOp> &batch) override {
+    int rejected = 0;
+    for (TableOp &op : batch) {
+      vector<string> keys, data;
+      for (int i = 0; i < op.nKeys; ++i) keys.push_back(toBmStr(op.keys[i].value, op.keys[i].bits));
+      for (int i = 0; i < op.nData; ++i) data.push_back(toBmStr(op.data[i].value, op.data[i].bits));
+      
+      switch (op.type) {
+        case TableOp::ADD:
+          op.handle = client.addEntry(op.table, op.action, keys, data);
+          rejected += op.handle < 0;
+          break;
+        case TableOp::MODIFY:
+          client.modifyEntry(op.table, op.action, op.handle, data);
+          break;
+        case TableOp::DELETE:
+          client.deleteEntry(op.table, op.handle);
+          break;
+      }
+    }
+    return rejected;
+  }
+  
+  void clear(const char *table) override {
+    client.clearEntries(table);
+  }
+  
+private:
+  Client &client;
+};
+
+ThriftBackend backend(client);
+ConcuryTableProgrammer programmer(backend);
+
 void send(uint src, uint16_t srcPort, uint dst, uint16_t dstPort, uint8_t protocol) {
   EthernetII eth = EthernetII("20:00:00:00:02:01", "10:00:00:00:01:02");
   IP ip = IP(IPv4Address(Endian::do_change_endian(dst)), IPv4Address(Endian::do_change_endian(src)));
@@ -289,81 +331,30 @@ void genSendAndCheck() {
   delete sniffer;
 }
 
-int *othelloHandles;
+// the P4 program takes two 32-bit seeds, the halves of the 64-bit one
+void syncDataPlane(int vipInd) {
+  uint64_t seed = othelloForQuery[vipInd].getH().s;
+  programmer.sync(vipInd, othelloForQuery[vipInd], (uint32_t) seed, (uint32_t) (seed >> 32), newHt[vipInd],
+                  dipPools[vipInd]);
+}
 
 void configureDataPlane(int vipInd) {
-  client.addEntry("seedA", "getSeed", { toBmStr(vipInd, 8) }, { toBmStr(conn[vipInd].getHa().s, 32) });
-  client.addEntry("seedB", "getSeed", { toBmStr(vipInd, 8) }, { toBmStr(conn[vipInd].getHb().s, 32) });
-  
-  for (int htInd = 0; htInd < HT_SIZE; ++htInd) {
-    DIP& dip = dipPools[vipInd][newHt[vipInd][htInd]];
-    
-    int res = client.addEntry("ht", "getDIP", { toBmStr(vipInd, 8), toBmStr(htInd, 12) }, { toBmStr(dip.addr.addr, 32), toBmStr(dip.addr.port, 16) });
-    assert(res == vipInd * HT_SIZE + htInd);
-  }
-  
-  int ma = conn[vipInd].getMa();
-  int mb = conn[vipInd].getMb();
-  
-  int handle = client.addEntry("lengthA", "getLength", { toBmStr(vipInd, 8) }, { toBmStr(ma, 32) });
-  assert(vipInd == handle);
-  handle = client.addEntry("lengthB", "getLength", { toBmStr(vipInd, 8) }, { toBmStr(mb, 32) });
-  assert(vipInd == handle);
-  
-  for (int i = 0; i < ma; ++i) {
-    othelloHandles[CONN_NUM * 3 * vipInd + i] = client.addEntry("othelloA", "getOthello", { toBmStr(vipInd, 8), toBmStr(i, 32) }, { toBmStr(conn[vipInd].memGet(i), 12) });
-  }
-  
-  for (int i = 0; i < mb; ++i) {
-    othelloHandles[CONN_NUM * 3 * vipInd + CONN_NUM * 2 + i] = client.addEntry("othelloB", "getOthello", { toBmStr(vipInd, 8), toBmStr(i, 32) }, { toBmStr(conn[vipInd].memGet(ma + i), 12) });
-  }
+  // the first sync of a VIP adds all its entries
+  othelloForQuery[vipInd].fullSync(conn[vipInd]);
+  syncDataPlane(vipInd);
 }
 
 void updateDataPlaneCallBack(int vipInd) {
   cout << "--updateDataPlaneCallBack@" << vipInd << endl;
   
-  client.modifyEntry("seedA", "getSeed", vipInd, { toBmStr(conn[vipInd].getHa().s, 32) }, { toBmStr(vipInd, 8) });
-  client.modifyEntry("seedB", "getSeed", vipInd, { toBmStr(conn[vipInd].getHb().s, 32) }, { toBmStr(vipInd, 8) });
-  
-  // Step3: write back the new ht and new othelloForQuery
-  
-  for (int htInd = 0; htInd < HT_SIZE; ++htInd) {
-    DIP& dip = dipPools[vipInd][newHt[vipInd][htInd]];
-    
-    client.modifyEntry("ht", "getDIP", HT_SIZE * vipInd + htInd, { toBmStr(dip.addr.addr, 32), toBmStr(dip.addr.port, 16) }, { toBmStr(vipInd, 8), toBmStr(htInd, 12) });
-  }
-  
-  int oldMa = othelloForQuery[vipInd].getMa();
-  int oldMb = othelloForQuery[vipInd].getMb();
-  int ma = conn[vipInd].getMa();
-  int mb = conn[vipInd].getMb();
-  
-  client.modifyEntry("lengthA", "getLength", vipInd, { toBmStr(ma, 32) }, { toBmStr(vipInd, 8) });
-  client.modifyEntry("lengthB", "getLength", vipInd, { toBmStr(mb, 32) }, { toBmStr(vipInd, 8) });
-  
-  for (int i = 0; i < ma; ++i) {
-    if (i < oldMa) {
-      client.modifyEntry("othelloA", "getOthello", othelloHandles[CONN_NUM * 3 * vipInd + i], { toBmStr(conn[vipInd].memGet(i), 12) }, { toBmStr(vipInd, 8), toBmStr(i, 32) });
-    } else {
-      othelloHandles[CONN_NUM * 3 * vipInd + i] = client.addEntry("othelloA", "getOthello", { toBmStr(vipInd, 8), toBmStr(i, 32) }, { toBmStr(conn[vipInd].memGet(i), 12) });
-    }
-  }
-  
-  for (int i = 0; i < mb; ++i) {
-    if (i < oldMb) {
-      client.modifyEntry("othelloB", "getOthello", othelloHandles[CONN_NUM * 3 * vipInd + CONN_NUM * 2 + i], { toBmStr(conn[vipInd].memGet(ma + i), 12) }, { toBmStr(vipInd, 8), toBmStr(i, 32) });
-    } else {
-      othelloHandles[CONN_NUM * 3 * vipInd + CONN_NUM * 2 + i] = client.addEntry("othelloB", "getOthello", { toBmStr(vipInd, 8), toBmStr(i, 32) }, { toBmStr(conn[vipInd].memGet(ma + i), 12) });
-    }
-  }
-  
+  // Step3: write back the new ht and new othelloForQuery, only the entries that changed
+  othelloForQuery[vipInd].fullSync(conn[vipInd]);
+  syncDataPlane(vipInd);
   memcpy(ht[vipInd], newHt[vipInd], HT_SIZE * sizeof(uint16_t));
-  othelloForQuery[vipInd].updateFromControlPlane(conn[vipInd]);
 }
 
 void init() {
   commonInit();
-  othelloHandles = new int[CONN_NUM * 3 * VIP_NUM];
 
   try {
     sender.default_interface(communicateIf[0]);
@@ -372,13 +363,9 @@ void init() {
   }
   
   cout << "--clearEntries" << endl;
-  client.clearEntries("seedA");
-  client.clearEntries("seedB");
-  client.clearEntries("ht");
-  client.clearEntries("lengthA");
-  client.clearEntries("lengthB");
-  client.clearEntries("othelloA");
-  client.clearEntries("othelloB");
+  for (const char *table : {"seedA", "seedB", "ht", "lengthA", "lengthB", "othelloA", "othelloB"}) {
+    backend.clear(table);
+  }
   
   cout << "--initDipPool" << endl;
   initDipPool();
@@ -393,7 +380,9 @@ int main(int argc, char **argv) {
   cout << "--simulateUpdatePoolData" << endl;
   simulateUpdatePoolData();
   cout << "--updateDataPlane" << endl;
+  programmer.resetStats();
   updateDataPlane();
+  programmer.printStats(cout);
   
   genSendAndCheck();
   
@@ -402,7 +391,9 @@ int main(int argc, char **argv) {
   cout << "--simulateUpdatePoolData" << endl;
   simulateUpdatePoolData();
   cout << "--updateDataPlane" << endl;
+  programmer.resetStats();
   updateDataPlane();
+  programmer.printStats(cout);
   
   genSendAndCheck();
   
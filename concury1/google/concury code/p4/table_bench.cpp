@@ -0,0 +1,128 @@
+/**
+ * Table programming of the P4 Concury control plane against the in-process backend: how many entries each update
+ * sends with minimal-delta programming, against rewriting every entry, and how long the diff and the programming
+ * take. Needs no switch and no Thrift.
+ *
+ * After every update the in-process tables are checked entry by entry against the control plane.
+ */
+#include "../concury.common.h"
+#include "table_programmer.h"
+
+InProcessBackend backend;
+ConcuryTableProgrammer programmer(backend);
+
+// the P4 program takes two 32-bit seeds, the halves of the 64-bit one here
+static uint32_t seedA(int vipInd) {
+  return (uint32_t) othelloForQuery[vipInd].getH().s;
+}
+
+static uint32_t seedB(int vipInd) {
+  return (uint32_t) (othelloForQuery[vipInd].getH().s >> 32);
+}
+
+void configureDataPlane(int vipInd) {
+  othelloForQuery[vipInd].fullSync(conn[vipInd]);
+  programmer.sync(vipInd, othelloForQuery[vipInd], seedA(vipInd), seedB(vipInd), newHt[vipInd], dipPools[vipInd]);
+}
+
+void updateDataPlaneCallBack(int vipInd) {
+  // Step3: write back the new ht and new othelloForQuery, and the entries of them that changed
+  othelloForQuery[vipInd].fullSync(conn[vipInd]);
+  programmer.sync(vipInd, othelloForQuery[vipInd], seedA(vipInd), seedB(vipInd), newHt[vipInd], dipPools[vipInd]);
+  memcpy(ht[vipInd], newHt[vipInd], HT_SIZE * sizeof(uint16_t));
+}
+
+static void verify() {
+  uint64_t cells = 0, expectedCells = 0, htEntries = 0, wrong = 0;
+  
+  backend.forEach("othelloA", [&](const InProcessBackend::Entry &e) {
+    int vipInd = e.keys[0].value, i = e.keys[1].value;
+    wrong += i >= othelloForQuery[vipInd].getMa() || e.data[0].value != othelloForQuery[vipInd].getCell(i);
+    ++cells;
+  });
+  backend.forEach("othelloB", [&](const InProcessBackend::Entry &e) {
+    int vipInd = e.keys[0].value, i = e.keys[1].value;
+    const auto &o = othelloForQuery[vipInd];
+    wrong += i >= o.getMb() || e.data[0].value != o.getCell(o.getMa() + i);
+    ++cells;
+  });
+  backend.forEach("ht", [&](const InProcessBackend::Entry &e) {
+    const DIP &dip = dipPools[e.keys[0].value][ht[e.keys[0].value][e.keys[1].value]];
+    wrong += e.data[0].value != dip.addr.addr || e.data[1].value != dip.addr.port;
+    ++htEntries;
+  });
+  backend.forEach("lengthA", [&](const InProcessBackend::Entry &e) {
+    wrong += e.data[0].value != othelloForQuery[e.keys[0].value].getMa();
+  });
+  backend.forEach("lengthB", [&](const InProcessBackend::Entry &e) {
+    wrong += e.data[0].value != othelloForQuery[e.keys[0].value].getMb();
+  });
+  backend.forEach("seedA", [&](const InProcessBackend::Entry &e) {
+    wrong += e.data[0].value != seedA(e.keys[0].value);
+  });
+  backend.forEach("seedB", [&](const InProcessBackend::Entry &e) {
+    wrong += e.data[0].value != seedB(e.keys[0].value);
+  });
+  
+  for (int vipInd = 0; vipInd < VIP_NUM; ++vipInd) {
+    expectedCells += othelloForQuery[vipInd].getMa() + othelloForQuery[vipInd].getMb();
+  }
+  if (wrong || cells != expectedCells || htEntries != (uint64_t) VIP_NUM * HT_SIZE) {
+    cout << "table mismatch: " << wrong << " wrong entries, " << cells << " of " << expectedCells << " cells, "
+         << htEntries << " ht entries" << endl;
+    exit(1);
+  }
+}
+
+static void update(const char *what) {
+  cout << "--updateDataPlane after " << what << endl;
+  programmer.resetStats();
+  updateDataPlane();
+  programmer.printStats(cout);
+  verify();
+}
+
+void init() {
+  commonInit();
+  
+  ht = new uint16_t *[VIP_NUM];
+  newHt = new uint16_t *[VIP_NUM];
+  for (int i = 0; i < VIP_NUM; ++i) {
+    ht[i] = new uint16_t[HT_SIZE];
+    newHt[i] = new uint16_t[HT_SIZE];
+    memset(ht[i], 0, sizeof(uint16_t[HT_SIZE]));
+    memset(newHt[i], 0, sizeof(uint16_t[HT_SIZE]));
+  }
+  
+  for (auto &o: conn) {
+    o.setMinimalKeyCapacity(CONN_NUM / VIP_NUM);
+  }
+  
+  cout << "--initDipPool" << endl;
+  programmer.resetStats();
+  initDipPool();
+  programmer.printStats(cout);
+  verify();
+}
+
+int main(int argc, char **argv) {
+  cout << "--init" << endl;
+  init();
+  
+  cout << "--simulateConnectionAdd" << endl;
+  simulateConnectionAdd();
+  update("connection add");
+  
+  simulateUpdatePoolData();
+  update("weight change");
+  
+  simulateUpdatePoolData();
+  update("another weight change");
+  
+  cout << "--simulateConnectionLeave" << endl;
+  simulateConnectionLeave();
+  update("connection leave");
+  
+  update("nothing");
+  return 0;
+}
@@ -0,0 +1,335 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <sys/time.h>
+
+#include "../common.h"
+
+using namespace std;
+
+/**
+ * Minimal-delta programming of the Concury tables of load_balance.p4.
+ *
+ * The programmer keeps a shadow of what the switch holds for every VIP: seeds, lengths, the ht entries and every
+ * Othello cell of othelloA/othelloB, with their entry handles. A sync diffs the new Othello arrays (the data plane
+ * copy of the ControlPlaneOthello memory, after fullSync) and the new ht against that shadow, and emits only what
+ * changed as one batch of add/modify/delete ops to a SwitchBackend: ThriftBackend (p4concury.cpp) for BMv2,
+ * InProcessBackend below to measure without a switch.
+ *
+ * In a batch, cells past the old length are added first and cells past the new length deleted last, so a cell is
+ * never referenced by a length that does not cover it. Seeds and cells still change one entry at a time, the same as
+ * a full rewrite: the P4 program has no version bit to flip them atomically.
+ */
+
+struct TableField {
+  uint64_t value;
+  uint8_t bits;
+};
+
+struct TableOp {
+  enum Type : uint8_t {
+    ADD, MODIFY, DELETE
+  };
+  
+  Type type;
+  const char *table;
+  const char *action;
+  int handle;             // of the entry to modify/delete. written back by the backend for an add
+  uint8_t nKeys;          // exact match fields, only for an add
+  uint8_t nData;          // action data, for an add or a modify
+  TableField keys[2];
+  TableField data[2];
+};
+
+class SwitchBackend {
+public:
+  virtual ~SwitchBackend() {}
+  
+  /// apply the ops in order, and set the handles of the added entries (-1 if rejected).
+  /// \return how many ops were rejected
+  virtual int apply(vector<TableOp> &batch) = 0;
+  
+  virtual void clear(const char *table) = 0;
+};
+
+/// the tables kept in memory, handles allocated the way BMv2 does: lowest free first
+class InProcessBackend : public SwitchBackend {
+public:
+  struct Entry {
+    const char *action;
+    uint8_t nKeys, nData;
+    TableField keys[2];
+    TableField data[2];
+    bool used;
+  };
+  
+  uint64_t adds = 0, modifies = 0, deletes = 0, batches = 0;
+  
+  int apply(vector<TableOp> &batch) override {
+    int rejected = 0;
+    for (TableOp &op : batch) {
+      Table &t = tables[op.table];
+      switch (op.type) {
+        case TableOp::ADD: {
+          int handle;
+          if (t.free.empty()) {
+            handle = (int) t.entries.size();
+            t.entries.emplace_back();
+          } else {
+            handle = t.free.back();
+            t.free.pop_back();
+          }
+          Entry &e = t.entries[handle];
+          e.action = op.action;
+          e.nKeys = op.nKeys;
+          e.nData = op.nData;
+          memcpy(e.keys, op.keys, sizeof(e.keys));
+          memcpy(e.data, op.data, sizeof(e.data));
+          e.used = true;
+          op.handle = handle;
+          ++adds;
+          break;
+        }
+        case TableOp::MODIFY:
+          if (!valid(t, op.handle)) {
+            ++rejected;
+            break;
+          }
+          t.entries[op.handle].action = op.action;
+          t.entries[op.handle].nData = op.nData;
+          memcpy(t.entries[op.handle].data, op.data, sizeof(op.data));
+          ++modifies;
+          break;
+        case TableOp::DELETE:
+          if (!valid(t, op.handle)) {
+            ++rejected;
+            break;
+          }
+          t.entries[op.handle].used = false;
+          t.free.push_back(op.handle);
+          ++deletes;
+          break;
+      }
+    }
+    ++batches;
+    return rejected;
+  }
+  
+  void clear(const char *table) override {
+    tables.erase(table);
+  }
+  
+  /// nullptr if there is no such entry
+  const Entry *get(const char *table, int handle) const {
+    auto it = tables.find(table);
+    return it != tables.end() && valid(it->second, handle) ? &it->second.entries[handle] : nullptr;
+  }
+  
+  template<class F>
+  void forEach(const char *table, F f) const {
+    auto it = tables.find(table);
+    if (it == tables.end()) return;
+    for (const Entry &e : it->second.entries) {
+      if (e.used) f(e);
+    }
+  }
+  
+  size_t size(const char *table) const {
+    auto it = tables.find(table);
+    return it == tables.end() ? 0 : it->second.entries.size() - it->second.free.size();
+  }
+
+private:
+  struct Table {
+    vector<Entry> entries;
+    vector<int> free;
+  };
+  
+  unordered_map<string, Table> tables;
+  
+  static bool valid(const Table &t, int handle) {
+    return handle >= 0 && handle < (int) t.entries.size() && t.entries[handle].used;
+  }
+};
+
+class ConcuryTableProgrammer {
+public:
+  struct Stats {
+    uint64_t adds = 0, modifies = 0, deletes = 0, rejected = 0;
+    uint64_t syncs = 0;
+    uint64_t fullEntries = 0;    // what rewriting every entry would have sent
+    uint64_t diffUs = 0, programUs = 0;
+  };
+  
+  explicit ConcuryTableProgrammer(SwitchBackend &backend, int vipNum = VIP_NUM)
+    : backend(backend), shadows(vipNum) {
+  }
+  
+  /// bring the switch to the given state of one VIP. all entries the first time, only the changed ones afterwards.
+  /// the seeds are the two 32-bit ones of load_balance.p4
+  template<class DPOthello>
+  void sync(int vipInd, const DPOthello &othello, uint32_t seedA, uint32_t seedB, const uint16_t *newHt,
+            const vector<DIP> &dipPool) {
+    static_assert(DPOthello::VDL == 12, "the Othello cells of load_balance.p4 are 12 bits, with no digest");
+    struct timeval start, diffed, end;
+    gettimeofday(&start, NULL);
+    
+    Shadow &s = shadows[vipInd];
+    const uint32_t ma = othello.getMa(), mb = othello.getMb();
+    batch.clear();
+    
+    if (!s.configured) {
+      s.htHandles.assign(HT_SIZE, -1);
+      s.ht.assign(HT_SIZE, 0);
+    }
+    
+    // grown cells first, unreachable until the lengths below cover them
+    syncCells(s.a, vipInd, "othelloA", othello, 0, ma, true);
+    syncCells(s.b, vipInd, "othelloB", othello, ma, mb, true);
+    
+    for (int htInd = 0; htInd < HT_SIZE; ++htInd) {
+      const DIP &dip = dipPool[newHt[htInd]];
+      uint64_t programmed = ((uint64_t) dip.addr.addr << 16) | dip.addr.port;
+      if (!s.configured) {
+        push(TableOp::ADD, "ht", "getDIP", -1, {{(uint64_t) vipInd, 8}, {(uint64_t) htInd, 12}},
+             {{dip.addr.addr, 32}, {dip.addr.port, 16}}, 2, &s.htHandles[htInd]);
+      } else if (s.ht[htInd] != programmed) {
+        push(TableOp::MODIFY, "ht", "getDIP", s.htHandles[htInd], {}, {{dip.addr.addr, 32}, {dip.addr.port, 16}}, 2);
+      }
+      s.ht[htInd] = programmed;
+    }
+    
+    syncScalar(s.configured, s.seedA, s.handles[0], vipInd, "seedA", "getSeed", seedA);
+    syncScalar(s.configured, s.seedB, s.handles[1], vipInd, "seedB", "getSeed", seedB);
+    syncScalar(s.configured, s.ma, s.handles[2], vipInd, "lengthA", "getLength", ma);
+    syncScalar(s.configured, s.mb, s.handles[3], vipInd, "lengthB", "getLength", mb);
+    
+    // shrunk cells last, the lengths no longer cover them
+    syncCells(s.a, vipInd, "othelloA", othello, 0, ma, false);
+    syncCells(s.b, vipInd, "othelloB", othello, ma, mb, false);
+    
+    gettimeofday(&diffed, NULL);
+    stats.rejected += backend.apply(batch);
+    gettimeofday(&end, NULL);
+    
+    // handles of what was just added
+    size_t n = 0;
+    for (const TableOp &op : batch) {
+      if (op.type != TableOp::ADD) continue;
+      *addedHandles[n++] = op.handle;
+    }
+    addedHandles.clear();
+    
+    for (const TableOp &op : batch) {
+      if (op.type == TableOp::ADD) ++stats.adds;
+      else if (op.type == TableOp::MODIFY) ++stats.modifies;
+      else ++stats.deletes;
+    }
+    stats.fullEntries += 4 + HT_SIZE + ma + mb;
+    stats.syncs++;
+    stats.diffUs += diff_us(diffed, start);
+    stats.programUs += diff_us(end, diffed);
+    s.configured = true;
+  }
+  
+  const Stats &getStats() const {
+    return stats;
+  }
+  
+  void resetStats() {
+    stats = Stats();
+  }
+  
+  void printStats(ostream &os) const {
+    uint64_t sent = stats.adds + stats.modifies + stats.deletes;
+    os << "table ops: " << stats.adds << " add, " << stats.modifies << " modify, " << stats.deletes << " delete, "
+       << stats.rejected << " rejected over " << stats.syncs << " syncs; " << sent << " of " << stats.fullEntries
+       << " entries (" << (stats.fullEntries ? 100.0 * sent / stats.fullEntries : 0) << "%); diff "
+       << stats.diffUs / 1000.0 << "ms, programming " << stats.programUs / 1000.0 << "ms" << endl;
+  }
+
+private:
+  struct Cells {
+    vector<uint16_t> values;    // as programmed
+    vector<int> handles;
+  };
+  
+  struct Shadow {
+    bool configured = false;
+    uint32_t seedA = 0, seedB = 0, ma = 0, mb = 0;
+    int handles[4] = {-1, -1, -1, -1};    // seedA, seedB, lengthA, lengthB
+    Cells a, b;
+    vector<uint64_t> ht;                  // addr << 16 | port, as programmed
+    vector<int> htHandles;
+  };
+  
+  SwitchBackend &backend;
+  vector<Shadow> shadows;
+  Stats stats;
+  
+  vector<TableOp> batch;             // reused across syncs
+  vector<int *> addedHandles;        // where the handle of the n-th add of the batch goes
+  
+  void push(TableOp::Type type, const char *table, const char *action, int handle,
+            std::initializer_list<TableField> keys, std::initializer_list<TableField> data, uint8_t nData,
+            int *handleOut = nullptr) {
+    TableOp op;
+    memset(&op, 0, sizeof(op));
+    op.type = type;
+    op.table = table;
+    op.action = action;
+    op.handle = handle;
+    op.nKeys = (uint8_t) keys.size();
+    op.nData = nData;
+    copy(keys.begin(), keys.end(), op.keys);
+    copy(data.begin(), data.end(), op.data);
+    batch.push_back(op);
+    if (type == TableOp::ADD) addedHandles.push_back(handleOut);
+  }
+  
+  /// first pass (grow): add the cells past the programmed length and modify the changed ones.
+  /// second pass: delete the cells past the new length
+  template<class DPOthello>
+  void syncCells(Cells &c, int vipInd, const char *table, const DPOthello &othello, uint32_t offset, uint32_t m,
+                 bool grow) {
+    uint32_t old = (uint32_t) c.values.size();
+    if (!grow) {
+      for (uint32_t i = m; i < old; ++i) {
+        push(TableOp::DELETE, table, "getOthello", c.handles[i], {}, {}, 0);
+      }
+      if (old > m) {
+        c.values.resize(m);
+        c.handles.resize(m);
+      }
+      return;
+    }
+    
+    if (m > old) {
+      c.values.resize(m);
+      c.handles.resize(m, -1);
+    }
+    for (uint32_t i = 0; i < m; ++i) {
+      uint16_t v = (uint16_t) othello.getCell(offset + i);
+      if (i >= old) {
+        push(TableOp::ADD, table, "getOthello", -1, {{(uint64_t) vipInd, 8}, {i, 32}}, {{v, 12}}, 1, &c.handles[i]);
+      } else if (c.values[i] != v) {
+        push(TableOp::MODIFY, table, "getOthello", c.handles[i], {}, {{v, 12}}, 1);
+      }
+      c.values[i] = v;
+    }
+  }
+  
+  void syncScalar(bool configured, uint32_t &programmed, int &handle, int vipInd, const char *table,
+                  const char *action, uint32_t value) {
+    if (!configured) {
+      push(TableOp::ADD, table, action, -1, {{(uint64_t) vipInd, 8}}, {{value, 32}}, 1, &handle);
+    } else if (programmed != value) {
+      push(TableOp::MODIFY, table, action, handle, {}, {{value, 32}}, 1);
+    }
+    programmed = value;
+  }
+};
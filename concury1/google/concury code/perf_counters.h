@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <ostream>
+#include <iomanip>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+using namespace std;
+
+/*! \file perf_counters.h
+ *  Hardware performance counters of the calling thread through perf_event_open, for Clocker and the serve and update
+ *  benchmarks.
+ */
+
+/// counter values, scaled up for the time an event was not scheduled when the PMU multiplexes
+struct PerfSample {
+  enum Event {
+    CYCLES, INSTRUCTIONS, BRANCH_MISSES, LLC_MISSES, DTLB_MISSES, EVENTS
+  };
+  
+  double value[EVENTS] = {};
+  bool valid[EVENTS] = {};
+  
+  static const char *name(int e) {
+    static const char *const names[EVENTS] = {"cycles", "instructions", "branch-misses", "LLC-misses", "dTLB-misses"};
+    return names[e];
+  }
+  
+  PerfSample &operator+=(const PerfSample &other) {
+    for (int e = 0; e < EVENTS; ++e) {
+      value[e] += other.value[e];
+      valid[e] = valid[e] || other.valid[e];
+    }
+    return *this;
+  }
+  
+  PerfSample operator-(const PerfSample &other) const {
+    PerfSample d = *this;
+    for (int e = 0; e < EVENTS; ++e) d.value[e] -= other.value[e];
+    return d;
+  }
+  
+  bool any() const {
+    for (bool v : valid) if (v) return true;
+    return false;
+  }
+  
+  /// each event per op, and IPC: "cycles/op 41.2, instructions/op 97.0 (IPC 2.35), ...". n/a for events not counted
+  void printPerOp(ostream &os, uint64_t ops) const {
+    ios::fmtflags flags = os.flags();
+    streamsize precision = os.precision(2);
+    os << fixed;
+    for (int e = 0; e < EVENTS; ++e) {
+      if (e) os << ", ";
+      os << name(e) << "/op ";
+      if (valid[e]) os << value[e] / ops;
+      else os << "n/a";
+      if (e == INSTRUCTIONS && valid[CYCLES] && valid[INSTRUCTIONS] && value[CYCLES] > 0) {
+        os << " (IPC " << value[INSTRUCTIONS] / value[CYCLES] << ")";
+      }
+    }
+    os.flags(flags);
+    os.precision(precision);
+  }
+};
+
+/**
+ * A perf_event_open group of the PerfSample events on the calling thread, user space only, so that it opens under
+ * perf_event_paranoid 2. The group counts from construction; read() is the running total, and a phase is the
+ * difference of two reads.
+ *
+ * An event the CPU or the hypervisor does not offer is left out and reads as not valid. When none opens (no PMU, a
+ * container without CAP_PERFMON, perf_event_paranoid 3), available() is false, every read is empty, and
+ * unavailableReason() says why, so the benchmarks run as before with n/a for the counters.
+ */
+class PerfCounters {
+  int fds[PerfSample::EVENTS];
+  uint64_t ids[PerfSample::EVENTS];
+  int leader = -1;
+  int opened = 0;
+  string reason;
+  
+  static int open(uint32_t type, uint64_t config, int groupFd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0);
+  }
+  
+  static uint64_t cacheConfig(uint64_t cache, uint64_t op, uint64_t result) {
+    return cache | (op << 8) | (result << 16);
+  }
+
+public:
+  PerfCounters() {
+    const struct {
+      uint32_t type;
+      uint64_t config;
+    } events[PerfSample::EVENTS] = {
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+      {PERF_TYPE_HW_CACHE, cacheConfig(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ,
+                                       PERF_COUNT_HW_CACHE_RESULT_MISS)},
+      {PERF_TYPE_HW_CACHE, cacheConfig(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+                                       PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    };
+    
+    for (int e = 0; e < PerfSample::EVENTS; ++e) {
+      fds[e] = open(events[e].type, events[e].config, leader);
+      if (fds[e] < 0) {
+        if (reason.empty()) reason = string(PerfSample::name(e)) + ": " + strerror(errno);
+        continue;
+      }
+      if (leader < 0) leader = fds[e];
+      ioctl(fds[e], PERF_EVENT_IOC_ID, &ids[e]);
+      ++opened;
+    }
+  }
+  
+  PerfCounters(const PerfCounters &) = delete;
+  
+  PerfCounters &operator=(const PerfCounters &) = delete;
+  
+  ~PerfCounters() {
+    for (int fd : fds) if (fd >= 0) close(fd);
+  }
+  
+  bool available() const {
+    return opened > 0;
+  }
+  
+  /// why an event, the first one that failed, did not open. empty if all did
+  const string &unavailableReason() const {
+    return reason;
+  }
+  
+  PerfSample read() const {
+    PerfSample s;
+    if (leader < 0) return s;
+    
+    uint64_t buf[3 + 2 * PerfSample::EVENTS];
+    if (::read(leader, buf, sizeof(buf)) < 0) return s;
+    uint64_t nr = buf[0], enabled = buf[1], running = buf[2];
+    double scale = running ? double(enabled) / running : 0;
+    
+    for (uint64_t i = 0; i < nr; ++i) {
+      uint64_t value = buf[3 + 2 * i], id = buf[4 + 2 * i];
+      for (int e = 0; e < PerfSample::EVENTS; ++e) {
+        if (fds[e] < 0 || ids[e] != id) continue;
+        s.value[e] = value * scale;
+        s.valid[e] = running > 0;
+      }
+    }
+    return s;
+  }
+};
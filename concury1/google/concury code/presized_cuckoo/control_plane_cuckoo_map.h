@@ -16,6 +16,11 @@
 #ifndef TENSORFLOW_UTIL_CONTROL_PLANE_CUCKOO_MAP_H_
 #define TENSORFLOW_UTIL_CONTROL_PLANE_CUCKOO_MAP_H_
 
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <immintrin.h>
 #include "macros.h"
 #include "../hash.h"
 #include "../common.h"
@@ -48,13 +53,78 @@ inline uint32_t multiply_high_u32(uint32_t x, uint32_t y) {
   return (uint32_t) (((uint64_t) x * (uint64_t) y) >> 32);
 }
 
-template<class Key, class Value, class Match>
+// std::allocator honours alignas(64) only with C++17 aligned new, and the
+// microbenchmarks still build as C++14: allocate over-aligned buckets with
+// posix_memalign instead.
+template<class T>
+struct AlignedAllocator {
+  typedef T value_type;
+  
+  AlignedAllocator() = default;
+  template<class U> AlignedAllocator(const AlignedAllocator<U> &) {}
+  
+  T *allocate(size_t n) {
+    void *p;
+    if (posix_memalign(&p, alignof(T) < sizeof(void *) ? sizeof(void *) : alignof(T), n * sizeof(T))) throw std::bad_alloc();
+    return (T *) p;
+  }
+  
+  void deallocate(T *p, size_t) {
+    free(p);
+  }
+};
+
+template<class T, class U>
+inline bool operator==(const AlignedAllocator<T> &, const AlignedAllocator<U> &) {
+  return true;
+}
+
+template<class T, class U>
+inline bool operator!=(const AlignedAllocator<T> &, const AlignedAllocator<U> &) {
+  return false;
+}
+
+// Compare `digest` against all `S` digests of a bucket, and return a bitmask
+// with bit i set iff digests[i] == digest. The wide layouts (8 or 16 digests
+// of 8/16 bits) fit into one or two SSE registers and are matched with a
+// single compare + movemask; everything else falls back to a scalar loop.
+template<class Match, int S>
+inline uint32_t MatchDigests(const Match *digests, Match digest) {
+  if (sizeof(Match) == 2 && S == 8) {
+    __m128i cmp = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *) digests), _mm_set1_epi16(digest));
+    return _mm_movemask_epi8(_mm_packs_epi16(cmp, _mm_setzero_si128()));
+  } else if (sizeof(Match) == 2 && S == 16) {
+#ifdef __AVX2__
+    __m256i cmp = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *) digests), _mm256_set1_epi16(digest));
+    return _mm_movemask_epi8(_mm_packs_epi16(_mm256_castsi256_si128(cmp), _mm256_extracti128_si256(cmp, 1)));
+#else
+    __m128i key = _mm_set1_epi16(digest);
+    __m128i lo = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *) digests), key);
+    __m128i hi = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *) digests + 1), key);
+    return _mm_movemask_epi8(_mm_packs_epi16(lo, hi));
+#endif
+  } else if (sizeof(Match) == 1 && S == 16) {
+    __m128i cmp = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) digests), _mm_set1_epi8(digest));
+    return _mm_movemask_epi8(cmp);
+  } else {
+    uint32_t result = 0;
+    for (int i = 0; i < S; i++) {
+      if (digests[i] == digest) result |= 1U << i;
+    }
+    return result;
+  }
+}
+
+template<class Key, class Value, class Match, int SlotsPerBucket>
 class ControlPlaneCuckooMap;
 
-template<class Key, class Value, class Match = uint16_t>
+// SlotsPerBucket = 5 is the original (unaligned) layout. 8 or 16 slots give
+// the wide layout: one cache-line aligned bucket per probe, and all digests of
+// a bucket are matched at once (see MatchDigests).
+template<class Key, class Value, class Match = uint16_t, int SlotsPerBucket = 5>
 class DataPlaneCuckooMap {
 public:
-  explicit DataPlaneCuckooMap(const ControlPlaneCuckooMap<Key, Value, Match>& controlPlane);
+  explicit DataPlaneCuckooMap(const ControlPlaneCuckooMap<Key, Value, Match, SlotsPerBucket>& controlPlane);
 
   void Clear(int num_entries);
 
@@ -67,40 +137,70 @@ public:
   // Returns true if found.  Sets *out = value.
   bool Find(const Key& k, Value *out) const {
     Match match = h[kCandidateBuckets](k);
+    uint32_t bucket[kCandidateBuckets];
     
+    // issue all candidate loads before probing any of them
     for (int i = 0; i < kCandidateBuckets; ++i) {
-      uint32_t bucket = fast_map_to_buckets(h[i](k));
-      if (FindInBucket(match, bucket, out)) return true;
+      bucket[i] = fast_map_to_buckets(h[i](k));
+      __builtin_prefetch(&buckets_[bucket[i]]);
+    }
+    
+    for (int i = 0; i < kCandidateBuckets; ++i) {
+      if (FindInBucket(match, bucket[i], out)) return true;
     }
     
     return false;
   }
   
-  static constexpr int kCandidateBuckets = ControlPlaneCuckooMap<Key, Value, Match>::kCandidateBuckets;
+  static constexpr int kCandidateBuckets = ControlPlaneCuckooMap<Key, Value, Match, SlotsPerBucket>::kCandidateBuckets;
   Hasher32<Key> h[kCandidateBuckets + 1];
 
-  static constexpr int kSlotsPerBucket = ControlPlaneCuckooMap<Key, Value, Match>::kSlotsPerBucket;
+  static constexpr int kSlotsPerBucket = SlotsPerBucket;
+  static constexpr bool kWideBucket = ControlPlaneCuckooMap<Key, Value, Match, SlotsPerBucket>::kWideBucket;
+  typedef typename ControlPlaneCuckooMap<Key, Value, Match, SlotsPerBucket>::Mask Mask;
 
   static constexpr int kNoSpace = -1; // SpaceAvailable return
   
   // Buckets are organized with key_types clustered for access speed
   // and for compactness while remaining aligned.
   struct Bucket {
-    uint8_t occupiedMask;
+    Mask occupiedMask;
     Match keyDigests[kSlotsPerBucket];
     Value values[kSlotsPerBucket];
   };
+  
+  // over-aligned: buckets_ allocates it through AlignedAllocator
+  struct alignas(64) WideBucket {
+    Match keyDigests[kSlotsPerBucket];   // first, so that the vector load is aligned
+    Value values[kSlotsPerBucket];
+    Mask occupiedMask;
+  };
+  
+  typedef typename std::conditional<kWideBucket, WideBucket, Bucket>::type BucketType;
+  
+  inline uint32_t BucketCount() const {
+    return num_buckets_;
+  }
+
+  MemoryBreakdown getMemoryBreakdown() const {
+    uint64_t slots = 0;
+    for (const BucketType &b : buckets_) slots += __builtin_popcount(b.occupiedMask);
+    
+    MemoryBreakdown b;
+    b.add("object", sizeof(*this), sizeof(*this));
+    b.add("buckets", slots * sizeof(BucketType) / kSlotsPerBucket, heapBytes(buckets_.data()));
+    return b;
+  }
 
 private:
   // For the associative cuckoo table, check all of the slots in
   // the bucket to see if the key is present.
   bool FindInBucket(Match digest, uint32_t b, Value *out) const {
-    const Bucket &bref = buckets_[b];
-    for (int i = 0; i < kSlotsPerBucket; i++) {
-      if (bref.keyDigests[i] == digest) {
-        *out = bref.values[i];
-        return true;
-      }
+    const BucketType &bref = buckets_[b];
+    uint32_t hits = MatchDigests<Match, kSlotsPerBucket>(bref.keyDigests, digest) & bref.occupiedMask;
+    if (hits) {
+      *out = bref.values[__builtin_ctz(hits)];
+      return true;
     }
     return false;
   }
@@ -115,13 +215,13 @@ private:
   
   // Set upon initialization: num_entries / kLoadFactor / kSlotsPerBucket.
   uint32_t num_buckets_;
-  std::vector<Bucket> buckets_;
+  std::vector<BucketType, AlignedAllocator<BucketType>> buckets_;
 };
 
-template<class Key, class Value, class Match = uint16_t>
+template<class Key, class Value, class Match = uint16_t, int SlotsPerBucket = 5>
 class ControlPlaneCuckooMap {
-  friend class DataPlaneCuckooMap<Key, Value, Match> ;
-  DataPlaneCuckooMap<Key, Value, Match> *associated = 0;
+  friend class DataPlaneCuckooMap<Key, Value, Match, SlotsPerBucket> ;
+  DataPlaneCuckooMap<Key, Value, Match, SlotsPerBucket> *associated = 0;
 public:
   // The key type is fixed as a pre-hashed key for this specialized use.
   explicit ControlPlaneCuckooMap(uint32_t num_entries = 64) {
@@ -131,7 +231,7 @@ public:
     }
   }
   
-  void SetAssociated(DataPlaneCuckooMap<Key, Value, Match> &dp) {
+  void SetAssociated(DataPlaneCuckooMap<Key, Value, Match, SlotsPerBucket> &dp) {
     associated = &dp;
   }
   
@@ -143,6 +243,19 @@ public:
     return entryCount;
   }
   
+  inline uint32_t BucketCount() const {
+    return num_buckets_;
+  }
+  
+  /// the buckets are used by the slots holding entries. the visited list is inline, in the object
+  MemoryBreakdown getMemoryBreakdown() const {
+    MemoryBreakdown b;
+    b.add("object", sizeof(*this), sizeof(*this));
+    b.add("buckets", (uint64_t) entryCount * sizeof(Bucket) / kSlotsPerBucket, heapBytes(buckets_.data()));
+    b.add("path-queue", sizeof(CuckooPathQueue), heapBytes(cpq_.get()));
+    return b;
+  }
+  
   void Clear(uint32_t num_entries) {
     entryCount = 0;
     cpq_.reset(new CuckooPathQueue());
@@ -166,13 +279,14 @@ public:
     uint32_t target_bucket = 0;
     int target_slot = kNoSpace;
     entryCount++;
+    Match digest = getDigestFunction()(k);
     
     for (int i = 0; i < kCandidateBuckets; ++i) {
       uint32_t bucket = fast_map_to_buckets(h[i](k));
       Bucket *bptr = &buckets_[bucket];
       for (int slot = 0; slot < kSlotsPerBucket; slot++) {
         if (bptr->occupiedMask & (1ULL << slot)) {
-          if (getDigestFunction()(bptr->key[slot]) == getDigestFunction()(k)) { // Duplicates are not allowed.
+          if (bptr->digests[slot] == digest) { // Duplicates are not allowed.
             entryCount--;
             return &bptr->key[slot];
           } else continue;
@@ -276,7 +390,9 @@ public:
   static constexpr int kCandidateBuckets = 4;
   Hasher32<Key> h[kCandidateBuckets + 1];   // the last h is the digest function used in associated data plane
   
-  static constexpr int kSlotsPerBucket = 5;
+  static constexpr int kSlotsPerBucket = SlotsPerBucket;
+  static constexpr bool kWideBucket = SlotsPerBucket == 8 || SlotsPerBucket == 16;
+  typedef typename std::conditional<(SlotsPerBucket > 8), uint16_t, uint8_t>::type Mask;
 
   // The load factor is chosen slightly conservatively for speed and
   // to avoid the need for a table rebuild on insertion failure.
@@ -292,8 +408,10 @@ public:
   // 400 reduces max occupancy;  much more results in very poor performance
   // around the full point.  For (2,4) a max BFS path len of 5 results in ~682
   // nodes to visit, calculated below, and is a good value.
+  // Wider buckets fan out much faster, so the path is shortened to keep the
+  // queue (and the number of visited nodes) in the same ballpark.
   
-  static constexpr uint8_t kMaxBFSPathLen = 5;
+  static constexpr uint8_t kMaxBFSPathLen = SlotsPerBucket <= 5 ? 5 : SlotsPerBucket <= 8 ? 4 : 3;
 
   // Constants for BFS cuckoo path search:
   // The visited list must be maintained for all but the last level of search
@@ -327,10 +445,13 @@ public:
   
   // Buckets are organized with key_types clustered for access speed
   // and for compactness while remaining aligned.
+  // digests[] caches getDigestFunction()(key[]), so that digest collision
+  // checks and data plane exports never rehash resident keys.
   struct Bucket {
-    uint8_t occupiedMask = 0;
+    Mask occupiedMask = 0;
     Key key[kSlotsPerBucket];
     Value values[kSlotsPerBucket];
+    Match digests[kSlotsPerBucket];
   };
 
 private:
@@ -390,9 +511,10 @@ private:
     Bucket *bptr = &buckets_[b];
     bptr->key[slot] = k;
     bptr->values[slot] = v;
+    bptr->digests[slot] = getDigestFunction()(k);
     bptr->occupiedMask |= 1U << slot;
     
-    if (associated) associated->InsertAt(b, slot, getDigestFunction()(k), v);
+    if (associated) associated->InsertAt(b, slot, bptr->digests[slot], v);
   }
   
   // For the associative cuckoo table, check all of the slots in
@@ -441,6 +563,7 @@ private:
     Bucket &dst_ref = buckets_[dst_bucket];
     dst_ref.key[dst_slot] = src_ref.key[src_slot];
     dst_ref.values[dst_slot] = src_ref.values[src_slot];
+    dst_ref.digests[dst_slot] = src_ref.digests[src_slot];
     
     if (associated) associated->CopyItem(src_bucket, src_slot, dst_bucket, dst_slot);
   }
@@ -518,19 +641,19 @@ private:
   CuckooPathEntry visited_[kVisitedListSize];
 };
 
-template<class Key, class Value, class Match>
-DataPlaneCuckooMap<Key, Value, Match>::DataPlaneCuckooMap(const ControlPlaneCuckooMap<Key, Value, Match>& controlPlane)
+template<class Key, class Value, class Match, int SlotsPerBucket>
+DataPlaneCuckooMap<Key, Value, Match, SlotsPerBucket>::DataPlaneCuckooMap(const ControlPlaneCuckooMap<Key, Value, Match, SlotsPerBucket>& controlPlane)
     : num_buckets_(controlPlane.num_buckets_) {
   for (int i = 0; i < kCandidateBuckets + 1; ++i) {
     h[i] = controlPlane.h[i];
   }
   
   for (auto &b : controlPlane.buckets_) {
-    Bucket bucket;
+    BucketType bucket;
     bucket.occupiedMask = b.occupiedMask;
     
     for (int i = 0; i < kSlotsPerBucket; ++i) {
-      bucket.keyDigests[i] = h[kCandidateBuckets](b.key[i]);
+      bucket.keyDigests[i] = b.digests[i];
       bucket.values[i] = b.values[i];
     }
     
@@ -538,30 +661,31 @@ DataPlaneCuckooMap<Key, Value, Match>::DataPlaneCuckooMap(const ControlPlaneCuck
   }
 }
 
-template<class Key, class Value, class Match>
-void DataPlaneCuckooMap<Key, Value, Match>::Clear(int num_buckets_) {
-  Bucket empty_bucket;
+template<class Key, class Value, class Match, int SlotsPerBucket>
+void DataPlaneCuckooMap<Key, Value, Match, SlotsPerBucket>::Clear(int num_buckets_) {
+  BucketType empty_bucket = BucketType();
   buckets_.clear();
   buckets_.resize(num_buckets_, empty_bucket);
 }
 
-template<class Key, class Value, class Match>
-void DataPlaneCuckooMap<Key, Value, Match>::InsertAt(int bucket, int slot, Match match, const Value &val) {
+template<class Key, class Value, class Match, int SlotsPerBucket>
+void DataPlaneCuckooMap<Key, Value, Match, SlotsPerBucket>::InsertAt(int bucket, int slot, Match match, const Value &val) {
   buckets_[bucket].occupiedMask |= 1ULL << slot;
   buckets_[bucket].keyDigests[slot] = match;
   buckets_[bucket].values[slot] = val;
 }
 
-template<class Key, class Value, class Match>
-inline void DataPlaneCuckooMap<Key, Value, Match>::CopyItem(uint32_t src_bucket, int src_slot, uint32_t dst_bucket, int dst_slot) {
-  Bucket &src_ref = buckets_[src_bucket];
-  Bucket &dst_ref = buckets_[dst_bucket];
+template<class Key, class Value, class Match, int SlotsPerBucket>
+inline void DataPlaneCuckooMap<Key, Value, Match, SlotsPerBucket>::CopyItem(uint32_t src_bucket, int src_slot, uint32_t dst_bucket, int dst_slot) {
+  BucketType &src_ref = buckets_[src_bucket];
+  BucketType &dst_ref = buckets_[dst_bucket];
   dst_ref.keyDigests[dst_slot] = src_ref.keyDigests[src_slot];
   dst_ref.values[dst_slot] = src_ref.values[src_slot];
+  dst_ref.occupiedMask |= 1ULL << dst_slot;
 }
 
-template<class Key, class Value, class Match>
-void DataPlaneCuckooMap<Key, Value, Match>::RemoveAt(int bucket, int slot) {
+template<class Key, class Value, class Match, int SlotsPerBucket>
+void DataPlaneCuckooMap<Key, Value, Match, SlotsPerBucket>::RemoveAt(int bucket, int slot) {
   buckets_[bucket].occupiedMask &= ~(1ULL << slot);
 }
 
@@ -0,0 +1,584 @@
+/**
+ * Scenarios for the benchmark driver: `lb_bench.<algorithm> scenario --file f ...`, see lb_bench.h.
+ *
+ * A scenario is a text file of settings and timed events, one per line, # to the end of the line a comment:
+ *
+ *   duration 30s                the scenario time covered                                     (required)
+ *   rate 1M                     packets per second of scenario time                           (default 1M)
+ *   connections 64K             live at the start                                             (default 64K)
+ *   flow-skew 1.0               Zipf exponent of the connection popularity, see workload.h    (default 0)
+ *   vip-skew 0.5                Zipf exponent of the VIP popularity                           (default 0)
+ *   lifetime exp:5s             forever, fixed:<t>, exp:<t> or pareto:<t>[:<shape>]           (default forever)
+ *   learn 10ms                  how often the new connections go to addConnections            (default 10ms)
+ *   interval 1s                 the reporting interval                                        (default 1s)
+ *   seed 7                      of the traffic and of the DIPs the events pick                (default 0xe2211)
+ *
+ *   t=10s fail 5% vip 3         weight 0 for n, or p%, of the DIPs of VIP i, or of every VIP. at least one stays up
+ *   t=20s recover vip 3         the failed DIPs back at their weights, of VIP i or of every VIP
+ *   t=20s weights 50%           new random weights for p% (default all) of the DIPs up, of VIP i or of every VIP
+ *   t=25s ramp 5s steps 5       to new random weights in n equal steps (default 10) over the time, same scope
+ *   t=0s arrivals 50K           new connections per second from then on                       (default 0)
+ *
+ * Times take s, ms or us, counts K and M. The random weights are 1-6, drawn as simulateUpdatePoolData draws them.
+ *
+ * The traffic is a Workload generated up front, about 24B per packet, and the run is not paced: scenario time is the
+ * packet count over rate, and the lookups go as fast as lookupBatch takes them. Every VIP starts at random weights.
+ * Between batches the events due are applied through setWeights, and the new connections handed to addConnections
+ * every learn period, as a control plane learns them; both are timed apart from the lookups.
+ *
+ * PCC: every packet is checked, untimed, against the DIP its connection last went to. A packet that goes to another
+ * DIP although the old one stayed up all along is a violation; one whose DIP went down in between is a legitimate
+ * move. A packet that goes to a DIP down is counted apart. Closed connections just stop sending: LoadBalancer has no
+ * erase.
+ */
+#include "lb_bench.h"
+#include "json_writer.h"
+#include "workload.h"
+
+struct ScenarioEvent {
+  enum Kind {
+    FAIL, RECOVER, WEIGHTS, RAMP, ARRIVALS
+  } kind;
+  double at = 0;          // s
+  string line;            // as written, for the report
+  int vip = -1;           // -1: every VIP
+  double amount = 100;    // FAIL: DIPs, WEIGHTS: % of the DIPs up. ARRIVALS: new connections per second
+  bool percent = true;    // FAIL: amount is a % of the DIPs
+  double over = 0;        // RAMP: s
+  int steps = 10;         // RAMP
+  
+  uint64_t ticks = 0;     // in setWeights
+  int updates = 0;        // setWeights calls
+};
+
+struct Scenario {
+  string file;
+  double duration = 0, rate = 1E6, learn = 0.01, interval = 1;
+  uint32_t connections = 64 << 10;
+  double flowSkew = 0, vipSkew = 0;
+  string lifetime = "forever";
+  uint64_t seed = 0xe2211;
+  vector<ScenarioEvent> events;
+};
+
+/// "30s", "500ms", "250us", or plain seconds
+static bool parseTime(const string &s, double &seconds) {
+  char *end;
+  double v = strtod(s.c_str(), &end);
+  string unit = end;
+  if (end == s.c_str() || v < 0) return false;
+  if (unit == "" || unit == "s") seconds = v;
+  else if (unit == "ms") seconds = v / 1E3;
+  else if (unit == "us") seconds = v / 1E6;
+  else return false;
+  return true;
+}
+
+/// "50K", "1M", "12", "5%". percent: whether it ended in %, if that is allowed
+static bool parseAmount(const string &s, double &v, bool *percent = nullptr) {
+  char *end;
+  v = strtod(s.c_str(), &end);
+  string unit = end;
+  if (end == s.c_str() || v < 0) return false;
+  if (percent) *percent = unit == "%";
+  if (unit == "K") v *= 1E3;
+  else if (unit == "M") v *= 1E6;
+  else if (unit != "" && !(percent && unit == "%")) return false;
+  return true;
+}
+
+/// the words of an event after its kind: [vip i] [steps n] and the like, as name value pairs
+static bool parseOptions(const vector<string> &words, size_t from, ScenarioEvent &e) {
+  for (size_t i = from; i < words.size(); i += 2) {
+    if (i + 1 == words.size()) return false;
+    double v;
+    if (!parseAmount(words[i + 1], v)) return false;
+    if (words[i] == "vip" && v < VIP_NUM) e.vip = int(v);
+    else if (words[i] == "steps" && e.kind == ScenarioEvent::RAMP && v >= 1) e.steps = int(v);
+    else return false;
+  }
+  return true;
+}
+
+static bool parseEvent(const vector<string> &words, ScenarioEvent &e) {
+  if (!parseTime(words[0].substr(2), e.at) || words.size() < 2) return false;
+  const string &kind = words[1];
+  
+  if (kind == "fail") {
+    e.kind = ScenarioEvent::FAIL;
+    return words.size() >= 3 && parseAmount(words[2], e.amount, &e.percent) && parseOptions(words, 3, e);
+  } else if (kind == "recover") {
+    e.kind = ScenarioEvent::RECOVER;
+    return parseOptions(words, 2, e);
+  } else if (kind == "weights") {
+    e.kind = ScenarioEvent::WEIGHTS;
+    if (words.size() >= 3 && words[2].back() == '%') {
+      return parseAmount(words[2], e.amount, &e.percent) && e.amount <= 100 && parseOptions(words, 3, e);
+    }
+    return parseOptions(words, 2, e);
+  } else if (kind == "ramp") {
+    e.kind = ScenarioEvent::RAMP;
+    return words.size() >= 3 && parseTime(words[2], e.over) && parseOptions(words, 3, e);
+  } else if (kind == "arrivals") {
+    e.kind = ScenarioEvent::ARRIVALS;
+    return words.size() == 3 && parseAmount(words[2], e.amount);
+  }
+  return false;
+}
+
+static bool parseScenario(const string &file, Scenario &s) {
+  ifstream in(file);
+  if (!in) {
+    cerr << "cannot read " << file << endl;
+    return false;
+  }
+  s.file = file;
+  
+  string line;
+  for (int number = 1; getline(in, line); ++number) {
+    string text = line.substr(0, line.find('#'));
+    istringstream iss(text);
+    vector<string> words;
+    for (string word; iss >> word;) words.push_back(word);
+    if (words.empty()) continue;
+    
+    bool ok;
+    double v;
+    const string &key = words[0];
+    if (key.compare(0, 2, "t=") == 0) {
+      ScenarioEvent e;
+      e.line = text.substr(text.find_first_not_of(" \t"));
+      e.line = e.line.substr(0, e.line.find_last_not_of(" \t\r") + 1);
+      ok = parseEvent(words, e);
+      if (ok) s.events.push_back(e);
+    } else if (words.size() != 2) {
+      ok = false;
+    } else if (key == "duration") {
+      ok = parseTime(words[1], s.duration) && s.duration > 0;
+    } else if (key == "rate") {
+      ok = parseAmount(words[1], s.rate) && s.rate >= 1;
+    } else if (key == "connections") {
+      ok = parseAmount(words[1], v) && v >= 1 && v <= CONN_NUM;
+      s.connections = uint32_t(v);
+    } else if (key == "flow-skew") {
+      ok = parseAmount(words[1], s.flowSkew);
+    } else if (key == "vip-skew") {
+      ok = parseAmount(words[1], s.vipSkew);
+    } else if (key == "lifetime") {
+      s.lifetime = words[1];
+      ok = true;
+    } else if (key == "learn") {
+      ok = parseTime(words[1], s.learn) && s.learn > 0;
+    } else if (key == "interval") {
+      ok = parseTime(words[1], s.interval) && s.interval > 0;
+    } else if (key == "seed") {
+      ok = parseAmount(words[1], v);
+      s.seed = uint64_t(v);
+    } else {
+      ok = false;
+    }
+    
+    if (!ok) {
+      cerr << file << ":" << number << ": cannot make sense of \"" << line << "\", see scenario.cpp" << endl;
+      return false;
+    }
+  }
+  
+  if (s.duration <= 0) {
+    cerr << file << ": no duration" << endl;
+    return false;
+  }
+  for (const ScenarioEvent &e : s.events) {
+    if (e.kind == ScenarioEvent::ARRIVALS && e.amount > s.rate) {
+      cerr << file << ": \"" << e.line << "\": more new connections than the " << s.rate << " packets per second"
+           << endl;
+      return false;
+    }
+  }
+  stable_sort(s.events.begin(), s.events.end(), [](const ScenarioEvent &a, const ScenarioEvent &b) {
+    return a.at < b.at;
+  });
+  return true;
+}
+
+/// a lifetime in scenario time, "exp:5s", to one in packets for LifetimeDist
+static bool parseLifetime(const Scenario &s, LifetimeDist &d) {
+  vector<string> parts = split(s.lifetime.c_str(), ':');
+  if (parts.size() >= 2) {
+    double seconds;
+    if (!parseTime(parts[1], seconds)) return false;
+    parts[1] = to_string(seconds * s.rate);
+  }
+  string packets;
+  for (size_t i = 0; i < parts.size(); ++i) packets += (i ? ":" : "") + parts[i];
+  return d.parse(packets);
+}
+
+/// what the events change, and the DIP state the PCC check reads
+class ScenarioRunner {
+  LoadBalancer &lb;
+  mt19937_64 rng;
+  
+  vector<vector<DIP>> pools;            // [vipInd][dipInd], as lb.dips gave them after the last setWeights
+  vector<map<int, int>> failed;         // [vipInd]: dipInd -> the weight before it failed
+  vector<vector<uint32_t>> downs;       // [vipInd][dipInd]: how many times it went down
+  unordered_map<uint64_t, pair<uint16_t, uint16_t>> dipOf;    // DIP address -> vipInd, dipInd
+  vector<vector<int>> rampFrom, rampTo; // [vipInd][dipInd] of the ramp going on
+  
+  static inline uint64_t keyOf(const Addr_Port &dip) {
+    return uint64_t(dip.addr) << 16 | dip.port;
+  }
+
+public:
+  LatencyHistogram updates;             // setWeights, per VIP
+  
+  ScenarioRunner(LoadBalancer &lb, uint64_t seed)
+    : lb(lb), rng(seed), pools(VIP_NUM), failed(VIP_NUM), downs(VIP_NUM), rampFrom(VIP_NUM), rampTo(VIP_NUM) {
+  }
+  
+  /// random weights for every VIP, untimed, and the DIP addresses
+  void start() {
+    for (int vipInd = 0; vipInd < VIP_NUM; ++vipInd) {
+      vector<int> weights = randomWeights(lb.dips(vipInd).size());
+      lb.setWeights(vipInd, weights);
+      pools[vipInd] = lb.dips(vipInd);
+      downs[vipInd].assign(pools[vipInd].size(), 0);
+      for (uint16_t j = 0; j < pools[vipInd].size(); ++j) dipOf[keyOf(pools[vipInd][j].addr)] = make_pair(vipInd, j);
+    }
+    updates.reset();
+  }
+  
+  vector<int> randomWeights(size_t n) {
+    vector<int> weights(n);
+    for (int &w : weights) w = max(1, int(log2(1 + rng() % 64)));
+    return weights;
+  }
+  
+  /// step k of event e, k > 0 for the steps of a ramp after its start
+  void apply(ScenarioEvent &e, int k) {
+    int first = e.vip < 0 ? 0 : e.vip, last = e.vip < 0 ? VIP_NUM : e.vip + 1;
+    for (int vipInd = first; vipInd < last; ++vipInd) {
+      vector<int> weights;
+      for (const DIP &dip : pools[vipInd]) weights.push_back(dip.weight);
+      vector<int> up;
+      for (int j = 0; j < (int) weights.size(); ++j) {
+        if (weights[j] > 0) up.push_back(j);
+      }
+      shuffle(up.begin(), up.end(), rng);
+      
+      switch (e.kind) {
+        case ScenarioEvent::FAIL: {
+          double n = e.percent ? e.amount * weights.size() / 100 : e.amount;
+          size_t count = min<size_t>(max<size_t>(size_t(n + 0.5), n > 0), up.empty() ? 0 : up.size() - 1);
+          for (size_t i = 0; i < count; ++i) {
+            failed[vipInd][up[i]] = weights[up[i]];
+            weights[up[i]] = 0;
+          }
+          break;
+        }
+        case ScenarioEvent::RECOVER:
+          for (const pair<const int, int> &f : failed[vipInd]) weights[f.first] = f.second;
+          failed[vipInd].clear();
+          break;
+        case ScenarioEvent::WEIGHTS: {
+          vector<int> random = randomWeights(weights.size());
+          size_t count = size_t(e.amount * up.size() / 100 + 0.5);
+          for (size_t i = 0; i < count; ++i) weights[up[i]] = random[up[i]];
+          break;
+        }
+        case ScenarioEvent::RAMP:
+          if (k == 0) {
+            rampFrom[vipInd] = weights;
+            rampTo[vipInd] = randomWeights(weights.size());
+            continue;
+          }
+          for (int j = 0; j < (int) weights.size(); ++j) {
+            if (weights[j] == 0) continue;    // down since the ramp started: it stays down
+            double from = rampFrom[vipInd][j], to = rampTo[vipInd][j];
+            weights[j] = max(1, int(from + (to - from) * k / e.steps + 0.5));
+          }
+          break;
+        default:
+          break;
+      }
+      
+      for (int j = 0; j < (int) weights.size(); ++j) downs[vipInd][j] += pools[vipInd][j].weight > 0 && !weights[j];
+      uint64_t start = tscNow();
+      lb.setWeights(vipInd, weights);
+      uint64_t ticks = tscNow() - start;
+      updates.record(ticks);
+      e.ticks += ticks;
+      ++e.updates;
+      pools[vipInd] = lb.dips(vipInd);
+    }
+  }
+  
+  /// the times the DIP went down so far. UINT32_MAX for an address that is no DIP
+  inline uint32_t downsOf(const Addr_Port &dip) const {
+    auto it = dipOf.find(keyOf(dip));
+    return it == dipOf.end() ? UINT32_MAX : downs[it->second.first][it->second.second];
+  }
+  
+  inline bool isUp(const Addr_Port &dip) const {
+    auto it = dipOf.find(keyOf(dip));
+    return it != dipOf.end() && pools[it->second.first][it->second.second].weight > 0;
+  }
+};
+
+/// the DIP a connection went to last, and how many times that DIP had gone down then
+struct Assignment {
+  Addr_Port dip;
+  uint32_t downs = 0;
+  bool seen = false, broken = false;
+};
+
+/// one reporting interval
+struct IntervalStats {
+  double from = 0;
+  uint64_t lookups = 0, lookupTicks = 0;
+  uint64_t newConnections = 0, updates = 0, updateTicks = 0, learnTicks = 0;
+  uint64_t violations = 0, moved = 0, toDown = 0;
+};
+
+/// an event, or a step of a ramp, at packet index packet
+struct ScenarioStep {
+  uint64_t packet;
+  int event, k;
+};
+
+int scenarioMain(int argc, char **argv, LoadBalancer &lb) {
+  string file, jsonFile = NAME ".scenario.json";
+  int batch = 32;
+  for (int i = 1; i < argc; i += 2) {
+    string arg = argv[i];
+    if (i + 1 == argc) {
+      cerr << arg << " needs a value" << endl;
+      return 1;
+    }
+    if (arg == "--file") file = argv[i + 1];
+    else if (arg == "--batch") batch = atoi(argv[i + 1]);
+    else if (arg == "--json") jsonFile = argv[i + 1];
+    else {
+      cerr << "unknown argument " << arg << endl;
+      return 1;
+    }
+  }
+  if (file.empty() || batch <= 0) {
+    cerr << "scenario needs --file, and a positive --batch" << endl;
+    return 1;
+  }
+  
+  Scenario s;
+  if (!parseScenario(file, s)) return 1;
+  
+  WorkloadParams wp;
+  wp.connections = s.connections;
+  wp.packets = uint64_t(s.duration * s.rate);
+  wp.flowSkew = s.flowSkew;
+  wp.vipSkew = s.vipSkew;
+  wp.seed = s.seed;
+  if (!parseLifetime(s, wp.lifetime)) {
+    cerr << file << ": lifetime " << s.lifetime << ": forever, fixed:<t>, exp:<t> or pareto:<t>[:<shape>]" << endl;
+    return 1;
+  }
+  
+  vector<ScenarioStep> steps;
+  for (int e = 0; e < (int) s.events.size(); ++e) {
+    const ScenarioEvent &event = s.events[e];
+    uint64_t packet = uint64_t(event.at * s.rate);
+    if (event.kind == ScenarioEvent::ARRIVALS) {
+      wp.arrivalSteps.push_back(make_pair(packet, event.amount / s.rate));
+      continue;
+    }
+    steps.push_back({packet, e, 0});
+    for (int k = 1; event.kind == ScenarioEvent::RAMP && k <= event.steps; ++k) {
+      steps.push_back({uint64_t((event.at + event.over * k / event.steps) * s.rate), e, k});
+    }
+  }
+  stable_sort(steps.begin(), steps.end(), [](const ScenarioStep &a, const ScenarioStep &b) {
+    return a.packet < b.packet;
+  });
+  
+  commonInit();
+  cout << "generating " << wp.packets << " packets" << endl;
+  Workload w = generateWorkload(wp);
+  const uint64_t total = w.packets.size();
+  const uint32_t connections = uint32_t(w.initial.size() + w.opens.size());
+  
+  lb.init((int) connections);
+  ScenarioRunner runner(lb, s.seed);
+  runner.start();
+  lb.addConnections(w.initial);
+  resetLatencies();
+  
+  vector<Assignment> assigned(connections);
+  {
+    vector<Addr_Port> dips(w.initial.size());
+    lb.lookupBatch(w.initial.data(), (int) w.initial.size(), dips.data());
+    for (uint32_t c = 0; c < w.initial.size(); ++c) {
+      assigned[c].dip = dips[c];
+      assigned[c].downs = runner.downsOf(dips[c]);
+      assigned[c].seen = true;
+    }
+  }
+  
+  const uint64_t learnPackets = max<uint64_t>(1, uint64_t(s.learn * s.rate));
+  const uint64_t intervalPackets = max<uint64_t>(1, uint64_t(s.interval * s.rate));
+  vector<IntervalStats> intervals(1);
+  LatencyHistogram learns;
+  vector<Tuple5> learning;
+  vector<Addr_Port> dips(batch);
+  size_t nextStep = 0, learnedOpens = 0;
+  uint64_t nextLearn = learnPackets, nextInterval = intervalPackets, broken = 0;
+  uint32_t sink = 0;
+  
+  for (uint64_t i = 0; i < total;) {
+    if (i >= nextInterval) {
+      intervals.push_back(IntervalStats());
+      intervals.back().from = double(nextInterval) / s.rate;
+      nextInterval += intervalPackets;
+    }
+    
+    while (nextStep < steps.size() && steps[nextStep].packet <= i) {
+      IntervalStats &now = intervals.back();
+      ScenarioEvent &e = s.events[steps[nextStep].event];
+      uint64_t ticks = e.ticks;
+      int updates = e.updates;
+      runner.apply(e, steps[nextStep].k);
+      now.updateTicks += e.ticks - ticks;
+      now.updates += e.updates - updates;
+      ++nextStep;
+    }
+    
+    if (i >= nextLearn) {
+      learning.clear();
+      for (; learnedOpens < w.opens.size() && w.opens[learnedOpens] < i; ++learnedOpens) {
+        learning.push_back(w.packets[w.opens[learnedOpens]]);
+      }
+      uint64_t start = tscNow();
+      lb.addConnections(learning);
+      uint64_t ticks = tscNow() - start;
+      learns.record(ticks);
+      intervals.back().learnTicks += ticks;
+      nextLearn += learnPackets;
+    }
+    
+    uint64_t until = min(min(nextLearn, nextInterval), total);
+    if (nextStep < steps.size()) until = min(until, steps[nextStep].packet);
+    int n = (int) min<uint64_t>(batch, max<uint64_t>(until, i + 1) - i);
+    
+    IntervalStats &now = intervals.back();
+    uint64_t start = tscNow();
+    lb.lookupBatch(&w.packets[i], n, dips.data());
+    now.lookupTicks += tscNow() - start;
+    now.lookups += n;
+    sink += dips[0].addr;
+    
+    for (int j = 0; j < n; ++j) {
+      Assignment &a = assigned[w.flows[i + j]];
+      now.toDown += !runner.isUp(dips[j]);
+      if (!a.seen) {
+        ++now.newConnections;
+      } else if (!(a.dip == dips[j])) {
+        // the old DIP stayed up all along: PCC broken
+        if (runner.isUp(a.dip) && runner.downsOf(a.dip) == a.downs) {
+          ++now.violations;
+          broken += !a.broken;
+          a.broken = true;
+        } else {
+          ++now.moved;
+        }
+      }
+      a.dip = dips[j];
+      a.downs = runner.downsOf(dips[j]);
+      a.seen = true;
+    }
+    i += n;
+  }
+  
+  // the report
+  uint64_t lookups = 0, lookupTicks = 0, violations = 0, moved = 0, toDown = 0;
+  for (const IntervalStats &t : intervals) {
+    lookups += t.lookups;
+    lookupTicks += t.lookupTicks;
+    violations += t.violations;
+    moved += t.moved;
+    toDown += t.toDown;
+  }
+  auto mpps = [](uint64_t lookups, uint64_t ticks) {
+    return ticks ? lookups / (ticks / tscPerNs() / 1E9) / 1E6 : 0;
+  };
+  auto ms = [](uint64_t ticks) {
+    return ticks / tscPerNs() / 1E6;
+  };
+  
+  printf("%d\b \b", sink & 7);
+  cout << dec << lb.name() << " scenario " << file << ": " << total << " packets over " << s.duration << "s, "
+       << connections << " connections (" << w.opens.size() << " new), " << mpps(lookups, lookupTicks) << "Mpps, "
+       << violations << " PCC violations in " << broken << " connections, " << moved << " moved off a DIP down, "
+       << toDown << " packets to a DIP down" << endl;
+  for (const ScenarioEvent &e : s.events) {
+    if (e.kind == ScenarioEvent::ARRIVALS) continue;
+    cout << "  " << e.line << ": " << e.updates << " updates, " << ms(e.ticks) << "ms" << endl;
+  }
+  cout << "  updates: " << runner.updates.count() << ", p50: " << runner.updates.percentileNs(0.5) / 1E3
+       << "us, p99: " << runner.updates.percentileNs(0.99) / 1E3 << "us, max: " << runner.updates.maxNs() / 1E3
+       << "us" << endl;
+  cout << "  learning: " << learns.count() << ", p50: " << learns.percentileNs(0.5) / 1E3 << "us, p99: "
+       << learns.percentileNs(0.99) / 1E3 << "us, max: " << learns.maxNs() / 1E3 << "us" << endl;
+  cout << setw(10) << "t" << setw(12) << "Mpps" << setw(10) << "new" << setw(10) << "updates" << setw(12)
+       << "update ms" << setw(12) << "learn ms" << setw(12) << "violations" << setw(10) << "moved" << setw(10)
+       << "to down" << endl;
+  for (const IntervalStats &t : intervals) {
+    cout << setw(10) << t.from << setw(12) << mpps(t.lookups, t.lookupTicks) << setw(10) << t.newConnections
+         << setw(10) << t.updates << setw(12) << ms(t.updateTicks) << setw(12) << ms(t.learnTicks) << setw(12)
+         << t.violations << setw(10) << t.moved << setw(10) << t.toDown << endl;
+  }
+  printLatencies(cout);
+  
+  ofstream out(jsonFile);
+  if (!out) {
+    cerr << "cannot write " << jsonFile << endl;
+    return 1;
+  }
+  JsonWriter json(out);
+  json.beginObject();
+  json.field("algorithm", lb.name()).field("name", NAME).field("scenario", file);
+  json.key("settings").beginObject();
+  json.field("duration_s", s.duration).field("rate", s.rate).field("connections", s.connections);
+  json.field("flow_skew", s.flowSkew).field("vip_skew", s.vipSkew).field("lifetime", s.lifetime);
+  json.field("learn_s", s.learn).field("interval_s", s.interval).field("seed", s.seed).field("batch", batch);
+  json.endObject();
+  
+  json.field("packets", total).field("new_connections", (uint64_t) w.opens.size());
+  json.field("lookups", lookups).field("mpps", mpps(lookups, lookupTicks));
+  json.field("violations", violations).field("broken_connections", broken).field("moved", moved);
+  json.field("to_dip_down", toDown);
+  json.key("updates").beginObject();
+  json.field("count", runner.updates.count()).field("p50_ns", runner.updates.percentileNs(0.5));
+  json.field("p99_ns", runner.updates.percentileNs(0.99)).field("max_ns", runner.updates.maxNs());
+  json.endObject();
+  json.key("learning").beginObject();
+  json.field("count", learns.count()).field("p50_ns", learns.percentileNs(0.5));
+  json.field("p99_ns", learns.percentileNs(0.99)).field("max_ns", learns.maxNs());
+  json.endObject();
+  
+  json.key("events").beginArray();
+  for (const ScenarioEvent &e : s.events) {
+    json.beginObject().field("t_s", e.at).field("event", e.line);
+    json.field("updates", e.updates).field("update_ms", ms(e.ticks)).endObject();
+  }
+  json.endArray();
+  json.key("intervals").beginArray();
+  for (const IntervalStats &t : intervals) {
+    json.beginObject().field("t_s", t.from).field("lookups", t.lookups).field("mpps", mpps(t.lookups, t.lookupTicks));
+    json.field("new_connections", t.newConnections).field("updates", t.updates);
+    json.field("update_ms", ms(t.updateTicks)).field("learn_ms", ms(t.learnTicks));
+    json.field("violations", t.violations).field("moved", t.moved).field("to_dip_down", t.toDown).endObject();
+  }
+  json.endArray();
+  json.endObject();
+  
+  cout << "results in " << jsonFile << endl;
+  return 0;
+}
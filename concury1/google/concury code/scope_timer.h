@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <x86intrin.h>
+
+#include "latency_histogram.h"
+
+using namespace std;
+
+/*! \file scope_timer.h
+ *  Nested scope timers for PROFILE builds: TSC ticks summed per call path in a preallocated tree per thread, reported
+ *  as JSON and as folded stacks when the program ends. Nothing is printed or allocated while timing.
+ */
+
+/// the TSC once the instructions before it have run, to close a scope
+inline uint64_t tscNowOrdered() {
+  unsigned aux;
+  return __rdtscp(&aux);
+}
+
+/// a scope of the tree: the name, its place among its parent's children, and its totals over every entry
+struct ScopeNode {
+  const char *name;
+  int parent, firstChild, nextSibling;
+  uint64_t count, ticks, maxTicks;
+};
+
+/**
+ * The scope tree of one thread. Node 0 is the thread itself; entering a scope walks the children of the current node
+ * for the name, comparing pointers, and takes a fresh node the first time. The nodes are a fixed array: when it is
+ * full, further new scopes are dropped and counted. Registered while the thread lives, merged into the retired report
+ * when it exits.
+ */
+class ScopeTimers {
+public:
+  static const int MAX_NODES = 1024;
+  
+  /// the nodes of all threads merged by call path, names compared as strings
+  struct Report {
+    uint64_t count = 0, ticks = 0, maxTicks = 0;
+    map<string, Report> children;
+  };
+
+private:
+  ScopeNode nodes[MAX_NODES];
+  int used = 1, current = 0;
+  uint64_t dropped = 0;
+  
+  struct Registry {
+    mutex lock;
+    vector<ScopeTimers *> live;
+    Report retired;
+    uint64_t dropped = 0;
+    set<string> names;
+  };
+  
+  void mergeInto(Report &r, int node) const {
+    for (int c = nodes[node].firstChild; c >= 0; c = nodes[c].nextSibling) {
+      Report &child = r.children[nodes[c].name];
+      child.count += nodes[c].count;
+      child.ticks += nodes[c].ticks;
+      child.maxTicks = std::max(child.maxTicks, nodes[c].maxTicks);
+      mergeInto(child, c);
+    }
+  }
+
+public:
+  ScopeTimers() {
+    nodes[0] = {"", -1, -1, -1, 0, 0, 0};
+    Registry &r = registry();
+    lock_guard<mutex> guard(r.lock);
+    r.live.push_back(this);
+  }
+  
+  ~ScopeTimers() {
+    Registry &r = registry();
+    lock_guard<mutex> guard(r.lock);
+    mergeInto(r.retired, 0);
+    r.dropped += dropped;
+    r.live.erase(find(r.live.begin(), r.live.end(), this));
+  }
+  
+  static Registry &registry() {
+    static Registry r;
+    return r;
+  }
+  
+  static inline ScopeTimers &local() {
+    static thread_local ScopeTimers timers;
+    return timers;
+  }
+  
+  /// a name that lives as long as the program, for scopes named at run time. takes a lock and may allocate
+  static const char *intern(const string &name) {
+    Registry &r = registry();
+    lock_guard<mutex> guard(r.lock);
+    return r.names.insert(name).first->c_str();
+  }
+  
+  /// \param name a string literal, or from intern
+  /// \return the node entered, -1 if the tree is full
+  inline int enter(const char *name) {
+    int c = nodes[current].firstChild;
+    while (c >= 0 && nodes[c].name != name) c = nodes[c].nextSibling;
+    if (c < 0) {
+      if (used == MAX_NODES) {
+        ++dropped;
+        return -1;
+      }
+      c = used++;
+      nodes[c] = {name, current, -1, nodes[current].firstChild, 0, 0, 0};
+      nodes[current].firstChild = c;
+    }
+    current = c;
+    return c;
+  }
+  
+  inline void exit(int node, uint64_t ticks) {
+    if (node < 0) return;
+    ScopeNode &n = nodes[node];
+    ++n.count;
+    n.ticks += ticks;
+    if (ticks > n.maxTicks) n.maxTicks = ticks;
+    current = n.parent;
+  }
+  
+  /// the scopes of all threads, the exited ones included, and how many were dropped. exact while no thread times
+  static Report merged(uint64_t &droppedScopes) {
+    Registry &r = registry();
+    lock_guard<mutex> guard(r.lock);
+    Report report = r.retired;
+    droppedScopes = r.dropped;
+    for (ScopeTimers *t : r.live) {
+      t->mergeInto(report, 0);
+      droppedScopes += t->dropped;
+    }
+    return report;
+  }
+};
+
+/// times its scope into the tree of the calling thread, in PROFILE builds. the name must outlive the program: a string
+/// literal, or from ScopeTimers::intern
+class ScopedTimer {
+  #ifdef PROFILE
+  int node;
+  uint64_t start;
+  #endif
+
+public:
+  explicit ScopedTimer(const char *name) {
+    #ifdef PROFILE
+    node = ScopeTimers::local().enter(name);
+    start = tscNow();
+    #endif
+  }
+  
+  ~ScopedTimer() {
+    #ifdef PROFILE
+    uint64_t end = tscNowOrdered();
+    ScopeTimers::local().exit(node, end - start);
+    #endif
+  }
+};
+
+/**
+ * Write the merged scopes to prefix ".timers.json", a tree of {"name", "count", "total_ns", "self_ns", "max_ns",
+ * "children"}, and to prefix ".timers.folded", one "outer;inner self_ns" line per scope for flamegraph.pl. Nothing is
+ * written if no scope was timed.
+ */
+void writeScopeTimers(const string &prefix);
@@ -12,30 +12,37 @@ vector<DataPlaneCuckooMap<Tuple5, uint8_t>> dpConnTables;                   // 5
 //int fail = 0;
 
 vector<vector<DIP>> dipPools[VIP_NUM];  // vipIndex, version, dipindex -> dip
+int dipNum[VIP_NUM];
+static const int POOL_VERSIONS = 64;    // the 6-bit versions of vipTable and the conn tables
 
 vector<ControlPlaneCuckooMap<Tuple5, uint8_t>> cpConnTables;
 ControlPlaneCuckooMap<Addr_Port, uint8_t> vipTable(VIP_NUM);             // vip->version: 144 -> 6
 ControlPlaneCuckooMap<pair<Addr_Port, uint8_t>, uint8_t> dipPoolTable(DIP_NUM);    // vip, version->dip_pool: 144 -> DIPPoolIndex 6
 
+/// dp.: what the switch holds. cp.: what only the control plane keeps
+MemoryBreakdown getMemoryBreakdown() {
+  MemoryBreakdown b;
+  for (int i = 0; i < dpConnTables.size(); ++i) {
+    b.add(dpConnTables[i].getMemoryBreakdown(), "dp.conn-tables.");
+    b.add(cpConnTables[i].getMemoryBreakdown(), "cp.conn-tables.");
+  }
+  b.add(vipTable.getMemoryBreakdown(), "dp.vip-table.");
+  b.add(dipPoolTable.getMemoryBreakdown(), "dp.dip-pool-table.");
+  for (int i = 0; i < VIP_NUM; ++i) b.addVector("dp.dip-pools", dipPools[i]);
+  return b;
+}
+
 void printMemoryUsage() {
-  uint64_t size = 0;
-  
   for (int i = 0; i < dpConnTables.size(); ++i) {
-    size += cpConnTables[i].EntryCount();
     cout << "connTrackingTable" << i << " entries: " << human(cpConnTables[i].EntryCount()) << endl;
   }
-  size = size * sizeof(DataPlaneCuckooMap<Tuple5, uint8_t>::Bucket) / DataPlaneCuckooMap<Tuple5, uint8_t>::kSlotsPerBucket;
-  
-  size += VIP_NUM * sizeof(ControlPlaneCuckooMap<Addr_Port, uint8_t>::Bucket) / ControlPlaneCuckooMap<Addr_Port, uint8_t>::kSlotsPerBucket;
-  size += DIP_NUM * sizeof(ControlPlaneCuckooMap<pair<Addr_Port, uint8_t>, uint8_t>::Bucket) / ControlPlaneCuckooMap<pair<Addr_Port, uint8_t>, uint8_t>::kSlotsPerBucket;
-  
-  size *= 1.1;
   
-  // dipTable
-  size += VIP_NUM * HT_SIZE * sizeof(uint16_t) + DIP_NUM * sizeof(DIP);
-  
-  cout << "Total memory usage: " << size << endl;
-  memoryLog << CONN_NUM << " " << size << endl;
+  MemoryBreakdown b = getMemoryBreakdown();
+  b.print(cout);
+  cout << "Total memory usage: " << b.reserved("dp.") << endl;
+#ifndef LB_BENCH
+  memoryLog << CONN_NUM << " " << b.reserved("dp.") << endl;
+#endif
 }
 
 uint64_t getTotalEntires() {
@@ -119,6 +126,7 @@ bool insertToConnTable(deque<pair<const Tuple5, uint8_t>>& waiting, uint8_t stag
 }
 
 bool insertToConnTable(const Tuple5& incoming, uint8_t version) {
+  ScopedLatency timer(LAT_INSERT);
   deque<pair<const Tuple5, uint8_t>> waiting;
   waiting.push_back(make_pair(incoming, version));
   
@@ -164,6 +172,8 @@ void serve() {
     
     // Step 2: lookup the ConnTable
     // note: handle SYN packets: syn packets should be directly inserted into the connTable to pypass the lookup
+    bool sampled = sampleLookup();
+    uint64_t lookupStart = sampled ? tscNow() : 0;
     hit = bigVirtualConnTable(tuple, version);
     assert(hit);
     
@@ -174,6 +184,7 @@ void serve() {
     uint16_t vipInd = tuple.dst.addr & VIP_MASK;
     auto &pool = dipPools[vipInd][dipPoolIndex];
     DIP dip = pool[hashers[0](tuple) % (pool.size())];
+    if (sampled) recordLatency(LAT_LOOKUP, tscNow() - lookupStart);
     
     stupid += dip.addr.addr;   //prevent optimize
     i++;
@@ -192,7 +203,9 @@ void serve() {
   sync_printf("%d\b \b", stupid & 7);
   gettimeofday(&curr, NULL);
   int diff = diff_ms(curr, start);
+#ifndef LB_BENCH
   queryLog << 1 << " " << CONN_NUM << " " << 5 * LOG_INTERVAL / (diff / 1000.0) << endl;
+#endif
 }
 
 /**
@@ -255,7 +268,9 @@ void simulateConnectionAdd(int limit = 0, int prestart = 0) {
   gettimeofday(&curr, NULL);
   double diff = diff_us(curr, start) / 1000.0;
   cout << "Cnt: " << limit << ", insert time: " << diff << "ms" << endl;
+#ifndef LB_BENCH
   addLog << limit << " " << diff << endl;
+#endif
 }
 
 /**
@@ -268,7 +283,6 @@ void simulateConnectionAdd(int limit = 0, int prestart = 0) {
  */
 //! cuckoo hash has to allocate memory before operation. No one can predict collisions and I just assume /2
 void initDipPool() {
-  int dipNum[VIP_NUM];
   for (int i = 0; i < VIP_NUM; ++i)
     dipNum[i] = DIP_NUM_MIN;
   
@@ -295,18 +309,61 @@ void initDipPool() {
   }
 }
 
-void initControlPlaneAndDataPlane() {
+/**
+ * a weight update of one VIP: it moves to the next version of its DIP pool, in which DIP j takes weights[j] slots.
+ * new connections take the version from vipTable, those in the conn tables keep theirs, and their pool until the
+ * version comes round again
+ */
+void updatePool(const Addr_Port &vip, const vector<int> &weights) {
+  uint16_t vipInd = vip.addr & VIP_MASK;
+  
+  uint8_t version = 0;
+  bool findRes = vipTable.Find(vip, &version);
+  assert(findRes);
+  version = (version + 1) % POOL_VERSIONS;
+  
+  vector<vector<DIP>> &pools = dipPools[vipInd];
+  if (pools.size() <= version) pools.resize(version + 1);
+  vector<DIP> &pool = pools[version];
+  pool.clear();
+  for (uint16_t j = 0; j < weights.size(); ++j) {
+    DIP dip = {{vip.addr, uint16_t(vip.port + j)}, weights[j]};
+    pool.insert(pool.end(), dip.weight, dip);
+  }
+  if (pool.empty()) pool.push_back({{vip.addr, vip.port}, 1});
+  
+  ScopedLatency timer(LAT_COMPOSE);
+  vipTable.Remove(vip);
+  vipTable.Insert(vip, version);
+  dipPoolTable.Remove(make_pair(vip, version));
+  dipPoolTable.Insert(make_pair(vip, version), version);
+}
+
+/// every VIP to new random weights, see updatePool
+void simulateUpdatePoolData() {
+  for (int i = 0; i < VIP_NUM; ++i) {
+    Addr_Port vip;
+    getVip(&vip);
+    
+    vector<int> weights(dipNum[vip.addr & VIP_MASK]);
+    for (int &w : weights) w = int(log2(1 + (rand() % 64)));   // 0-6
+    updatePool(vip, weights);
+  }
+}
+
+/// capacity: the connections the first conn table is presized for
+void initControlPlaneAndDataPlane(int capacity = CONN_NUM) {
   dpConnTables.clear();
   cpConnTables.clear();
   hashers.clear();
   
-  cpConnTables.push_back(ControlPlaneCuckooMap<Tuple5, uint8_t>(CONN_NUM));   // cascade, initially 4 empty table
+  cpConnTables.push_back(ControlPlaneCuckooMap<Tuple5, uint8_t>(capacity));   // cascade, initially 4 empty table
   dpConnTables.push_back(DataPlaneCuckooMap<Tuple5, uint8_t>(cpConnTables.back()));   // cascade, initially 4 empty table
   cpConnTables.back().SetAssociated(dpConnTables.back());
   hashers.push_back(cpConnTables.back().getDigestFunction());
   
   vipTable.Clear(VIP_NUM);
-  dipPoolTable.Clear(VIP_NUM);
+  dipPoolTable.Clear(VIP_NUM * POOL_VERSIONS);
   
   for (int i = 0; i < VIP_NUM; ++i) {
     Addr_Port vip;
@@ -390,25 +447,197 @@ void dynamicThroughput() {
     
     printf("%d\b \b", stupid & 7);
     
+#ifndef LB_BENCH
     dynamicLog << newConnPerSec << " " << LOG_INTERVAL * 1.0 * round / diff_ms(last, start) / 1000 << endl;
+#endif
   }
+#ifndef LB_BENCH
   dynamicLog.close();
+#endif
 }
 
+/**
+ * compare bucket layouts of the conn table on a single table: the load factor
+ * reached at the first failed insert (capped at 2 * CONN_NUM), the insert
+ * throughput up to that point, and the data plane Find latency on hits.
+ */
+template<int S>
+void benchmarkBucketLayout() {
+  ControlPlaneCuckooMap<Tuple5, uint8_t, uint16_t, S> cp(CONN_NUM);
+  DataPlaneCuckooMap<Tuple5, uint8_t, uint16_t, S> dp(cp);
+  cp.SetAssociated(dp);
+  
+  struct timeval start, curr;
+  LFSRGen<Tuple3> tuple3Gen(0xe2211, 2 * CONN_NUM, 0);
+  Tuple5 tuple;
+  tuple.dst.addr = 0x0a800000;
+  tuple.dst.port = 0;
+  
+  gettimeofday(&start, NULL);
+  for (int i = 0; i < 2 * CONN_NUM; ++i) {
+    tuple3Gen.gen((Tuple3*) &tuple.src);
+    if (!cp.Insert(tuple, i & 0xff)) break;
+  }
+  gettimeofday(&curr, NULL);
+  int cnt = cp.EntryCount();
+  double insertUs = diff_us(curr, start);
+  
+  vector<Tuple5> keys(min(cnt, 1 << 20));
+  LFSRGen<Tuple3> replayGen(0xe2211, 2 * CONN_NUM, 0);
+  for (auto &key : keys) {
+    key.dst = tuple.dst;
+    replayGen.gen((Tuple3*) &key.src);
+  }
+  
+  int stupid = 0;
+  gettimeofday(&start, NULL);
+  for (int i = 0, j = 0; i < LOG_INTERVAL; ++i) {
+    uint8_t version = 0;   // left as it is on a miss
+    stupid += dp.Find(keys[j], &version) + version;
+    if (++j == keys.size()) j = 0;
+  }
+  gettimeofday(&curr, NULL);
+  printf("%d\b \b", stupid & 7);
+  
+  cout << S << " slots/bucket, " << sizeof(typename DataPlaneCuckooMap<Tuple5, uint8_t, uint16_t, S>::BucketType)
+       << "B/bucket: load factor " << cnt * 1.0 / (cp.BucketCount() * S)
+       << ", insert " << cnt / insertUs << "Mops"
+       << ", find " << diff_us(curr, start) * 1000.0 / LOG_INTERVAL << "ns" << endl;
+}
+
+/// memory against the connection count, from what is allocated after adding them: NAME ".memcurve.data"
+void memoryCurve() {
+  ofstream curveLog(NAME ".memcurve.data");
+  for (int conns = 1024; conns <= CONN_NUM; conns *= 2) {
+    initControlPlaneAndDataPlane();
+    simulateConnectionAdd(conns, 0);
+    
+    MemoryBreakdown b = getMemoryBreakdown();
+    b.log(curveLog, conns);
+    cout << conns << " connections: " << b.reserved("dp.") << "B data plane, " << b.reserved("cp.")
+         << "B control plane, " << double(b.reserved()) / conns << "B/conn" << endl;
+  }
+}
+
+#ifdef LB_BENCH
+#include "lb_bench.h"
+
+class SilkRoadLoadBalancer : public LoadBalancer {
+  /// a connection the conn tables miss is new: it takes the current version of its VIP, as in dynamicThroughput
+  static inline Addr_Port route(const Tuple5 &tuple) {
+    uint8_t version, dipPoolIndex;
+    if (!bigVirtualConnTable(tuple, version)) {
+      vipTable.Find(tuple.dst, &version);
+      insertToConnTable(tuple, version);
+    }
+    
+    // a digest false hit can carry the version of a connection of another VIP, one this VIP has no pool of yet
+    if (!dipPoolTable.Find(make_pair(tuple.dst, version), &dipPoolIndex)) {
+      vipTable.Find(tuple.dst, &version);
+      dipPoolTable.Find(make_pair(tuple.dst, version), &dipPoolIndex);
+    }
+    auto &pool = dipPools[tuple.dst.addr & VIP_MASK][dipPoolIndex];
+    return pool[hashers[0](tuple) % pool.size()].addr;
+  }
+
+public:
+  const char *name() const override {
+    return "silkroad";
+  }
+  
+  void init(int capacity) override {
+    initControlPlaneAndDataPlane(capacity);
+  }
+  
+  void addConnections(int count) override {
+    simulateConnectionAdd(count, 0);
+  }
+  
+  void addConnections(const vector<Tuple5> &packets) override {
+    for (const Tuple5 &packet : packets) route(packet);
+  }
+  
+  Addr_Port lookup(const Tuple5 &packet) override {
+    return route(packet);
+  }
+  
+  void lookupBatch(const Tuple5 *packets, int n, Addr_Port *dips) override {
+    for (int i = 0; i < n; ++i) dips[i] = route(packets[i]);
+  }
+  
+  void updateWeights() override {
+    simulateUpdatePoolData();
+  }
+  
+  /// the weights of the current version, the slots each DIP takes in its pool
+  vector<DIP> dips(int vipInd) override {
+    Addr_Port vip = {uint32_t(0x0a800000 + vipInd), 0};
+    uint8_t version = 0;
+    bool findRes = vipTable.Find(vip, &version);
+    assert(findRes);
+    
+    vector<DIP> result;
+    for (uint16_t j = 0; j < dipNum[vipInd]; ++j) result.push_back({{vip.addr, uint16_t(vip.port + j)}, 0});
+    for (const DIP &dip : dipPools[vipInd][version]) ++result[dip.addr.port - vip.port].weight;
+    return result;
+  }
+  
+  void setWeights(int vipInd, const vector<int> &weights) override {
+    updatePool({uint32_t(0x0a800000 + vipInd), 0}, weights);
+  }
+  
+  MemoryBreakdown getMemoryBreakdown() const override {
+    return ::getMemoryBreakdown();
+  }
+};
+#endif
+
 int main(int argc, char **argv) {
+#ifdef LB_BENCH
+  SilkRoadLoadBalancer lb;
+  return benchmarkMain(argc, argv, lb);
+#endif
+
+#ifdef LAYOUT
+  cout << "--benchmarkBucketLayout" << endl;
+  benchmarkBucketLayout<5>();
+  benchmarkBucketLayout<8>();
+  benchmarkBucketLayout<16>();
+  return 0;
+#endif
+  
   cout << "--init" << endl;
   init();
 
+#ifdef MEMORY_CURVE
+  cout << "--memoryCurve" << endl;
+  memoryCurve();
+  return 0;
+#endif
+
   cout << "--simulateConnectionAdd" << endl;
   simulateConnectionAdd();
   printMemoryUsage();
 
   cout << "--serve" << endl;
-  serve();
+  {
+    Clocker clocker("serve, per packet", 5 * LOG_INTERVAL);
+    serve();
+  }
+  
+  cout << "--latency" << endl;
+  ofstream latencyLog(NAME ".latency.data");
+  printLatencies(cout);
+  logLatencies(latencyLog, "static");
+  resetLatencies();
   
   if (CONN_NUM == 16777216) {
     cout << "--dynamicThroughput" << endl;
     dynamicThroughput();
+    
+    cout << "--latency" << endl;
+    printLatencies(cout);
+    logLatencies(latencyLog, "dynamic");
   }
   return 0;
 }
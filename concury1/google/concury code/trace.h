@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+/*! \file trace.h
+ *  The binary packet trace: a TraceHeader, then count fixed TraceRecords, in host (x86, little endian) byte order.
+ *  trace_convert writes it from text dumps and pcap files; MappedTrace maps it for realTraceDistribution and the
+ *  replay of the benchmark driver (trace_replay.cpp).
+ */
+
+static const char TRACE_MAGIC[8] = {'L', 'B', 'T', 'R', 'A', 'C', 'E', 0};
+static const uint32_t TRACE_VERSION = 1;
+static const uint32_t TRACE_TIMESTAMPS = 1;    // the records carry capture times
+
+#pragma pack(push, 1)
+struct TraceHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t recordSize;    // sizeof(TraceRecord) of the writer
+  uint64_t count;
+  uint32_t flags;
+  uint32_t reserved;
+};
+
+struct TraceRecord {      // 24B
+  uint64_t ns;            // since the first packet. 0 without TRACE_TIMESTAMPS
+  uint32_t srcAddr, dstAddr;    // IPv4, as integers: 10.128.0.0 is 0x0a800000
+  uint16_t srcPort, dstPort;
+  uint8_t protocol;
+  uint8_t pad[3];
+};
+#pragma pack(pop)
+
+static_assert(sizeof(TraceHeader) == 32, "TraceHeader is part of the file format");
+static_assert(sizeof(TraceRecord) == 24, "TraceRecord is part of the file format");
+
+/// a trace file mapped read only. throws runtime_error if it cannot be opened or is not a trace
+class MappedTrace {
+  int fd = -1;
+  void *base = MAP_FAILED;
+  size_t length = 0;
+
+public:
+  explicit MappedTrace(const string &path) {
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw runtime_error(path + ": " + strerror(errno));
+    
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(TraceHeader)) {
+      close(fd);
+      throw runtime_error(path + ": not a trace, too short");
+    }
+    length = st.st_size;
+    base = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+      close(fd);
+      throw runtime_error(path + ": mmap: " + strerror(errno));
+    }
+    madvise(base, length, MADV_SEQUENTIAL);
+    
+    const TraceHeader &h = header();
+    string error;
+    if (memcmp(h.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) error = "not a trace";
+    else if (h.version != TRACE_VERSION) error = "trace version " + to_string(h.version);
+    else if (h.recordSize != sizeof(TraceRecord)) error = "record size " + to_string(h.recordSize);
+    else if ((length - sizeof(TraceHeader)) / sizeof(TraceRecord) < h.count) error = "truncated";
+    if (!error.empty()) {
+      munmap(base, length);
+      close(fd);
+      throw runtime_error(path + ": " + error);
+    }
+  }
+  
+  MappedTrace(const MappedTrace &) = delete;
+  
+  MappedTrace &operator=(const MappedTrace &) = delete;
+  
+  ~MappedTrace() {
+    munmap(base, length);
+    close(fd);
+  }
+  
+  inline const TraceHeader &header() const {
+    return *(const TraceHeader *) base;
+  }
+  
+  inline const TraceRecord *records() const {
+    return (const TraceRecord *) ((const char *) base + sizeof(TraceHeader));
+  }
+  
+  inline uint64_t size() const {
+    return header().count;
+  }
+  
+  inline bool hasTimestamps() const {
+    return header().flags & TRACE_TIMESTAMPS;
+  }
+};
+
+/// writes a trace through stdio. the header is rewritten with the count by close. throws runtime_error on I/O errors
+class TraceWriter {
+  FILE *out;
+  string path;
+  TraceHeader h;
+
+public:
+  TraceWriter(const string &path, uint32_t flags) : path(path) {
+    out = fopen(path.c_str(), "wb");
+    if (!out) throw runtime_error(path + ": " + strerror(errno));
+    
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    h.version = TRACE_VERSION;
+    h.recordSize = sizeof(TraceRecord);
+    h.flags = flags;
+    fwrite(&h, sizeof(h), 1, out);
+  }
+  
+  TraceWriter(const TraceWriter &) = delete;
+  
+  TraceWriter &operator=(const TraceWriter &) = delete;
+  
+  ~TraceWriter() {
+    if (out) fclose(out);
+  }
+  
+  inline void add(const TraceRecord &r) {
+    fwrite(&r, sizeof(r), 1, out);
+    ++h.count;
+  }
+  
+  inline uint64_t size() const {
+    return h.count;
+  }
+  
+  void close() {
+    bool ok = !ferror(out) && fseek(out, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, out) == 1;
+    ok = fclose(out) == 0 && ok;
+    out = nullptr;
+    if (!ok) throw runtime_error(path + ": write failed");
+  }
+};
@@ -0,0 +1,185 @@
+/**
+ * Converts packet traces to the binary format of trace.h:
+ *
+ *   trace_convert text out.trace in...   text dumps, one packet per line: "srcAddr srcPort dstAddr dstPort protocol"
+ *                                        as decimal integers, the format of the processed Facebook traces. no times
+ *   trace_convert pcap out.trace in...   pcap captures (not pcapng), microsecond or nanosecond, either byte order,
+ *                                        over Ethernet (VLAN tagged or not), raw IP or Linux cooked. IPv4 only
+ *
+ * The inputs are appended in the order given. pcap times are kept relative to the first packet of the first input.
+ * Packets that are not IPv4 are skipped and counted; a fragment after the first keeps ports 0.
+ */
+#include "trace.h"
+#include <iostream>
+#include <vector>
+
+static bool convertText(const char *path, TraceWriter &out) {
+  FILE *in = fopen(path, "r");
+  if (!in) {
+    cerr << path << ": " << strerror(errno) << endl;
+    return false;
+  }
+  
+  TraceRecord r;
+  memset(&r, 0, sizeof(r));
+  unsigned srcAddr, srcPort, dstAddr, dstPort, protocol;
+  while (fscanf(in, "%u %u %u %u %u", &srcAddr, &srcPort, &dstAddr, &dstPort, &protocol) == 5) {
+    r.srcAddr = srcAddr;
+    r.srcPort = srcPort;
+    r.dstAddr = dstAddr;
+    r.dstPort = dstPort;
+    r.protocol = protocol;
+    out.add(r);
+  }
+  
+  bool ok = feof(in);
+  if (!ok) cerr << path << ": parse error after " << out.size() << " packets" << endl;
+  fclose(in);
+  return ok;
+}
+
+static inline uint16_t be16(const uint8_t *p) {
+  return uint16_t(p[0] << 8 | p[1]);
+}
+
+static inline uint32_t be32(const uint8_t *p) {
+  return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+}
+
+/// the IPv4 packet at ip, of len bytes, into r. \return false if it is not one
+static bool parseIPv4(const uint8_t *ip, uint32_t len, TraceRecord &r) {
+  if (len < 20 || (ip[0] >> 4) != 4) return false;
+  uint32_t ihl = (ip[0] & 0xf) * 4;
+  if (ihl < 20 || len < ihl) return false;
+  
+  r.protocol = ip[9];
+  r.srcAddr = be32(ip + 12);
+  r.dstAddr = be32(ip + 16);
+  r.srcPort = r.dstPort = 0;
+  
+  bool firstFragment = (be16(ip + 6) & 0x1fff) == 0;
+  if (firstFragment && (r.protocol == 6 || r.protocol == 17) && len >= ihl + 4) {
+    r.srcPort = be16(ip + ihl);
+    r.dstPort = be16(ip + ihl + 2);
+  }
+  return true;
+}
+
+struct PcapState {
+  bool started = false;
+  uint64_t firstNs = 0;
+  uint64_t skipped = 0;
+};
+
+static bool convertPcap(const char *path, TraceWriter &out, PcapState &state) {
+  FILE *in = fopen(path, "rb");
+  if (!in) {
+    cerr << path << ": " << strerror(errno) << endl;
+    return false;
+  }
+  
+  uint8_t global[24];
+  if (fread(global, sizeof(global), 1, in) != 1) {
+    cerr << path << ": not a pcap file, too short" << endl;
+    fclose(in);
+    return false;
+  }
+  
+  uint32_t magic;
+  memcpy(&magic, global, 4);
+  bool swapped = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+  bool nanos = magic == 0xa1b23c4d || magic == 0x4d3cb2a1;
+  if (!swapped && magic != 0xa1b2c3d4 && magic != 0xa1b23c4d) {
+    cerr << path << ": not a pcap file (pcapng is not supported)" << endl;
+    fclose(in);
+    return false;
+  }
+  auto field = [swapped](const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return swapped ? __builtin_bswap32(v) : v;
+  };
+  
+  uint32_t linkType = field(global + 20) & 0xffff;
+  if (linkType != 1 && linkType != 101 && linkType != 113) {
+    cerr << path << ": link type " << linkType << ", only Ethernet, raw IP and Linux cooked are supported" << endl;
+    fclose(in);
+    return false;
+  }
+  
+  vector<uint8_t> packet(65536);
+  uint8_t header[16];
+  TraceRecord r;
+  memset(&r, 0, sizeof(r));
+  while (fread(header, sizeof(header), 1, in) == 1) {
+    uint64_t ns = field(header) * 1000000000ULL + field(header + 4) * (nanos ? 1 : 1000);
+    uint32_t caplen = field(header + 8);
+    if (caplen > packet.size()) packet.resize(caplen);
+    if (fread(packet.data(), 1, caplen, in) != caplen) {
+      cerr << path << ": truncated after " << out.size() << " packets" << endl;
+      break;
+    }
+    
+    const uint8_t *p = packet.data();
+    uint32_t len = caplen;
+    uint16_t etherType = 0x0800;
+    if (linkType == 1) {
+      if (len < 14) etherType = 0;
+      else {
+        etherType = be16(p + 12);
+        p += 14, len -= 14;
+        while ((etherType == 0x8100 || etherType == 0x88a8) && len >= 4) {
+          etherType = be16(p + 2);
+          p += 4, len -= 4;
+        }
+      }
+    } else if (linkType == 113) {
+      if (len < 16) etherType = 0;
+      else {
+        etherType = be16(p + 14);
+        p += 16, len -= 16;
+      }
+    }
+    
+    if (etherType != 0x0800 || !parseIPv4(p, len, r)) {
+      ++state.skipped;
+      continue;
+    }
+    
+    if (!state.started) {
+      state.started = true;
+      state.firstNs = ns;
+    }
+    r.ns = ns >= state.firstNs ? ns - state.firstNs : 0;
+    out.add(r);
+  }
+  
+  fclose(in);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4 || (string(argv[1]) != "text" && string(argv[1]) != "pcap")) {
+    cerr << "usage: " << argv[0] << " text|pcap out.trace in..." << endl;
+    return 1;
+  }
+  bool pcap = string(argv[1]) == "pcap";
+  
+  try {
+    TraceWriter out(argv[2], pcap ? TRACE_TIMESTAMPS : 0);
+    PcapState state;
+    for (int i = 3; i < argc; ++i) {
+      bool ok = pcap ? convertPcap(argv[i], out, state) : convertText(argv[i], out);
+      if (!ok) return 1;
+    }
+    out.close();
+    
+    cout << argv[2] << ": " << out.size() << " packets";
+    if (state.skipped) cout << ", " << state.skipped << " not IPv4 skipped";
+    cout << endl;
+  } catch (exception &e) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+  return 0;
+}
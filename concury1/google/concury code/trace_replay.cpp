@@ -0,0 +1,254 @@
+/**
+ * Trace replay for the benchmark driver: `lb_bench.<algorithm> replay --trace file ...`, see lb_bench.h.
+ *
+ * The trace (trace.h) is mapped, not read. Its VIPs are folded onto the VIP_NUM of the build, 0x0a800000 + (dstAddr &
+ * VIP_MASK) with port 0, so any trace runs on any build. Its distinct connections are added to the balancer first, so
+ * that the replay itself only looks up: every balancer serves lookups of known connections from many threads.
+ *
+ * The packets are split over the threads by a hash of the connection, as RSS does, into one index list per thread.
+ * Each thread is pinned to its core and feeds its packets to lookupBatch, batch by batch, either as fast as it can or
+ * at the times recorded in the trace: a batch goes when its first packet is due, and how late the latest one went is
+ * reported as the lag.
+ */
+#include "lb_bench.h"
+#include "json_writer.h"
+#include "trace.h"
+#include <atomic>
+
+struct ReplayParams {
+  string trace;
+  int threads = 1;
+  int batch = 32;
+  bool recorded = false;
+  double speed = 1;
+  int loops = 1;
+  string json = NAME ".replay.json";
+};
+
+static bool parseParams(int argc, char **argv, ReplayParams &p) {
+  for (int i = 1; i < argc; i += 2) {
+    string arg = argv[i];
+    if (i + 1 == argc) {
+      cerr << arg << " needs a value" << endl;
+      return false;
+    }
+    const char *value = argv[i + 1];
+    
+    if (arg == "--trace") {
+      p.trace = value;
+    } else if (arg == "--threads") {
+      p.threads = atoi(value);
+    } else if (arg == "--batch") {
+      p.batch = atoi(value);
+    } else if (arg == "--pace") {
+      if (string(value) != "full" && string(value) != "recorded") {
+        cerr << "--pace is full or recorded" << endl;
+        return false;
+      }
+      p.recorded = string(value) == "recorded";
+    } else if (arg == "--speed") {
+      p.speed = atof(value);
+    } else if (arg == "--loops") {
+      p.loops = atoi(value);
+    } else if (arg == "--json") {
+      p.json = value;
+    } else {
+      cerr << "unknown argument " << arg << endl;
+      return false;
+    }
+  }
+  
+  if (p.trace.empty()) {
+    cerr << "replay needs --trace" << endl;
+    return false;
+  }
+  if (p.threads <= 0 || p.batch <= 0 || p.speed <= 0 || p.loops <= 0) {
+    cerr << "--threads, --batch, --speed and --loops must be positive" << endl;
+    return false;
+  }
+  if (p.recorded && p.loops != 1) {
+    cerr << "--loops is for --pace full only" << endl;
+    return false;
+  }
+  return true;
+}
+
+static inline Tuple5 toTuple(const TraceRecord &r) {
+  Tuple5 tuple;
+  tuple.src.addr = r.srcAddr;
+  tuple.src.port = r.srcPort;
+  tuple.protocol = r.protocol;
+  tuple.dst.addr = 0x0a800000 + (r.dstAddr & VIP_MASK);
+  tuple.dst.port = 0;
+  return tuple;
+}
+
+struct ReplayThread {
+  int id;
+  const ReplayParams *p;
+  const TraceRecord *records;
+  vector<uint32_t> packets;     // indices into records, ascending
+  LoadBalancer *lb;
+  
+  uint64_t startTick;           // when the replay starts, the same for all threads
+  atomic<int> *ready;
+  atomic<bool> *go;
+  
+  uint64_t lookups = 0, ticks = 0, maxLagTicks = 0;
+  uint32_t sink = 0;
+};
+
+static void *replay(ReplayThread *t) {
+  stick_this_thread_to_core(t->id);
+  const ReplayParams &p = *t->p;
+  const double ticksPerNs = tscPerNs() / p.speed;   // trace ns to TSC ticks
+  vector<Tuple5> batch(p.batch);
+  vector<Addr_Port> dips(p.batch);
+  
+  t->ready->fetch_add(1);
+  while (!t->go->load()) _mm_pause();
+  while (tscNow() < t->startTick) _mm_pause();
+  
+  const uint64_t firstNs = t->records[0].ns;
+  for (int loop = 0; loop < p.loops; ++loop) {
+    for (size_t i = 0; i < t->packets.size(); i += p.batch) {
+      int n = (int) min<size_t>(p.batch, t->packets.size() - i);
+      for (int j = 0; j < n; ++j) batch[j] = toTuple(t->records[t->packets[i + j]]);
+      
+      if (p.recorded) {
+        uint64_t due = t->startTick + uint64_t((t->records[t->packets[i]].ns - firstNs) * ticksPerNs);
+        uint64_t now = tscNow();
+        while (now < due) {
+          _mm_pause();
+          now = tscNow();
+        }
+        t->maxLagTicks = max(t->maxLagTicks, now - due);
+      }
+      
+      t->lb->lookupBatch(batch.data(), n, dips.data());
+      t->sink += dips[0].addr;
+      t->lookups += n;
+    }
+  }
+  t->ticks = tscNow() - t->startTick;
+  return nullptr;
+}
+
+int replayMain(int argc, char **argv, LoadBalancer &lb) {
+  ReplayParams p;
+  if (!parseParams(argc, argv, p)) return 1;
+  
+  commonInit();
+  
+  unique_ptr<MappedTrace> trace;
+  try {
+    trace.reset(new MappedTrace(p.trace));
+  } catch (exception &e) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+  const TraceRecord *records = trace->records();
+  const uint64_t count = trace->size();
+  if (count == 0 || count > UINT32_MAX) {
+    cerr << p.trace << ": " << count << " packets, the replay takes 1.." << UINT32_MAX << endl;
+    return 1;
+  }
+  if (p.recorded && !trace->hasTimestamps()) {
+    cerr << p.trace << " has no timestamps: --pace recorded needs a trace converted from pcap" << endl;
+    return 1;
+  }
+  
+  // one pass over the trace: its distinct connections, and the packets of each thread
+  // on the tuples themselves: a connection lost to a hash collision would take the miss path of route(), which
+  // inserts into the tables shared by the threads
+  Hasher64<Tuple5> hasher;
+  unordered_set<Tuple5, Hasher64<Tuple5>> seen;
+  vector<Tuple5> connections;
+  vector<ReplayThread> threads(p.threads);
+  for (uint64_t i = 0; i < count; ++i) {
+    Tuple5 tuple = toTuple(records[i]);
+    if (seen.insert(tuple).second) connections.push_back(tuple);
+    threads[(hasher(tuple) >> 32) % p.threads].packets.push_back(uint32_t(i));
+  }
+  seen.clear();
+  if (connections.size() > CONN_NUM) {
+    cerr << p.trace << ": " << connections.size() << " connections, more than the CONN_NUM " << CONN_NUM
+         << " of this build" << endl;
+    return 1;
+  }
+  
+  lb.init((int) connections.size());
+  lb.addConnections(connections);
+  resetLatencies();
+  
+  atomic<int> ready(0);
+  atomic<bool> go(false);
+  vector<pthread_t> ids(p.threads);
+  for (int i = 0; i < p.threads; ++i) {
+    ReplayThread &t = threads[i];
+    t.id = i;
+    t.p = &p;
+    t.records = records;
+    t.lb = &lb;
+    t.ready = &ready;
+    t.go = &go;
+    int rc = pthread_create(&ids[i], NULL, (void *(*)(void *)) replay, &t);
+    if (rc) {
+      cerr << "pthread_create: " << strerror(rc) << endl;
+      exit(-1);
+    }
+  }
+  
+  while (ready.load() < p.threads) _mm_pause();
+  uint64_t startTick = tscNow() + uint64_t(tscPerNs() * 1000000);   // 1ms for every thread to see go
+  for (ReplayThread &t : threads) t.startTick = startTick;
+  go.store(true);
+  for (pthread_t id : ids) pthread_join(id, NULL);
+  
+  uint64_t lookups = 0, ticks = 0, maxLagTicks = 0;
+  uint32_t sink = 0;
+  for (ReplayThread &t : threads) {
+    lookups += t.lookups;
+    ticks = max(ticks, t.ticks);
+    maxLagTicks = max(maxLagTicks, t.maxLagTicks);
+    sink += t.sink;
+  }
+  double seconds = ticks / tscPerNs() / 1E9;
+  
+  printf("%d\b \b", sink & 7);
+  cout << dec << lb.name() << " replay of " << p.trace << ": " << count << " packets, " << connections.size()
+       << " connections, " << p.threads << " threads, " << (p.recorded ? "recorded pace" : "full speed") << ", "
+       << lookups / seconds / 1E6 << "Mpps";
+  if (p.recorded) cout << ", max lag " << maxLagTicks / tscPerNs() / 1000 << "us";
+  cout << endl;
+  for (ReplayThread &t : threads) {
+    cout << "  thread " << t.id << ": " << t.lookups << " lookups, " << t.lookups / (t.ticks / tscPerNs() / 1E9) / 1E6
+         << "Mpps" << endl;
+  }
+  printLatencies(cout);
+  
+  ofstream out(p.json);
+  if (!out) {
+    cerr << "cannot write " << p.json << endl;
+    return 1;
+  }
+  JsonWriter json(out);
+  json.beginObject();
+  json.field("algorithm", lb.name()).field("name", NAME).field("trace", p.trace);
+  json.field("packets", count).field("connections", (uint64_t) connections.size());
+  json.key("params").beginObject();
+  json.field("threads", p.threads).field("batch", p.batch).field("pace", p.recorded ? "recorded" : "full");
+  json.field("speed", p.speed).field("loops", p.loops);
+  json.endObject();
+  json.field("lookups", lookups).field("seconds", seconds).field("mpps", lookups / seconds / 1E6);
+  if (p.recorded) json.field("max_lag_us", maxLagTicks / tscPerNs() / 1000);
+  json.key("threads").beginArray();
+  for (ReplayThread &t : threads) {
+    json.beginObject().field("lookups", t.lookups).field("seconds", t.ticks / tscPerNs() / 1E9).endObject();
+  }
+  json.endArray();
+  json.endObject();
+  
+  cout << "results in " << p.json << endl;
+  return 0;
+}
@@ -0,0 +1,181 @@
+#include "workload.h"
+
+bool LifetimeDist::parse(const string &s) {
+  vector<string> parts = split(s.c_str(), ':');
+  if (parts.size() == 1 && parts[0] == "forever") {
+    kind = FOREVER;
+    return true;
+  }
+  if (parts.size() < 2) return false;
+  
+  mean = atof(parts[1].c_str());
+  if (parts[0] == "fixed" && parts.size() == 2) kind = FIXED;
+  else if (parts[0] == "exp" && parts.size() == 2) kind = EXPONENTIAL;
+  else if (parts[0] == "pareto" && parts.size() <= 3) {
+    kind = PARETO;
+    if (parts.size() == 3) shape = atof(parts[2].c_str());
+    if (shape <= 1) return false;
+  } else return false;
+  return mean >= 1;
+}
+
+uint64_t LifetimeDist::sample(mt19937_64 &rng) const {
+  switch (kind) {
+    case FIXED:
+      return uint64_t(mean);
+    case EXPONENTIAL:
+      return uint64_t(exponential_distribution<double>(1 / mean)(rng)) + 1;
+    case PARETO: {
+      // x_m (1 - U)^(-1/shape), with x_m making the mean as given
+      double xm = mean * (shape - 1) / shape;
+      double u = uniform_real_distribution<double>(0, 1)(rng);
+      return uint64_t(min(xm * pow(1 - u, -1 / shape), 1E18)) + 1;
+    }
+    default:
+      return UINT64_MAX;
+  }
+}
+
+string LifetimeDist::str() const {
+  ostringstream oss;
+  switch (kind) {
+    case FIXED:
+      oss << "fixed:" << mean;
+      break;
+    case EXPONENTIAL:
+      oss << "exp:" << mean;
+      break;
+    case PARETO:
+      oss << "pareto:" << mean << ":" << shape;
+      break;
+    default:
+      oss << "forever";
+  }
+  return oss.str();
+}
+
+/// weights by slot, with prefix sums and the search of a prefix sum in O(log n)
+class FenwickTree {
+  vector<double> tree;
+  uint32_t top = 1;
+
+public:
+  explicit FenwickTree(uint32_t n) : tree(n + 1, 0) {
+    while (top * 2 <= n) top *= 2;
+  }
+  
+  void add(uint32_t slot, double w) {
+    for (uint32_t i = slot + 1; i < tree.size(); i += i & -i) tree[i] += w;
+  }
+  
+  double total() const {
+    double sum = 0;
+    for (uint32_t i = tree.size() - 1; i; i -= i & -i) sum += tree[i];
+    return sum;
+  }
+  
+  /// the slot where the prefix sum passes x
+  uint32_t find(double x) const {
+    uint32_t pos = 0;
+    for (uint32_t step = top; step; step >>= 1) {
+      if (pos + step < tree.size() && tree[pos + step] <= x) {
+        pos += step;
+        x -= tree[pos];
+      }
+    }
+    return min<uint32_t>(pos, tree.size() - 2);
+  }
+};
+
+Workload generateWorkload(const WorkloadParams &p) {
+  mt19937_64 rng(p.seed);
+  uniform_real_distribution<double> uniform(0, 1);
+  LFSRGen<Tuple3> tuple3Gen(p.seed, UINT32_MAX, 0);
+  
+  vector<double> vipCdf(VIP_NUM);
+  for (int i = 0; i < VIP_NUM; ++i) vipCdf[i] = (i ? vipCdf[i - 1] : 0) + pow(i + 1, -p.vipSkew);
+  for (double &c : vipCdf) c /= vipCdf.back();
+  
+  // a slot per connection ever live, so that the weight of a gone one just stays 0
+  double expected = 0, rate = p.arrivals;
+  uint64_t from = 0;
+  for (const pair<uint64_t, double> &step : p.arrivalSteps) {
+    expected += rate * (min(step.first, p.packets) - min(from, p.packets));
+    from = step.first;
+    rate = step.second;
+  }
+  expected += rate * (p.packets - min(from, p.packets));
+  uint64_t expectedArrivals = uint64_t(expected * 1.1) + 1024;
+  uint32_t capacity = uint32_t(min<uint64_t>(p.connections + expectedArrivals, UINT32_MAX - 1));
+  FenwickTree weights(capacity);
+  vector<Tuple5> slots;
+  vector<double> slotWeights;
+  slots.reserve(capacity);
+  slotWeights.reserve(capacity);
+  uint32_t live = 0;
+  priority_queue<pair<uint64_t, uint32_t>, vector<pair<uint64_t, uint32_t>>, greater<pair<uint64_t, uint32_t>>> deaths;
+  
+  Workload w;
+  w.packets.reserve(p.packets);
+  w.flows.reserve(p.packets);
+  
+  auto open = [&](uint64_t now, uint32_t rank) {
+    Tuple5 tuple;
+    tuple3Gen.gen((Tuple3 *) &tuple.src);
+    int vipInd = int(lower_bound(vipCdf.begin(), vipCdf.end(), uniform(rng)) - vipCdf.begin());
+    tuple.dst.addr = 0x0a800000 + min(vipInd, VIP_NUM - 1);
+    tuple.dst.port = 0;
+    
+    uint32_t slot = slots.size();
+    slots.push_back(tuple);
+    slotWeights.push_back(pow(rank, -p.flowSkew));
+    weights.add(slot, slotWeights.back());
+    ++live;
+    uint64_t lifetime = p.lifetime.sample(rng);
+    if (lifetime != UINT64_MAX) deaths.push(make_pair(now + lifetime, slot));
+    return tuple;
+  };
+  
+  for (uint32_t i = 0; i < p.connections; ++i) w.initial.push_back(open(0, i + 1));
+  
+  // arrivals are memoryless: at a change of rate the next one is just drawn again
+  double arrivals = p.arrivals;
+  size_t nextStep = 0;
+  auto gap = [&] {
+    return arrivals > 0 ? exponential_distribution<double>(arrivals)(rng) : 1E300;
+  };
+  double nextArrival = gap();
+  uniform_int_distribution<uint32_t> rankOf(1, max<uint32_t>(p.connections, 1));
+  for (uint64_t i = 0; i < p.packets; ++i) {
+    for (; nextStep < p.arrivalSteps.size() && p.arrivalSteps[nextStep].first <= i; ++nextStep) {
+      arrivals = p.arrivalSteps[nextStep].second;
+      nextArrival = i + gap();
+    }
+    
+    while (!deaths.empty() && deaths.top().first <= i) {
+      uint32_t slot = deaths.top().second;
+      deaths.pop();
+      weights.add(slot, -slotWeights[slot]);
+      slotWeights[slot] = 0;
+      --live;
+      w.closes.push_back(make_pair(i, slots[slot]));
+    }
+    
+    if ((nextArrival <= i || !live) && slots.size() < capacity) {
+      w.opens.push_back(i);
+      w.flows.push_back(slots.size());
+      w.packets.push_back(open(i, rankOf(rng)));
+      nextArrival += gap();
+    } else if (live) {
+      // a gone slot keeps a rounding residue of the sums at most: draw again
+      double total = weights.total();
+      uint32_t slot;
+      do slot = weights.find(uniform(rng) * total); while (slot >= slots.size() || slotWeights[slot] == 0);
+      w.flows.push_back(slot);
+      w.packets.push_back(slots[slot]);
+    } else {
+      break;    // every connection is gone and no slot is left for a new one
+    }
+  }
+  return w;
+}
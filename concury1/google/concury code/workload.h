@@ -0,0 +1,51 @@
+#pragma once
+
+#include "common.h"
+
+/*! \file workload.h
+ *  Synthetic traffic with skewed popularity and connection churn, generated into buffers up front so that the
+ *  generation stays out of what is measured. The benchmark driver runs it with --flow-skew and the like, see lb_bench.h.
+ */
+
+/// how long a connection lives, in packets of the workload
+struct LifetimeDist {
+  enum Kind {
+    FOREVER, FIXED, EXPONENTIAL, PARETO
+  } kind = FOREVER;
+  double mean = 0;
+  double shape = 1.5;     // PARETO only: the tail index, > 1. the smaller, the heavier the tail
+  
+  /// "forever", "fixed:<mean>", "exp:<mean>" or "pareto:<mean>[:<shape>]". \return false if it is none of them
+  bool parse(const string &s);
+  
+  uint64_t sample(mt19937_64 &rng) const;
+  
+  string str() const;
+};
+
+struct WorkloadParams {
+  uint32_t connections = 1 << 20;   // live when the workload starts
+  uint64_t packets = 16 << 20;
+  double flowSkew = 0;    // Zipf exponent of the popularity of the connections. 0 is uniform
+  double vipSkew = 0;     // Zipf exponent of the popularity of the VIPs, by which a connection picks its VIP
+  double arrivals = 0;    // new connections per packet, a Poisson process
+  vector<pair<uint64_t, double>> arrivalSteps;    // (i, r): arrivals is r from packets[i] on. ascending i
+  LifetimeDist lifetime;
+  uint64_t seed = 0xe2211;
+};
+
+/**
+ * A connection gets a popularity rank r, uniform in 1..connections (the ones live at the start take 1..connections in
+ * order), and its packets are drawn with weight r^-flowSkew among the live connections. A new connection sends its
+ * first packet when it arrives, and none after its lifetime. Keys are distinct: sources from an LFSRGen<Tuple3>, VIPs
+ * 0x0a800000 + the Zipf pick, port 0.
+ */
+struct Workload {
+  vector<Tuple5> initial;     // live at the start: add them before the packets
+  vector<Tuple5> packets;
+  vector<uint32_t> flows;     // the connection of each packet: 0.. the initial ones, then the new ones as they open
+  vector<uint64_t> opens;     // indices of the first packets of the new connections
+  vector<pair<uint64_t, Tuple5>> closes;    // (i, c): c sends nothing from packets[i] on
+};
+
+Workload generateWorkload(const WorkloadParams &p);